@@ -0,0 +1,53 @@
+#ifndef FOOFXP_BENCHMARK_HPP_INCLUDED
+#define FOOFXP_BENCHMARK_HPP_INCLUDED
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+// Wall clock timer for the benchmarks.
+class stopwatch
+{
+public:
+
+	stopwatch() : start_(now()) {};
+
+	void restart() { start_ = now(); };
+
+	double elapsed_ms() const
+	{
+		return (now() - start_).total_microseconds() / 1000.0;
+	};
+
+private:
+
+	static boost::posix_time::ptime now()
+	{
+		return boost::posix_time::microsec_clock::universal_time();
+	};
+
+	boost::posix_time::ptime start_;
+};
+
+// Print one result row: name, total time, and time per operation.
+inline void report(const std::string & name, double elapsed_ms,
+	unsigned long operations)
+{
+	std::cout << std::left << std::setw(40) << name
+		<< std::right << std::setw(10) << std::fixed << std::setprecision(2)
+		<< elapsed_ms << " ms"
+		<< std::setw(10) << std::setprecision(1)
+		<< (operations ? elapsed_ms * 1000000.0 / operations : 0.0)
+		<< " ns/op" << std::endl;
+}
+
+// Print a result row with just the time, for one-off operations.
+inline void report(const std::string & name, double elapsed_ms)
+{
+	std::cout << std::left << std::setw(40) << name
+		<< std::right << std::setw(10) << std::fixed << std::setprecision(2)
+		<< elapsed_ms << " ms" << std::endl;
+}
+
+#endif // FOOFXP_BENCHMARK_HPP_INCLUDED
@@ -0,0 +1,170 @@
+// Browsing back and forth between a few directories, against an ftp_stand_in
+// with a simulated round trip time: CWD/PWD, then list, then on to the next.
+// Timed from each CWD to the listing showing up. Without the listing cache
+// every listing is a round trip (or three, with MLSD); with it, only the first
+// visit to each directory is, leaving just the CWD/PWD round trip. Last, with a zero ttl, so every listing is
+// stale: shown from the cache at once, then fetched again in the background.
+//
+// Usage: browse_benchmark [visits] [round trip ms]
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/bind.hpp>
+#include "benchmark.hpp"
+#include "ftp_stand_in.hpp"
+#include "model/ftp/client.hpp"
+#include "model/ftp/feature_cache.hpp"
+
+using namespace std;
+using namespace boost::asio;
+using foofxp::model::ftp::client;
+using foofxp::model::ftp::feature_cache;
+
+// Once logged in, visits the paths in turn, each time waiting for the client
+// to go idle (i.e. for any revalidation to finish) before moving on.
+class browse_driver
+{
+public:
+
+	browse_driver(io_service & io_service, client & client,
+		const vector<string> & paths) :
+		io_service_(io_service),
+		client_(client),
+		paths_(paths),
+		next_(0),
+		listed_(false),
+		displayed_ms(0),
+		from_cache(0)
+	{
+		client.received_directory_list.connect(
+			boost::bind(&browse_driver::handle_listed, this));
+		client.changed_directory.connect(
+			boost::bind(&browse_driver::handle_changed_directory, this));
+		client.idle.connect(
+			boost::bind(&browse_driver::handle_idle, this));
+		client.change_directory_failed.connect(
+			boost::bind(&browse_driver::handle_error, this, _2));
+		client.directory_list_failed.connect(
+			boost::bind(&browse_driver::handle_error, this, _2));
+		client.fatal_error_occurred.connect(
+			boost::bind(&browse_driver::handle_error, this, _2));
+	};
+
+	// From each CWD to its listing, added up.
+	double displayed_ms;
+	unsigned long from_cache;
+
+private:
+
+	void handle_listed()
+	{
+		// Only the first of a stale listing and its revalidation counts.
+		if (listed_)
+			return;
+
+		listed_ = true;
+
+		if (next_ == 0)
+			return;
+
+		displayed_ms += timer_.elapsed_ms();
+
+		if (client_.listing_from_cache())
+			from_cache++;
+	};
+
+	void handle_changed_directory()
+	{
+		client_.begin_get_directory_contents();
+	};
+
+	void handle_idle()
+	{
+		if (!listed_)
+			return;
+
+		if (next_ == paths_.size())
+		{
+			io_service_.stop();
+			return;
+		}
+
+		listed_ = false;
+		timer_.restart();
+		client_.begin_change_directory(paths_[next_++]);
+	};
+
+	void handle_error(const string & message)
+	{
+		cerr << "error: " << message << endl;
+		io_service_.stop();
+	};
+
+	io_service & io_service_;
+	client & client_;
+	const vector<string> & paths_;
+	size_t next_;
+	bool listed_;
+	stopwatch timer_;
+};
+
+static void run(const string & name, const vector<string> & paths,
+	unsigned long latency_ms, bool machine_listings, bool cache,
+	const boost::posix_time::time_duration & ttl)
+{
+	io_service io_service;
+	ssl::context context(io_service, ssl::context::tlsv1_client);
+	ftp_stand_in server(io_service, 1024, latency_ms);
+	server.tree(2, 4, 200);
+	server.machine_listings(machine_listings);
+
+	client c("127.0.0.1", server.port(), false, false, "bench", "bench",
+		io_service, context);
+	c.machine_listings(machine_listings);
+
+	feature_cache features(boost::posix_time::hours(1));
+	c.capabilities(&features);
+
+	if (cache)
+		c.cache_listings(16 * 1024 * 1024, ttl);
+
+	browse_driver driver(io_service, c, paths);
+
+	c.begin_connect();
+	io_service.run();
+
+	report(name, driver.displayed_ms);
+	cout << "  " << driver.displayed_ms / paths.size() << " ms per visit, "
+		<< driver.from_cache << " of " << paths.size() << " from the cache"
+		<< endl;
+}
+
+int main(int argc, char * argv[])
+{
+	unsigned long visits = argc > 1 ? strtoul(argv[1], 0, 10) : 40;
+	unsigned long latency_ms = argc > 2 ? strtoul(argv[2], 0, 10) : 50;
+
+	// Into each of the first three directories and back out again, over and
+	// over.
+	vector<string> paths;
+	for (unsigned long i = 0; i < visits; ++i)
+		paths.push_back(i % 2 ? string("/") :
+			"/dir" + string(1, static_cast<char>('0' + i / 2 % 3)));
+
+	cout << visits << " visits, " << latency_ms << " ms round trip" << endl;
+
+	boost::posix_time::time_duration ttl = boost::posix_time::minutes(5);
+
+	run("STAT -l, no cache", paths, latency_ms, false, false, ttl);
+	run("STAT -l, cached", paths, latency_ms, false, true, ttl);
+	run("MLSD, no cache", paths, latency_ms, true, false, ttl);
+	run("MLSD, cached", paths, latency_ms, true, true, ttl);
+	run("MLSD, stale while revalidating", paths, latency_ms, true, true,
+		boost::posix_time::seconds(0));
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,127 @@
+// Time for a batch of sessions to connect and get their first directory
+// listing from an ftp_stand_in, the way they all reconnect at once after the
+// network drops out. Compares looking the host up for every session with
+// using the shared resolver_cache, and a host whose first address silently
+// drops connection attempts (a listener with its backlog full), which used to
+// hold every session up for the whole connect timeout.
+//
+// Usage: connect_benchmark [sessions] [round trip ms]
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include "benchmark.hpp"
+#include "ftp_stand_in.hpp"
+#include "model/ftp/client.hpp"
+#include "model/ftp/resolver_cache.hpp"
+
+using namespace std;
+using namespace boost::asio;
+using namespace boost::asio::ip;
+using foofxp::model::ftp::client;
+using foofxp::model::ftp::resolver_cache;
+
+// Stops the io_service once every session has its first listing.
+class connect_driver
+{
+public:
+
+	connect_driver(io_service & io_service, unsigned long sessions) :
+		io_service_(io_service),
+		remaining_(sessions)
+	{};
+
+	void watch(client & client)
+	{
+		client.received_directory_list.connect(
+			boost::bind(&connect_driver::handle_listed, this));
+		client.fatal_error_occurred.connect(
+			boost::bind(&connect_driver::handle_error, this, _2));
+	};
+
+private:
+
+	void handle_listed()
+	{
+		if (--remaining_ == 0)
+			io_service_.stop();
+	};
+
+	void handle_error(const string & message)
+	{
+		cerr << "error: " << message << endl;
+		io_service_.stop();
+	};
+
+	io_service & io_service_;
+	unsigned long remaining_;
+};
+
+static void run(const string & name, const string & host,
+	unsigned long sessions, unsigned long latency_ms, bool dead_first)
+{
+	io_service io_service;
+	ssl::context context(io_service, ssl::context::tlsv1_client);
+	ftp_stand_in server(io_service, 1024, latency_ms);
+
+	// Something listening on another loopback address and the same port,
+	// with a connection already filling its backlog, so further SYNs to it
+	// go unanswered.
+	tcp::acceptor dead(io_service);
+	tcp::socket filler(io_service);
+	if (dead_first)
+	{
+		tcp::endpoint endpoint(address::from_string("127.0.0.2"),
+			server.port());
+		dead.open(endpoint.protocol());
+		dead.bind(endpoint);
+		dead.listen(0);
+		filler.connect(endpoint);
+
+		resolver_cache::endpoints endpoints;
+		endpoints.push_back(endpoint);
+		endpoints.push_back(tcp::endpoint(address_v4::loopback(), 0));
+		resolver_cache::shared().insert(host, false, endpoints);
+	}
+
+	connect_driver driver(io_service, sessions);
+	vector<boost::shared_ptr<client> > clients;
+	for (unsigned long i = 0; i < sessions; i++)
+	{
+		clients.push_back(boost::shared_ptr<client>(new client(host,
+			server.port(), false, false, "bench", "bench", io_service,
+			context)));
+		driver.watch(*clients.back());
+	}
+
+	stopwatch timer;
+
+	for (unsigned long i = 0; i < sessions; i++)
+		clients[i]->begin_connect();
+
+	io_service.run();
+
+	report(name, timer.elapsed_ms());
+}
+
+int main(int argc, char * argv[])
+{
+	unsigned long sessions = argc > 1 ? strtoul(argv[1], 0, 10) : 30;
+	unsigned long latency_ms = argc > 2 ? strtoul(argv[2], 0, 10) : 0;
+
+	cout << sessions << " sessions, " << latency_ms << " ms round trip" << endl;
+
+	resolver_cache::shared().clear();
+	run("localhost, resolved", "localhost", sessions, latency_ms, false);
+	run("localhost, cached", "localhost", sessions, latency_ms, false);
+
+	resolver_cache::shared().clear();
+	run("dead first address", "dead-first.test", sessions, latency_ms, true);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,188 @@
+// Counts the io_service handler invocations needed to receive a STAT -l reply
+// over loopback, comparing control_stream's batched line extraction with one
+// async_read_until per line (the way control_stream used to read).
+//
+// Usage: control_stream_benchmark [lines]
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/bind.hpp>
+#include "benchmark.hpp"
+#include "model/ftp/control_stream.cpp"
+
+using namespace std;
+using namespace boost::asio;
+using namespace boost::asio::ip;
+using boost::system::error_code;
+using foofxp::model::ftp::control_stream;
+
+static string make_reply(unsigned long count)
+{
+	string reply = "213-status of -l:\r\n";
+	char buf[128];
+
+	for (unsigned long i = 0; i < count; ++i)
+	{
+		snprintf(buf, sizeof(buf), "-rw-r--r--   1 site  site  %lu Jan  1 "
+			"12:00 Some.Release.Name-GRP.r%02lu\r\n", i, i % 100);
+		reply += buf;
+	}
+
+	return reply + "213 End of Status\r\n";
+}
+
+// Loopback stand-in for the server: accepts one connection and writes the
+// whole reply to it in one go.
+class reply_server
+{
+public:
+
+	reply_server(io_service & io_service, const string & reply) :
+		reply_(reply),
+		acceptor_(io_service, tcp::endpoint(address_v4::loopback(), 0)),
+		socket_(io_service)
+	{
+		acceptor_.async_accept(socket_,
+			boost::bind(&reply_server::handle_accept, this,
+				placeholders::error));
+	};
+
+	unsigned short port() const { return acceptor_.local_endpoint().port(); };
+
+private:
+
+	void handle_accept(const error_code & error)
+	{
+		if (!error)
+			async_write(socket_, buffer(reply_),
+				boost::bind(&reply_server::handle_write, this,
+					placeholders::error));
+	};
+
+	void handle_write(const error_code & error) {};
+
+	string reply_;
+	tcp::acceptor acceptor_;
+	tcp::socket socket_;
+};
+
+// Minimal client for control_stream, reading lines until the end of the reply.
+struct counting_client
+{
+	counting_client() : stream(0), lines(0) {};
+
+	void handle_connect() { stream->begin_read_line(); };
+	void handle_handshake() {};
+
+	void handle_line_received(const string & line)
+	{
+		++lines;
+
+		if (line.compare(0, 4, "213 ") != 0)
+			stream->begin_read_line();
+	};
+
+	void handle_control_stream_error(const string & message, bool fatal)
+	{
+		cerr << "control_stream error: " << message << endl;
+	};
+
+	control_stream<counting_client> * stream;
+	unsigned long lines;
+};
+
+// Reads one line per async_read_until, as control_stream used to.
+class per_line_reader
+{
+public:
+
+	per_line_reader(io_service & io_service, unsigned short port) :
+		lines(0), socket_(io_service), reply_()
+	{
+		socket_.async_connect(tcp::endpoint(address_v4::loopback(), port),
+			boost::bind(&per_line_reader::handle_connect, this,
+				placeholders::error));
+	};
+
+	unsigned long lines;
+
+private:
+
+	void handle_connect(const error_code & error)
+	{
+		if (!error)
+			begin_read_line();
+	};
+
+	void begin_read_line()
+	{
+		async_read_until(socket_, reply_, "\r\n",
+			boost::bind(&per_line_reader::handle_read_line, this,
+				placeholders::error));
+	};
+
+	void handle_read_line(const error_code & error)
+	{
+		if (error)
+			return;
+
+		string line;
+		istream stream(&reply_);
+		getline(stream, line);
+		++lines;
+
+		if (line.compare(0, 4, "213 ") != 0)
+			begin_read_line();
+	};
+
+	tcp::socket socket_;
+	boost::asio::streambuf reply_;
+};
+
+int main(int argc, char * argv[])
+{
+	unsigned long count = argc > 1 ? strtoul(argv[1], 0, 10) : 10000;
+	string reply = make_reply(count);
+
+	cout << count << "-line reply (" << reply.length() << " bytes)" << endl;
+
+	{
+		io_service io_service;
+		io_service::strand strand(io_service);
+		ssl::context context(io_service, ssl::context::tlsv1_client);
+		reply_server server(io_service, reply);
+
+		counting_client client;
+		control_stream<counting_client> stream(client, "127.0.0.1",
+			server.port(), false, io_service, strand, context,
+			boost::posix_time::seconds(15));
+		client.stream = &stream;
+
+		stopwatch timer;
+		stream.begin_connect();
+		size_t handlers = io_service.run();
+
+		report("control_stream (batched)", timer.elapsed_ms(), client.lines);
+		cout << "  " << client.lines << " lines, " << handlers
+			<< " handler invocations" << endl;
+	}
+
+	{
+		io_service io_service;
+		reply_server server(io_service, reply);
+		per_line_reader reader(io_service, server.port());
+
+		stopwatch timer;
+		size_t handlers = io_service.run();
+
+		report("async_read_until per line", timer.elapsed_ms(), reader.lines);
+		cout << "  " << reader.lines << " lines, " << handlers
+			<< " handler invocations" << endl;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,182 @@
+// Lists a whole directory tree with tree_crawler, against ftp_stand_ins with
+// a simulated round trip time: over one session, then over several, then on
+// two sites at once -- one with a big tree and one with a small one -- to see
+// that the small one isn't kept waiting behind the big one. Last, over several
+// sessions again, listing with MLSD instead of STAT -l.
+//
+// Usage: crawl_benchmark [depth] [subdirectories] [round trip ms] [sessions]
+
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#include <boost/bind.hpp>
+#include "benchmark.hpp"
+#include "ftp_stand_in.hpp"
+#include "model/session_controller.hpp"
+#include "model/tree_crawler.hpp"
+
+using namespace std;
+using foofxp::model::session_controller;
+using foofxp::model::tree_crawler;
+using foofxp::model::ftp::bookmark;
+
+static bookmark site_for(const ftp_stand_in & server)
+{
+	bookmark site;
+	site.host("127.0.0.1");
+	site.port(server.port());
+	site.auth_tls(false);
+	site.username("bench");
+	site.password("bench");
+	return site;
+}
+
+// Starts the crawl once the pools are warm, and notes when each site is done.
+class crawl_driver
+{
+public:
+
+	crawl_driver(session_controller & controller, tree_crawler & crawler,
+		size_t sessions) :
+		finished_ms(),
+		elapsed_ms(0),
+		controller_(controller),
+		crawler_(crawler),
+		sessions_(sessions),
+		started_(false),
+		remaining_()
+	{
+		crawler.directory_listed.connect(
+			boost::bind(&crawl_driver::handle_listed, this, _2, _3));
+		crawler.directory_failed.connect(
+			boost::bind(&crawl_driver::handle_error, this, _4));
+		crawler.completed.connect(
+			boost::bind(&crawl_driver::handle_completed, this));
+		controller.state_changed.connect(
+			boost::bind(&crawl_driver::handle_state_changed, this));
+	};
+
+	// One root per site, so sites are told apart by port.
+	void add_root(const bookmark & site)
+	{
+		crawler_.add_root(site, "/");
+		remaining_[site.port()] = 1;
+	};
+
+	map<unsigned short, double> finished_ms;
+	double elapsed_ms;
+
+private:
+
+	void handle_state_changed()
+	{
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+
+			if (started_ || controller_.idle_count() < sessions_)
+				return;
+
+			started_ = true;
+			timer_.restart();
+		}
+
+		crawler_.begin();
+	};
+
+	void handle_listed(const bookmark & site,
+		const tree_crawler::directory & listed)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		long & remaining = remaining_[site.port()];
+		remaining += static_cast<long>(listed.subdirectories.size()) - 1;
+
+		if (remaining == 0)
+			finished_ms[site.port()] = timer_.elapsed_ms();
+	};
+
+	void handle_completed()
+	{
+		elapsed_ms = timer_.elapsed_ms();
+		controller_.stop();
+	};
+
+	void handle_error(const string & message)
+	{
+		cerr << "error: " << message << endl;
+		controller_.stop();
+	};
+
+	session_controller & controller_;
+	tree_crawler & crawler_;
+	size_t sessions_;
+	boost::mutex mutex_;
+	bool started_;
+	map<unsigned short, long> remaining_;
+	stopwatch timer_;
+};
+
+static void run(const string & name, unsigned int depth,
+	unsigned int subdirectories, unsigned long latency_ms, size_t sessions,
+	bool two_sites, bool machine_listings = false)
+{
+	// One thread, so the stand-ins can share it.
+	session_controller controller(1);
+
+	ftp_stand_in big(controller.io_service(), 1024, latency_ms);
+	big.tree(depth, subdirectories, 20);
+	big.machine_listings(machine_listings);
+
+	ftp_stand_in small(controller.io_service(), 1024, latency_ms);
+	small.tree(1, subdirectories, 20);
+
+	tree_crawler crawler(controller);
+	crawler.max_sessions_per_site(sessions);
+	crawler.max_sessions(sessions * 2);
+
+	crawl_driver driver(controller, crawler, two_sites ? sessions * 2 :
+		sessions);
+
+	driver.add_root(site_for(big));
+	controller.keep_warm(site_for(big), sessions);
+
+	if (two_sites)
+	{
+		driver.add_root(site_for(small));
+		controller.keep_warm(site_for(small), sessions);
+	}
+
+	controller.join();
+
+	report(name, driver.elapsed_ms);
+
+	if (two_sites)
+		cout << "  small tree done after " << driver.finished_ms[small.port()]
+			<< " ms, big tree after " << driver.finished_ms[big.port()]
+			<< " ms" << endl;
+
+	cout << "  " << crawler.directories_listed() << " directories, "
+		<< (driver.elapsed_ms > 0 ? crawler.directories_listed() * 1000.0 /
+		driver.elapsed_ms : 0.0) << " per second" << endl;
+}
+
+int main(int argc, char * argv[])
+{
+	unsigned int depth = argc > 1 ? strtoul(argv[1], 0, 10) : 3;
+	unsigned int subdirectories = argc > 2 ? strtoul(argv[2], 0, 10) : 6;
+	unsigned long latency_ms = argc > 3 ? strtoul(argv[3], 0, 10) : 20;
+	size_t sessions = argc > 4 ? strtoul(argv[4], 0, 10) : 4;
+
+	cout << "depth " << depth << ", " << subdirectories
+		<< " subdirectories each, " << latency_ms << " ms round trip" << endl;
+
+	run("one session", depth, subdirectories, latency_ms, 1, false);
+	run("several sessions", depth, subdirectories, latency_ms, sessions,
+		false);
+	run("two sites", depth, subdirectories, latency_ms, sessions, true);
+	run("several sessions, MLSD", depth, subdirectories, latency_ms, sessions,
+		false, true);
+
+	return EXIT_SUCCESS;
+}
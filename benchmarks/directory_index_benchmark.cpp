@@ -0,0 +1,167 @@
+// A synthetic index of several sites' worth of releases: the time to save it
+// and to map it again, and then lookups by exact name, by prefix and by
+// substring, against the snapshot and against the same listings still held in
+// memory (which is what the lookups would have to scan without one).
+//
+// Usage: directory_index_benchmark [sites] [directories per site]
+//	[files per directory]
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include "benchmark.hpp"
+#include "model/directory_index.hpp"
+
+using namespace std;
+using namespace boost::posix_time;
+using foofxp::model::directory_index;
+using foofxp::model::file;
+
+static const char * index_path = "/tmp/foofxp-directory-index-benchmark";
+
+// Each site has most of the same releases as the others, under different
+// paths, with the usual few names in every one of them.
+static void make_directory(unsigned long site, unsigned long index,
+	unsigned long count, vector<file> & files)
+{
+	static const char * const common[] =
+	{
+		"Sample", ".message", "imdb.nfo", "Proof", "Subs"
+	};
+
+	ptime time(boost::gregorian::date(2008, 1, 1));
+	char buf[128];
+
+	files.clear();
+
+	for (unsigned long i = 0; i < count; ++i)
+	{
+		file f;
+
+		if (i < sizeof(common) / sizeof(common[0]))
+		{
+			f.name(common[i]);
+			f.type(i == 0 || i >= 3 ? file::directory : file::plain_old_file);
+		}
+		else
+		{
+			snprintf(buf, sizeof(buf), "Some.Release.Name.%lu-GRP.r%02lu",
+				index + site * 97, i);
+			f.name(buf);
+			f.size(50000000 + i * 1024);
+		}
+
+		f.time(time + seconds(static_cast<long>((index * 7919 + i * 104729) %
+			31536000)));
+		files.push_back(f);
+	}
+}
+
+static void fill(directory_index & index, unsigned long sites,
+	unsigned long directories, unsigned long files)
+{
+	vector<file> listing;
+	char site[32];
+	char path[64];
+
+	for (unsigned long s = 0; s < sites; ++s)
+	{
+		snprintf(site, sizeof(site), "site%lu", s);
+
+		for (unsigned long d = 0; d < directories; ++d)
+		{
+			snprintf(path, sizeof(path), "/incoming/%02lu/release.%lu",
+				d % 30, d);
+			make_directory(s, d, files, listing);
+			index.update(site, path, listing);
+		}
+	}
+}
+
+// Runs each kind of lookup a few times over, reporting time per lookup.
+// Substring searches are slower, and scanning listings in memory slower
+// still, so they're run fewer times.
+static void lookups(const string & name, const directory_index & index,
+	unsigned long directories, unsigned long repeat)
+{
+	const unsigned long exact = repeat;
+	const unsigned long prefixes = repeat;
+	const unsigned long searches = repeat / 100 + 1;
+
+	vector<directory_index::match> matches;
+	unsigned long found = 0;
+	char buf[128];
+
+	stopwatch timer;
+	for (unsigned long i = 0; i < exact; ++i)
+	{
+		snprintf(buf, sizeof(buf), "some.release.name.%lu-grp.r07",
+			i * 7919 % directories);
+		matches.clear();
+		found += index.find(buf, matches);
+	}
+	report(name + ", find", timer.elapsed_ms(), exact);
+
+	timer.restart();
+	for (unsigned long i = 0; i < prefixes; ++i)
+	{
+		snprintf(buf, sizeof(buf), "SOME.RELEASE.NAME.%lu-",
+			i * 7919 % directories);
+		matches.clear();
+		found += index.find_prefix(buf, matches, 100);
+	}
+	report(name + ", find_prefix", timer.elapsed_ms(), prefixes);
+
+	timer.restart();
+	for (unsigned long i = 0; i < searches; ++i)
+	{
+		snprintf(buf, sizeof(buf), "name.%lu-grp.r1",
+			i * 7919 % directories);
+		matches.clear();
+		found += index.search(buf, matches, 100);
+	}
+	report(name + ", search", timer.elapsed_ms(), searches);
+
+	cout << "  " << found << " matches" << endl;
+}
+
+int main(int argc, char * argv[])
+{
+	unsigned long sites = argc > 1 ? strtoul(argv[1], 0, 10) : 4;
+	unsigned long directories = argc > 2 ? strtoul(argv[2], 0, 10) : 25000;
+	unsigned long files = argc > 3 ? strtoul(argv[3], 0, 10) : 20;
+
+	cout << sites << " sites, " << directories << " directories each, "
+		<< files << " files per directory" << endl;
+
+	remove(index_path);
+
+	directory_index index;
+
+	stopwatch timer;
+	fill(index, sites, directories, files);
+	report("update", timer.elapsed_ms(), index.size());
+
+	lookups("in memory", index, directories, 10);
+
+	timer.restart();
+	index.save(index_path);
+	report("save", timer.elapsed_ms(), index.size());
+
+	directory_index mapped;
+	timer.restart();
+	mapped.open(index_path);
+	report("open", timer.elapsed_ms(), mapped.size());
+
+	struct stat status;
+	if (stat(index_path, &status) == 0)
+		cout << "  " << status.st_size / 1024 / 1024 << " MB, "
+			<< status.st_size / mapped.size() << " bytes per entry" << endl;
+
+	lookups("mapped", mapped, directories, 1000);
+
+	remove(index_path);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,178 @@
+// Compares a synthetic directory tree held as a vector<file> per directory
+// against directory_tables sharing one name_arena: memory used, and the time
+// to sort every directory by name and to total the sizes of its plain files.
+//
+// Usage: directory_table_benchmark [directories] [files per directory]
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include "benchmark.hpp"
+#include "model/directory_table.hpp"
+
+using namespace std;
+using namespace boost::posix_time;
+using foofxp::model::directory_table;
+using foofxp::model::file;
+using foofxp::model::name_arena;
+
+// A release per directory: the same few names everywhere (Sample, .message,
+// the .sfv...) and the rest unique to it.
+static void make_directory(unsigned long index, unsigned long count,
+	vector<file> & files)
+{
+	static const char * const common[] =
+	{
+		"Sample", ".message", "imdb.nfo", "Proof", "Subs"
+	};
+
+	ptime time(boost::gregorian::date(2008, 1, 1));
+	char buf[128];
+
+	for (unsigned long i = 0; i < count; ++i)
+	{
+		file f;
+
+		if (i < sizeof(common) / sizeof(common[0]))
+		{
+			f.name(common[i]);
+			f.type(i == 0 || i >= 3 ? file::directory : file::plain_old_file);
+		}
+		else
+		{
+			snprintf(buf, sizeof(buf), "some.release.name.%lu-grp.r%02lu",
+				index, i);
+			f.name(buf);
+			f.size(50000000 + i * 1024);
+		}
+
+		f.time(time + seconds(static_cast<long>((index * 7919 + i * 104729) %
+			31536000)));
+		files.push_back(f);
+	}
+}
+
+static bool name_less(const file & a, const file & b)
+{
+	return a.name() < b.name();
+}
+
+// What a vector<file> costs: the files, plus names too long for the
+// string's own buffer.
+static size_t memory_used(const vector<file> & files)
+{
+	size_t bytes = files.capacity() * sizeof(file);
+
+	for (vector<file>::const_iterator f = files.begin(); f != files.end(); ++f)
+		if (f->name().capacity() > 15)
+			bytes += f->name().capacity() + 1;
+
+	return bytes;
+}
+
+int main(int argc, char * argv[])
+{
+	unsigned long directories = argc > 1 ? strtoul(argv[1], 0, 10) : 10000;
+	unsigned long count = argc > 2 ? strtoul(argv[2], 0, 10) : 50;
+
+	cout << directories << " directories of " << count << " files" << endl;
+
+	vector<vector<file> > tree(directories);
+	for (unsigned long i = 0; i < directories; ++i)
+		make_directory(i, count, tree[i]);
+
+	boost::shared_ptr<name_arena> arena(new name_arena());
+	vector<directory_table> tables(directories, directory_table(arena));
+
+	stopwatch timer;
+
+	for (unsigned long i = 0; i < directories; ++i)
+	{
+		tables[i].reserve(tree[i].size());
+
+		for (vector<file>::const_iterator f = tree[i].begin();
+			f != tree[i].end(); ++f)
+			tables[i].push_back(*f);
+	}
+
+	unsigned long operations = directories * count;
+	report("directory_table push_back", timer.elapsed_ms(), operations);
+
+	size_t file_bytes = 0;
+	size_t table_bytes = arena->memory_used();
+
+	for (unsigned long i = 0; i < directories; ++i)
+	{
+		file_bytes += memory_used(tree[i]);
+		table_bytes += tables[i].memory_used();
+	}
+
+	cout << "  vector<file>      " << file_bytes / operations
+		<< " bytes/file" << endl;
+	cout << "  directory_table   " << table_bytes / operations
+		<< " bytes/file (" << arena->size() << " distinct names)" << endl;
+
+	size_t checksum = 0;
+
+	// Sorting copies of the directories, as a view sorting its own would.
+	timer.restart();
+
+	for (unsigned long i = 0; i < directories; ++i)
+	{
+		vector<file> sorted(tree[i]);
+		sort(sorted.begin(), sorted.end(), name_less);
+		checksum += sorted.front().name().length();
+	}
+
+	report("vector<file> sort by name", timer.elapsed_ms(), operations);
+
+	vector<directory_table::index_type> rows;
+	timer.restart();
+
+	for (unsigned long i = 0; i < directories; ++i)
+	{
+		tables[i].order_by_name(rows);
+		checksum += rows.front();
+	}
+
+	report("directory_table order_by_name", timer.elapsed_ms(), operations);
+
+	file::size_type file_total = 0;
+	timer.restart();
+
+	for (unsigned long i = 0; i < directories; ++i)
+		for (vector<file>::const_iterator f = tree[i].begin();
+			f != tree[i].end(); ++f)
+			if (f->is_file())
+				file_total += f->size();
+
+	report("vector<file> total sizes", timer.elapsed_ms(), operations);
+
+	file::size_type table_total = 0;
+	timer.restart();
+
+	for (unsigned long i = 0; i < directories; ++i)
+	{
+		const vector<boost::uint8_t> & flags = tables[i].flags();
+		const vector<directory_table::size_type> & sizes = tables[i].sizes();
+
+		for (directory_table::index_type row = 0; row < sizes.size(); ++row)
+			if ((flags[row] & directory_table::type_mask) ==
+				file::plain_old_file)
+				table_total += sizes[row];
+	}
+
+	report("directory_table total sizes", timer.elapsed_ms(), operations);
+
+	if (file_total != table_total)
+	{
+		cerr << "vector<file> and directory_table disagree on the total!"
+			<< endl;
+		return EXIT_FAILURE;
+	}
+
+	return checksum ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,702 @@
+#ifndef FOOFXP_FTP_STAND_IN_HPP_INCLUDED
+#define FOOFXP_FTP_STAND_IN_HPP_INCLUDED
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <deque>
+#include <istream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/shared_ptr.hpp>
+
+// Just enough of an FTP server, on loopback, to drive ftp::client through
+// login, STAT -l and transfers for the benchmarks. RETR sends file_size bytes
+// of junk; STOR swallows whatever it's given. Both passive (PASV/EPSV) and
+// active (PORT/EPRT) data connections work, so two stand-ins can FXP between
+// each other.
+//
+// latency is added to every reply on the control connection, as if the client
+// were that many milliseconds of round trip away. Replies to commands that
+// arrive back to back are all delayed from when their own command arrived, so
+// pipelining pays off the way it would over a real network. With
+// reject_pipelined_commands() on, the stand-in plays a server that can't cope
+// with that, and answers any command sent before the previous one was
+// answered with a 503.
+//
+// banner_lines() pads the welcome and login replies out into multi-line
+// replies, the way some sites greet you with a page of ASCII art.
+//
+// REST applies to the next RETR, which then sends the rest of the file from
+// there. rate_limit() caps how fast RETR sends, per data connection, either
+// for every session or for one of them (numbered in the order they connect),
+// the way many sites throttle each connection. drop_after() cuts the next
+// RETR off partway, the way a flaky link would.
+//
+// STAT -l <path> lists a made-up tree set up with tree(): every directory
+// down to the given depth holds the same number of subdirectories and files.
+// FEAT lists EPSV; with machine_listings() on, it lists MLST too, and MLSD
+// <path> lists the same tree over a data connection. CWD goes anywhere (PWD
+// says where), and once there is a tree, STAT -l and MLSD without a path list
+// the working directory in it. DELE and MKD always work, and change nothing.
+//
+// Runs on the io_service it's given, so it shares a thread with the client
+// under test.
+class ftp_stand_in
+{
+public:
+
+	ftp_stand_in(boost::asio::io_service & io_service,
+		boost::uint64_t file_size, unsigned long latency_ms = 0) :
+		io_service_(io_service),
+		acceptor_(io_service, boost::asio::ip::tcp::endpoint(
+			boost::asio::ip::address_v4::loopback(), 0)),
+		file_size_(file_size),
+		latency_(boost::posix_time::milliseconds(latency_ms)),
+		reject_pipelined_(false),
+		banner_lines_(0),
+		machine_listings_(false),
+		data_(1024 * 1024, 'x'),
+		bytes_received_(0),
+		rate_(0),
+		session_rates_(),
+		sessions_(0),
+		drop_after_(0),
+		tree_depth_(0),
+		tree_directories_(0),
+		tree_files_(0)
+	{
+		begin_accept();
+	};
+
+	unsigned short port() const { return acceptor_.local_endpoint().port(); };
+
+	void reject_pipelined_commands(bool reject) { reject_pipelined_ = reject; };
+
+	void banner_lines(unsigned int lines) { banner_lines_ = lines; };
+
+	void machine_listings(bool machine) { machine_listings_ = machine; };
+
+	// Bytes per second; 0 for no limit.
+	void rate_limit(boost::uint64_t rate) { rate_ = rate; };
+	void rate_limit(std::size_t session, boost::uint64_t rate)
+	{
+		session_rates_.resize(std::max(session_rates_.size(), session + 1),
+			rate_);
+		session_rates_[session] = rate;
+	};
+
+	// Close the data connection of the next RETR after it has sent this many
+	// bytes, and answer it with a 426.
+	void drop_after(boost::uint64_t bytes) { drop_after_ = bytes; };
+
+	void tree(unsigned int depth, unsigned int directories, unsigned int files)
+	{
+		tree_depth_ = depth;
+		tree_directories_ = directories;
+		tree_files_ = files;
+	};
+
+	boost::uint64_t bytes_received() const { return bytes_received_; };
+
+private:
+
+	class session : public boost::enable_shared_from_this<session>
+	{
+	public:
+
+		session(ftp_stand_in & server) :
+			server_(server),
+			control_(server.io_service_),
+			data_(server.io_service_),
+			passive_(server.io_service_),
+			request_(),
+			pipelined_(false),
+			replies_(),
+			reply_(),
+			reply_timer_(server.io_service_),
+			buffer_(64 * 1024),
+			listing_(),
+			working_directory_("/"),
+			active_(false),
+			active_endpoint_(),
+			data_accepted_(false),
+			ready_(false),
+			transfer_(none),
+			remaining_(0),
+			restart_(0),
+			number_(server.sessions_++),
+			drop_after_(0),
+			rate_(0),
+			sent_(0),
+			started_(),
+			data_timer_(server.io_service_)
+		{};
+
+		boost::asio::ip::tcp::socket & control() { return control_; };
+
+		void start()
+		{
+			send_reply(server_.banner("220", "foofxp stand-in ready."));
+			begin_read_command();
+		};
+
+	private:
+
+		typedef enum { none, retr, stor, mlsd } transfer_type;
+
+		void begin_read_command()
+		{
+			boost::asio::async_read_until(control_, request_, "\r\n",
+				boost::bind(&session::handle_command, shared_from_this(),
+					boost::asio::placeholders::error));
+		};
+
+		void handle_command(const boost::system::error_code & error)
+		{
+			if (error)
+				return;
+
+			std::string line;
+			std::istream stream(&request_);
+			std::getline(stream, line);
+
+			if (!line.empty() && line[line.length() - 1] == '\r')
+				line.erase(line.length() - 1);
+
+			// Anything already buffered behind this command was sent before
+			// it was answered.
+			bool pipelined = pipelined_;
+			pipelined_ = request_.size() != 0;
+
+			std::string verb = line.substr(0, line.find(' '));
+			std::transform(verb.begin(), verb.end(), verb.begin(), ::toupper);
+
+			if (pipelined && server_.reject_pipelined_)
+				send_reply("503 Bad sequence of commands.");
+
+			else if (verb == "USER")
+				send_reply("331 Password required.");
+
+			else if (verb == "PASS")
+				send_reply(server_.banner("230", "Logged in."));
+
+			else if (verb == "TYPE" || verb == "NOOP")
+				send_reply("200 Okay.");
+
+			else if (verb == "PWD")
+				send_reply("257 \"" + working_directory_ +
+					"\" is current directory.");
+
+			else if (verb == "CWD")
+			{
+				change_directory(line.substr(4));
+				send_reply("250 CWD command successful.");
+			}
+
+			else if (verb == "STAT" && line.length() > 8)
+				send_reply(server_.list(line.substr(8)));
+
+			else if (verb == "STAT" && server_.has_tree())
+				send_reply(server_.list(working_directory_));
+
+			else if (verb == "STAT")
+				send_reply("213- status of -l:\r\n"
+					"-rw-r--r--   1 site  site  1024 Jan  1 12:00 a.file\r\n"
+					"213 End of Status");
+
+			else if (verb == "FEAT")
+				send_reply(std::string("211-Features:\r\n"
+					" EPSV\r\n") + (server_.machine_listings_ ?
+					" MLST type*;size*;modify*;\r\n" : "") +
+					" UTF8\r\n"
+					"211 End");
+
+			else if (verb == "MLSD" && server_.machine_listings_)
+			{
+				listing_ = server_.machine_list(line.length() > 5 ?
+					line.substr(5) : working_directory_);
+				begin_transfer(mlsd);
+			}
+
+			else if (verb == "PASV" || verb == "EPSV")
+				open_passive(verb == "EPSV");
+
+			else if (verb == "PORT" || verb == "EPRT")
+				open_active(line.substr(verb.length() + 1), verb == "EPRT");
+
+			else if (verb == "REST")
+			{
+				unsigned long long offset = 0;
+				std::sscanf(line.c_str() + verb.length(), "%llu", &offset);
+				restart_ = offset;
+				send_reply("350 Restarting at " +
+					line.substr(verb.length() + 1) + ".");
+			}
+
+			else if (verb == "ABOR")
+				// Always after the transfer -- see below.
+				send_reply("226 ABOR command successful.");
+
+			else if (verb == "RETR")
+				begin_transfer(retr);
+
+			else if (verb == "STOR")
+				begin_transfer(stor);
+
+			else if (verb == "DELE")
+				send_reply("250 DELE command successful.");
+
+			else if (verb == "MKD")
+				send_reply("257 \"" + line.substr(4) + "\" created.");
+
+			else if (verb == "QUIT")
+				send_reply("221 Goodbye.");
+
+			else
+				send_reply("502 Command not implemented.");
+
+			// Like a real server, don't look at the next command until the
+			// data has gone through.
+			if (transfer_ == none)
+				begin_read_command();
+		};
+
+		void change_directory(const std::string & path)
+		{
+			if (!path.empty() && path[0] == '/')
+				working_directory_ = path;
+			else if (path == "..")
+			{
+				std::string::size_type slash = working_directory_.rfind('/');
+				working_directory_.erase(slash == 0 ? 1 : slash);
+			}
+			else if (working_directory_ == "/")
+				working_directory_ += path;
+			else
+				working_directory_ += "/" + path;
+		};
+
+		void send_reply(const std::string & reply)
+		{
+			replies_.push_back(std::make_pair(
+				boost::posix_time::microsec_clock::universal_time() +
+				server_.latency_, reply + "\r\n"));
+
+			if (replies_.size() == 1)
+				begin_write_reply();
+		};
+
+		void begin_write_reply()
+		{
+			if (server_.latency_.total_microseconds() == 0)
+			{
+				write_reply(boost::system::error_code());
+				return;
+			}
+
+			reply_timer_.expires_at(replies_.front().first);
+			reply_timer_.async_wait(boost::bind(&session::write_reply,
+				shared_from_this(), boost::asio::placeholders::error));
+		};
+
+		void write_reply(const boost::system::error_code & error)
+		{
+			if (error)
+				return;
+
+			reply_ = replies_.front().second;
+
+			boost::asio::async_write(control_, boost::asio::buffer(reply_),
+				boost::bind(&session::handle_reply_sent, shared_from_this(),
+					boost::asio::placeholders::error));
+		};
+
+		void handle_reply_sent(const boost::system::error_code & error)
+		{
+			if (error)
+				return;
+
+			replies_.pop_front();
+
+			if (transfer_ != none && !reply_.compare(0, 3, "150"))
+			{
+				ready_ = true;
+
+				if (active_)
+					data_.async_connect(active_endpoint_,
+						boost::bind(&session::handle_data_accept,
+							shared_from_this(),
+							boost::asio::placeholders::error));
+
+				else if (data_accepted_)
+					start_transfer();
+			}
+
+			if (!replies_.empty())
+				begin_write_reply();
+		};
+
+		void open_passive(bool extended)
+		{
+			using namespace boost::asio::ip;
+
+			boost::system::error_code ignored;
+			passive_.close(ignored);
+			active_ = false;
+
+			passive_.open(tcp::v4());
+			passive_.bind(tcp::endpoint(address_v4::loopback(), 0));
+			passive_.listen();
+
+			data_accepted_ = false;
+			passive_.async_accept(data_,
+				boost::bind(&session::handle_data_accept, shared_from_this(),
+					boost::asio::placeholders::error));
+
+			unsigned short port = passive_.local_endpoint().port();
+			char reply[128];
+
+			if (extended)
+				snprintf(reply, sizeof(reply),
+					"229 Entering Extended Passive Mode (|||%u|)", port);
+			else
+				snprintf(reply, sizeof(reply),
+					"227 Entering Passive Mode (127,0,0,1,%u,%u)", port / 256,
+					port % 256);
+
+			send_reply(reply);
+		};
+
+		void open_active(const std::string & argument, bool extended)
+		{
+			using namespace boost::asio::ip;
+
+			unsigned int h1, h2, h3, h4, p1, p2;
+			char address[64];
+			unsigned int port;
+
+			if (!extended && sscanf(argument.c_str(), "%u,%u,%u,%u,%u,%u", &h1,
+				&h2, &h3, &h4, &p1, &p2) == 6)
+			{
+				address_v4::bytes_type bytes = {{ h1, h2, h3, h4 }};
+				active_endpoint_ = tcp::endpoint(address_v4(bytes),
+					p1 * 256 + p2);
+			}
+			else if (extended && sscanf(argument.c_str(), "|%*u|%63[^|]|%u|",
+				address, &port) == 2)
+				active_endpoint_ = tcp::endpoint(
+					address::from_string(address), port);
+			else
+			{
+				send_reply("501 Syntax error in parameters.");
+				return;
+			}
+
+			active_ = true;
+			send_reply("200 PORT command successful.");
+		};
+
+		void handle_data_accept(const boost::system::error_code & error)
+		{
+			if (error)
+				return;
+
+			data_accepted_ = true;
+
+			if (ready_)
+				start_transfer();
+		};
+
+		void begin_transfer(transfer_type type)
+		{
+			transfer_ = type;
+			send_reply("150 Opening BINARY mode data connection.");
+		};
+
+		void start_transfer()
+		{
+			ready_ = false;
+
+			if (transfer_ == retr)
+			{
+				remaining_ = server_.file_size_ -
+					std::min(restart_, server_.file_size_);
+				restart_ = 0;
+				drop_after_ = server_.drop_after_;
+				server_.drop_after_ = 0;
+				rate_ = server_.session_rate(number_);
+				sent_ = 0;
+				started_ = boost::posix_time::microsec_clock::universal_time();
+				send_data(boost::system::error_code(), 0);
+			}
+			else if (transfer_ == mlsd)
+				boost::asio::async_write(data_, boost::asio::buffer(listing_),
+					boost::bind(&session::handle_listing_sent,
+						shared_from_this(), boost::asio::placeholders::error));
+			else
+				receive_data(boost::system::error_code(), 0);
+		};
+
+		void send_data(const boost::system::error_code & error,
+			std::size_t bytes_transferred)
+		{
+			remaining_ -= bytes_transferred;
+			sent_ += bytes_transferred;
+
+			if (error)
+			{
+				// E.g. the client closed the connection to abort.
+				finish_transfer("426 Connection closed; transfer aborted.");
+				return;
+			}
+			else if (remaining_ == 0)
+			{
+				finish_transfer();
+				return;
+			}
+			else if (drop_after_ != 0 && sent_ >= drop_after_)
+			{
+				finish_transfer("426 Connection lost; transfer aborted.");
+				return;
+			}
+
+			if (rate_ != 0)
+			{
+				// Hold off until the data sent so far is due.
+				boost::posix_time::ptime due = started_ +
+					boost::posix_time::microseconds(sent_ * 1000000 / rate_);
+
+				if (due > boost::posix_time::microsec_clock::universal_time())
+				{
+					data_timer_.expires_at(due);
+					data_timer_.async_wait(boost::bind(&session::send_data,
+						shared_from_this(), boost::asio::placeholders::error,
+						0));
+					return;
+				}
+			}
+
+			// A tenth of a second's worth at a time when rate limited.
+			boost::uint64_t chunk = rate_ == 0 ? server_.data_.size() :
+				std::max<boost::uint64_t>(rate_ / 10, 1);
+
+			if (drop_after_ != 0)
+				chunk = std::min(chunk, drop_after_ - sent_);
+
+			std::size_t length = static_cast<std::size_t>(std::min(remaining_,
+				std::min<boost::uint64_t>(chunk, server_.data_.size())));
+
+			boost::asio::async_write(data_,
+				boost::asio::buffer(&server_.data_[0], length),
+				boost::bind(&session::send_data, shared_from_this(),
+					boost::asio::placeholders::error,
+					boost::asio::placeholders::bytes_transferred));
+		};
+
+		void handle_listing_sent(const boost::system::error_code & error)
+		{
+			if (error)
+				finish_transfer("426 Connection closed; transfer aborted.");
+			else
+				finish_transfer();
+		};
+
+		void receive_data(const boost::system::error_code & error,
+			std::size_t bytes_transferred)
+		{
+			server_.bytes_received_ += bytes_transferred;
+
+			if (error)
+			{
+				// End of file (or the client gave up).
+				finish_transfer();
+				return;
+			}
+
+			data_.async_read_some(boost::asio::buffer(buffer_),
+				boost::bind(&session::receive_data, shared_from_this(),
+					boost::asio::placeholders::error,
+					boost::asio::placeholders::bytes_transferred));
+		};
+
+		void finish_transfer(const std::string & reply =
+			"226 Transfer complete.")
+		{
+			boost::system::error_code ignored;
+			data_.close(ignored);
+			passive_.close(ignored);
+
+			transfer_ = none;
+			active_ = false;
+			data_accepted_ = false;
+			send_reply(reply);
+			begin_read_command();
+		};
+
+		ftp_stand_in & server_;
+		boost::asio::ip::tcp::socket control_;
+		boost::asio::ip::tcp::socket data_;
+		boost::asio::ip::tcp::acceptor passive_;
+		boost::asio::streambuf request_;
+		bool pipelined_;
+		std::deque<std::pair<boost::posix_time::ptime, std::string> >
+			replies_;
+		std::string reply_;
+		boost::asio::deadline_timer reply_timer_;
+		std::vector<char> buffer_;
+		std::string listing_;
+		std::string working_directory_;
+		bool active_;
+		boost::asio::ip::tcp::endpoint active_endpoint_;
+		bool data_accepted_;
+		bool ready_;
+		transfer_type transfer_;
+		boost::uint64_t remaining_;
+		boost::uint64_t restart_;
+		std::size_t number_;
+		boost::uint64_t drop_after_;
+		boost::uint64_t rate_;
+		boost::uint64_t sent_;
+		boost::posix_time::ptime started_;
+		boost::asio::deadline_timer data_timer_;
+	};
+
+	void begin_accept()
+	{
+		boost::shared_ptr<session> next(new session(*this));
+
+		acceptor_.async_accept(next->control(),
+			boost::bind(&ftp_stand_in::handle_accept, this, next,
+				boost::asio::placeholders::error));
+	};
+
+	void handle_accept(boost::shared_ptr<session> next,
+		const boost::system::error_code & error)
+	{
+		if (error)
+			return;
+
+		// Like most real servers -- otherwise back to back replies (e.g. 150
+		// then 226) sit in Nagle's buffer waiting for a delayed ACK.
+		boost::system::error_code ignored;
+		next->control().set_option(boost::asio::ip::tcp::no_delay(true),
+			ignored);
+
+		next->start();
+		begin_accept();
+	};
+
+	boost::uint64_t session_rate(std::size_t session) const
+	{
+		return session < session_rates_.size() ? session_rates_[session] :
+			rate_;
+	};
+
+	bool has_tree() const
+	{
+		return tree_directories_ != 0 || tree_files_ != 0;
+	};
+
+	static unsigned int depth(const std::string & path)
+	{
+		unsigned int depth = 0;
+		for (std::size_t i = 0; i < path.length(); i++)
+			if (path[i] == '/' && i + 1 < path.length() && path[i + 1] != '/')
+				depth++;
+
+		return depth;
+	};
+
+	// STAT -l <path> of the made-up tree.
+	std::string list(const std::string & path) const
+	{
+		unsigned int depth = ftp_stand_in::depth(path);
+
+		std::string reply = "213- status of -l " + path + ":\r\n";
+		char line[128];
+
+		if (depth < tree_depth_)
+			for (unsigned int i = 0; i < tree_directories_; i++)
+			{
+				snprintf(line, sizeof(line), "drwxr-xr-x   2 site  site  4096 "
+					"Jan  1 12:00 dir%u\r\n", i);
+				reply += line;
+			}
+
+		for (unsigned int i = 0; i < tree_files_; i++)
+		{
+			snprintf(line, sizeof(line), "-rw-r--r--   1 site  site  1024 "
+				"Jan  1 12:00 file%u.rar\r\n", i);
+			reply += line;
+		}
+
+		return reply + "213 End of Status";
+	};
+
+	// MLSD <path> of the same tree.
+	std::string machine_list(const std::string & path) const
+	{
+		unsigned int depth = ftp_stand_in::depth(path);
+
+		std::string listing =
+			"type=cdir;modify=20100101120000;perm=flcdmpe; .\r\n"
+			"type=pdir;modify=20100101120000;perm=flcdmpe; ..\r\n";
+		char line[128];
+
+		if (depth < tree_depth_)
+			for (unsigned int i = 0; i < tree_directories_; i++)
+			{
+				snprintf(line, sizeof(line), "type=dir;modify=20100101120000;"
+					"perm=flcdmpe; dir%u\r\n", i);
+				listing += line;
+			}
+
+		for (unsigned int i = 0; i < tree_files_; i++)
+		{
+			snprintf(line, sizeof(line), "type=file;size=1024;"
+				"modify=20100101120000;perm=adfrw; file%u.rar\r\n", i);
+			listing += line;
+		}
+
+		return listing;
+	};
+
+	std::string banner(const char * code, const std::string & message) const
+	{
+		if (banner_lines_ == 0)
+			return std::string(code) + " " + message;
+
+		// RFC 959 style: the lines in between don't need a reply code.
+		std::string reply = std::string(code) + "-" + message + "\r\n";
+		for (unsigned int i = 0; i < banner_lines_; i++)
+			reply += "  |  welcome to the foofxp stand-in  |\r\n";
+
+		return reply + code + " " + message;
+	};
+
+	boost::asio::io_service & io_service_;
+	boost::asio::ip::tcp::acceptor acceptor_;
+	boost::uint64_t file_size_;
+	boost::posix_time::time_duration latency_;
+	bool reject_pipelined_;
+	unsigned int banner_lines_;
+	bool machine_listings_;
+	std::vector<char> data_;
+	boost::uint64_t bytes_received_;
+	boost::uint64_t rate_;
+	std::vector<boost::uint64_t> session_rates_;
+	std::size_t sessions_;
+	boost::uint64_t drop_after_;
+	unsigned int tree_depth_;
+	unsigned int tree_directories_;
+	unsigned int tree_files_;
+};
+
+#endif // FOOFXP_FTP_STAND_IN_HPP_INCLUDED
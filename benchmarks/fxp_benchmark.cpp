@@ -0,0 +1,131 @@
+// Queue throughput of fxp_job between two ftp_stand_in servers on loopback.
+// With lots of small files, per-file command round trips dominate, so this is
+// mostly a measure of how well the job keeps both control connections busy.
+//
+// Usage: fxp_benchmark [files] [kilobytes per file]
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/bind.hpp>
+#include "benchmark.hpp"
+#include "ftp_stand_in.hpp"
+#include "model/ftp/client.hpp"
+#include "model/fxp_job.hpp"
+#include "utility/format.hpp"
+
+using namespace std;
+using namespace boost::asio;
+using foofxp::model::fxp_job;
+using foofxp::model::ftp::client;
+
+// Starts the job once both sessions have logged in, and stops the io_service
+// when it's done.
+class fxp_driver
+{
+public:
+
+	fxp_driver(io_service & io_service, client & source, client & destination,
+		fxp_job & job) :
+		io_service_(io_service),
+		job_(job),
+		logged_in_(0),
+		failed_(0)
+	{
+		source.received_directory_list.connect(
+			boost::bind(&fxp_driver::handle_logged_in, this));
+		destination.received_directory_list.connect(
+			boost::bind(&fxp_driver::handle_logged_in, this));
+		source.fatal_error_occurred.connect(
+			boost::bind(&fxp_driver::handle_error, this, _2));
+		destination.fatal_error_occurred.connect(
+			boost::bind(&fxp_driver::handle_error, this, _2));
+		job.file_failed.connect(
+			boost::bind(&fxp_driver::handle_file_failed, this, _2, _3));
+		job.completed.connect(
+			boost::bind(&fxp_driver::handle_completed, this));
+	};
+
+	double elapsed_ms;
+	unsigned long failed() const { return failed_; };
+
+private:
+
+	void handle_logged_in()
+	{
+		if (++logged_in_ < 2)
+			return;
+
+		timer_.restart();
+		job_.begin();
+	};
+
+	void handle_file_failed(const string & path, const string & message)
+	{
+		if (failed_++ == 0)
+			cerr << "error: " << path << ": " << message << endl;
+	};
+
+	void handle_completed()
+	{
+		elapsed_ms = timer_.elapsed_ms();
+		io_service_.stop();
+	};
+
+	void handle_error(const string & message)
+	{
+		cerr << "error: " << message << endl;
+		io_service_.stop();
+	};
+
+	io_service & io_service_;
+	fxp_job & job_;
+	int logged_in_;
+	unsigned long failed_;
+	stopwatch timer_;
+};
+
+int main(int argc, char * argv[])
+{
+	unsigned long files = argc > 1 ? strtoul(argv[1], 0, 10) : 1000;
+	unsigned long kilobytes = argc > 2 ? strtoul(argv[2], 0, 10) : 4;
+
+	io_service io_service;
+	ssl::context context(io_service, ssl::context::tlsv1_client);
+	ftp_stand_in source_site(io_service, kilobytes * 1024);
+	ftp_stand_in destination_site(io_service, 0);
+
+	client source("127.0.0.1", source_site.port(), false, false, "bench",
+		"bench", io_service, context);
+	client destination("127.0.0.1", destination_site.port(), false, false,
+		"bench", "bench", io_service, context);
+
+	fxp_job job(source, destination);
+	for (unsigned long i = 0; i < files; i++)
+	{
+		string name = foofxp::utility::format(32, "file%lu", i);
+		job.add(name, name);
+	}
+
+	fxp_driver driver(io_service, source, destination, job);
+	driver.elapsed_ms = 0;
+
+	source.begin_connect();
+	destination.begin_connect();
+	io_service.run();
+
+	cout << files << " files of " << kilobytes << " KB" << endl;
+	report("fxp_job queue", driver.elapsed_ms, files);
+
+	if (driver.failed() != 0)
+		cerr << "  " << driver.failed() << " files failed" << endl;
+
+	if (destination_site.bytes_received() != files * kilobytes * 1024)
+		cerr << "  expected " << files * kilobytes * 1024
+			<< " bytes at the destination, got "
+			<< destination_site.bytes_received() << endl;
+
+	return EXIT_SUCCESS;
+}
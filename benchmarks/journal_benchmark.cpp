@@ -0,0 +1,174 @@
+// What journaling downloads costs, and what it saves. Downloads a file from
+// ftp_stand_in without a transfer_journal, then with one at a couple of
+// checkpoint intervals, then has the stand-in drop the connection halfway
+// through and downloads it again, resuming from the last checkpoint.
+//
+// Usage: journal_benchmark [megabytes]
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include "benchmark.hpp"
+#include "ftp_stand_in.hpp"
+#include "model/ftp/client.hpp"
+#include "model/ftp/transfer_journal.hpp"
+
+// For stat() and unlink().
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace boost::asio;
+using foofxp::model::ftp::client;
+using foofxp::model::ftp::transfer_journal;
+
+static const char * local_path = "/tmp/foofxp-journal-benchmark";
+static const char * journal_path = "/tmp/foofxp-journal-benchmark.journal";
+
+// Logs in and downloads, once more after a failure if asked to, then stops.
+class journal_driver
+{
+public:
+
+	journal_driver(io_service & io_service, client & client, bool retry) :
+		elapsed_ms(0),
+		retry_ms(0),
+		retry_bytes(0),
+		io_service_(io_service),
+		client_(client),
+		retry_(retry)
+	{
+		client.received_directory_list.connect(
+			boost::bind(&journal_driver::handle_logged_in, this));
+		client.transfer_completed.connect(
+			boost::bind(&journal_driver::handle_completed, this));
+		client.transfer_failed.connect(
+			boost::bind(&journal_driver::handle_failed, this, _2));
+		client.fatal_error_occurred.connect(
+			boost::bind(&journal_driver::handle_failed, this, _2));
+	};
+
+	double elapsed_ms;
+	double retry_ms;
+	boost::uint64_t retry_bytes;
+
+private:
+
+	void handle_logged_in()
+	{
+		timer_.restart();
+		client_.begin_download("big.file", local_path);
+	};
+
+	void handle_completed()
+	{
+		if (retry_ms == 0 && elapsed_ms != 0)
+		{
+			retry_ms = timer_.elapsed_ms();
+			retry_bytes = client_.bytes_transferred();
+		}
+		else
+			elapsed_ms = timer_.elapsed_ms();
+
+		io_service_.stop();
+	};
+
+	void handle_failed(const string & message)
+	{
+		if (!retry_ || elapsed_ms != 0)
+		{
+			cerr << "error: " << message << endl;
+			io_service_.stop();
+			return;
+		}
+
+		elapsed_ms = timer_.elapsed_ms();
+		timer_.restart();
+
+		// Once the failure has been dealt with.
+		client_.strand().post(boost::bind(&client::begin_download, &client_,
+			string("big.file"), string(local_path)));
+	};
+
+	io_service & io_service_;
+	client & client_;
+	bool retry_;
+	stopwatch timer_;
+};
+
+static void run(const string & name, boost::uint64_t file_size, bool journal,
+	boost::uint64_t checkpoint_bytes, boost::uint64_t drop_after)
+{
+	::unlink(local_path);
+	::unlink(journal_path);
+
+	io_service io_service;
+	ssl::context context(io_service, ssl::context::tlsv1_client);
+	ftp_stand_in server(io_service, file_size);
+	server.drop_after(drop_after);
+
+	client c("127.0.0.1", server.port(), false, false, "bench", "bench",
+		io_service, context);
+
+	boost::scoped_ptr<transfer_journal> records;
+	if (journal)
+	{
+		records.reset(new transfer_journal(journal_path));
+		c.journal(records.get());
+		c.checkpoint_bytes(checkpoint_bytes);
+	}
+
+	journal_driver driver(io_service, c, drop_after != 0);
+
+	c.begin_connect();
+	io_service.run();
+
+	unsigned long megabytes = static_cast<unsigned long>(file_size >> 20);
+
+	if (drop_after == 0)
+	{
+		report(name, driver.elapsed_ms, megabytes);
+		cout << "  " << (driver.elapsed_ms > 0 ?
+			megabytes * 1000.0 / driver.elapsed_ms : 0.0) << " MB/s";
+	}
+	else
+	{
+		report(name + " (dropped)", driver.elapsed_ms);
+		report(name + " (again)", driver.retry_ms);
+		cout << "  " << driver.retry_bytes / 1024 << " KB fetched again";
+	}
+
+	if (records)
+		cout << ", " << records->flushes() << " journal syncs";
+	cout << endl;
+
+	struct stat status;
+	if (::stat(local_path, &status) != 0 ||
+		static_cast<boost::uint64_t>(status.st_size) != file_size)
+		cerr << "  expected " << file_size << " bytes in " << local_path
+			<< endl;
+}
+
+int main(int argc, char * argv[])
+{
+	unsigned long megabytes = argc > 1 ? strtoul(argv[1], 0, 10) : 256;
+	boost::uint64_t file_size = static_cast<boost::uint64_t>(megabytes) << 20;
+
+	cout << megabytes << " MB file (times are per MB)" << endl;
+
+	run("no journal", file_size, false, 0, 0);
+	run("journal, checkpoint every 32 MB", file_size, true, 32 << 20, 0);
+	run("journal, checkpoint every 4 MB", file_size, true, 4 << 20, 0);
+	run("no journal", file_size, false, 0, file_size / 2);
+	run("journal", file_size, true, 32 << 20, file_size / 2);
+
+	::unlink(local_path);
+	::unlink(journal_path);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,123 @@
+// Compares the original file_mapper get_files() against list_parser on a
+// synthetic STAT -l listing.
+//
+// Usage: list_parser_benchmark [lines] [iterations]
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "benchmark.hpp"
+#include "model/ftp/file_mapper.hpp"
+#include "model/ftp/list_parser.hpp"
+
+using namespace std;
+using foofxp::model::file;
+using foofxp::model::ftp::get_files;
+using foofxp::model::ftp::list_parser;
+
+static const char * const months[] =
+{
+	"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+	"Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+// Build a listing mixing the usual shapes of entry: owner and group, group
+// only, clock times and years, directories and links.
+static vector<string> make_listing(unsigned long count)
+{
+	vector<string> lines;
+	lines.reserve(count + 1);
+	lines.push_back("total 123456");
+
+	char buf[256];
+
+	for (unsigned long i = 0; i < count; ++i)
+	{
+		const char * month = months[i % 12];
+		int day = static_cast<int>(i % 28) + 1;
+
+		switch (i % 4)
+		{
+			case 0:
+				snprintf(buf, sizeof(buf), "-rw-r--r--   1 site  site  "
+					"%lu %s %2d 12:%02lu Some.Release.Name-GRP.r%02lu",
+					i * 1024, month, day, i % 60, i % 100);
+				break;
+
+			case 1:
+				snprintf(buf, sizeof(buf), "drwxrwxrwx   3 site  4096 "
+					"%s %2d  2007 Some.Other.Release.%lu-GRP", month, day, i);
+				break;
+
+			case 2:
+				snprintf(buf, sizeof(buf), "-rw-r--r--   1  %lu %s %2d "
+					"2006 file with spaces %lu.nfo", i, month, day, i);
+				break;
+
+			default:
+				snprintf(buf, sizeof(buf), "lrwxrwxrwx   1 site  site  "
+					"7 %s %2d 00:17 link%lu -> ../target%lu", month, day, i, i);
+				break;
+		}
+
+		lines.push_back(buf);
+	}
+
+	return lines;
+}
+
+int main(int argc, char * argv[])
+{
+	unsigned long count = argc > 1 ? strtoul(argv[1], 0, 10) : 100000;
+	int iterations = argc > 2 ? atoi(argv[2]) : 5;
+
+	vector<string> lines = make_listing(count);
+
+	cout << count << " lines, " << iterations << " iterations" << endl;
+
+	// Sanity check: both parsers should agree.
+	vector<file> expected = get_files(lines);
+	vector<file> actual;
+	list_parser().parse_lines(lines, actual);
+
+	if (expected != actual)
+	{
+		cerr << "get_files() and list_parser disagree!" << endl;
+		return EXIT_FAILURE;
+	}
+
+	unsigned long operations = count * iterations;
+	size_t checksum = 0;
+	stopwatch timer;
+
+	for (int i = 0; i < iterations; ++i)
+		checksum += get_files(lines).size();
+
+	report("file_mapper get_files()", timer.elapsed_ms(), operations);
+
+	timer.restart();
+
+	for (int i = 0; i < iterations; ++i)
+	{
+		vector<file> files;
+		checksum += list_parser().parse_lines(lines, files);
+	}
+
+	report("list_parser (fresh records)", timer.elapsed_ms(), operations);
+
+	// Reusing the vector from the previous listing means its storage is
+	// already allocated.
+	vector<file> files;
+	timer.restart();
+
+	for (int i = 0; i < iterations; ++i)
+	{
+		files.clear();
+		checksum += list_parser().parse_lines(lines, files);
+	}
+
+	report("list_parser (reused vector)", timer.elapsed_ms(), operations);
+
+	return checksum ? EXIT_SUCCESS : EXIT_FAILURE;
+}
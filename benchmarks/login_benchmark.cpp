@@ -0,0 +1,139 @@
+// Time to first directory listing, then to change directory and start a
+// passive download, against an ftp_stand_in with a simulated round trip time.
+// Compares pipelined commands with lockstep, and with a server that rejects
+// pipelined commands (so the client has to fall back), and with a site that
+// sends long multi-line welcome and login banners. Lockstep is timed again
+// with the server's features already cached, as they would be from an earlier
+// session, so there's no FEAT to wait for.
+//
+// Usage: login_benchmark [round trip ms]
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/bind.hpp>
+#include "benchmark.hpp"
+#include "ftp_stand_in.hpp"
+#include "model/ftp/client.hpp"
+#include "model/ftp/feature_cache.hpp"
+
+using namespace std;
+using namespace boost::asio;
+using foofxp::model::ftp::client;
+using foofxp::model::ftp::feature_cache;
+
+// Logs in, changes directory and downloads a small file, timing each step
+// from the start of the connection.
+class login_driver
+{
+public:
+
+	login_driver(io_service & io_service, client & client) :
+		io_service_(io_service),
+		client_(client),
+		listed_ms(0),
+		changed_directory_ms(0),
+		transferred_ms(0)
+	{
+		client.received_directory_list.connect(
+			boost::bind(&login_driver::handle_listed, this));
+		client.changed_directory.connect(
+			boost::bind(&login_driver::handle_changed_directory, this));
+		client.transfer_completed.connect(
+			boost::bind(&login_driver::handle_transferred, this));
+		client.transfer_failed.connect(
+			boost::bind(&login_driver::handle_error, this, _2));
+		client.change_directory_failed.connect(
+			boost::bind(&login_driver::handle_error, this, _2));
+		client.fatal_error_occurred.connect(
+			boost::bind(&login_driver::handle_error, this, _2));
+	};
+
+	double listed_ms;
+	double changed_directory_ms;
+	double transferred_ms;
+
+private:
+
+	void handle_listed()
+	{
+		listed_ms = timer_.elapsed_ms();
+		client_.begin_change_directory("/pub");
+	};
+
+	void handle_changed_directory()
+	{
+		changed_directory_ms = timer_.elapsed_ms();
+		client_.begin_download("a.file", "/dev/null");
+	};
+
+	void handle_transferred()
+	{
+		transferred_ms = timer_.elapsed_ms();
+		io_service_.stop();
+	};
+
+	void handle_error(const string & message)
+	{
+		cerr << "error: " << message << endl;
+		io_service_.stop();
+	};
+
+	io_service & io_service_;
+	client & client_;
+	stopwatch timer_;
+};
+
+static void run(const string & name, bool pipeline, bool reject_pipelined,
+	unsigned long latency_ms, unsigned int banner_lines = 0,
+	bool features_cached = false)
+{
+	io_service io_service;
+	ssl::context context(io_service, ssl::context::tlsv1_client);
+	ftp_stand_in server(io_service, 1024, latency_ms);
+	server.reject_pipelined_commands(reject_pipelined);
+	server.banner_lines(banner_lines);
+
+	client c("127.0.0.1", server.port(), false, false, "bench", "bench",
+		io_service, context);
+	c.pipeline_commands(pipeline);
+
+	// Each run has a fresh cache, so only the one that asks for it starts out
+	// knowing the stand-in's features.
+	feature_cache features(boost::posix_time::hours(1));
+	c.capabilities(&features);
+
+	if (features_cached)
+	{
+		feature_cache::feature_set known;
+		known.insert("EPSV");
+		known.insert("UTF8");
+		features.insert("127.0.0.1", server.port(), known);
+	}
+
+	login_driver driver(io_service, c);
+
+	c.begin_connect();
+	io_service.run();
+
+	report(name + " first listing", driver.listed_ms);
+	report(name + " + CWD/PWD", driver.changed_directory_ms);
+	report(name + " + TYPE/PASV/RETR", driver.transferred_ms);
+}
+
+int main(int argc, char * argv[])
+{
+	unsigned long latency_ms = argc > 1 ? strtoul(argv[1], 0, 10) : 100;
+
+	cout << latency_ms << " ms round trip (cumulative times)" << endl;
+
+	run("lockstep", false, false, latency_ms);
+	run("lockstep, features cached", false, false, latency_ms, 0, true);
+	run("pipelined", true, false, latency_ms);
+	run("fallback", true, true, latency_ms);
+	run("banners", true, false, latency_ms, 60);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,168 @@
+// Compares file_mapper get_files() and list_parser on a synthetic STAT -l
+// listing against mlsx_parser on the MLSD listing of the same files.
+//
+// Usage: mlsx_parser_benchmark [lines] [iterations]
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "benchmark.hpp"
+#include "model/ftp/file_mapper.hpp"
+#include "model/ftp/list_parser.hpp"
+#include "model/ftp/mlsx_parser.hpp"
+
+using namespace std;
+using foofxp::model::file;
+using foofxp::model::ftp::get_files;
+using foofxp::model::ftp::list_parser;
+using foofxp::model::ftp::mlsx_parser;
+
+static const char * const months[] =
+{
+	"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+	"Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+// The same files both ways: plain files with clock times, directories with
+// years, names with spaces, and links.
+static void make_listings(unsigned long count, vector<string> & list,
+	vector<string> & machine_list)
+{
+	list.reserve(count);
+	machine_list.reserve(count + 2);
+
+	machine_list.push_back("type=cdir;modify=20080101000000;perm=flcdmpe; .");
+	machine_list.push_back("type=pdir;modify=20080101000000;perm=flcdmpe; ..");
+
+	char buf[256];
+
+	for (unsigned long i = 0; i < count; ++i)
+	{
+		int month = static_cast<int>(i % 12);
+		int day = static_cast<int>(i % 28) + 1;
+
+		switch (i % 4)
+		{
+			case 0:
+				snprintf(buf, sizeof(buf), "-rw-r--r--   1 site  site  "
+					"%lu %s %2d 12:%02lu Some.Release.Name-GRP.r%02lu",
+					i * 1024, months[month], day, i % 60, i % 100);
+				list.push_back(buf);
+
+				snprintf(buf, sizeof(buf), "type=file;size=%lu;"
+					"modify=2008%02d%02d12%02lu00;UNIX.mode=0644; "
+					"Some.Release.Name-GRP.r%02lu", i * 1024, month + 1, day,
+					i % 60, i % 100);
+				machine_list.push_back(buf);
+				break;
+
+			case 1:
+				snprintf(buf, sizeof(buf), "drwxrwxrwx   3 site  4096 "
+					"%s %2d  2007 Some.Other.Release.%lu-GRP", months[month],
+					day, i);
+				list.push_back(buf);
+
+				snprintf(buf, sizeof(buf), "type=dir;size=4096;"
+					"modify=2007%02d%02d000000;UNIX.mode=0777; "
+					"Some.Other.Release.%lu-GRP", month + 1, day, i);
+				machine_list.push_back(buf);
+				break;
+
+			case 2:
+				snprintf(buf, sizeof(buf), "-rw-r--r--   1  %lu %s %2d "
+					"2006 file with spaces %lu.nfo", i, months[month], day, i);
+				list.push_back(buf);
+
+				snprintf(buf, sizeof(buf), "type=file;size=%lu;"
+					"modify=2006%02d%02d000000;UNIX.mode=0644; "
+					"file with spaces %lu.nfo", i, month + 1, day, i);
+				machine_list.push_back(buf);
+				break;
+
+			default:
+				snprintf(buf, sizeof(buf), "lrwxrwxrwx   1 site  site  "
+					"7 %s %2d 00:17 link%lu -> ../target%lu", months[month],
+					day, i, i);
+				list.push_back(buf);
+
+				snprintf(buf, sizeof(buf), "type=OS.unix=slink:../target%lu;"
+					"size=7;modify=2008%02d%02d001700; link%lu", i, month + 1,
+					day, i);
+				machine_list.push_back(buf);
+				break;
+		}
+	}
+}
+
+int main(int argc, char * argv[])
+{
+	unsigned long count = argc > 1 ? strtoul(argv[1], 0, 10) : 100000;
+	int iterations = argc > 2 ? atoi(argv[2]) : 5;
+
+	vector<string> list;
+	vector<string> machine_list;
+	make_listings(count, list, machine_list);
+
+	cout << count << " lines, " << iterations << " iterations" << endl;
+
+	// Sanity check: both should find the same files. Names of links and
+	// times differ (ls gives "link -> target", and guesses the year of
+	// clock times), so only compare what both are sure of.
+	vector<file> expected;
+	vector<file> actual;
+	list_parser().parse_lines(list, expected);
+	mlsx_parser().parse_lines(machine_list, actual);
+
+	if (expected.size() != actual.size())
+	{
+		cerr << "list_parser and mlsx_parser disagree on the count!" << endl;
+		return EXIT_FAILURE;
+	}
+
+	for (vector<file>::size_type i = 0; i < expected.size(); ++i)
+		if (expected[i].type() != actual[i].type() ||
+			expected[i].size() != actual[i].size() ||
+			(expected[i].type() != file::link &&
+			expected[i].name() != actual[i].name()))
+		{
+			cerr << "list_parser and mlsx_parser disagree on '"
+				<< actual[i].name() << "'!" << endl;
+			return EXIT_FAILURE;
+		}
+
+	unsigned long operations = count * iterations;
+	size_t checksum = 0;
+
+	stopwatch timer;
+
+	for (int i = 0; i < iterations; ++i)
+		checksum += get_files(list).size();
+
+	report("file_mapper get_files() (STAT -l)", timer.elapsed_ms(),
+		operations);
+
+	// The parsers into a reused vector, as the client does.
+	vector<file> files;
+	timer.restart();
+
+	for (int i = 0; i < iterations; ++i)
+	{
+		files.clear();
+		checksum += list_parser().parse_lines(list, files);
+	}
+
+	report("list_parser (STAT -l)", timer.elapsed_ms(), operations);
+
+	timer.restart();
+
+	for (int i = 0; i < iterations; ++i)
+	{
+		files.clear();
+		checksum += mlsx_parser().parse_lines(machine_list, files);
+	}
+
+	report("mlsx_parser (MLSD)", timer.elapsed_ms(), operations);
+
+	return checksum ? EXIT_SUCCESS : EXIT_FAILURE;
+}
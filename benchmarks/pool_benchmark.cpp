@@ -0,0 +1,212 @@
+// A queue of small downloads from one site over a few slots, against an
+// ftp_stand_in with a simulated round trip time: once with a new session
+// (connect and log in) for every file, and once leasing sessions from a
+// session_controller pool that keeps the slots logged in.
+//
+// Usage: pool_benchmark [files] [slots] [round trip ms]
+
+#include <cstdlib>
+#include <iostream>
+#include <set>
+#include <string>
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+#include "benchmark.hpp"
+#include "ftp_stand_in.hpp"
+#include "model/session_controller.hpp"
+
+using namespace std;
+using foofxp::model::session_controller;
+using foofxp::model::ftp::bookmark;
+using foofxp::model::ftp::client;
+
+typedef session_controller::client_ptr client_ptr;
+
+// Downloads files one per slot at a time, either over sessions opened (and
+// closed) per file, or over sessions leased from a pool.
+class queue_driver
+{
+public:
+
+	queue_driver(session_controller & controller, const bookmark & site,
+		unsigned long files, unsigned long slots, bool pooled) :
+		controller_(controller),
+		site_(site),
+		pooled_(pooled),
+		slots_(slots),
+		queued_(files),
+		remaining_(files),
+		watched_(),
+		timer_(),
+		elapsed_ms(0)
+	{};
+
+	double elapsed_ms;
+
+	void begin()
+	{
+		if (pooled_)
+		{
+			controller_.state_changed.connect(
+				boost::bind(&queue_driver::handle_state_changed, this));
+			controller_.keep_warm(site_, slots_);
+			return;
+		}
+
+		for (unsigned long i = 0; i < slots_; i++)
+			open_session();
+	};
+
+private:
+
+	void open_session()
+	{
+		client_ptr session = controller_.open_session(site_);
+		watch(session);
+		controller_.begin_connect(session);
+	};
+
+	void watch(const client_ptr & session)
+	{
+		session->transfer_completed.connect(boost::bind(
+			&queue_driver::handle_transferred, this, session));
+		session->transfer_failed.connect(
+			boost::bind(&queue_driver::handle_error, this, _2));
+		session->fatal_error_occurred.connect(
+			boost::bind(&queue_driver::handle_error, this, _2));
+
+		if (!pooled_)
+			session->received_directory_list.connect(boost::bind(
+				&queue_driver::handle_logged_in, this, session));
+	};
+
+	// Per-file sessions: download as soon as the login is done.
+	void handle_logged_in(client_ptr session)
+	{
+		if (take_file())
+			session->begin_download("a.file", "/dev/null");
+	};
+
+	// Pooled sessions: lease whatever is free.
+	void handle_state_changed()
+	{
+		for (;;)
+		{
+			if (!take_file())
+				return;
+
+			client_ptr session = controller_.lease_session(site_);
+			if (!session)
+			{
+				boost::mutex::scoped_lock lock(mutex_);
+				queued_++;
+				return;
+			}
+
+			bool watched;
+			{
+				boost::mutex::scoped_lock lock(mutex_);
+				watched = !watched_.insert(session.get()).second;
+			}
+
+			if (!watched)
+				watch(session);
+
+			session->strand().post(boost::bind(&client::begin_download,
+				session.get(), string("a.file"), string("/dev/null")));
+		}
+	};
+
+	bool take_file()
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		if (queued_ == 0)
+			return false;
+
+		queued_--;
+		return true;
+	};
+
+	void handle_transferred(client_ptr session)
+	{
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+
+			if (--remaining_ == 0)
+			{
+				elapsed_ms = timer_.elapsed_ms();
+				controller_.stop();
+				return;
+			}
+		}
+
+		if (pooled_)
+			controller_.release_session(session);
+		else
+		{
+			controller_.close_session(session);
+
+			boost::mutex::scoped_lock lock(mutex_);
+			if (queued_ != 0)
+			{
+				lock.unlock();
+				open_session();
+			}
+		}
+	};
+
+	void handle_error(const string & message)
+	{
+		cerr << "error: " << message << endl;
+		controller_.stop();
+	};
+
+	session_controller & controller_;
+	bookmark site_;
+	bool pooled_;
+	unsigned long slots_;
+	boost::mutex mutex_;
+	unsigned long queued_;
+	unsigned long remaining_;
+	set<const client *> watched_;
+	stopwatch timer_;
+};
+
+static void run(const string & name, unsigned long files,
+	unsigned long slots, unsigned long latency_ms, bool pooled)
+{
+	// One thread, so the stand-in can share it.
+	session_controller controller(1);
+	ftp_stand_in server(controller.io_service(), 1024, latency_ms);
+
+	bookmark site;
+	site.host("127.0.0.1");
+	site.port(server.port());
+	site.auth_tls(false);
+	site.username("bench");
+	site.password("bench");
+
+	queue_driver driver(controller, site, files, slots, pooled);
+	driver.begin();
+	controller.join();
+
+	report(name, driver.elapsed_ms);
+	cout << "  " << driver.elapsed_ms * slots / files << " ms per file per slot"
+		<< endl;
+}
+
+int main(int argc, char * argv[])
+{
+	unsigned long files = argc > 1 ? strtoul(argv[1], 0, 10) : 100;
+	unsigned long slots = argc > 2 ? strtoul(argv[2], 0, 10) : 4;
+	unsigned long latency_ms = argc > 3 ? strtoul(argv[3], 0, 10) : 20;
+
+	cout << files << " files, " << slots << " slots, " << latency_ms
+		<< " ms round trip" << endl;
+
+	run("session per file", files, slots, latency_ms, false);
+	run("pooled sessions", files, slots, latency_ms, true);
+
+	return EXIT_SUCCESS;
+}
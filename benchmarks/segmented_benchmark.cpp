@@ -0,0 +1,182 @@
+// One large download from an ftp_stand_in that limits each data connection's
+// rate, the way many sites do. Compares a single connection with
+// segmented_download over several, and with one of those connections much
+// slower than the rest, with and without slow ranges being split.
+//
+// Usage: segmented_benchmark [megabytes] [KB/s per connection] [connections]
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include "benchmark.hpp"
+#include "ftp_stand_in.hpp"
+#include "model/ftp/client.hpp"
+#include "model/segmented_download.hpp"
+
+// For stat() and unlink().
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace boost::asio;
+using foofxp::model::segmented_download;
+using foofxp::model::ftp::client;
+
+static const char * local_path = "/tmp/foofxp-segmented-benchmark";
+
+// Starts the download once every session has logged in, and stops the
+// io_service when it's done.
+class segmented_driver
+{
+public:
+
+	segmented_driver(io_service & io_service,
+		const vector<client *> & clients, segmented_download * job) :
+		elapsed_ms(0),
+		io_service_(io_service),
+		clients_(clients.size()),
+		job_(job),
+		logged_in_(0)
+	{
+		for (size_t i = 0; i < clients.size(); i++)
+		{
+			clients[i]->received_directory_list.connect(
+				boost::bind(&segmented_driver::handle_logged_in, this, _1));
+			clients[i]->fatal_error_occurred.connect(
+				boost::bind(&segmented_driver::handle_error, this, _2));
+		}
+
+		if (!job)
+		{
+			clients[0]->transfer_completed.connect(
+				boost::bind(&segmented_driver::handle_completed, this));
+			clients[0]->transfer_failed.connect(
+				boost::bind(&segmented_driver::handle_error, this, _2));
+		}
+		else
+		{
+			job->segment_completed.connect(
+				boost::bind(&segmented_driver::handle_segment, this, _2));
+			job->completed.connect(
+				boost::bind(&segmented_driver::handle_completed, this));
+			job->failed.connect(
+				boost::bind(&segmented_driver::handle_error, this, _2));
+		}
+	};
+
+	double elapsed_ms;
+
+private:
+
+	void handle_logged_in(client & sender)
+	{
+		if (++logged_in_ < clients_)
+			return;
+
+		timer_.restart();
+
+		if (job_)
+			job_->begin();
+		else
+			sender.begin_download("big.file", local_path);
+	};
+
+	void handle_segment(const segmented_download::segment_report & segment)
+	{
+		cout << "    client " << segment.client << ": "
+			<< segment.length / 1024 << " KB from " << segment.offset / 1024
+			<< " KB at " << static_cast<unsigned long>(
+				segment.bytes_per_second() / 1024) << " KB/s" << endl;
+	};
+
+	void handle_completed()
+	{
+		elapsed_ms = timer_.elapsed_ms();
+		io_service_.stop();
+	};
+
+	void handle_error(const string & message)
+	{
+		cerr << "error: " << message << endl;
+		io_service_.stop();
+	};
+
+	io_service & io_service_;
+	size_t clients_;
+	segmented_download * job_;
+	size_t logged_in_;
+	stopwatch timer_;
+};
+
+static void run(const string & name, unsigned long megabytes,
+	unsigned long rate, size_t connections, bool slow, bool split)
+{
+	boost::uint64_t size = static_cast<boost::uint64_t>(megabytes) << 20;
+
+	io_service io_service;
+	ssl::context context(io_service, ssl::context::tlsv1_client);
+	ftp_stand_in server(io_service, size);
+	server.rate_limit(rate * 1024);
+	if (slow)
+		server.rate_limit(1, rate * 1024 / 8);
+
+	vector<boost::shared_ptr<client> > sessions;
+	vector<client *> clients;
+	for (size_t i = 0; i < connections; i++)
+	{
+		sessions.push_back(boost::shared_ptr<client>(new client("127.0.0.1",
+			server.port(), false, false, "bench", "bench", io_service,
+			context)));
+		clients.push_back(sessions.back().get());
+	}
+
+	boost::shared_ptr<segmented_download> job;
+	if (connections > 1)
+	{
+		job.reset(new segmented_download(clients, "big.file", local_path,
+			size));
+		job->split_segments(split);
+	}
+
+	cout << name << endl;
+
+	segmented_driver driver(io_service, clients, job.get());
+
+	// In order, so the stand-in numbers the sessions the same way.
+	for (size_t i = 0; i < connections; i++)
+		clients[i]->begin_connect();
+
+	io_service.run();
+
+	report("  total", driver.elapsed_ms);
+
+	struct stat status;
+	if (::stat(local_path, &status) != 0 ||
+		static_cast<boost::uint64_t>(status.st_size) != size)
+		cerr << "  expected " << size << " bytes in " << local_path << endl;
+
+	::unlink(local_path);
+}
+
+int main(int argc, char * argv[])
+{
+	unsigned long megabytes = argc > 1 ? strtoul(argv[1], 0, 10) : 16;
+	unsigned long rate = argc > 2 ? strtoul(argv[2], 0, 10) : 4096;
+	size_t connections = argc > 3 ? strtoul(argv[3], 0, 10) : 4;
+
+	cout << megabytes << " MB at " << rate << " KB/s per connection" << endl;
+
+	run("single connection", megabytes, rate, 1, false, true);
+	run("segmented", megabytes, rate, connections, false, true);
+	run("segmented, one slow connection, no splitting", megabytes, rate,
+		connections, true, false);
+	run("segmented, one slow connection", megabytes, rate, connections, true,
+		true);
+
+	return EXIT_SUCCESS;
+}
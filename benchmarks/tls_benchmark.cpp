@@ -0,0 +1,168 @@
+// Cost of a full TLS handshake against one that resumes a cached session,
+// making the same tls_session_cache calls as control_stream, against a
+// loopback server that greets each connection with a reply line (TLS 1.3
+// servers send the session to resume after the handshake, so the client has
+// to read something before it can save it).
+//
+// Usage: tls_benchmark cert.pem key.pem [connections]
+//
+// Any certificate will do, e.g.
+//
+//    openssl req -x509 -newkey rsa:2048 -nodes -subj /CN=localhost \
+//        -keyout key.pem -out cert.pem
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include "benchmark.hpp"
+#include "model/ftp/tls_session_cache.hpp"
+#include "utility/asio.hpp"
+
+using namespace std;
+using namespace boost::asio;
+using namespace boost::asio::ip;
+using foofxp::model::ftp::tls_session_cache;
+using foofxp::native_ssl;
+
+typedef ssl::stream<tcp::socket> ssl_socket;
+
+// Handshakes with and greets whoever connects, on its own thread.
+class greeter
+{
+public:
+
+	greeter(const string & certificate, const string & key) :
+		io_service_(),
+		context_(io_service_, ssl::context::tlsv1_server),
+		acceptor_(io_service_, tcp::endpoint(address_v4::loopback(), 0)),
+		greeting_("220 Hello.\r\n")
+	{
+		context_.use_certificate_chain_file(certificate);
+		context_.use_private_key_file(key, ssl::context::pem);
+		begin_accept();
+		thread_.reset(new boost::thread(
+			boost::bind(&io_service::run, &io_service_)));
+	};
+
+	~greeter()
+	{
+		io_service_.stop();
+		thread_->join();
+	};
+
+	tcp::endpoint endpoint() const { return acceptor_.local_endpoint(); };
+
+private:
+
+	void begin_accept()
+	{
+		boost::shared_ptr<ssl_socket> next(
+			new ssl_socket(io_service_, context_));
+
+		acceptor_.async_accept(next->lowest_layer(),
+			boost::bind(&greeter::handle_accept, this, next,
+				placeholders::error));
+	};
+
+	void handle_accept(boost::shared_ptr<ssl_socket> next,
+		const boost::system::error_code & error)
+	{
+		if (error)
+			return;
+
+		next->next_layer().set_option(tcp::no_delay(true));
+		next->async_handshake(ssl::stream_base::server,
+			boost::bind(&greeter::handle_handshake, this, next,
+				placeholders::error));
+		begin_accept();
+	};
+
+	void handle_handshake(boost::shared_ptr<ssl_socket> next,
+		const boost::system::error_code & error)
+	{
+		if (error)
+			return;
+
+		async_write(*next, buffer(greeting_),
+			boost::bind(&greeter::handle_greeted, this, next,
+				placeholders::error));
+	};
+
+	void handle_greeted(boost::shared_ptr<ssl_socket> next,
+		const boost::system::error_code & error)
+	{
+		// Hang on to the connection until the client closes it.
+		next->next_layer().async_read_some(null_buffers(),
+			boost::bind(&greeter::handle_closed, this, next));
+	};
+
+	void handle_closed(boost::shared_ptr<ssl_socket> next) {};
+
+	io_service io_service_;
+	ssl::context context_;
+	tcp::acceptor acceptor_;
+	string greeting_;
+	boost::shared_ptr<boost::thread> thread_;
+};
+
+static void run(const string & name, const tcp::endpoint & endpoint,
+	unsigned long connections, bool resume)
+{
+	io_service io_service;
+	ssl::context context(io_service, ssl::context::tlsv1_client);
+	tls_session_cache sessions;
+	const string key = "127.0.0.1:21";
+
+	stopwatch timer;
+
+	for (unsigned long i = 0; i < connections; i++)
+	{
+		tcp::socket socket(io_service);
+		ssl::stream<tcp::socket &> stream(socket, context);
+		socket.connect(endpoint);
+		socket.set_option(tcp::no_delay(true));
+
+		if (resume)
+			sessions.resume(native_ssl(stream), key);
+
+		stream.handshake(ssl::stream_base::client);
+		sessions.handshake_completed(native_ssl(stream));
+		sessions.save(native_ssl(stream), key);
+
+		boost::asio::streambuf greeting;
+		read_until(stream, greeting, "\r\n");
+		sessions.save(native_ssl(stream), key);
+
+		tls_session_cache::close_cleanly(native_ssl(stream));
+	}
+
+	double elapsed_ms = timer.elapsed_ms();
+
+	report(name, elapsed_ms);
+	cout << "  " << elapsed_ms / connections << " ms per connection, "
+		<< sessions.hits() << " resumed, " << sessions.misses() << " full"
+		<< endl;
+}
+
+int main(int argc, char * argv[])
+{
+	if (argc < 3)
+	{
+		cerr << "Usage: tls_benchmark cert.pem key.pem [connections]" << endl;
+		return EXIT_FAILURE;
+	}
+
+	unsigned long connections = argc > 3 ? strtoul(argv[3], 0, 10) : 500;
+
+	greeter server(argv[1], argv[2]);
+
+	run("full handshakes", server.endpoint(), connections, false);
+	run("resumed handshakes", server.endpoint(), connections, true);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,145 @@
+// Passive mode transfer throughput over loopback, against ftp_stand_in:
+// downloads a file with ftp::client and uploads it again, once with zero-copy
+// data connections and once buffered.
+//
+// Usage: transfer_benchmark [megabytes]
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/bind.hpp>
+#include "benchmark.hpp"
+#include "ftp_stand_in.hpp"
+#include "model/ftp/client.hpp"
+
+#include <unistd.h>
+
+using namespace std;
+using namespace boost::asio;
+using foofxp::model::ftp::client;
+using foofxp::model::file;
+
+// Logs in, downloads to local_path, uploads it back, then stops.
+class transfer_driver
+{
+public:
+
+	transfer_driver(io_service & io_service, client & client,
+		const string & local_path, boost::uint64_t file_size) :
+		io_service_(io_service),
+		client_(client),
+		local_path_(local_path),
+		file_size_(file_size),
+		downloaded_(false)
+	{
+		client.received_directory_list.connect(
+			boost::bind(&transfer_driver::handle_logged_in, this));
+		client.transfer_completed.connect(
+			boost::bind(&transfer_driver::handle_transfer_completed, this));
+		client.transfer_failed.connect(
+			boost::bind(&transfer_driver::handle_error, this, _2));
+		client.fatal_error_occurred.connect(
+			boost::bind(&transfer_driver::handle_error, this, _2));
+	};
+
+	double download_ms;
+	double upload_ms;
+
+private:
+
+	void handle_logged_in()
+	{
+		timer_.restart();
+		client_.begin_download("big.file", local_path_);
+	};
+
+	void handle_transfer_completed()
+	{
+		if (!downloaded_)
+		{
+			download_ms = timer_.elapsed_ms();
+			downloaded_ = true;
+
+			timer_.restart();
+			client_.begin_upload(local_path_, "big.file.copy");
+		}
+		else
+		{
+			upload_ms = timer_.elapsed_ms();
+			io_service_.stop();
+		}
+	};
+
+	void handle_error(const string & message)
+	{
+		cerr << "error: " << message << endl;
+		io_service_.stop();
+	};
+
+	io_service & io_service_;
+	client & client_;
+	string local_path_;
+	boost::uint64_t file_size_;
+	bool downloaded_;
+	stopwatch timer_;
+};
+
+static void run(const string & name, bool zero_copy, boost::uint64_t file_size,
+	const string & local_path)
+{
+	io_service io_service;
+	ssl::context context(io_service, ssl::context::tlsv1_client);
+	ftp_stand_in server(io_service, file_size);
+
+	client c("127.0.0.1", server.port(), false, false, "bench", "bench",
+		io_service, context);
+	c.zero_copy_transfers(zero_copy);
+
+	transfer_driver driver(io_service, c, local_path, file_size);
+	driver.download_ms = driver.upload_ms = 0;
+
+	c.begin_connect();
+	io_service.run();
+
+	// Report per megabyte rather than per byte.
+	unsigned long megabytes = static_cast<unsigned long>(file_size >> 20);
+
+	report(name + " RETR", driver.download_ms, megabytes);
+	report(name + " STOR", driver.upload_ms, megabytes);
+
+	if (server.bytes_received() != file_size)
+		cerr << "  expected " << file_size << " bytes back, got "
+			<< server.bytes_received() << endl;
+
+	cout << "  " << (driver.download_ms > 0 ?
+		megabytes * 1000.0 / driver.download_ms : 0.0) << " MB/s down, "
+		<< (driver.upload_ms > 0 ? megabytes * 1000.0 / driver.upload_ms : 0.0)
+		<< " MB/s up" << endl;
+}
+
+int main(int argc, char * argv[])
+{
+	unsigned long megabytes = argc > 1 ? strtoul(argv[1], 0, 10) : 256;
+	boost::uint64_t file_size = static_cast<boost::uint64_t>(megabytes) << 20;
+
+	char local_path[] = "/tmp/foofxp-transfer-benchmark-XXXXXX";
+	int fd = mkstemp(local_path);
+	if (fd == -1)
+	{
+		perror("mkstemp");
+		return EXIT_FAILURE;
+	}
+	close(fd);
+
+	cout << megabytes << " MB file (times are per MB)" << endl;
+
+	run("zero-copy", true, file_size, local_path);
+	run("buffered", false, file_size, local_path);
+
+	unlink(local_path);
+
+	return EXIT_SUCCESS;
+}
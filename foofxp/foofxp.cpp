@@ -1,9 +1,9 @@
+#include <algorithm>
 #include <iostream>
 #include <vector>
-#include <boost/asio.hpp>
-#include <boost/asio/ssl.hpp>
-#include <boost/shared_ptr.hpp>
+#include "model/ftp/bookmark.hpp"
 #include "model/ftp/client.hpp"
+#include "model/session_controller.hpp"
 #include "curses/curses.hpp"
 #include "utility/trace.hpp"
 #include "model/file.hpp"
@@ -16,7 +16,17 @@ using foofxp::model::file;
 
 void print_line(const logger & log)
 {
-	cout << "Session: " << log.last_line() << endl;
+	static unsigned long printed = 0;
+	
+	// Updates are coalesced, so print everything added since last time, oldest
+	// first.
+	logger::size_type fresh = min<unsigned long>(log.lines_added() - printed,
+		log.size());
+	
+	while (fresh > 0)
+		cout << "Session: " << log[--fresh] << endl;
+	
+	printed = log.lines_added();
 }
 
 void print_error(const client & client, const string & msg)
@@ -67,24 +77,24 @@ int main()
 	//curses::terminal::enter_fullscreen_mode();
 	//curses::terminal::exit_fullscreen_mode();
 	
-	boost::asio::io_service io_service;
-	boost::asio::io_service::work work(io_service);
-	boost::asio::ssl::context ctx(io_service, boost::asio::ssl::context::tlsv1_client);
+	session_controller controller(2);
 	
-	client c("192.168.0.7", 666, false, false, "test", "test", io_service, ctx);
+	bookmark site;
+	site.host("192.168.0.7");
+	site.port(666);
+	site.auth_tls(false);
+	site.username("test");
+	site.password("test");
 	
-	c.log().updated.connect(&print_line);
-	c.error_occurred.connect(&print_error);
-	c.fatal_error_occurred.connect(&print_fatal_error);
-	c.received_directory_list.connect(&print_directory_list);
+	session_controller::client_ptr c = controller.open_session(site);
 	
-	c.begin_connect();
-
-#if 0
-	for (;;)
-		io_service.poll();
-#endif
-	io_service.run();
+	c->log().updated.connect(&print_line);
+	c->error_occurred.connect(&print_error);
+	c->fatal_error_occurred.connect(&print_fatal_error);
+	c->received_directory_list.connect(&print_directory_list);
+	
+	controller.begin_connect(c);
+	controller.join();
 	
 	trace("exiting application.");
 	
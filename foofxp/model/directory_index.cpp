@@ -0,0 +1,872 @@
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include "directory_index.hpp"
+#include "../utility/format.hpp"
+#include "../utility/trace.hpp"
+
+// These are for open(), fstat(), mmap(), write(), fdatasync() and rename().
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace boost::posix_time;
+using namespace foofxp::utility;
+
+namespace foofxp {
+namespace model {
+
+static const char magic[8] = { 'F', 'X', 'P', 'I', 'N', 'D', 'E', 'X' };
+static const boost::uint32_t version = 1;
+
+static const ptime epoch(boost::gregorian::date(1970, 1, 1));
+
+static string lower_case(const string & text)
+{
+	string result(text);
+	for (string::iterator c = result.begin(); c != result.end(); ++c)
+		*c = static_cast<char>(::tolower(static_cast<unsigned char>(*c)));
+
+	return result;
+}
+
+static void write_all(int fd, const void * data, size_t length,
+	const string & path) throw (runtime_error)
+{
+	const char * next = static_cast<const char *>(data);
+
+	while (length != 0)
+	{
+		ssize_t result = ::write(fd, next, length);
+
+		if (result < 0 && errno == EINTR)
+			continue;
+
+		if (result < 0)
+			throw runtime_error(format(256, "Could not write %s: %s",
+				path.c_str(), strerror(errno)));
+
+		next += result;
+		length -= result;
+	}
+}
+
+// The first occurrence of text in [begin, end), or 0.
+static const char * find_text(const char * begin, const char * end,
+	const string & text)
+{
+	size_t length = text.length();
+
+	while (static_cast<size_t>(end - begin) >= length)
+	{
+		const char * first = static_cast<const char *>(
+			memchr(begin, text[0], end - begin - length + 1));
+		if (!first)
+			return 0;
+
+		if (memcmp(first, text.data(), length) == 0)
+			return first;
+
+		begin = first + 1;
+	}
+
+	return 0;
+}
+
+namespace {
+
+// Orders records by the string their key points at, for binary searches by
+// name.
+struct key_less
+{
+	explicit key_less(const char * strings) : strings(strings) {};
+
+	template <typename Record>
+	bool operator()(const Record & record, const string & key) const
+	{
+		return strcmp(strings + record.key, key.c_str()) < 0;
+	}
+
+	template <typename Record>
+	bool operator()(const string & key, const Record & record) const
+	{
+		return strcmp(key.c_str(), strings + record.key) < 0;
+	}
+
+	const char * strings;
+};
+
+// Orders records by where their key is, which comes to the same thing.
+struct offset_less
+{
+	template <typename Record>
+	bool operator()(const Record & record, boost::uint64_t offset) const
+	{
+		return record.key < offset;
+	}
+
+	template <typename Record>
+	bool operator()(boost::uint64_t offset, const Record & record) const
+	{
+		return offset < record.key;
+	}
+};
+
+// Name tests for the listings held in memory, on lower-cased names.
+
+struct name_equals
+{
+	explicit name_equals(const string & name) : name(name) {};
+
+	bool operator()(const string & lower) const { return lower == name; };
+
+	const string & name;
+};
+
+struct name_starts
+{
+	explicit name_starts(const string & prefix) : prefix(prefix) {};
+
+	bool operator()(const string & lower) const
+	{
+		return lower.compare(0, prefix.length(), prefix) == 0;
+	};
+
+	const string & prefix;
+};
+
+struct name_contains
+{
+	explicit name_contains(const string & text) : text(text) {};
+
+	bool operator()(const string & lower) const
+	{
+		return lower.find(text) != string::npos;
+	};
+
+	const string & text;
+};
+
+// An entry on its way into a new snapshot, pointing at its strings wherever
+// they are now.
+struct pending_entry
+{
+	const char * key;
+	const char * name;
+	boost::uint64_t size;
+	boost::int64_t time;
+	boost::uint32_t directory;
+	boost::uint8_t flags;
+};
+
+struct pending_less
+{
+	bool operator()(const pending_entry & a, const pending_entry & b) const
+	{
+		int order = strcmp(a.key, b.key);
+		if (order != 0)
+			return order < 0;
+
+		return a.directory < b.directory;
+	};
+};
+
+struct pending_directory
+{
+	const char * site;
+	const char * path;
+
+	// Index in the old snapshot, or -1 if it was listed since.
+	long snapshot;
+	const vector<file> * listed;
+};
+
+struct directory_less
+{
+	bool operator()(const pending_directory & a,
+		const pending_directory & b) const
+	{
+		int order = strcmp(a.site, b.site);
+		if (order != 0)
+			return order < 0;
+
+		return strcmp(a.path, b.path) < 0;
+	};
+};
+
+} // namespace
+
+directory_index::directory_index() :
+	mutex_(),
+	mapping_(0),
+	mapping_length_(0),
+	header_(0),
+	directories_(0),
+	entries_(0),
+	strings_(0),
+	hidden_(),
+	hidden_directories_(0),
+	hidden_entries_(0),
+	listed_(),
+	listed_entries_(0)
+{}
+
+directory_index::~directory_index()
+{
+	unmap();
+}
+
+void directory_index::open(const string & path) throw (runtime_error)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+
+	unmap();
+	listed_.clear();
+	listed_entries_ = 0;
+
+	map(path);
+}
+
+void directory_index::save(const string & path) throw (runtime_error)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+
+	// Directories, old and new, in order.
+	size_t old_count = header_ ? header_->directory_count : 0;
+	size_t old_entries = header_ ? header_->entry_count : 0;
+
+	vector<pending_directory> directories;
+	directories.reserve(old_count - hidden_directories_ + listed_.size());
+
+	for (size_t i = 0; i < old_count; ++i)
+	{
+		if (hidden_[i])
+			continue;
+
+		pending_directory directory = { string_at(directories_[i].site),
+			string_at(directories_[i].path), static_cast<long>(i), 0 };
+		directories.push_back(directory);
+	}
+
+	for (listing_map::const_iterator listing = listed_.begin();
+		listing != listed_.end(); ++listing)
+	{
+		pending_directory directory = { listing->first.first.c_str(),
+			listing->first.second.c_str(), -1, &listing->second };
+		directories.push_back(directory);
+	}
+
+	sort(directories.begin(), directories.end(), directory_less());
+
+	// Then their entries, by name.
+	vector<boost::uint32_t> renumbered(old_count, 0);
+	vector<pending_entry> entries;
+	entries.reserve(static_cast<size_t>(old_entries - hidden_entries_) +
+		listed_entries_);
+	deque<string> keys;
+
+	for (size_t i = 0; i < directories.size(); ++i)
+	{
+		const pending_directory & directory = directories[i];
+
+		if (directory.snapshot >= 0)
+		{
+			renumbered[directory.snapshot] = static_cast<boost::uint32_t>(i);
+			continue;
+		}
+
+		for (vector<file>::const_iterator f = directory.listed->begin();
+			f != directory.listed->end(); ++f)
+		{
+			keys.push_back(lower_case(f->name()));
+
+			pending_entry entry = { keys.back().c_str(), f->name().c_str(),
+				f->size(), 0, static_cast<boost::uint32_t>(i),
+				static_cast<boost::uint8_t>(f->type() &
+				directory_table::type_mask) };
+
+			if (!f->time().is_special())
+			{
+				entry.time = (f->time() - epoch).total_microseconds();
+				entry.flags |= directory_table::has_time;
+			}
+
+			entries.push_back(entry);
+		}
+	}
+
+	for (size_t i = 0; i < old_entries; ++i)
+	{
+		const entry_record & record = entries_[i];
+		if (hidden_[record.directory])
+			continue;
+
+		pending_entry entry = { string_at(record.key), string_at(record.name),
+			record.size, record.time, renumbered[record.directory],
+			record.flags };
+		entries.push_back(entry);
+	}
+
+	sort(entries.begin(), entries.end(), pending_less());
+
+	// The strings: each key once, in order, then the names that differ from
+	// their keys, then sites and paths.
+	string strings;
+	vector<entry_record> entry_records(entries.size());
+	vector<directory_record> directory_records(directories.size());
+
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		if (i == 0 || strcmp(entries[i].key, entries[i - 1].key) != 0)
+		{
+			entry_records[i].key = strings.length();
+			strings.append(entries[i].key, strlen(entries[i].key) + 1);
+		}
+		else
+			entry_records[i].key = entry_records[i - 1].key;
+	}
+
+	boost::uint64_t keys_length = strings.length();
+
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		entry_record & record = entry_records[i];
+		const pending_entry & entry = entries[i];
+
+		if (strcmp(entry.name, entry.key) == 0)
+			record.name = record.key;
+		else
+		{
+			record.name = strings.length();
+			strings.append(entry.name, strlen(entry.name) + 1);
+		}
+
+		record.size = entry.size;
+		record.time = entry.time;
+		record.directory = entry.directory;
+		record.flags = entry.flags;
+		memset(record.padding, 0, sizeof(record.padding));
+
+		directory_records[entry.directory].entries++;
+	}
+
+	std::map<string, boost::uint64_t> sites;
+
+	for (size_t i = 0; i < directories.size(); ++i)
+	{
+		std::map<string, boost::uint64_t>::iterator site =
+			sites.find(directories[i].site);
+
+		if (site == sites.end())
+		{
+			site = sites.insert(make_pair(string(directories[i].site),
+				static_cast<boost::uint64_t>(strings.length()))).first;
+			strings.append(directories[i].site,
+				strlen(directories[i].site) + 1);
+		}
+
+		directory_records[i].site = site->second;
+		directory_records[i].path = strings.length();
+		strings.append(directories[i].path, strlen(directories[i].path) + 1);
+	}
+
+	header new_header;
+	memset(&new_header, 0, sizeof(new_header));
+	memcpy(new_header.magic, magic, sizeof(magic));
+	new_header.version = version;
+	new_header.directory_count =
+		static_cast<boost::uint32_t>(directory_records.size());
+	new_header.entry_count = entry_records.size();
+	new_header.keys_offset = 0;
+	new_header.keys_length = keys_length;
+	new_header.strings_length = strings.length();
+
+	// Written to one side and renamed over the old file, so a crash leaves
+	// one or the other, never a mixture.
+	string temporary = path + ".new";
+	int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1)
+		throw runtime_error(format(256, "Could not create %s: %s",
+			temporary.c_str(), strerror(errno)));
+
+	try
+	{
+		write_all(fd, &new_header, sizeof(new_header), temporary);
+
+		if (!directory_records.empty())
+			write_all(fd, &directory_records[0],
+				directory_records.size() * sizeof(directory_record),
+				temporary);
+
+		if (!entry_records.empty())
+			write_all(fd, &entry_records[0],
+				entry_records.size() * sizeof(entry_record), temporary);
+
+		write_all(fd, strings.data(), strings.length(), temporary);
+	}
+	catch (const runtime_error &)
+	{
+		::close(fd);
+		throw;
+	}
+
+	if (::fdatasync(fd) != 0 || ::rename(temporary.c_str(), path.c_str()) != 0)
+	{
+		string message = format(256, "Could not replace %s: %s",
+			path.c_str(), strerror(errno));
+		::close(fd);
+		throw runtime_error(message);
+	}
+
+	::close(fd);
+
+	trace_this_at(info, general, ("directory_index saved %lu entries in %lu "
+		"directories to %s", static_cast<unsigned long>(entries.size()),
+		static_cast<unsigned long>(directories.size()), path.c_str()));
+
+	// Everything listed is in the new snapshot now.
+	entries.clear();
+	directories.clear();
+	keys.clear();
+
+	unmap();
+	listed_.clear();
+	listed_entries_ = 0;
+
+	map(path);
+}
+
+void directory_index::update(const string & site, const string & path,
+	const vector<file> & files)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+
+	directory_key key(site, path);
+	vector<file> & listing = listed_[key];
+
+	listed_entries_ -= listing.size();
+	listing.clear();
+	listing.reserve(files.size());
+
+	for (vector<file>::const_iterator f = files.begin(); f != files.end(); ++f)
+		if (f->name() != "." && f->name() != "..")
+			listing.push_back(*f);
+
+	listed_entries_ += listing.size();
+
+	hide(key);
+}
+
+void directory_index::update(const string & site, const string & path,
+	const directory_table & files)
+{
+	vector<file> listing;
+	listing.reserve(files.size());
+
+	for (directory_table::index_type row = 0; row < files.size(); ++row)
+		listing.push_back(files.at(row));
+
+	update(site, path, listing);
+}
+
+void directory_index::remove(const string & site, const string & path)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+
+	directory_key key(site, path);
+	listing_map::iterator listing = listed_.find(key);
+
+	if (listing != listed_.end())
+	{
+		listed_entries_ -= listing->second.size();
+		listed_.erase(listing);
+	}
+
+	hide(key);
+}
+
+size_t directory_index::find(const string & name, vector<match> & results,
+	size_t limit) const
+{
+	string key = lower_case(name);
+	size_t found = 0;
+
+	boost::mutex::scoped_lock lock(mutex_);
+
+	if (header_)
+	{
+		pair<const entry_record *, const entry_record *> range =
+			equal_range(entries_, entries_ + header_->entry_count, key,
+			key_less(strings_));
+
+		found += collect(range.first - entries_, range.second - entries_,
+			results, limit);
+	}
+
+	if (!limit || found < limit)
+		found += collect_listed(name_equals(key), results,
+			limit ? limit - found : 0);
+
+	return found;
+}
+
+size_t directory_index::find_prefix(const string & prefix,
+	vector<match> & results, size_t limit) const
+{
+	string key = lower_case(prefix);
+	size_t found = 0;
+
+	boost::mutex::scoped_lock lock(mutex_);
+
+	if (header_)
+	{
+		const entry_record * end = entries_ + header_->entry_count;
+		const entry_record * first = lower_bound(entries_, end, key,
+			key_less(strings_));
+		const entry_record * last = first;
+
+		// The keys that start with it all come together.
+		while (last != end && strncmp(string_at(last->key), key.c_str(),
+			key.length()) == 0 && (!limit || found < limit))
+		{
+			const entry_record * next = last + 1;
+			while (next != end && next->key == last->key)
+				++next;
+
+			found += collect(last - entries_, next - entries_, results,
+				limit ? limit - found : 0);
+			last = next;
+		}
+	}
+
+	if (!limit || found < limit)
+		found += collect_listed(name_starts(key), results,
+			limit ? limit - found : 0);
+
+	return found;
+}
+
+size_t directory_index::search(const string & text, vector<match> & results,
+	size_t limit) const
+{
+	if (text.empty())
+		return find_prefix(text, results, limit);
+
+	string key = lower_case(text);
+	size_t found = 0;
+
+	boost::mutex::scoped_lock lock(mutex_);
+
+	if (header_)
+	{
+		const char * keys = strings_ + header_->keys_offset;
+		const char * end = keys + header_->keys_length;
+		const char * next = keys;
+
+		while (!limit || found < limit)
+		{
+			const char * hit = find_text(next, end, key);
+			if (!hit)
+				break;
+
+			// Back to the start of the key it's in.
+			const char * start = hit;
+			while (start != keys && start[-1] != '\0')
+				--start;
+
+			pair<const entry_record *, const entry_record *> range =
+				equal_range(entries_, entries_ + header_->entry_count,
+				static_cast<boost::uint64_t>(start - strings_),
+				offset_less());
+
+			found += collect(range.first - entries_, range.second - entries_,
+				results, limit ? limit - found : 0);
+
+			next = start + strlen(start) + 1;
+		}
+	}
+
+	if (!limit || found < limit)
+		found += collect_listed(name_contains(key), results,
+			limit ? limit - found : 0);
+
+	return found;
+}
+
+size_t directory_index::size() const
+{
+	boost::mutex::scoped_lock lock(mutex_);
+
+	boost::uint64_t snapshot = header_ ? header_->entry_count : 0;
+	return static_cast<size_t>(snapshot - hidden_entries_) + listed_entries_;
+}
+
+size_t directory_index::directories() const
+{
+	boost::mutex::scoped_lock lock(mutex_);
+
+	size_t snapshot = header_ ? header_->directory_count : 0;
+	return snapshot - hidden_directories_ + listed_.size();
+}
+
+boost::signals::connection directory_index::watch(ftp::client & session,
+	const string & site)
+{
+	return session.received_directory_list.connect(boost::bind(
+		&directory_index::handle_listing, this, _1, site, _2));
+}
+
+boost::signals::connection directory_index::watch(tree_crawler & crawler)
+{
+	return crawler.directory_listed.connect(boost::bind(
+		&directory_index::handle_directory_listed, this, _2, _3));
+}
+
+size_t directory_index::collect(size_t first, size_t last,
+	vector<match> & results, size_t limit) const
+{
+	size_t found = 0;
+
+	for (size_t i = first; i != last && (!limit || found < limit); ++i)
+	{
+		const entry_record & record = entries_[i];
+		if (hidden_[record.directory])
+			continue;
+
+		const directory_record & directory = directories_[record.directory];
+
+		results.push_back(match());
+		match & result = results.back();
+		result.site = string_at(directory.site);
+		result.path = string_at(directory.path);
+		result.entry.name(string_at(record.name));
+		result.entry.type(static_cast<file::file_type>(record.flags &
+			directory_table::type_mask));
+		result.entry.size(record.size);
+
+		if (record.flags & directory_table::has_time)
+			result.entry.time(epoch + microseconds(record.time));
+
+		found++;
+	}
+
+	return found;
+}
+
+template <typename Predicate>
+size_t directory_index::collect_listed(Predicate matches,
+	vector<match> & results, size_t limit) const
+{
+	size_t found = 0;
+
+	for (listing_map::const_iterator listing = listed_.begin();
+		listing != listed_.end(); ++listing)
+		for (vector<file>::const_iterator f = listing->second.begin();
+			f != listing->second.end(); ++f)
+		{
+			if (limit && found == limit)
+				return found;
+
+			if (!matches(lower_case(f->name())))
+				continue;
+
+			results.push_back(match());
+			results.back().site = listing->first.first;
+			results.back().path = listing->first.second;
+			results.back().entry = *f;
+			found++;
+		}
+
+	return found;
+}
+
+size_t directory_index::find_directory(const directory_key & key) const
+{
+	size_t count = header_ ? header_->directory_count : 0;
+	size_t low = 0;
+	size_t high = count;
+
+	while (low < high)
+	{
+		size_t middle = low + (high - low) / 2;
+		const directory_record & directory = directories_[middle];
+
+		int order = strcmp(string_at(directory.site), key.first.c_str());
+		if (order == 0)
+			order = strcmp(string_at(directory.path), key.second.c_str());
+
+		if (order == 0)
+			return middle;
+
+		if (order < 0)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	return count;
+}
+
+void directory_index::hide(const directory_key & key)
+{
+	size_t found = find_directory(key);
+
+	if (found == hidden_.size() || hidden_[found])
+		return;
+
+	hidden_[found] = true;
+	hidden_directories_++;
+	hidden_entries_ += directories_[found].entries;
+}
+
+void directory_index::map(const string & path) throw (runtime_error)
+{
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd == -1)
+	{
+		if (errno == ENOENT)
+			// Nothing saved yet.
+			return;
+
+		throw runtime_error(format(256, "Could not open %s: %s",
+			path.c_str(), strerror(errno)));
+	}
+
+	struct stat status;
+	if (::fstat(fd, &status) != 0)
+	{
+		string message = format(256, "Could not open %s: %s", path.c_str(),
+			strerror(errno));
+		::close(fd);
+		throw runtime_error(message);
+	}
+
+	size_t length = static_cast<size_t>(status.st_size);
+	if (length < sizeof(header))
+	{
+		::close(fd);
+		throw runtime_error(format(256, "%s is not a directory index",
+			path.c_str()));
+	}
+
+	void * mapping = ::mmap(0, length, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+
+	if (mapping == MAP_FAILED)
+		throw runtime_error(format(256, "Could not map %s: %s", path.c_str(),
+			strerror(errno)));
+
+	// Check everything points where it should before believing any of it:
+	// a few milliseconds for millions of entries, once.
+	const char * base = static_cast<const char *>(mapping);
+	const header * found = reinterpret_cast<const header *>(base);
+	size_t space = length - sizeof(header);
+
+	bool valid = memcmp(found->magic, magic, sizeof(magic)) == 0 &&
+		found->version == version &&
+		found->directory_count <= space / sizeof(directory_record);
+
+	if (valid)
+	{
+		space -= found->directory_count * sizeof(directory_record);
+		valid = found->entry_count <= space / sizeof(entry_record);
+	}
+
+	if (valid)
+	{
+		space -= static_cast<size_t>(found->entry_count) *
+			sizeof(entry_record);
+		valid = found->strings_length == space &&
+			found->keys_offset <= found->strings_length &&
+			found->keys_length <= found->strings_length - found->keys_offset &&
+			(space == 0 ? found->entry_count == 0 &&
+			found->directory_count == 0 : base[length - 1] == '\0');
+	}
+
+	const directory_record * directories =
+		reinterpret_cast<const directory_record *>(base + sizeof(header));
+	const entry_record * entries = reinterpret_cast<const entry_record *>(
+		directories + (valid ? found->directory_count : 0));
+
+	boost::uint64_t strings_length = found->strings_length;
+	boost::uint64_t listed = 0;
+
+	for (size_t i = 0; valid && i < found->directory_count; ++i)
+	{
+		valid = directories[i].site < strings_length &&
+			directories[i].path < strings_length;
+		listed += directories[i].entries;
+	}
+
+	valid = valid && listed == found->entry_count;
+
+	boost::uint64_t keys_end = found->keys_offset + found->keys_length;
+	boost::uint64_t last_key = found->keys_offset;
+
+	for (size_t i = 0; valid && i < found->entry_count; ++i)
+	{
+		valid = entries[i].key >= last_key && entries[i].key < keys_end &&
+			entries[i].name < strings_length &&
+			entries[i].directory < found->directory_count;
+		last_key = entries[i].key;
+	}
+
+	if (!valid)
+	{
+		::munmap(mapping, length);
+		throw runtime_error(format(256, "%s is not a directory index",
+			path.c_str()));
+	}
+
+	mapping_ = mapping;
+	mapping_length_ = length;
+	header_ = found;
+	directories_ = directories;
+	entries_ = entries;
+	strings_ = reinterpret_cast<const char *>(entries + found->entry_count);
+	hidden_.assign(found->directory_count, false);
+
+	trace_this_at(info, general, ("directory_index mapped %lu entries in %lu "
+		"directories from %s", static_cast<unsigned long>(found->entry_count),
+		static_cast<unsigned long>(found->directory_count), path.c_str()));
+}
+
+void directory_index::unmap()
+{
+	if (mapping_)
+		::munmap(mapping_, mapping_length_);
+
+	mapping_ = 0;
+	mapping_length_ = 0;
+	header_ = 0;
+	directories_ = 0;
+	entries_ = 0;
+	strings_ = 0;
+	hidden_.clear();
+	hidden_directories_ = 0;
+	hidden_entries_ = 0;
+}
+
+void directory_index::handle_listing(ftp::client & session,
+	const string & site, const vector<file> & files)
+{
+	if (!session.listing_path().empty())
+		update(site, session.listing_path(), files);
+}
+
+void directory_index::handle_directory_listed(const ftp::bookmark & site,
+	const tree_crawler::directory & listed)
+{
+	update(site.name().empty() ? site.host() : site.name(), listed.path,
+		listed.files);
+}
+
+} // namespace model
+} // namespace foofxp
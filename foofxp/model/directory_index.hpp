@@ -0,0 +1,187 @@
+#ifndef FOOFXP_DIRECTORY_INDEX_HPP_INCLUDED
+#define FOOFXP_DIRECTORY_INDEX_HPP_INCLUDED
+
+#include <cstddef>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread_safe_signal.hpp>
+#include "directory_table.hpp"
+#include "file.hpp"
+#include "ftp/client.hpp"
+#include "tree_crawler.hpp"
+
+namespace foofxp {
+namespace model {
+
+// Every file seen in every directory listed, on every site, kept on disk so
+// that "which of my sites has this release?" can be answered without logging
+// in to any of them.
+//
+// The index is a snapshot file, memory-mapped, plus whatever has been listed
+// since. update() replaces a directory's entries in memory; save() merges
+// them into a new snapshot, written alongside and renamed over the old one,
+// and maps that instead. Queries look at both, the newer listing of a
+// directory hiding the older.
+//
+// In the snapshot, entries are sorted by lower-cased name, so exact and
+// prefix lookups are binary searches. Each distinct lower-cased name is kept
+// once, in name order, in one block, which search() scans for substrings.
+// The file is in the machine's own byte order, for the machine that wrote
+// it; open() refuses anything else.
+//
+// watch() feeds the index from a session's listings, or from a tree_crawler
+// as it goes. Sites are whatever name the caller gives them.
+//
+// Safe to use from any thread.
+class directory_index : private boost::noncopyable
+{
+public:
+
+	struct match
+	{
+		std::string site;
+		std::string path;
+		file entry;
+	};
+
+	directory_index();
+	~directory_index();
+
+	// Maps the snapshot at path, dropping anything not yet saved. A missing
+	// file is an empty index.
+	void open(const std::string & path) throw (std::runtime_error);
+
+	// Writes the snapshot and what's been listed since to path (by way of a
+	// temporary file), and maps the result.
+	void save(const std::string & path) throw (std::runtime_error);
+
+	// Replaces what's known of the directory at path on site.
+	void update(const std::string & site, const std::string & path,
+		const std::vector<file> & files);
+	void update(const std::string & site, const std::string & path,
+		const directory_table & files);
+
+	// Forgets the directory at path on site.
+	void remove(const std::string & site, const std::string & path);
+
+	// Entries called name (any case). Up to limit matches are appended to
+	// results, 0 for no limit; returns how many.
+	std::size_t find(const std::string & name, std::vector<match> & results,
+		std::size_t limit = 0) const;
+
+	// Entries whose names start with prefix (any case).
+	std::size_t find_prefix(const std::string & prefix,
+		std::vector<match> & results, std::size_t limit = 0) const;
+
+	// Entries whose names contain text (any case).
+	std::size_t search(const std::string & text,
+		std::vector<match> & results, std::size_t limit = 0) const;
+
+	// Entries and directories, in the snapshot and since.
+	std::size_t size() const;
+	std::size_t directories() const;
+
+	// Updates the index with everything session lists from now on, as site.
+	// Listings whose path isn't known (see client::listing_path()) are left
+	// out.
+	boost::signals::connection watch(ftp::client & session,
+		const std::string & site);
+
+	// Updates the index with every directory crawler lists, under the site's
+	// bookmark name, or its host if it hasn't one.
+	boost::signals::connection watch(tree_crawler & crawler);
+
+private:
+
+	// On disk, after the header: the directories, the entries, then the
+	// strings they point into, NUL-terminated.
+	struct header
+	{
+		char magic[8];
+		boost::uint32_t version;
+		boost::uint32_t directory_count;
+		boost::uint64_t entry_count;
+		boost::uint64_t keys_offset;
+		boost::uint64_t keys_length;
+		boost::uint64_t strings_length;
+	};
+
+	// Sorted by site, then path.
+	struct directory_record
+	{
+		boost::uint64_t site;
+		boost::uint64_t path;
+		boost::uint64_t entries;
+	};
+
+	// Sorted by key (the lower-cased name, in the keys block), so keys only
+	// ever go up.
+	struct entry_record
+	{
+		boost::uint64_t key;
+		boost::uint64_t name;
+		boost::uint64_t size;
+		boost::int64_t time;
+		boost::uint32_t directory;
+		boost::uint8_t flags;
+		boost::uint8_t padding[3];
+	};
+
+	typedef std::pair<std::string, std::string> directory_key;
+	typedef std::map<directory_key, std::vector<file> > listing_map;
+
+	// Appends the snapshot's entries in [first, last) that aren't hidden.
+	std::size_t collect(std::size_t first, std::size_t last,
+		std::vector<match> & results, std::size_t limit) const;
+
+	// Listings since the snapshot whose names pass matches().
+	template <typename Predicate>
+	std::size_t collect_listed(Predicate matches,
+		std::vector<match> & results, std::size_t limit) const;
+
+	// Index into the snapshot's directories, or directory_count.
+	std::size_t find_directory(const directory_key & key) const;
+	void hide(const directory_key & key);
+
+	void map(const std::string & path) throw (std::runtime_error);
+	void unmap();
+
+	const char * string_at(boost::uint64_t offset) const
+	{
+		return strings_ + offset;
+	};
+
+	void handle_listing(ftp::client & session, const std::string & site,
+		const std::vector<file> & files);
+	void handle_directory_listed(const ftp::bookmark & site,
+		const tree_crawler::directory & listed);
+
+	mutable boost::mutex mutex_;
+
+	// The mapped snapshot; all 0 if there isn't one.
+	void * mapping_;
+	std::size_t mapping_length_;
+	const header * header_;
+	const directory_record * directories_;
+	const entry_record * entries_;
+	const char * strings_;
+
+	// Snapshot directories listed again (or removed) since.
+	std::vector<bool> hidden_;
+	std::size_t hidden_directories_;
+	boost::uint64_t hidden_entries_;
+	listing_map listed_;
+	std::size_t listed_entries_;
+
+}; // class directory_index
+
+} // namespace model
+} // namespace foofxp
+
+#endif // FOOFXP_DIRECTORY_INDEX_HPP_INCLUDED
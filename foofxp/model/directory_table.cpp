@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include "directory_table.hpp"
+
+using namespace std;
+using namespace boost::posix_time;
+
+namespace foofxp {
+namespace model {
+
+static const ptime epoch(boost::gregorian::date(1970, 1, 1));
+
+namespace {
+
+// Comparisons of rows by one column, for sorting row numbers.
+
+struct name_less
+{
+	explicit name_less(const vector<const char *> & names) : names(names) {};
+
+	bool operator()(size_t a, size_t b) const
+	{
+		return strcmp(names[a], names[b]) < 0;
+	};
+
+	const vector<const char *> & names;
+};
+
+template <typename T>
+struct column_less
+{
+	explicit column_less(const vector<T> & column) : column(column) {};
+
+	bool operator()(size_t a, size_t b) const
+	{
+		return column[a] < column[b];
+	};
+
+	const vector<T> & column;
+};
+
+template <typename Compare>
+void order(size_t count, vector<size_t> & rows, Compare compare)
+{
+	rows.resize(count);
+	for (size_t i = 0; i < count; ++i)
+		rows[i] = i;
+
+	stable_sort(rows.begin(), rows.end(), compare);
+}
+
+} // namespace
+
+const directory_table::index_type directory_table::npos;
+
+directory_table::directory_table() :
+	arena_(new name_arena()),
+	names_(),
+	sizes_(),
+	times_(),
+	flags_()
+{}
+
+directory_table::directory_table(const boost::shared_ptr<name_arena> & names) :
+	arena_(names),
+	names_(),
+	sizes_(),
+	times_(),
+	flags_()
+{}
+
+void directory_table::push_back(const file & f)
+{
+	push_back(f.name().c_str(), f.type(), f.size(), f.time());
+}
+
+void directory_table::push_back(const char * name, file::file_type type,
+	size_type size, const ptime & time)
+{
+	names_.push_back(arena_->intern(name));
+	sizes_.push_back(size);
+
+	boost::uint8_t flags = static_cast<boost::uint8_t>(type & type_mask);
+
+	if (time.is_special())
+		times_.push_back(numeric_limits<time_type>::min());
+	else
+	{
+		times_.push_back((time - epoch).total_microseconds());
+		flags |= has_time;
+	}
+
+	flags_.push_back(flags);
+}
+
+void directory_table::reserve(size_t rows)
+{
+	names_.reserve(rows);
+	sizes_.reserve(rows);
+	times_.reserve(rows);
+	flags_.reserve(rows);
+}
+
+void directory_table::clear()
+{
+	names_.clear();
+	sizes_.clear();
+	times_.clear();
+	flags_.clear();
+}
+
+ptime directory_table::time(index_type row) const
+{
+	if (!(flags_[row] & has_time))
+		return ptime();
+
+	return epoch + microseconds(times_[row]);
+}
+
+file directory_table::at(index_type row) const
+{
+	file f(names_[row]);
+	f.type(type(row));
+	f.size(sizes_[row]);
+	f.time(time(row));
+	return f;
+}
+
+directory_table::index_type directory_table::find(const string & name) const
+{
+	const char * interned = arena_->find(name.data(),
+		name.data() + name.length());
+	if (!interned)
+		return npos;
+
+	vector<const char *>::const_iterator found =
+		std::find(names_.begin(), names_.end(), interned);
+	if (found == names_.end())
+		return npos;
+
+	return found - names_.begin();
+}
+
+void directory_table::order_by_name(vector<index_type> & rows) const
+{
+	order(size(), rows, name_less(names_));
+}
+
+void directory_table::order_by_size(vector<index_type> & rows) const
+{
+	order(size(), rows, column_less<size_type>(sizes_));
+}
+
+void directory_table::order_by_time(vector<index_type> & rows) const
+{
+	order(size(), rows, column_less<time_type>(times_));
+}
+
+void directory_table::select(file::file_type type,
+	vector<index_type> & rows) const
+{
+	for (index_type row = 0; row < flags_.size(); ++row)
+		if ((flags_[row] & type_mask) == type)
+			rows.push_back(row);
+}
+
+size_t directory_table::memory_used() const
+{
+	return names_.capacity() * sizeof(const char *) +
+		sizes_.capacity() * sizeof(size_type) +
+		times_.capacity() * sizeof(time_type) +
+		flags_.capacity() * sizeof(boost::uint8_t);
+}
+
+} // namespace model
+} // namespace foofxp
@@ -0,0 +1,128 @@
+#ifndef FOOFXP_DIRECTORY_TABLE_HPP_INCLUDED
+#define FOOFXP_DIRECTORY_TABLE_HPP_INCLUDED
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/shared_ptr.hpp>
+#include "file.hpp"
+#include "name_arena.hpp"
+
+namespace foofxp {
+namespace model {
+
+// A directory's files, for keeping whole trees of them in memory: where a
+// vector<file> costs a std::string, a ptime and padding per entry -- around
+// 100 bytes once the name is on the heap -- a table keeps one column per
+// field, 25 bytes an entry, with names interned in a name_arena that every
+// table in the tree can share.
+//
+// Each column is a vector of its own:
+//
+//    names     const char *, the arena's NUL-terminated copy
+//    sizes     64-bit bytes
+//    times     64-bit microseconds since 1970-01-01 UTC
+//    flags     8 bits: the file_type, and whether there's a time at all
+//
+// so scanning one field (e.g. totting up sizes) doesn't drag the others
+// through the cache. The accessors hand out references to the columns, and
+// the sorts and filters produce vectors of row numbers rather than copies of
+// rows; at() is there for when a file is really wanted.
+//
+// As names are interned, two rows (in tables sharing an arena) have the same
+// name exactly when they have the same name pointer.
+class directory_table
+{
+public:
+
+	typedef std::size_t index_type;
+	typedef file::size_type size_type;
+	typedef boost::int64_t time_type;
+
+	enum
+	{
+		type_mask = 0x03,
+		has_time = 0x04
+	};
+
+	// With an arena of its own.
+	directory_table();
+
+	explicit directory_table(const boost::shared_ptr<name_arena> & names);
+
+	void push_back(const file & f);
+	void push_back(const char * name, file::file_type type, size_type size,
+		const boost::posix_time::ptime & time);
+
+	void reserve(std::size_t rows);
+
+	// Names stay in the arena.
+	void clear();
+
+	std::size_t size() const { return names_.size(); };
+	bool empty() const { return names_.empty(); };
+
+	const char * name(index_type row) const { return names_[row]; };
+	const size_type & file_size(index_type row) const { return sizes_[row]; };
+	file::file_type type(index_type row) const
+	{
+		return static_cast<file::file_type>(flags_[row] & type_mask);
+	};
+	bool is_directory(index_type row) const
+	{
+		return type(row) == file::directory || type(row) == file::link;
+	};
+
+	// Microseconds since the epoch, or the lowest time_type if there's no
+	// time (see has_time), so that undated rows sort first.
+	const time_type & epoch_time(index_type row) const
+	{
+		return times_[row];
+	};
+
+	// Not a date time if the server didn't say.
+	boost::posix_time::ptime time(index_type row) const;
+
+	// The row as a file of its own.
+	file at(index_type row) const;
+
+	const std::vector<const char *> & names() const { return names_; };
+	const std::vector<size_type> & sizes() const { return sizes_; };
+	const std::vector<time_type> & times() const { return times_; };
+	const std::vector<boost::uint8_t> & flags() const { return flags_; };
+
+	const boost::shared_ptr<name_arena> & arena() const { return arena_; };
+
+	// The row named name, or npos. Looks the name up in the arena, then
+	// compares pointers.
+	index_type find(const std::string & name) const;
+
+	// Rows in order of name (strcmp), size or time; ties keep their order.
+	void order_by_name(std::vector<index_type> & rows) const;
+	void order_by_size(std::vector<index_type> & rows) const;
+	void order_by_time(std::vector<index_type> & rows) const;
+
+	// Appends the rows of the given type to rows.
+	void select(file::file_type type, std::vector<index_type> & rows) const;
+
+	// Bytes held by the columns, not counting the arena.
+	std::size_t memory_used() const;
+
+	static const index_type npos = static_cast<index_type>(-1);
+
+private:
+
+	boost::shared_ptr<name_arena> arena_;
+	std::vector<const char *> names_;
+	std::vector<size_type> sizes_;
+	std::vector<time_type> times_;
+	std::vector<boost::uint8_t> flags_;
+
+}; // class directory_table
+
+} // namespace model
+} // namespace foofxp
+
+#endif // FOOFXP_DIRECTORY_TABLE_HPP_INCLUDED
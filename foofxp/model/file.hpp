@@ -2,6 +2,7 @@
 #define FOOFXP_FILE_HPP_INCLUDED
 
 #include <string>
+#include <boost/cstdint.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
 namespace foofxp {
@@ -11,7 +12,7 @@ class file
 {
 public:
 	
-	typedef unsigned long size_type;
+	typedef boost::uint64_t size_type;
 	typedef boost::posix_time::ptime time_type;
 	typedef enum { plain_old_file, directory, link, other } file_type;
 	
@@ -27,8 +28,6 @@ public:
 		time_(other.time_)
 	{};
 	
-	virtual ~file() {};
-	
 	file & operator=(const file & other)
 	{
 		name_ = other.name_;
@@ -55,11 +54,15 @@ public:
 	};
 	
 	void name(const std::string & name) { name_ = name; };
+	void name(const char * begin, const char * end)
+	{
+		name_.assign(begin, end);
+	};
 	void type(file_type type) { type_ = type; };
 	void size(size_type size) { size_ = size; };
 	void time(time_type time) { time_ = time; };
 	
-	const std::string name() const { return name_; };
+	const std::string & name() const { return name_; };
 	file_type type() const { return type_; };
 	size_type size() const { return size_; };
 	time_type time() const { return time_; };
@@ -82,7 +85,7 @@ public:
 		return type_ == directory || type_ == link;
 	};
 	
-protected:
+private:
 	
 	std::string name_;
 	file_type type_;
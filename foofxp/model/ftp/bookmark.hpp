@@ -25,7 +25,9 @@ public:
 		ipv6_(false),
 		username_(),
 		password_(),
-		path_()
+		path_(),
+		keep_alive_interval_(60),
+		pipelining_(true)
 	{};
 	
 	bookmark(const bookmark & other) : 
@@ -37,7 +39,9 @@ public:
 		ipv6_(other.ipv6_),
 		username_(other.username_),
 		password_(other.password_),
-		path_(other.path_)
+		path_(other.path_),
+		keep_alive_interval_(other.keep_alive_interval_),
+		pipelining_(other.pipelining_)
 	{};
 	
 	virtual ~bookmark() {};
@@ -53,6 +57,8 @@ public:
 		username_ = other.username_;
 		password_ = other.password_;
 		path_     = other.path_;
+		keep_alive_interval_ = other.keep_alive_interval_;
+		pipelining_ = other.pipelining_;
 		
 		modified(*this);
 		
@@ -69,7 +75,9 @@ public:
 		       ipv6_     == other.ipv6_ &&
 		       username_ == other.username_ &&
 		       password_ == other.password_ &&
-		       path_     == other.path_;
+		       path_     == other.path_ &&
+		       keep_alive_interval_ == other.keep_alive_interval_ &&
+		       pipelining_ == other.pipelining_;
 	};
 	
 	virtual bool operator!=(const bookmark & other) const
@@ -82,7 +90,9 @@ public:
 		       ipv6_     != other.ipv6_ ||
 		       username_ != other.username_ ||
 		       password_ != other.password_ ||
-		       path_     != other.path_;
+		       path_     != other.path_ ||
+		       keep_alive_interval_ != other.keep_alive_interval_ ||
+		       pipelining_ != other.pipelining_;
 	};
 	
 	bookmark_event modified;
@@ -141,6 +151,22 @@ public:
 		modified(*this);
 	};
 	
+	// Seconds a session may sit idle before a NOOP is sent to stop the server
+	// from dropping it. 0 turns keep-alives off.
+	void keep_alive_interval(unsigned int seconds)
+	{
+		keep_alive_interval_ = seconds;
+		modified(*this);
+	};
+	
+	// Whether sessions send predictable commands back to back without waiting
+	// for each reply. Turn off for servers that lose pipelined commands.
+	void pipelining(bool pipelining)
+	{
+		pipelining_ = pipelining;
+		modified(*this);
+	};
+	
 	const std::string name() const { return name_; };
 	bool auth_tls() const { return auth_tls_; };
 	bool tls_data() const { return tls_data_; };
@@ -150,6 +176,8 @@ public:
 	const std::string username() const { return username_; };
 	const std::string password() const { return password_; };
 	const std::string path() const { return path_; };
+	unsigned int keep_alive_interval() const { return keep_alive_interval_; };
+	bool pipelining() const { return pipelining_; };
 		
 protected:
 	
@@ -162,6 +190,8 @@ protected:
 	std::string username_;
 	std::string password_;
 	std::string path_;
+	unsigned int keep_alive_interval_;
+	bool pipelining_;
 	
 }; // class bookmark
 
@@ -1,10 +1,20 @@
-
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <boost/bind.hpp>
+#include <boost/static_assert.hpp>
 #include "client.hpp"
 #include "commands.hpp"
-#include "file_mapper.hpp"
+#include "list_parser.hpp"
+#include "reply_codes.hpp"
 #include "../../utility/format.hpp"
 #include "../../utility/trace.hpp"
 
+// These are for open(), close(), fstat() and fdatasync().
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 using namespace std;
 using namespace boost::asio;
 using namespace boost::asio::ip;
@@ -21,18 +31,75 @@ client::client(const string & host, port_type port, bool ipv6,
 	io_service & io_service, ssl::context & context) :
 	state_(not_connected),
 	auth_tls_(auth_tls),
+	protect_data_(false),
+	pipelining_(true),
 	username_(username),
 	password_(password),
-	control_stream_(*this, host, port, ipv6, io_service, context, 
+	feature_cache_(&feature_cache::shared()),
+	features_(),
+	features_known_(false),
+	machine_listings_(true),
+	directory_list_parser_(),
+	machine_list_parser_(),
+	machine_list_line_(),
+	directory_list_(),
+	directory_list_size_(0),
+	directory_list_lines_(0),
+	directory_list_chunk_size_(0),
+	listings_(0, boost::posix_time::seconds(30)),
+	listing_path_(),
+	cached_listing_(),
+	cached_listing_pending_(false),
+	listing_from_cache_(false),
+	transfer_path_(),
+	transfer_fd_(-1),
+	transfer_upload_(false),
+	transfer_listing_(false),
+	data_connected_(false),
+	data_done_(false),
+	transfer_started_(false),
+	transfer_reply_received_(false),
+	transfer_error_(),
+	ranged_(false),
+	range_aborted_(false),
+	range_offset_(0),
+	range_length_(0),
+	journal_(0),
+	journal_id_(0),
+	journaling_(false),
+	checkpoint_bytes_(32 * 1024 * 1024),
+	next_checkpoint_(0),
+	working_directory_(),
+	current_command_(),
+	pending_replies_(),
+	replies_(),
+	fxp_paths_(),
+	operation_paths_(),
+	fxp_error_(),
+	binary_mode_(false),
+	fxp_tls_client_(false),
+	sscn_on_(false),
+	strand_(io_service),
+	control_stream_(*this, host, port, ipv6, io_service, strand_, context, 
 		boost::posix_time::seconds(15)),
-	log_(200)
+	data_stream_(*this, io_service, strand_, context),
+	log_(200, strand_)
 {
-	trace_this(format(256,
-		"creating new client for ftp://%s@%s:%i (ipv6=%i, auth_tls=%i)", 
+	trace_this_at(info, client,
+		("creating new client for ftp://%s@%s:%i (ipv6=%i, auth_tls=%i)", 
 		username.c_str(), host.c_str(), port, ipv6, auth_tls));
 }
 
-client::~client() {}
+client::~client()
+{
+	if (transfer_fd_ != -1)
+		::close(transfer_fd_);
+}
+
+bool client::has_feature(const string & feature) const
+{
+	return feature_cache::supports(features_, feature);
+}
 
 // ----------------------------------------------------------------------------
 // public asynchronous operations
@@ -44,34 +111,320 @@ void client::begin_connect()
 	// it's left as a second step to give users time to set up client signal
 	// handlers.
 	
-	trace_this("client connecting");
+	trace_this_at(info, client, ("client connecting"));
 	
 	// Log event.
 	log_.add_line("Connecting...");
 	
+	// Unless we were told last time, FEAT goes out with the login.
+	features_.clear();
+	features_known_ = feature_cache_ && feature_cache_->find(
+		control_stream_.host(), control_stream_.port(), features_);
+	
+	// A new connection starts with the server handshaking as the TLS server.
+	sscn_on_ = false;
+	
+	// And somewhere we haven't asked about yet, so nothing is listed from the
+	// cache until the next PWD.
+	working_directory_.clear();
+	listing_path_.clear();
+	
 	control_stream_.begin_connect();
 }
 
-void client::begin_close() {}
+void client::begin_close()
+{
+	trace_this_at(info, client, ("client closing"));
+	
+	control_stream_.disconnect();
+	data_stream_.close();
+	state_ = not_connected;
+	current_command_.clear();
+	replies_.reset();
+	pending_replies_.clear();
+	fxp_paths_.clear();
+	operation_paths_.clear();
+	cached_listing_pending_ = false;
+	
+	// Log event.
+	log_.add_line("Disconnected.");
+}
 
 void client::begin_get_directory_contents()
 {
-	assert(state_ == logged_in);
+	assert(!is_busy());
+	
+	trace_this_at(info, client, ("client beginning get directory contents"));
+	
+	if (list_from_cache(string()))
+		return;
+	
+	if (machine_listings_ && has_feature("MLST"))
+	{
+		begin_machine_list(string());
+		return;
+	}
+	
+	reset_directory_list();
+	send_command(commands::stat_l(), awaiting_stat_l_reply);
+	busy(*this);
+}
+
+void client::begin_get_directory_contents(const string & path)
+{
+	assert(!is_busy());
+	
+	trace_this_at(info, client, ("client beginning get contents of %s",
+		path.c_str()));
+	
+	if (list_from_cache(path))
+		return;
+	
+	if (machine_listings_ && has_feature("MLST"))
+	{
+		begin_machine_list(path);
+		return;
+	}
+	
+	reset_directory_list();
+	send_command(commands::stat_l(path), awaiting_stat_l_reply);
+	busy(*this);
+}
+
+void client::begin_delete(const string & path)
+{
+	trace_this_at(info, client,
+		("client beginning delete of %s", path.c_str()));
+	
+	invalidate_listings(path);
+	
+	send_command(commands::dele(path), awaiting_dele_reply);
+	operation_paths_.push_back(path);
+	busy(*this);
+}
+
+void client::begin_make_directory(const string & path)
+{
+	trace_this_at(info, client, ("client beginning make directory %s",
+		path.c_str()));
+	
+	invalidate_listings(path);
+	
+	send_command(commands::mkdir(path), awaiting_mkd_reply);
+	operation_paths_.push_back(path);
+	busy(*this);
+}
+
+void client::begin_keep_alive()
+{
+	// We may have lost the connection since this was scheduled.
+	if (state_ != logged_in)
+		return;
+	
+	trace_this_at(debug, client, ("client sending keep-alive"));
+	
+	send_command(commands::noop(), awaiting_noop_reply);
+	busy(*this);
+}
+
+void client::begin_download(const string & remote_path,
+	const string & local_path, boost::uint64_t size)
+{
+	if (!journal_)
+	{
+		int fd = ::open(local_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+			0644);
+		
+		if (fd == -1)
+		{
+			error_occurred(*this, format(256, "Could not open %s: %s",
+				local_path.c_str(), strerror(errno)));
+			return;
+		}
+		
+		begin_transfer(remote_path, fd, false);
+		return;
+	}
+	
+	// Readable too, for the checksums.
+	int fd = ::open(local_path.c_str(), O_RDWR | O_CREAT, 0644);
+	
+	if (fd == -1)
+	{
+		error_occurred(*this, format(256, "Could not open %s: %s",
+			local_path.c_str(), strerror(errno)));
+		return;
+	}
+	
+	string key = journal_key(remote_path);
+	boost::uint64_t offset = resume_offset(fd, key, local_path, size);
+	
+	// Anything past the checkpoint may not have made it to disk intact.
+	if (::ftruncate(fd, offset) != 0)
+	{
+		error_occurred(*this, format(256, "Could not truncate %s: %s",
+			local_path.c_str(), strerror(errno)));
+		::close(fd);
+		return;
+	}
+	
+	transfer_journal::id_type id = journal_->begin(key, local_path, size);
+	
+	begin_transfer(remote_path, fd, false);
+	
+	journaling_ = true;
+	journal_id_ = id;
+	next_checkpoint_ = checkpoint_bytes_;
+	
+	if (offset != 0)
+	{
+		ranged_ = true;
+		range_offset_ = offset;
+		
+		// Log event.
+		log_.add_line(format(256, "Resuming %s at %lu bytes.",
+			remote_path.c_str(), static_cast<unsigned long>(offset)));
+	}
+}
+
+void client::begin_upload(const string & local_path,
+	const string & remote_path)
+{
+	int fd = ::open(local_path.c_str(), O_RDONLY);
+	
+	if (fd == -1)
+	{
+		error_occurred(*this, format(256, "Could not open %s: %s",
+			local_path.c_str(), strerror(errno)));
+		return;
+	}
+	
+	begin_transfer(remote_path, fd, true);
+}
+
+void client::begin_download_range(const string & remote_path, int fd,
+	boost::uint64_t offset, boost::uint64_t length)
+{
+	// Our own copy, so finish_transfer() can close it like any other.
+	fd = ::dup(fd);
+	
+	if (fd == -1)
+	{
+		error_occurred(*this, format(256, "Could not duplicate descriptor: %s",
+			strerror(errno)));
+		return;
+	}
+	
+	begin_transfer(remote_path, fd, false);
+	
+	ranged_ = true;
+	range_offset_ = offset;
+	range_length_ = length;
+}
+
+void client::shrink_download_range(boost::uint64_t length)
+{
+	if (!ranged_ || transfer_fd_ == -1 ||
+		(range_length_ != 0 && length >= range_length_))
+		return;
+	
+	trace_this_at(debug, client, ("client shrinking range of %s to %lu bytes",
+		transfer_path_.c_str(), static_cast<unsigned long>(length)));
+	
+	range_length_ = length;
+	
+	if (transfer_started_ && data_connected_ && !data_done_)
+		data_stream_.limit(length);
+}
+
+void client::begin_fxp_passive()
+{
+	assert(state_ == logged_in || in_fxp_operation());
+	
+	trace_this_at(info, client, ("client beginning FXP passive mode"));
+	
+	bool was_busy = is_busy();
+	begin_fxp_operation();
+	
+	// The other server gets the address from the reply, which EPSV doesn't
+	// give, so it's only for IPv6 here.
+	if (control_stream_.remote_address().is_v6())
+		send_command(commands::epsv(), awaiting_fxp_pasv_reply);
+	else
+		send_command(commands::pasv(), awaiting_fxp_pasv_reply);
+	
+	if (!was_busy)
+		busy(*this);
+}
+
+void client::begin_fxp_store(const string & path)
+{
+	assert(state_ == logged_in || in_fxp_operation());
 	
-	trace_this("client beginning get directory contents");
+	trace_this_at(info, client, ("client beginning FXP store of %s",
+		path.c_str()));
+	
+	bool was_busy = is_busy();
+	begin_fxp_operation();
+	
+	invalidate_listings(path);
+	
+	send_command(commands::stor(path), awaiting_fxp_transfer_reply);
+	fxp_paths_.push_back(path);
+	
+	if (!was_busy)
+		busy(*this);
+}
+
+void client::begin_fxp_retrieve(const tcp::endpoint & endpoint,
+	const string & path)
+{
+	assert(state_ == logged_in || in_fxp_operation());
+	
+	trace_this_at(info, client, ("client beginning FXP retrieve of %s",
+		path.c_str()));
+	
+	bool was_busy = is_busy();
+	begin_fxp_operation();
+	
+	// Send RETR straight after PORT. If PORT fails, so will RETR.
+	if (endpoint.address().is_v6())
+		send_command(commands::eprt(endpoint), awaiting_fxp_port_reply);
+	else
+		send_command(commands::port(endpoint), awaiting_fxp_port_reply);
+	
+	send_command(commands::retr(path), awaiting_fxp_transfer_reply);
+	fxp_paths_.push_back(path);
+	
+	if (!was_busy)
+		busy(*this);
+}
+
+void client::begin_fxp_abort(const string & path)
+{
+	// It may have finished, and the next begun, since this was scheduled.
+	if (state_ != awaiting_fxp_transfer_reply || fxp_paths_.front() != path)
+		return;
 	
-	directory_list_output_buffer_.clear();
+	trace_this_at(info, client, ("client aborting FXP transfer of %s",
+		path.c_str()));
 	
-	send_command(commands::stat_l());
-	state_ = awaiting_stat_l_reply;
+	// The transfer's reply (usually 426) comes first, then one to the ABOR.
+	send_command(commands::abor(), awaiting_discarded_reply);
 }
 
 void client::begin_change_directory(const string & directory)
 {
-	trace_this("client beginning change directory");
+	trace_this_at(info, client, ("client beginning change directory"));
+	
+	send_command(commands::cwd(directory), awaiting_cwd_reply);
 	
-	send_command(commands::cwd(directory));
-	state_ = awaiting_cwd_reply;
+	// Send PWD to ask the server where we are now -- expands symlink paths
+	// etc. If the CWD fails, its reply is ignored.
+	if (pipelining_)
+		send_command(commands::pwd(), awaiting_pwd_reply);
+	
+	busy(*this);
 }
 
 // ----------------------------------------------------------------------------
@@ -80,17 +433,19 @@ void client::begin_change_directory(const string & directory)
 
 void client::handle_connect()
 {
-	trace_this("client connected");
+	trace_this_at(info, client, ("client connected"));
 	
 	// Log event.
 	log_.add_line("Connected.");
 	
 	// Wait for the server's welcome message.
-	trace_this("client waiting for welcome message");
+	trace_this_at(debug, client, ("client waiting for welcome message"));
 	control_stream_.begin_read_line();
 	
 	// Get ready for the server's "220 Blah FTP Server ready" welcome message.
 	state_ = awaiting_welcome_message;
+	current_command_.clear();
+	replies_.reset();
 }
 
 void client::handle_control_stream_error(const string & message, bool fatal)
@@ -107,89 +462,188 @@ void client::handle_control_stream_error(const string & message, bool fatal)
 
 void client::handle_handshake()
 {
-	trace_this("client handshake successful, setting protection buffer size");
+	trace_this_at(info, client,
+		("client handshake successful, setting protection buffer size"));
 	
 	// Follow a successful handshake by sending PBSZ 0.
-	send_command(commands::pbsz());
-	state_ = awaiting_pbsz_reply;
+	send_command(commands::pbsz(), awaiting_pbsz_reply);
+	
+	// None of the rest of the login depends on what the server says (short
+	// of failing), so send it all now.
+	if (pipelining_)
+	{
+		if (protect_data_)
+			send_command(commands::prot_p(), awaiting_prot_reply);
+	
+		pipeline_login();
+	}
 }
 
+// What each state does with the reply to its command, in state_type order.
+// States with no positive handler aren't waiting on a reply at all. A new
+// command needs a state, a row here, and handlers for the replies it cares
+// about; everything else (logging, multi-line replies, fatal errors, falling
+// back from pipelining) is taken care of by handle_line_received().
+//
+// Interior lines are the ones between the first and last lines of a multi-line
+// reply.
+const client::transition client::transitions_[] =
+{
+	// state
+	//     positive, negative (0: fatal), 1xx (0: ignored),
+	//     interior line (0: kept with the reply),
+	//     resend if rejected while pipelining
+	
+	{ not_connected,
+		0, 0, 0, 0, false },
+	{ awaiting_welcome_message,
+		&client::handle_welcome_message, 0, 0, 0, false },
+	{ awaiting_auth_tls_reply,
+		&client::handle_auth_tls_reply, 0, 0, 0, false },
+	{ awaiting_handshake,
+		0, 0, 0, 0, false },
+	{ awaiting_pbsz_reply,
+		&client::handle_pbsz_reply, 0, 0, 0, false },
+	{ awaiting_user_reply,
+		&client::handle_user_reply, 0, 0, 0, true },
+	{ awaiting_pass_reply,
+		&client::handle_pass_reply, 0, 0, 0, true },
+	// Not resent: a 500 here more likely means the server has never heard of
+	// FEAT than that it was pipelined.
+	{ awaiting_feat_reply,
+		&client::handle_feat_reply, &client::handle_feat_reply, 0, 0, false },
+	{ logged_in,
+		0, 0, 0, 0, false },
+	{ awaiting_cwd_reply,
+		&client::handle_cwd_reply, &client::handle_cwd_failed, 0, 0, false },
+	{ awaiting_pwd_reply,
+		&client::handle_pwd_reply, 0, 0, 0, true },
+	{ awaiting_stat_l_reply,
+		&client::handle_stat_l_reply, &client::handle_stat_l_failed, 0,
+		&client::handle_stat_l_entry, true },
+	{ awaiting_noop_reply,
+		&client::handle_noop_reply, 0, 0, 0, false },
+	{ awaiting_dele_reply,
+		&client::handle_dele_reply, &client::handle_dele_failed, 0, 0, false },
+	{ awaiting_mkd_reply,
+		&client::handle_mkd_reply, &client::handle_mkd_failed, 0, 0, false },
+	{ awaiting_prot_reply,
+		&client::handle_prot_reply, 0, 0, 0, true },
+	{ awaiting_type_reply,
+		&client::handle_type_reply, &client::handle_transfer_failed, 0, 0,
+		false },
+	{ awaiting_pasv_reply,
+		&client::handle_pasv_reply, &client::handle_transfer_failed, 0, 0,
+		true },
+	{ awaiting_rest_reply,
+		&client::handle_rest_reply, &client::handle_rest_failed, 0, 0,
+		false },
+	{ awaiting_transfer_reply,
+		&client::handle_transfer_reply, &client::handle_transfer_failed,
+		&client::handle_transfer_started, 0, false },
+	{ transferring,
+		0, 0, 0, 0, false },
+	{ awaiting_fxp_type_reply,
+		&client::handle_fxp_setup_reply, &client::handle_fxp_type_failed, 0,
+		0, false },
+	{ awaiting_fxp_sscn_reply,
+		&client::handle_fxp_setup_reply, &client::handle_fxp_sscn_failed, 0,
+		0, false },
+	{ awaiting_fxp_pasv_reply,
+		&client::handle_fxp_pasv_reply, &client::handle_fxp_pasv_failed, 0,
+		0, false },
+	{ awaiting_fxp_port_reply,
+		&client::handle_fxp_setup_reply, &client::handle_fxp_error, 0, 0,
+		false },
+	{ awaiting_fxp_transfer_reply,
+		&client::handle_fxp_transfer_reply,
+		&client::handle_fxp_transfer_failed,
+		&client::handle_fxp_transfer_started, 0, false },
+	{ awaiting_discarded_reply,
+		&client::handle_discarded_reply, &client::handle_discarded_reply, 0,
+		&client::handle_discarded_line, false }
+};
+
 void client::handle_line_received(const string & line)
 {
-	trace_this("client received line from server \"" + line + "\"");
+	BOOST_STATIC_ASSERT(sizeof(transitions_) / sizeof(transitions_[0]) ==
+		awaiting_discarded_reply + 1);
 	
-	// Create server reply instance from line.
-	server_reply reply(line);
+	trace_this_at(debug, client, ("client received line from server \"%s\"",
+		line.c_str()));
+	
+	const transition & entry = transitions_[state_];
+	assert(entry.state == state_);
 	
-	// Pass the line to an appropriate handler method.
-	switch (state_)
+	reply_assembler::result_type result = replies_.add_line(line,
+		!entry.interior);
+	
+	if (result == reply_assembler::invalid)
 	{
-		case awaiting_welcome_message:
-			handle_welcome_message(reply);
-			return;
-			
-		case awaiting_auth_tls_reply:
-			handle_auth_tls_reply(reply);
-			return;
-		
-		case awaiting_pbsz_reply:
-			handle_pbsz_reply(reply);
-			return; 
-		
-		case awaiting_user_reply:
-			handle_user_reply(reply);
-			return;
-		
-		case awaiting_pass_reply:
-			handle_pass_reply(reply);
-			return;
-			
-		case awaiting_cwd_reply:
-			handle_cwd_reply(reply);
-			return;
-		
-		case awaiting_pwd_reply:
-			handle_pwd_reply(reply);
-			return;
-		
-		case awaiting_stat_l_reply:
-			handle_stat_l_reply(reply);
-			return;
-			
-		default:
-			// No state set. This means that the client has received a line
-			// from the server out of the blue (i.e. not in response to any
-			// command we sent).
-			//
-			// Usually this will be a "550 Goodbye!" farewell message before
-			// the server kicks us off for being idle too long.
-			handle_unexpected_message(reply);
-			return;
+		log_.add_line(line);
+		fatal_error_occurred(*this, "Invalid reply received.");
+		return;
 	}
-}
-
-bool client::handle_basic_reply_details(const server_reply & reply)
-{
-	log_.add_line(reply.original_line());
 	
-	if (!reply.is_valid_format())
+	if (result == reply_assembler::interior && entry.interior)
 	{
-		fatal_error_occurred(*this, "Invalid reply received.");
-		return false;
+		// Deal with it now, rather than holding on to it until the end of
+		// the reply.
+		(this->*entry.interior)(line);
+		return;
 	}
-	else if (!reply.is_end_of_reply())
+	
+	log_.add_line(line);
+	
+	if (result != reply_assembler::complete)
 	{
 		// Didn't get the whole reply yet...
 		control_stream_.begin_read_line();
-		return false;
+		return;
 	}
-	else if (reply.is_negative_reply())
+	
+	// Decode the last line where it is, without copying it. The rest of a
+	// multi-line reply is in replies_.text().
+	server_reply reply(line);
+	
+	if (!entry.positive)
 	{
-		fatal_error_occurred(*this, reply.original_line());
-		return false;
+		// Not waiting on a reply. This means that the client has received a
+		// reply from the server out of the blue (i.e. not in response to any
+		// command we sent).
+		//
+		// Usually this will be a "421 Goodbye!" farewell message before the
+		// server kicks us off for being idle too long.
+		handle_unexpected_message(reply);
+		return;
 	}
 	
-	return true;
+	if (reply.is_preliminary_reply())
+	{
+		// E.g. 150 Opening BINARY mode data connection. The final reply
+		// follows.
+		if (entry.preliminary)
+			(this->*entry.preliminary)(reply);
+	
+		control_stream_.begin_read_line();
+		return;
+	}
+	
+	bool negative = reply.is_negative_reply();
+	
+	if (negative && entry.resend_if_rejected && retry_in_lockstep(reply))
+		return;
+	
+	// Move on to the next reply before handling this one, so the handler is
+	// free to send commands of its own.
+	next_reply();
+	
+	if (!negative)
+		(this->*entry.positive)(reply);
+	else if (entry.negative)
+		(this->*entry.negative)(reply);
+	else
+		fatal_error_occurred(*this, line);
 }
 
 // ----------------------------------------------------------------------------
@@ -198,28 +652,25 @@ bool client::handle_basic_reply_details(const server_reply & reply)
 
 void client::handle_welcome_message(const server_reply & reply)
 {
-	if (!handle_basic_reply_details(reply))
-		return;
-	
 	if (auth_tls_)
 	{
 		// Begin TLS handshake by sending AUTH TLS command.
-		send_command(commands::auth_tls());
-		state_ = awaiting_auth_tls_reply;
+		send_command(commands::auth_tls(), awaiting_auth_tls_reply);
+	}
+	else if (pipelining_)
+	{
+		// Log in and ask for a directory list in one go.
+		pipeline_login();
 	}
 	else
 	{
 		// Begin log-in by sending USER command.
-		send_command(commands::user(username_));
-		state_ = awaiting_user_reply;
+		send_command(commands::user(username_), awaiting_user_reply);
 	}
 }
 
 void client::handle_auth_tls_reply(const server_reply & reply)
 {
-	if (!handle_basic_reply_details(reply))
-		return;
-	
 	// Start handshake.
 	control_stream_.begin_handshake();
 	state_ = awaiting_handshake;
@@ -227,58 +678,114 @@ void client::handle_auth_tls_reply(const server_reply & reply)
 
 void client::handle_pbsz_reply(const server_reply & reply)
 {
-	if (!handle_basic_reply_details(reply))
+	if (awaiting_reply())
+		// The rest of the login is already on its way.
+		return;
+	
+	if (protect_data_)
+	{
+		// Encrypt data connections too.
+		send_command(commands::prot_p(), awaiting_prot_reply);
 		return;
+	}
 	
 	// Begin log-in by sending USER command.
-	send_command(commands::user(username_));
-	state_ = awaiting_user_reply;
+	send_command(commands::user(username_), awaiting_user_reply);
 }
 
 void client::handle_user_reply(const server_reply & reply)
 {
-	if (!handle_basic_reply_details(reply))
+	if (awaiting_reply())
+		// Already sent PASS.
 		return;
 	
-	send_command(commands::pass(password_));
-	state_ = awaiting_pass_reply;
+	send_command(commands::pass(password_), awaiting_pass_reply);
 }
 
 void client::handle_pass_reply(const server_reply & reply)
 {
-	if (!handle_basic_reply_details(reply))
-		return;
+	trace_this_at(info, client, ("user logged in"));
 	
-	trace_this("user logged in");
+	if (awaiting_reply())
+		// FEAT or the directory list is already on its way.
+		return;
 	
-	state_ = logged_in;
+	if (!features_known_)
+	{
+		send_command(commands::feat(), awaiting_feat_reply);
+		return;
+	}
 	
 	// Tell anyone who's listening that we've logged in.
 	idle(*this);
 	
+	begin_get_directory_contents();
+}
+
+void client::handle_feat_reply(const server_reply & reply)
+{
+	// 211-Features:
+	//  MLST type*;size*;modify*;
+	//  UTF8
+	// 211 End
+	//
+	// A negative reply just means there aren't any we can use. Only remember
+	// that if it's the server saying it doesn't know FEAT, and not that it
+	// choked on a pipelined command or couldn't answer just now.
+	server_reply::reply_code_type code = reply.get_reply_code();
+	
+	if (!reply.is_negative_reply())
+		feature_cache::parse_feat_reply(replies_.text(), features_);
+	
+	if (feature_cache_ && (!reply.is_negative_reply() ||
+		code == reply_codes::bad_command ||
+		code == reply_codes::command_not_implemented))
+		feature_cache_->insert(control_stream_.host(), control_stream_.port(),
+			features_);
+	
+	features_known_ = true;
+	
+	trace_this_at(info, client, ("server listed %lu features",
+		static_cast<unsigned long>(features_.size())));
+	
+	if (awaiting_reply())
+		// The directory list is already on its way.
+		return;
+	
+	// Tell anyone who's listening that we've logged in.
+	idle(*this);
 	
 	begin_get_directory_contents();
 }
 
 void client::handle_cwd_reply(const server_reply & reply)
 {
-	if (!handle_basic_reply_details(reply))
-		return;
+	trace_this_at(info, client, ("user changed directory"));
 	
-	trace_this("user changed directory");
+	if (awaiting_reply())
+		// Already sent PWD.
+		return;
 	
 	// Send PWD to ask the server where we are now -- expands symlink paths etc.
 	//
 	// E.g. CWD ~ actually might send us to "/users/richard".
-	send_command(commands::pwd());
-	state_ = awaiting_pwd_reply;
+	send_command(commands::pwd(), awaiting_pwd_reply);
 }
 
-void client::handle_pwd_reply(const server_reply & reply)
+void client::handle_cwd_failed(const server_reply & reply)
 {
-	if (!handle_basic_reply_details(reply))
-		return;
+	// Not fatal -- we're still wherever we were before.
+	trace_this_at(info, client, ("user could not change directory"));
 	
+	discard_replies();
+	change_directory_failed(*this, reply.original_line());
+	
+	if (!is_busy())
+		idle(*this);
+}
+
+void client::handle_pwd_reply(const server_reply & reply)
+{
 	string path;
 	try
 	{
@@ -293,65 +800,1032 @@ void client::handle_pwd_reply(const server_reply & reply)
 		return;
 	}
 	
-	trace_this("user successfully changed directory to " + path);
+	trace_this_at(info, client, ("user successfully changed directory to %s",
+		path.c_str()));
+	
+	working_directory_ = path;
 	
 	// All done! Notify any subscribers that we've changed directory.
-	state_ = logged_in;
 	changed_directory(*this, path);
+	
+	// Unless a listener has already started something else.
+	if (!is_busy())
+		idle(*this);
 }
 
-void client::handle_stat_l_reply(const server_reply & reply)
+void client::handle_stat_l_entry(const string & line)
 {
-	// If this line is a valid FTP reply, process it as such. Otherwise, process
-	// it as a file entry - append it to the dirlist output buffer, and do not
-	// log it.
-	if (!reply.is_valid_format())
+	if (server_reply(line).is_valid_format())
 	{
-		// Insert a placeholder message into the session log to mark where the
-		// directory list was.
-		if (directory_list_output_buffer_.empty())
-			log_.add_line("(directory list was here)");
-		
-		directory_list_output_buffer_.push_back(reply.original_line());
-		
-		// Wait for more entries or the end of the reply.
+		// Status text rather than an entry, e.g. "213- total 12".
+		log_.add_line(line);
 		control_stream_.begin_read_line();
 		return;
 	}
-	else if (!handle_basic_reply_details(reply))
-		return;
 	
-	trace_this("received directory list");
+	// A file entry - parse it straight into the directory list, and do not
+	// log it. Insert a placeholder message into the session log to mark where
+	// the directory list was.
+	if (directory_list_lines_++ == 0)
+		log_.add_line("(directory list was here)");
 	
-	// All done! Notify any subscribers that we've received a directory list.
-	state_ = logged_in;
+	if (!add_directory_list_entry(line))
+		return;
+	
+	// Wait for more entries or the end of the reply.
+	control_stream_.begin_read_line();
+}
+
+void client::handle_stat_l_reply(const server_reply & reply)
+{
+	trace_this_at(info, client, ("received directory list"));
 	
-	vector<file> files = get_files(directory_list_output_buffer_);
+	deliver_directory_list();
 	
-	received_directory_list(*this, files);
+	if (!is_busy())
+		idle(*this);
 }
 
-void client::handle_unexpected_message(const server_reply & reply)
+void client::handle_stat_l_failed(const server_reply & reply)
 {
-	trace_this("client received unexpected message from server");
+	// E.g. no such directory. The session carries on.
+	trace_this_at(info, client, ("could not get directory list"));
 	
-	if (!handle_basic_reply_details(reply))
-		return;
+	// If it's gone, so is what we had of it.
+	listings_.invalidate(listing_path_);
+	
+	directory_list_failed(*this, reply.original_line());
+	
+	if (!is_busy())
+		idle(*this);
 }
 
-// ----------------------------------------------------------------------------
-// internal client stuff
-// ----------------------------------------------------------------------------
+void client::handle_noop_reply(const server_reply & reply)
+{
+	idle(*this);
+}
 
-void client::send_command(const string & command)
+void client::handle_dele_reply(const server_reply & reply)
 {
-	trace_this("client sending command \"" + command + "\"");
+	string path = operation_paths_.front();
+	operation_paths_.pop_front();
 	
-	log_.add_line(">>> " + command);
+	trace_this_at(info, client, ("client deleted %s", path.c_str()));
 	
-	control_stream_.begin_send_command(command);
+	deleted(*this, path);
 	
-	control_stream_.begin_read_line();
+	if (!is_busy())
+		idle(*this);
+}
+
+void client::handle_dele_failed(const server_reply & reply)
+{
+	// Not fatal: e.g. no such file, or not allowed.
+	string path = operation_paths_.front();
+	operation_paths_.pop_front();
+	
+	trace_this_at(info, client, ("client could not delete %s", path.c_str()));
+	
+	delete_failed(*this, reply.original_line());
+	
+	if (!is_busy())
+		idle(*this);
+}
+
+void client::handle_mkd_reply(const server_reply & reply)
+{
+	string path = operation_paths_.front();
+	operation_paths_.pop_front();
+	
+	trace_this_at(info, client, ("client made directory %s", path.c_str()));
+	
+	made_directory(*this, path);
+	
+	if (!is_busy())
+		idle(*this);
+}
+
+void client::handle_mkd_failed(const server_reply & reply)
+{
+	string path = operation_paths_.front();
+	operation_paths_.pop_front();
+	
+	trace_this_at(info, client, ("client could not make directory %s",
+		path.c_str()));
+	
+	make_directory_failed(*this, reply.original_line());
+	
+	if (!is_busy())
+		idle(*this);
+}
+
+void client::handle_prot_reply(const server_reply & reply)
+{
+	if (awaiting_reply())
+		// Already sent USER.
+		return;
+	
+	// Begin log-in by sending USER command.
+	send_command(commands::user(username_), awaiting_user_reply);
+}
+
+void client::handle_type_reply(const server_reply & reply)
+{
+	if (awaiting_reply())
+		// Already sent PASV.
+		return;
+	
+	send_command(passive_command(), awaiting_pasv_reply);
+}
+
+void client::handle_pasv_reply(const server_reply & reply)
+{
+	tcp::endpoint endpoint;
+	try
+	{
+		// EPSV gives just a port, on the address we're already talking to.
+		if (reply.get_reply_code() == reply_codes::epsv_okay)
+			endpoint = tcp::endpoint(control_stream_.remote_address(),
+				reply.get_epsv_port());
+		else
+			endpoint = reply.get_pasv_endpoint();
+	}
+	catch (const invalid_argument & ex)
+	{
+		transfer_error_ = ex.what();
+		finish_transfer();
+		return;
+	}
+	
+	// Connect and send the command at the same time -- the server is already
+	// listening, and will wait for us if the command gets there first.
+	data_stream_.begin_connect(endpoint,
+		protect_data_ && control_stream_.encrypted(),
+		control_stream_.tls_session_key());
+	
+	if (ranged_ && range_offset_ != 0)
+	{
+		send_command(commands::rest(range_offset_), awaiting_rest_reply);
+		
+		if (!pipelining_)
+			return;
+	}
+	
+	send_transfer_command();
+}
+
+void client::handle_rest_reply(const server_reply & reply)
+{
+	// 350 Restarting at n.
+	if (awaiting_reply())
+		// Already sent RETR.
+		return;
+	
+	send_transfer_command();
+}
+
+void client::handle_rest_failed(const server_reply & reply)
+{
+	// A server that can't resume will go on refusing, so don't try again next
+	// time.
+	if (journaling_)
+	{
+		journal_->complete(journal_id_);
+		journaling_ = false;
+	}
+	
+	handle_transfer_failed(reply);
+}
+
+void client::handle_transfer_started(const server_reply & reply)
+{
+	// 150 Opening BINARY mode data connection. The final reply follows once
+	// the data is through.
+	transfer_started_ = true;
+	
+	// A listing is nobody's business but ours until it's parsed.
+	if (!transfer_listing_)
+		transfer_started(*this, transfer_path_);
+	
+	if (data_connected_)
+		start_data_transfer();
+}
+
+void client::handle_transfer_reply(const server_reply & reply)
+{
+	// 226 Transfer complete. The data connection may not have caught up yet.
+	transfer_reply_received_ = true;
+	
+	if (!transfer_started_)
+	{
+		data_stream_.close();
+		data_done_ = true;
+	}
+	
+	if (data_done_)
+		finish_transfer();
+	else
+		state_ = transferring;
+}
+
+void client::handle_transfer_failed(const server_reply & reply)
+{
+	// The 426 that answers an ABOR once we had the range we wanted.
+	if (range_aborted_ && data_done_ && transfer_error_.empty())
+	{
+		handle_transfer_reply(reply);
+		return;
+	}
+	
+	// Only the transfer fails, not the whole session.
+	if (transfer_error_.empty())
+		transfer_error_ = reply.original_line();
+	
+	// If TYPE failed, there's still the reply to the PASV behind it.
+	discard_replies();
+	
+	data_stream_.close();
+	finish_transfer();
+}
+
+void client::handle_fxp_setup_reply(const server_reply & reply)
+{
+	// TYPE or PORT went through. The operation behind it reports back.
+}
+
+void client::handle_fxp_type_failed(const server_reply & reply)
+{
+	handle_fxp_error(reply);
+	
+	// Try again with the next operation. This one gets the error.
+	binary_mode_ = false;
+}
+
+void client::handle_fxp_sscn_failed(const server_reply & reply)
+{
+	handle_fxp_error(reply);
+	
+	// As above: the server is still the way it was.
+	sscn_on_ = !sscn_on_;
+}
+
+void client::handle_fxp_error(const server_reply & reply)
+{
+	// As with passive transfers, a negative reply only fails the operation it
+	// belongs to. The error is held until that operation reports back.
+	if (fxp_error_.empty())
+		fxp_error_ = reply.original_line();
+}
+
+void client::handle_fxp_pasv_reply(const server_reply & reply)
+{
+	tcp::endpoint endpoint;
+	if (fxp_error_.empty())
+	{
+		try
+		{
+			if (control_stream_.remote_address().is_v6())
+				endpoint = tcp::endpoint(control_stream_.remote_address(),
+					reply.get_epsv_port());
+			else
+				endpoint = reply.get_pasv_endpoint();
+		}
+		catch (const invalid_argument & ex)
+		{
+			fxp_error_ = ex.what();
+		}
+	}
+	
+	finish_fxp_passive(endpoint);
+}
+
+void client::handle_fxp_pasv_failed(const server_reply & reply)
+{
+	handle_fxp_error(reply);
+	finish_fxp_passive(tcp::endpoint());
+}
+
+void client::handle_fxp_transfer_started(const server_reply & reply)
+{
+	// 150 Opening BINARY mode data connection. Wait for the 226.
+	if (fxp_error_.empty())
+		transfer_started(*this, fxp_paths_.front());
+}
+
+void client::handle_fxp_transfer_reply(const server_reply & reply)
+{
+	finish_fxp_transfer();
+}
+
+void client::handle_fxp_transfer_failed(const server_reply & reply)
+{
+	handle_fxp_error(reply);
+	finish_fxp_transfer();
+}
+
+void client::handle_discarded_reply(const server_reply & reply)
+{
+	// The reply to a command we no longer care about, or have sent again.
+	if (!is_busy())
+		idle(*this);
+}
+
+void client::handle_discarded_line(const string & line)
+{
+	// STAT -l entries aren't valid replies, so skip those quietly.
+	control_stream_.begin_read_line();
+}
+
+void client::handle_unexpected_message(const server_reply & reply)
+{
+	trace_this_at(info, client,
+		("client received unexpected message from server"));
+	
+	if (reply.is_negative_reply())
+		fatal_error_occurred(*this, reply.original_line());
+}
+
+// ----------------------------------------------------------------------------
+// data_stream event handlers
+// ----------------------------------------------------------------------------
+
+void client::handle_data_connect()
+{
+	trace_this_at(debug, client, ("client data connection open"));
+	
+	data_connected_ = true;
+	
+	if (transfer_started_)
+		start_data_transfer();
+}
+
+void client::handle_data_transfer_complete()
+{
+	trace_this_at(debug, client, ("client data connection done"));
+	
+	data_done_ = true;
+	
+	if (transfer_reply_received_)
+	{
+		finish_transfer();
+		return;
+	}
+	
+	if (ranged_ && data_stream_.limit() != 0 &&
+		data_stream_.bytes_transferred() >= data_stream_.limit())
+	{
+		// The server is still sending the rest of the file. Its reply to RETR
+		// (usually 426) comes first, then one to the ABOR.
+		trace_this_at(debug, client, ("client aborting rest of %s",
+			transfer_path_.c_str()));
+		
+		range_aborted_ = true;
+		send_command(commands::abor(), awaiting_discarded_reply);
+	}
+}
+
+void client::handle_data_stream_error(const string & message)
+{
+	string msg = format(128, "Data connection error: %s", message.c_str());
+	log_.add_line(msg);
+	
+	if (transfer_error_.empty())
+		transfer_error_ = msg;
+	
+	// The server will follow up with a 425/426 on the control stream.
+	data_done_ = true;
+	
+	if (transfer_reply_received_)
+		finish_transfer();
+}
+
+void client::handle_data_progress()
+{
+	if (journaling_ && data_stream_.bytes_transferred() >= next_checkpoint_)
+	{
+		checkpoint_transfer();
+		next_checkpoint_ = data_stream_.bytes_transferred() +
+			checkpoint_bytes_;
+	}
+}
+
+void client::handle_data_received(const char * data, size_t length)
+{
+	// An MLSD listing, one entry per line. Lines can straddle reads, so the
+	// tail of each read waits in machine_list_line_ for the rest.
+	if (!transfer_error_.empty())
+		// Already given up on it; let the rest drain.
+		return;
+	
+	const char * end = data + length;
+	
+	while (data != end)
+	{
+		const char * line_end = find(data, end, '\n');
+		machine_list_line_.append(data, line_end);
+	
+		if (line_end == end)
+			return;
+	
+		data = line_end + 1;
+	
+		if (!add_machine_list_entry(machine_list_line_))
+			return;
+	
+		machine_list_line_.clear();
+	}
+}
+
+// ----------------------------------------------------------------------------
+// internal client stuff
+// ----------------------------------------------------------------------------
+
+void client::begin_transfer(const string & remote_path, int fd, bool upload)
+{
+	assert(state_ == logged_in);
+	
+	trace_this_at(info, client, ("client beginning %s of %s",
+		upload ? "upload" : "download", remote_path.c_str()));
+	
+	// Whatever happens, the listing with the file in it is out of date.
+	if (upload)
+		invalidate_listings(remote_path);
+	
+	transfer_path_ = remote_path;
+	transfer_fd_ = fd;
+	transfer_upload_ = upload;
+	transfer_listing_ = false;
+	data_connected_ = false;
+	data_done_ = false;
+	transfer_started_ = false;
+	transfer_reply_received_ = false;
+	transfer_error_.clear();
+	ranged_ = false;
+	range_aborted_ = false;
+	range_offset_ = 0;
+	range_length_ = 0;
+	journaling_ = false;
+	
+	send_command(commands::type_i(), awaiting_type_reply);
+	
+	if (pipelining_)
+		send_command(passive_command(), awaiting_pasv_reply);
+	
+	busy(*this);
+}
+
+void client::begin_fxp_operation()
+{
+	// Switch to binary mode before the first transfer of the session.
+	if (!binary_mode_)
+	{
+		send_command(commands::type_i(), awaiting_fxp_type_reply);
+		binary_mode_ = true;
+	}
+	
+	// And tell the server which end of the data connection's handshake it's
+	// on, if that has changed.
+	if (sscn_on_ != fxp_tls_client_)
+	{
+		send_command(commands::sscn(fxp_tls_client_),
+			awaiting_fxp_sscn_reply);
+		sscn_on_ = fxp_tls_client_;
+	}
+}
+
+bool client::in_fxp_operation() const
+{
+	// Discarded replies include those to begin_fxp_abort()'s ABOR.
+	return state_ == awaiting_discarded_reply ||
+		state_ == awaiting_fxp_type_reply ||
+		state_ == awaiting_fxp_sscn_reply ||
+		state_ == awaiting_fxp_pasv_reply ||
+		state_ == awaiting_fxp_port_reply ||
+		state_ == awaiting_fxp_transfer_reply;
+}
+
+bool client::awaiting_reply() const
+{
+	return transitions_[state_].positive != 0;
+}
+
+void client::next_reply()
+{
+	if (pending_replies_.empty())
+	{
+		state_ = logged_in;
+		current_command_.clear();
+		return;
+	}
+	
+	state_ = pending_replies_.front().first;
+	current_command_.swap(pending_replies_.front().second);
+	pending_replies_.pop_front();
+	
+	control_stream_.begin_read_line();
+}
+
+void client::pipeline_login()
+{
+	// Login, followed by the first directory list.
+	send_command(commands::user(username_), awaiting_user_reply);
+	send_command(commands::pass(password_), awaiting_pass_reply);
+	
+	if (!features_known_)
+		send_command(commands::feat(), awaiting_feat_reply);
+	
+	reset_directory_list();
+	send_command(commands::stat_l(), awaiting_stat_l_reply);
+}
+
+bool client::retry_in_lockstep(const server_reply & reply)
+{
+	// Some servers choke on commands that arrive before they've answered the
+	// last one, and answer them with a syntax or bad sequence error (500-504)
+	// instead. If that happens, stop pipelining, skip the replies to anything
+	// else we'd already sent, and send this command again on its own. Later
+	// handlers notice there's nothing pending and carry on one at a time.
+	if (!pipelining_)
+		return false;
+	
+	if (reply.get_reply_code() / 10 != 50)
+		return false;
+	
+	const string & line = reply.original_line();
+	
+	trace_this_at(warning, client,
+		("client falling back to lockstep commands after \"%s\"",
+		line.c_str()));
+	
+	log_.add_line("Server can't handle pipelined commands, sending them one "
+		"at a time.");
+	
+	pipelining_ = false;
+	
+	state_type state = state_;
+	string command;
+	command.swap(current_command_);
+	
+	discard_replies();
+	send_command(command, state);
+	next_reply();
+	
+	return true;
+}
+
+void client::discard_replies()
+{
+	if (awaiting_reply())
+		state_ = awaiting_discarded_reply;
+	
+	for (deque<pair<state_type, string> >::iterator pending =
+		pending_replies_.begin(); pending != pending_replies_.end(); pending++)
+		pending->first = awaiting_discarded_reply;
+}
+
+void client::finish_fxp_passive(const tcp::endpoint & endpoint)
+{
+	string error;
+	error.swap(fxp_error_);
+	
+	if (error.empty())
+		passive_mode_entered(*this, endpoint);
+	else
+		transfer_failed(*this, error);
+	
+	if (!is_busy())
+		idle(*this);
+}
+
+void client::finish_fxp_transfer()
+{
+	string path = fxp_paths_.front();
+	fxp_paths_.pop_front();
+	
+	string error;
+	error.swap(fxp_error_);
+	
+	if (error.empty())
+	{
+		trace_this_at(info, client, ("client FXP transfer of %s complete",
+			path.c_str()));
+	
+		transfer_completed(*this, path);
+	}
+	else
+	{
+		trace_this_at(warning, client, ("client FXP transfer of %s failed: %s",
+			path.c_str(), error.c_str()));
+	
+		transfer_failed(*this, error);
+	}
+	
+	if (!is_busy())
+		idle(*this);
+}
+
+void client::reset_directory_list()
+{
+	// Reset the parser so hh:mm entries are dated relative to today.
+	directory_list_parser_ = list_parser();
+	directory_list_size_ = 0;
+	directory_list_lines_ = 0;
+}
+
+bool client::caching_listings() const
+{
+	// Streamed listings are for ones too big to hold on to.
+	return listings_.max_bytes() != 0 && directory_list_chunk_size_ == 0;
+}
+
+bool client::list_from_cache(const string & path)
+{
+	listing_path_ = listing_cache::absolute_path(working_directory_, path);
+	
+	if (!caching_listings() || listing_path_.empty())
+		return false;
+	
+	bool fresh;
+	const vector<file> * cached = listings_.find(listing_path_, fresh);
+	if (!cached)
+		return false;
+	
+	trace_this_at(info, client, ("client listing %s from cache (%s)",
+		listing_path_.c_str(), fresh ? "fresh" : "stale"));
+	
+	// Copied, as the cache may have changed by the time it's delivered (e.g.
+	// by a DELE sent in the meantime). Delivered from the strand like any
+	// other listing, rather than from inside this call.
+	cached_listing_ = *cached;
+	cached_listing_pending_ = true;
+	strand_.post(boost::bind(&client::deliver_cached_listing, this));
+	
+	if (!fresh)
+		return false;
+	
+	busy(*this);
+	return true;
+}
+
+void client::deliver_cached_listing()
+{
+	// Closed since.
+	if (!cached_listing_pending_)
+		return;
+	
+	cached_listing_pending_ = false;
+	
+	listing_from_cache_ = true;
+	received_directory_list(*this, cached_listing_);
+	listing_from_cache_ = false;
+	
+	vector<file>().swap(cached_listing_);
+	
+	if (!is_busy())
+		idle(*this);
+}
+
+void client::invalidate_listings(const string & path)
+{
+	// The listing path is in, and its own if it's a directory.
+	string absolute = listing_cache::absolute_path(working_directory_, path);
+	
+	if (absolute.empty())
+	{
+		// No telling which, so none of them.
+		listings_.clear();
+		return;
+	}
+	
+	listings_.invalidate(absolute);
+	listings_.invalidate(listing_cache::parent_path(absolute));
+}
+
+string client::passive_command() const
+{
+	// IPv6 servers can't give us an address with PASV, so use EPSV there, and
+	// wherever the server has it: the reply is simpler, and survives NAT.
+	if (control_stream_.remote_address().is_v6() || has_feature("EPSV"))
+		return commands::epsv();
+	
+	return commands::pasv();
+}
+
+void client::send_transfer_command()
+{
+	if (transfer_listing_)
+		send_command(transfer_path_.empty() ? commands::mlsd() :
+			commands::mlsd(transfer_path_), awaiting_transfer_reply);
+	else if (transfer_upload_)
+		send_command(commands::stor(transfer_path_), awaiting_transfer_reply);
+	else
+		send_command(commands::retr(transfer_path_), awaiting_transfer_reply);
+}
+
+void client::start_data_transfer()
+{
+	if (transfer_listing_)
+		data_stream_.begin_receive();
+	else if (transfer_upload_)
+		data_stream_.begin_upload(transfer_fd_);
+	else if (ranged_)
+		data_stream_.begin_download(transfer_fd_, range_offset_,
+			range_length_);
+	else
+		data_stream_.begin_download(transfer_fd_);
+}
+
+void client::finish_transfer()
+{
+	if (journaling_)
+	{
+		if (transfer_error_.empty())
+			journal_->complete(journal_id_);
+		else
+		{
+			// Keep what we have for next time, and make sure it's on disk.
+			checkpoint_transfer();
+			
+			try
+			{
+				journal_->flush();
+			}
+			catch (const runtime_error & ex)
+			{
+				trace_this_at(warning, client,
+					("client could not flush journal: %s", ex.what()));
+			}
+		}
+		
+		journaling_ = false;
+	}
+	
+	if (transfer_fd_ != -1)
+	{
+		::close(transfer_fd_);
+		transfer_fd_ = -1;
+	}
+	
+	if (state_ == transferring)
+		state_ = logged_in;
+	
+	if (transfer_listing_)
+	{
+		finish_machine_list();
+		return;
+	}
+	
+	if (transfer_error_.empty())
+	{
+		trace_this_at(info, client, ("client transferred %s (%lu bytes)",
+			transfer_path_.c_str(),
+			static_cast<unsigned long>(data_stream_.bytes_transferred())));
+		
+		transfer_completed(*this, transfer_path_);
+	}
+	else
+	{
+		trace_this_at(warning, client, ("client transfer of %s failed: %s",
+			transfer_path_.c_str(), transfer_error_.c_str()));
+		
+		transfer_failed(*this, transfer_error_);
+	}
+	
+	if (!is_busy())
+		idle(*this);
+}
+
+boost::uint64_t client::resume_offset(int fd, const string & key,
+	const string & local_path, boost::uint64_t size)
+{
+	transfer_journal::entry unfinished;
+	if (!journal_->find(key, local_path, unfinished))
+		return 0;
+	
+	if (unfinished.size != 0 && size != 0 && unfinished.size != size)
+	{
+		trace_this_at(info, client,
+			("client not resuming %s: remote file has changed",
+			local_path.c_str()));
+		
+		// Drop the old record, so the new one has the new size.
+		journal_->complete(unfinished.id);
+		return 0;
+	}
+	
+	if (unfinished.offset == 0)
+		return 0;
+	
+	struct stat status;
+	if (::fstat(fd, &status) != 0 ||
+		static_cast<boost::uint64_t>(status.st_size) < unfinished.offset)
+	{
+		trace_this_at(info, client, ("client not resuming %s: file is short",
+			local_path.c_str()));
+		return 0;
+	}
+	
+	boost::uint32_t checksum;
+	if (unfinished.has_checksum &&
+		(!transfer_journal::tail_checksum(fd, unfinished.offset, checksum) ||
+		checksum != unfinished.checksum))
+	{
+		trace_this_at(info, client, ("client not resuming %s: file has changed",
+			local_path.c_str()));
+		return 0;
+	}
+	
+	return unfinished.offset;
+}
+
+void client::checkpoint_transfer()
+{
+	// The journal's word that the data is there is only as good as ours.
+	if (::fdatasync(transfer_fd_) != 0)
+	{
+		trace_this_at(warning, client, ("client could not sync %s: %s",
+			transfer_path_.c_str(), strerror(errno)));
+		return;
+	}
+	
+	boost::uint64_t offset = range_offset_ + bytes_transferred();
+	
+	boost::uint32_t checksum;
+	if (transfer_journal::tail_checksum(transfer_fd_, offset, checksum))
+		journal_->checkpoint(journal_id_, offset, checksum);
+	else
+		journal_->checkpoint(journal_id_, offset);
+}
+
+string client::journal_key(const string & remote_path) const
+{
+	string key = format(256, "ftp://%s@%s:%i", username_.c_str(),
+		control_stream_.host().c_str(), control_stream_.port());
+	
+	if (remote_path.empty() || remote_path[0] != '/')
+	{
+		key += working_directory_;
+		if (key[key.size() - 1] != '/')
+			key += '/';
+	}
+	
+	return key + remote_path;
+}
+
+void client::begin_machine_list(const string & path)
+{
+	reset_directory_list();
+	machine_list_line_.clear();
+	
+	// An empty path lists the working directory.
+	begin_transfer(path, -1, false);
+	transfer_listing_ = true;
+}
+
+bool client::add_machine_list_entry(const string & line)
+{
+	// As add_directory_list_entry(), but a bad entry only fails the listing:
+	// the control connection is still in step.
+	if (line.empty() || (line.length() == 1 && line[0] == '\r'))
+		return true;
+	
+	if (directory_list_size_ == directory_list_.size())
+		directory_list_.resize(directory_list_size_ + 1);
+	
+	try
+	{
+		if (!machine_list_parser_.parse_line(line,
+			directory_list_[directory_list_size_]))
+			// . or ..
+			return true;
+	}
+	catch (const runtime_error & ex)
+	{
+		transfer_error_ = "Could not parse directory list entry '" + line +
+			"': " + ex.what();
+		return false;
+	}
+	
+	if (++directory_list_size_ == directory_list_chunk_size_)
+		flush_directory_list_entries();
+	
+	return true;
+}
+
+void client::finish_machine_list()
+{
+	// The last line may not have had a line break.
+	if (transfer_error_.empty() && !machine_list_line_.empty())
+		add_machine_list_entry(machine_list_line_);
+	
+	machine_list_line_.clear();
+	transfer_listing_ = false;
+	
+	if (transfer_error_.empty())
+	{
+		trace_this_at(info, client, ("received machine directory list"));
+		deliver_directory_list();
+	}
+	else
+	{
+		trace_this_at(info, client, ("could not get machine directory list: %s",
+			transfer_error_.c_str()));
+		
+		listings_.invalidate(listing_path_);
+		
+		directory_list_failed(*this, transfer_error_);
+	}
+	
+	if (!is_busy())
+		idle(*this);
+}
+
+void client::deliver_directory_list()
+{
+	// All done! Notify any subscribers that we've received a directory list.
+	if (directory_list_chunk_size_ != 0)
+	{
+		// Deliver the last partial chunk.
+		flush_directory_list_entries();
+		directory_entries_completed(*this);
+	}
+	else
+	{
+		directory_list_.resize(directory_list_size_);
+		
+		if (caching_listings() && !listing_path_.empty())
+			listings_.insert(listing_path_, directory_list_);
+		
+		received_directory_list(*this, directory_list_);
+		
+		// Don't hang on to the memory of large listings.
+		vector<file>().swap(directory_list_);
+		directory_list_size_ = 0;
+	}
+}
+
+bool client::add_directory_list_entry(const string & line)
+{
+	// Parse into the next free record. In streaming mode the records of the
+	// previous chunk are reused, along with their name buffers.
+	if (directory_list_size_ == directory_list_.size())
+		directory_list_.resize(directory_list_size_ + 1);
+	
+	try
+	{
+		if (!directory_list_parser_.parse_line(line,
+			directory_list_[directory_list_size_]))
+			// "total 1234" line.
+			return true;
+	}
+	catch (const runtime_error & ex)
+	{
+		fatal_error_occurred(*this, "Could not parse directory list entry '" +
+			line + "': " + ex.what());
+		return false;
+	}
+	
+	if (++directory_list_size_ == directory_list_chunk_size_)
+		flush_directory_list_entries();
+	
+	return true;
+}
+
+void client::flush_directory_list_entries()
+{
+	if (directory_list_size_ == 0)
+		return;
+	
+	trace_this_at(debug, client,
+		("client delivering %lu directory list entries",
+		static_cast<unsigned long>(directory_list_size_)));
+	
+	vector<file>::const_iterator begin = directory_list_.begin();
+	directory_entries_received(*this,
+		file_range(begin, begin + directory_list_size_));
+	
+	directory_list_size_ = 0;
+}
+
+void client::send_command(const string & command, state_type state)
+{
+	trace_this_at(debug, client, ("client sending command \"%s\"",
+		command.c_str()));
+	
+	log_.add_line(">>> " + command);
+	
+	control_stream_.begin_send_command(command);
+	
+	control_stream_.begin_read_line();
+	
+	if (awaiting_reply())
+		// Still waiting on an earlier reply.
+		pending_replies_.push_back(make_pair(state, command));
+	else
+	{
+		state_ = state;
+		current_command_ = command;
+	}
 }
 
 } // namespace ftp
@@ -1,17 +1,27 @@
 #ifndef FOOFXP_CLIENT_HPP_INCLUDED
 #define FOOFXP_CLIENT_HPP_INCLUDED
 
+#include <deque>
 #include <string>
+#include <utility>
 #include <vector>
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
+#include <boost/range/iterator_range.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/thread_safe_signal.hpp>
 #include "../file.hpp"
 #include "port_type.hpp"
 #include "control_stream.hpp"
+#include "data_stream.hpp"
+#include "feature_cache.hpp"
+#include "list_parser.hpp"
+#include "listing_cache.hpp"
 #include "../logger.hpp"
+#include "mlsx_parser.hpp"
+#include "reply_assembler.hpp"
 #include "server_reply.hpp"
+#include "transfer_journal.hpp"
 
 namespace foofxp {
 namespace model {
@@ -30,10 +40,26 @@ public:
 		awaiting_pbsz_reply,
 		awaiting_user_reply,
 		awaiting_pass_reply,
+		awaiting_feat_reply,
 		logged_in,
 		awaiting_cwd_reply,
 		awaiting_pwd_reply,
-		awaiting_stat_l_reply
+		awaiting_stat_l_reply,
+		awaiting_noop_reply,
+		awaiting_dele_reply,
+		awaiting_mkd_reply,
+		awaiting_prot_reply,
+		awaiting_type_reply,
+		awaiting_pasv_reply,
+		awaiting_rest_reply,
+		awaiting_transfer_reply,
+		transferring,
+		awaiting_fxp_type_reply,
+		awaiting_fxp_sscn_reply,
+		awaiting_fxp_pasv_reply,
+		awaiting_fxp_port_reply,
+		awaiting_fxp_transfer_reply,
+		awaiting_discarded_reply
 	}
 	state_type;
 	
@@ -52,6 +78,13 @@ public:
 	typedef boost::signal<void(client & client, 
 		const std::vector<file> & files)>
 		received_directory_list_event;
+	typedef boost::iterator_range<std::vector<file>::const_iterator>
+		file_range;
+	typedef boost::signal<void(client & client, const file_range & files)>
+		directory_entries_received_event;
+	typedef boost::signal<void(client & client,
+		const boost::asio::ip::tcp::endpoint & endpoint)>
+		client_endpoint_event;
 	
 	client_event idle;
 	client_event busy;
@@ -60,46 +93,399 @@ public:
 	client_changed_directory_event changed_directory;
 	client_error_event change_directory_failed;
 	received_directory_list_event received_directory_list;
+	directory_entries_received_event directory_entries_received;
+	client_event directory_entries_completed;
+	client_error_event directory_list_failed;
+	client_changed_directory_event transfer_started;
+	client_changed_directory_event transfer_completed;
+	client_error_event transfer_failed;
+	client_endpoint_event passive_mode_entered;
+	client_changed_directory_event deleted;
+	client_error_event delete_failed;
+	client_changed_directory_event made_directory;
+	client_error_event make_directory_failed;
 	
 	const logger & log() const { return log_; };
 	logger & log() { return log_; };
 	
+	// The client's handlers all run on this strand, and so do its signals. If
+	// the io_service is run by more than one thread, the begin_*() operations
+	// must be called from it too, e.g. via strand().post().
+	boost::asio::io_service::strand & strand() { return strand_; };
+	
+	// Whether the client's connections still have completion handlers to run
+	// (cancelled ones included). A closed client can only be destroyed once
+	// this is false; ask from the strand.
+	bool operations_pending() const
+	{
+		return control_stream_.operations_pending() ||
+			data_stream_.operations_pending();
+	};
+	
+	bool is_busy() const
+	{
+		return state_ != logged_in || cached_listing_pending_;
+	};
+	
+	// By default directory lists are delivered whole, via
+	// received_directory_list. With a non-zero chunk size they are streamed
+	// instead: directory_entries_received fires for every chunk_size entries
+	// parsed, and directory_entries_completed once the list is done, so memory
+	// use is bounded by the chunk size rather than the size of the listing.
+	void stream_directory_lists(std::size_t chunk_size)
+	{
+		directory_list_chunk_size_ = chunk_size;
+	};
+	
+	std::size_t directory_list_chunk_size() const
+	{
+		return directory_list_chunk_size_;
+	};
+	
+	// Encrypt data connections as well (PROT P). Only applies to AUTH TLS
+	// sessions, and has to be set before connecting.
+	void protect_data(bool protect_data) { protect_data_ = protect_data; };
+	bool protect_data() const { return protect_data_; };
+	
+	// Send commands whose replies we can predict (USER/PASS, CWD/PWD,
+	// TYPE/PASV) back to back rather than waiting for each reply. On by
+	// default; switches itself off for the rest of the session if the server
+	// answers a pipelined command with a syntax or bad sequence error.
+	void pipeline_commands(bool pipeline) { pipelining_ = pipeline; };
+	bool pipeline_commands() const { return pipelining_; };
+	
+	// Whether the server listed feature (e.g. "MLST") in its reply to FEAT,
+	// which is sent on logging in unless the server's features are already
+	// in capabilities(). Case-insensitive.
+	bool has_feature(const std::string & feature) const;
+	
+	// Where FEAT replies are kept from one session to the next; by default
+	// feature_cache::shared(). 0 asks every time. Takes effect on connecting.
+	void capabilities(feature_cache * cache) { feature_cache_ = cache; };
+	feature_cache * capabilities() const { return feature_cache_; };
+	
+	// List directories with MLSD rather than STAT -l where the server supports
+	// it. MLSD needs a data connection, so costs a round trip or two more, but
+	// gives exact sizes and UTC times instead of ls-style guesses. On by
+	// default; the first list after logging in always uses STAT -l, as it goes
+	// out before the reply to FEAT is back.
+	void machine_listings(bool machine) { machine_listings_ = machine; };
+	bool machine_listings() const { return machine_listings_; };
+	
+	// Keep up to max_bytes of the listings fetched this session, by absolute
+	// path, so going back to a directory doesn't wait on the server. A
+	// listing younger than ttl is delivered from the cache alone; an older one
+	// is delivered from the cache straight away, and then again once the
+	// server has sent a new one -- listing_from_cache() tells the two apart.
+	// Our own STOR, DELE and MKD drop the listings they change.
+	//
+	// Only whole listings are cached (not streamed ones), and only once the
+	// working directory is known, i.e. after a PWD. Off (0 bytes) by default.
+	void cache_listings(std::size_t max_bytes,
+		const boost::posix_time::time_duration & ttl)
+	{
+		listings_.max_bytes(max_bytes);
+		listings_.ttl(ttl);
+	};
+	
+	listing_cache & listings() { return listings_; };
+	
+	// True while received_directory_list is delivering a cached listing.
+	bool listing_from_cache() const { return listing_from_cache_; };
+	
+	// The absolute path of the listing being delivered, whether from the
+	// cache or the server. Empty if the working directory wasn't known when
+	// it was asked for, as for the listing sent with the login.
+	const std::string & listing_path() const { return listing_path_; };
+	
+	// For FXP between two servers that both protect data (PROT P), one of
+	// them has to handshake as the TLS client on the data connection. Setting
+	// this has FXP operations from now on ask this server to (SSCN ON); it
+	// must have listed SSCN. Typically set by fxp_job.
+	void fxp_tls_client(bool tls_client) { fxp_tls_client_ = tls_client; };
+	bool fxp_tls_client() const { return fxp_tls_client_; };
+	
+	// Plain data connections use zero-copy I/O where the platform has it.
+	void zero_copy_transfers(bool zero_copy)
+	{
+		data_stream_.zero_copy(zero_copy);
+	};
+	
+	// Progress of the current (or last) transfer. Nothing has moved until the
+	// server opens the data connection (150).
+	boost::uint64_t bytes_transferred() const
+	{
+		if (transfer_fd_ != -1 && !transfer_started_)
+			return 0;
+		
+		return data_stream_.bytes_transferred();
+	};
+	
+	// Record the progress of downloads in journal, and pick up where an
+	// unfinished one left off rather than starting again. The journal must
+	// outlive the client, and can be shared between clients. None by default.
+	void journal(transfer_journal * journal) { journal_ = journal; };
+	transfer_journal * journal() const { return journal_; };
+	
+	// How often, in bytes, a journaled download syncs the local file and
+	// records a checkpoint. Default 32 MB.
+	void checkpoint_bytes(boost::uint64_t bytes) { checkpoint_bytes_ = bytes; };
+	boost::uint64_t checkpoint_bytes() const { return checkpoint_bytes_; };
+	
 	void begin_connect();
 	void begin_change_directory(const std::string & directory);
 	void begin_get_directory_contents();
+	
+	// Lists path (STAT -l <path>) without changing directory, so there's no
+	// CWD/PWD round trip. The list is delivered the same way as above, or
+	// directory_list_failed fires if the server refuses.
+	void begin_get_directory_contents(const std::string & path);
+	
 	void begin_close();
 	
+	// DELE path; deleted or delete_failed fires.
+	void begin_delete(const std::string & path);
+	
+	// MKD path; made_directory or make_directory_failed fires.
+	void begin_make_directory(const std::string & path);
+	
+	// Sends a NOOP so the server doesn't drop an idle session. Does nothing
+	// unless the client is logged in and idle.
+	void begin_keep_alive();
+	
+	// Binary mode passive transfers. local_path is overwritten by a download,
+	// unless the journal has an unfinished download of the same file to it
+	// that still matches what's there, in which case it's resumed (REST).
+	// size is the remote file's, if known (from its listing): the journal
+	// keeps it, and a file that has changed size since isn't resumed.
+	// transfer_completed or transfer_failed fires when the transfer is done.
+	void begin_download(const std::string & remote_path,
+		const std::string & local_path, boost::uint64_t size = 0);
+	void begin_upload(const std::string & local_path,
+		const std::string & remote_path);
+	
+	// Download length bytes of remote_path, starting at offset (REST), into
+	// the same place in fd. A length of 0 runs to the end of the file. fd is
+	// left open and its position alone, so several clients can download parts
+	// of one file at once; see segmented_download.
+	//
+	// Once the range is in, the data connection is closed and the rest of the
+	// transfer aborted (ABOR), with the server's 426 counting as success.
+	void begin_download_range(const std::string & remote_path, int fd,
+		boost::uint64_t offset, boost::uint64_t length);
+	
+	// Bring the end of the range being downloaded forward, so another client
+	// can take over the rest. Ignored unless it makes the range shorter. The
+	// part already downloaded may run past the new end.
+	void shrink_download_range(boost::uint64_t length);
+	
+	// Site-to-site (FXP) operations, where the data connection runs between
+	// two servers rather than through us. Typically used through fxp_job.
+	//
+	// These may be called while earlier FXP operations are still waiting for
+	// their replies: the commands go out straight away, and the replies are
+	// matched up in order. Each operation reports back exactly once:
+	//
+	//    begin_fxp_passive()   passive_mode_entered or transfer_failed
+	//    begin_fxp_store()     transfer_completed or transfer_failed
+	//    begin_fxp_retrieve()  transfer_completed or transfer_failed
+	//
+	// and transfer_started fires when the server opens the data connection.
+	void begin_fxp_passive();
+	void begin_fxp_store(const std::string & path);
+	void begin_fxp_retrieve(const boost::asio::ip::tcp::endpoint & endpoint,
+		const std::string & path);
+	
+	// Abort the FXP transfer of path (ABOR), e.g. a STOR whose source has
+	// failed, rather than wait for the server to give up on the data
+	// connection. It still reports back as usual, normally with
+	// transfer_failed. Ignored unless its reply is the one due next.
+	void begin_fxp_abort(const std::string & path);
+	
 	void handle_connect();
 	void handle_line_received(const std::string & line);
 	void handle_control_stream_error(const std::string & message, bool fatal);
 	void handle_handshake();
 	
+	void handle_data_connect();
+	void handle_data_transfer_complete();
+	void handle_data_stream_error(const std::string & message);
+	void handle_data_progress();
+	void handle_data_received(const char * data, std::size_t length);
+	
 private:
 	
-	bool handle_basic_reply_details(const server_reply & reply);
+	// One entry per state, in state_type order. See client.cpp.
+	typedef void (client::*reply_handler)(const server_reply & reply);
+	typedef void (client::*line_handler)(const std::string & line);
+	
+	struct transition
+	{
+		state_type state;
+		
+		// Final 2xx/3xx reply. Null if the state isn't waiting on a reply.
+		reply_handler positive;
+		
+		// Final 4xx/5xx reply. Null for fatal.
+		reply_handler negative;
+		
+		// 1xx reply. Null to wait for the final one regardless.
+		reply_handler preliminary;
+		
+		// A line in the middle of a multi-line reply, e.g. a STAT -l entry.
+		// Null to keep it with the rest of the reply.
+		line_handler interior;
+		
+		// Send the command again on its own if it gets a syntax or bad
+		// sequence error while pipelining.
+		bool resend_if_rejected;
+	};
+	
+	static const transition transitions_[];
 	
 	void handle_welcome_message(const server_reply & reply);
 	void handle_auth_tls_reply(const server_reply & reply);
 	void handle_pbsz_reply(const server_reply & reply);
 	void handle_user_reply(const server_reply & reply);
 	void handle_pass_reply(const server_reply & reply);
+	void handle_feat_reply(const server_reply & reply);
 	void handle_cwd_reply(const server_reply & reply);
+	void handle_cwd_failed(const server_reply & reply);
 	void handle_pwd_reply(const server_reply & reply);
+	void handle_stat_l_entry(const std::string & line);
 	void handle_stat_l_reply(const server_reply & reply);
+	void handle_stat_l_failed(const server_reply & reply);
+	void handle_noop_reply(const server_reply & reply);
+	void handle_dele_reply(const server_reply & reply);
+	void handle_dele_failed(const server_reply & reply);
+	void handle_mkd_reply(const server_reply & reply);
+	void handle_mkd_failed(const server_reply & reply);
+	void handle_prot_reply(const server_reply & reply);
+	void handle_type_reply(const server_reply & reply);
+	void handle_pasv_reply(const server_reply & reply);
+	void handle_rest_reply(const server_reply & reply);
+	void handle_rest_failed(const server_reply & reply);
+	void handle_transfer_started(const server_reply & reply);
+	void handle_transfer_reply(const server_reply & reply);
+	void handle_transfer_failed(const server_reply & reply);
+	void handle_discarded_reply(const server_reply & reply);
+	void handle_discarded_line(const std::string & line);
+	
+	void handle_fxp_setup_reply(const server_reply & reply);
+	void handle_fxp_type_failed(const server_reply & reply);
+	void handle_fxp_sscn_failed(const server_reply & reply);
+	void handle_fxp_error(const server_reply & reply);
+	void handle_fxp_pasv_reply(const server_reply & reply);
+	void handle_fxp_pasv_failed(const server_reply & reply);
+	void handle_fxp_transfer_started(const server_reply & reply);
+	void handle_fxp_transfer_reply(const server_reply & reply);
+	void handle_fxp_transfer_failed(const server_reply & reply);
+	
+	void begin_transfer(const std::string & remote_path, int fd, bool upload);
+	void send_transfer_command();
+	void start_data_transfer();
+	void finish_transfer();
+	
+	boost::uint64_t resume_offset(int fd, const std::string & key,
+		const std::string & local_path, boost::uint64_t size);
+	void checkpoint_transfer();
+	std::string journal_key(const std::string & remote_path) const;
+	
+	void begin_fxp_operation();
+	bool in_fxp_operation() const;
+	void finish_fxp_passive(const boost::asio::ip::tcp::endpoint & endpoint);
+	void finish_fxp_transfer();
+	
+	bool awaiting_reply() const;
+	void next_reply();
+	void pipeline_login();
+	bool retry_in_lockstep(const server_reply & reply);
+	void discard_replies();
+	
+	void reset_directory_list();
+	bool caching_listings() const;
+	bool list_from_cache(const std::string & path);
+	void deliver_cached_listing();
+	void invalidate_listings(const std::string & path);
+	std::string passive_command() const;
 	
 	void handle_unexpected_message(const server_reply & reply);
 	
-	inline void send_command(const std::string & command);
+	bool add_directory_list_entry(const std::string & line);
+	void flush_directory_list_entries();
+	void deliver_directory_list();
+	
+	void begin_machine_list(const std::string & path);
+	bool add_machine_list_entry(const std::string & line);
+	void finish_machine_list();
+	
+	// Sends a command whose reply is handled in the given state. If an earlier
+	// reply is still outstanding, that state waits its turn.
+	void send_command(const std::string & command, state_type state);
 	
 	state_type state_;
 	
 	bool auth_tls_;
+	bool protect_data_;
+	bool pipelining_;
 	std::string username_;
 	std::string password_;
 	
-	std::vector<std::string> directory_list_output_buffer_;
+	feature_cache * feature_cache_;
+	feature_cache::feature_set features_;
+	bool features_known_;
+	bool machine_listings_;
+	
+	list_parser directory_list_parser_;
+	mlsx_parser machine_list_parser_;
+	std::string machine_list_line_;
+	std::vector<file> directory_list_;
+	std::vector<file>::size_type directory_list_size_;
+	std::size_t directory_list_lines_;
+	std::size_t directory_list_chunk_size_;
+	
+	listing_cache listings_;
+	std::string listing_path_;
+	std::vector<file> cached_listing_;
+	bool cached_listing_pending_;
+	bool listing_from_cache_;
+	
+	std::string transfer_path_;
+	int transfer_fd_;
+	bool transfer_upload_;
+	bool transfer_listing_;
+	bool data_connected_;
+	bool data_done_;
+	bool transfer_started_;
+	bool transfer_reply_received_;
+	std::string transfer_error_;
+	bool ranged_;
+	bool range_aborted_;
+	boost::uint64_t range_offset_;
+	boost::uint64_t range_length_;
+	
+	transfer_journal * journal_;
+	transfer_journal::id_type journal_id_;
+	bool journaling_;
+	boost::uint64_t checkpoint_bytes_;
+	boost::uint64_t next_checkpoint_;
+	std::string working_directory_;
+	
+	// The command state_ is waiting on the reply to, and the replies still to
+	// come for commands sent while it was, in the order the commands went out.
+	std::string current_command_;
+	std::deque<std::pair<state_type, std::string> > pending_replies_;
+	reply_assembler replies_;
+	std::deque<std::string> fxp_paths_;
+	std::deque<std::string> operation_paths_;
+	std::string fxp_error_;
+	bool binary_mode_;
+	bool fxp_tls_client_;
+	bool sscn_on_;
 	
+	boost::asio::io_service::strand strand_;
 	ftp::control_stream<client> control_stream_;
+	ftp::data_stream<client> data_stream_;
 	logger log_;
 	
 }; // class client
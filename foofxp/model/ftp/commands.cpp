@@ -2,6 +2,8 @@
 #include "../../utility/enforce_that.hpp"
 #include "../../utility/format.hpp"
 
+using boost::asio::ip::address_v4;
+using boost::asio::ip::tcp;
 using std::invalid_argument;
 using std::size_t;
 using std::string;
@@ -12,6 +14,8 @@ namespace model {
 namespace ftp {
 namespace commands {
 
+string abor() { return "ABOR"; }
+
 string auth_tls() { return "AUTH TLS"; }
 
 string cwd(const string & path)
@@ -34,6 +38,18 @@ string dele(const string & path) throw (invalid_argument)
 	return format(size, command_format, path.c_str());
 }
 
+string eprt(const tcp::endpoint & endpoint)
+{
+	// E.g. EPRT |2|::1|1234| -- net-prt 1 is IPv4, 2 is IPv6.
+	string address = endpoint.address().to_string();
+	
+	return format(address.length() + 32, "EPRT |%d|%s|%u|",
+		endpoint.address().is_v6() ? 2 : 1, address.c_str(),
+		static_cast<unsigned int>(endpoint.port()));
+}
+
+string epsv() { return "EPSV"; }
+
 string feat() { return "FEAT"; }
 
 string mkdir(const string & path) throw (invalid_argument)
@@ -46,6 +62,20 @@ string mkdir(const string & path) throw (invalid_argument)
 	return format(size, command_format, path.c_str());
 }
 
+string mlsd() { return "MLSD"; }
+
+string mlsd(const string & path) throw (invalid_argument)
+{
+	enforce_that(!path.empty(), invalid_argument, "Empty path.");
+	
+	string command_format = "MLSD %s";
+	size_t size = command_format.length() + path.length();
+	
+	return format(size, command_format, path.c_str());
+}
+
+string noop() { return "NOOP"; }
+
 string pass(const string & password) throw (invalid_argument)
 {
 	enforce_that(!password.empty(), invalid_argument, "Empty password.");
@@ -64,8 +94,38 @@ string pbsz()
 	return "PBSZ 0";
 }
 
+string port(const tcp::endpoint & endpoint) throw (invalid_argument)
+{
+	enforce_that(endpoint.address().is_v4(), invalid_argument,
+		"PORT only takes IPv4 addresses.");
+	
+	// E.g. PORT 127,0,0,1,4,210
+	address_v4::bytes_type address = endpoint.address().to_v4().to_bytes();
+	unsigned int port = endpoint.port();
+	
+	return format(64, "PORT %u,%u,%u,%u,%u,%u", address[0], address[1],
+		address[2], address[3], port / 256, port % 256);
+}
+
+string prot_p() { return "PROT P"; }
+
 string pwd() { return "PWD"; }
 
+string rest(boost::uint64_t offset)
+{
+	return format(32, "REST %llu", static_cast<unsigned long long>(offset));
+}
+
+string retr(const string & path) throw (invalid_argument)
+{
+	enforce_that(!path.empty(), invalid_argument, "Empty path.");
+	
+	string command_format = "RETR %s";
+	size_t size = command_format.length() + path.length();
+	
+	return format(size, command_format, path.c_str());
+}
+
 string site(const string & command) throw (invalid_argument)
 {
 	enforce_that(!command.empty(), invalid_argument, "Empty command.");
@@ -76,8 +136,32 @@ string site(const string & command) throw (invalid_argument)
 	return format(size, command_format, command.c_str());
 }
 
+string sscn(bool client) { return client ? "SSCN ON" : "SSCN OFF"; }
+
 string stat_l() { return "STAT -l"; }
 
+string stat_l(const string & path) throw (invalid_argument)
+{
+	enforce_that(!path.empty(), invalid_argument, "Empty path.");
+	
+	string command_format = "STAT -l %s";
+	size_t size = command_format.length() + path.length();
+	
+	return format(size, command_format, path.c_str());
+}
+
+string stor(const string & path) throw (invalid_argument)
+{
+	enforce_that(!path.empty(), invalid_argument, "Empty path.");
+	
+	string command_format = "STOR %s";
+	size_t size = command_format.length() + path.length();
+	
+	return format(size, command_format, path.c_str());
+}
+
+string type_i() { return "TYPE I"; }
+
 string user(const string & username) throw (invalid_argument)
 {
 	enforce_that(!username.empty(), invalid_argument, "Empty username.");
@@ -3,23 +3,40 @@
 
 #include <stdexcept>
 #include <string>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/cstdint.hpp>
 
 namespace foofxp {
 namespace model {
 namespace ftp {
 namespace commands {
 
+std::string abor();
 std::string auth_tls();
 std::string cwd(const std::string & path);
 std::string dele(const std::string & path) throw (std::invalid_argument);
+std::string eprt(const boost::asio::ip::tcp::endpoint & endpoint);
+std::string epsv();
 std::string feat();
 std::string mkdir(const std::string & path) throw (std::invalid_argument);
+std::string mlsd();
+std::string mlsd(const std::string & path) throw (std::invalid_argument);
+std::string noop();
 std::string pass(const std::string & password) throw (std::invalid_argument);
 std::string pasv();
 std::string pbsz();
+std::string port(const boost::asio::ip::tcp::endpoint & endpoint)
+	throw (std::invalid_argument);
+std::string prot_p();
 std::string pwd();
+std::string rest(boost::uint64_t offset);
+std::string retr(const std::string & path) throw (std::invalid_argument);
 std::string site(const std::string & command) throw (std::invalid_argument);
+std::string sscn(bool client);
 std::string stat_l();
+std::string stat_l(const std::string & path) throw (std::invalid_argument);
+std::string stor(const std::string & path) throw (std::invalid_argument);
+std::string type_i();
 std::string user(const std::string & username) throw (std::invalid_argument);
 
 } // namespace commands
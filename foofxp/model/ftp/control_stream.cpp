@@ -1,15 +1,16 @@
 #include <algorithm>
+#include <cctype>
 #include <iostream>
-#include <istream>
-#include <boost/algorithm/string/trim.hpp>
+#include <unistd.h>
 #include "control_stream.hpp"
+#include "resolver_cache.hpp"
+#include "tls_session_cache.hpp"
 #include "../../utility/enforce_that.hpp"
 #include "../../utility/format.hpp"
 #include "../../utility/trace.hpp"
 #include "../../utility/asio.hpp"
 
 using namespace std;
-using namespace boost::algorithm;
 using namespace boost::asio;
 using namespace boost::asio::ip;
 using boost::bind;
@@ -23,26 +24,65 @@ namespace ftp {
 
 static const string end_of_line = "\r\n";
 
+// How long a connection attempt gets to itself before the next address is
+// tried alongside it (RFC 8305 section 5).
+static const long connection_attempt_delay_ms = 250;
+
+// Alternate between address families, starting with IPv6, but otherwise keep
+// the order the resolver put them in (RFC 8305 section 4).
+static void interleave_families(vector<tcp::endpoint> & endpoints)
+{
+	vector<tcp::endpoint> v6, v4;
+	for (vector<tcp::endpoint>::const_iterator i = endpoints.begin();
+		i != endpoints.end(); i++)
+		(i->address().is_v6() ? v6 : v4).push_back(*i);
+	
+	endpoints.clear();
+	for (size_t i = 0; i < max(v6.size(), v4.size()); i++)
+	{
+		if (i < v6.size())
+			endpoints.push_back(v6[i]);
+		if (i < v4.size())
+			endpoints.push_back(v4[i]);
+	}
+}
+
 template<class client_type>
 control_stream<client_type>::control_stream(client_type & client,
 	const string & host, port_type port, bool ipv6, io_service & io_service,
-	ssl::context & context, const time_duration & timeout) :
+	io_service::strand & strand, ssl::context & context,
+	const time_duration & timeout) :
 	client_(client),
 	host_(host),
 	port_(port),
 	ipv6_(ipv6),
 	encrypted_(false),
 	io_service_(io_service),
+	strand_(strand),
 	context_(context),
+	outgoing_(),
+	writing_(),
 	reply_(),
+	line_(),
+	read_requested_(false),
+	reading_(false),
+	dispatching_(false),
 	socket_(io_service),
 	stream_(socket_, context),
 	resolver_(io_service),
 	timeout_(timeout),
-	timer_(io_service)
+	timer_(io_service),
+	connecting_(false),
+	endpoints_(),
+	attempts_(),
+	next_attempt_(0),
+	attempts_pending_(0),
+	attempt_timer_(io_service),
+	operations_(new int(0))
 {
-	trace_this(format(128, "control_stream created for %s:%i (ipv6=%i)", 
-		host.c_str(), port, ipv6));
+	trace_this_at(info, control_stream,
+		("control_stream created for %s:%i (ipv6=%i)", host.c_str(), port,
+		ipv6));
 
 	enforce_that(!host_.empty(), runtime_error, "Empty host.");
 }
@@ -50,44 +90,71 @@ control_stream<client_type>::control_stream(client_type & client,
 template<class client_type>
 control_stream<client_type>::~control_stream() {}
 
+template<class client_type>
+string control_stream<client_type>::tls_session_key() const
+{
+	return format(256, "%s:%u", host_.c_str(),
+		static_cast<unsigned int>(port_));
+}
+
 template<class client_type>
 void control_stream<client_type>::begin_connect() throw (runtime_error)
 {
-	enforce_that(!socket_.is_open(), runtime_error, "Socket is already open.");
+	enforce_that(!socket_.is_open() && !connecting_, runtime_error,
+		"Socket is already open.");
+	
+	connecting_ = true;
 	
-	if (ipv6_)
+	if (resolver_cache::shared().find(host_, ipv6_, endpoints_))
 	{
-		trace_this("control_stream starting async_resolve \"" + host_ + 
-			"\" (ipv6)");
+		trace_this_at(info, control_stream,
+			("control_stream using cached endpoints for \"%s\"",
+			host_.c_str()));
 		
-		// v6 query (AAAA records).
-		tcp::resolver::query query(tcp::v6(), host_, string());
-
-		resolver_.async_resolve(query, 
-			bind(&control_stream::handle_resolve, this, placeholders::error, 
-				placeholders::iterator));
+		// Carry on through the strand, so the client doesn't hear back before
+		// this returns, just as if the host had been resolved.
+		strand_.post(bind(&control_stream::begin_attempts, this));
+		return;
 	}
-	else
-	{
-		trace_this("control_stream starting async_resolve \"" + host_ + 
-			"\" (ipv4)");
 	
-		// v4 query (A records).
-		tcp::resolver::query query(tcp::v4(), host_, string());
-
-		resolver_.async_resolve(query, 
-			bind(&control_stream::handle_resolve, this, placeholders::error,
-				placeholders::iterator));
-	}
+	trace_this_at(info, control_stream,
+		("control_stream starting async_resolve \"%s\" (%s)", host_.c_str(),
+		ipv6_ ? "ipv6 and ipv4" : "ipv4"));
+	
+	// With IPv6 on, look up both AAAA and A records and race them against
+	// each other, rather than give up on sites that are only reachable one
+	// way.
+	tcp::resolver::query query = ipv6_ ?
+		tcp::resolver::query(host_, string()) :
+		tcp::resolver::query(tcp::v4(), host_, string());
+	
+	resolver_.async_resolve(query, 
+		strand_.wrap(count_handler(bind(&control_stream::handle_resolve, this,
+			placeholders::error, placeholders::iterator), operations_)));
+	
+	begin_timeout();
 }
 
 template<class client_type>
 void control_stream<client_type>::disconnect()
 {
-	trace_this("control_stream disconnecting");
+	trace_this_at(info, control_stream, ("control_stream disconnecting"));
 	
 	// Cancel timeout.
 	timer_.cancel();
+	
+	// Give up on any connection still being made.
+	resolver_.cancel();
+	cancel_attempts();
+	
+	// Keep the TLS session resumable for the next connection.
+	if (encrypted_)
+		tls_session_cache::close_cleanly(native_ssl(stream_));
+	
+	// Forget any outstanding read request, and anything still to be sent.
+	read_requested_ = false;
+	outgoing_.clear();
+	writing_.clear();
 
 	// Close socket (cancels any remaining async operations).
 	socket_.close();
@@ -99,60 +166,140 @@ void control_stream<client_type>::begin_send_command(const string & cmd)
 {	
 	enforce_that(socket_.is_open(), runtime_error, "Socket is not open.");
 	
+	// Commands may be sent back to back without waiting for replies. Anything
+	// sent while a write is in progress is queued up and goes out in a single
+	// write after it, rather than as lots of little segments.
+	outgoing_ += cmd;
+	outgoing_ += end_of_line;
+	
+	if (writing_.empty())
+		begin_async_write();
+}
+
+template<class client_type>
+void control_stream<client_type>::begin_async_write()
+{
+	// Both buffers keep their capacity, so this doesn't allocate once the
+	// stream has warmed up.
+	writing_.swap(outgoing_);
+	outgoing_.clear();
+	
 	if (encrypted_)
 	{
-		trace_this("control_stream starting async_write \"" + cmd +
-			"\" (encrypted)");
+		trace_this_at(debug, control_stream,
+			("control_stream starting async_write (%lu bytes, encrypted)",
+			static_cast<unsigned long>(writing_.length())));
 		
-		async_write(stream_, buffer(cmd + end_of_line), 
-			bind(&control_stream::handle_write_line, this, placeholders::error,
-				placeholders::bytes_transferred));
+		async_write(stream_, buffer(writing_), 
+			strand_.wrap(count_handler(bind(&control_stream::handle_write_line,
+				this, placeholders::error, placeholders::bytes_transferred),
+				operations_)));
 	}
 	else
 	{
-		trace_this("control_stream starting async_write \"" + cmd + "\"");
+		trace_this_at(debug, control_stream,
+			("control_stream starting async_write (%lu bytes)",
+			static_cast<unsigned long>(writing_.length())));
 		
-		async_write(socket_, buffer(cmd + end_of_line), 
-			bind(&control_stream::handle_write_line, this, placeholders::error,
-				placeholders::bytes_transferred));
+		async_write(socket_, buffer(writing_), 
+			strand_.wrap(count_handler(bind(&control_stream::handle_write_line,
+				this, placeholders::error, placeholders::bytes_transferred),
+				operations_)));
 	}
 	
 	begin_timeout();
 }
 
 template<class client_type>
-void control_stream<client_type>::begin_connect(tcp::resolver::iterator
-	endpoint_iterator) throw (runtime_error)
+void control_stream<client_type>::begin_attempts()
 {
-	trace_this("control_stream starting async_connect");
+	if (!connecting_)
+		// Disconnected in the meantime.
+		return;
+	
+	enforce_that(!endpoints_.empty(), runtime_error, "No endpoints.");
+	
+	interleave_families(endpoints_);
+	
+	attempts_.assign(endpoints_.size(), socket_ptr());
+	next_attempt_ = 0;
+	attempts_pending_ = 0;
+	
+	begin_next_attempt();
+}
+
+template<class client_type>
+void control_stream<client_type>::begin_next_attempt()
+{
+	attempt_timer_.cancel();
 	
-	enforce_that(endpoint_iterator != tcp::resolver::iterator(), 
-		runtime_error, "Invalid endpoint_iterator.");
-	enforce_that(!socket_.is_open(), runtime_error, "Socket is already open.")
+	size_t attempt = next_attempt_++;
 	
-	tcp::endpoint remote_endpoint = *endpoint_iterator;
+	tcp::endpoint remote_endpoint = endpoints_[attempt];
 
 	// Set port.
 	remote_endpoint.port(port_);
+	
+	trace_this_at(debug, control_stream,
+		("control_stream starting async_connect to %s",
+		remote_endpoint.address().to_string().c_str()));
+	
+	socket_ptr socket(new tcp::socket(io_service_));
+	attempts_[attempt] = socket;
+	attempts_pending_++;
 
 	// Begin async connect.
-	socket_.async_connect(remote_endpoint,
-		bind(&control_stream::handle_connect, this, placeholders::error, 
-			++endpoint_iterator));
+	socket->async_connect(remote_endpoint,
+		strand_.wrap(count_handler(bind(&control_stream::handle_connect, this,
+			placeholders::error, attempt), operations_)));
+	
+	// If it hasn't connected by the time the delay is up, try the next
+	// address as well, and take whichever connects first.
+	if (next_attempt_ < endpoints_.size())
+	{
+		attempt_timer_.expires_from_now(
+			milliseconds(connection_attempt_delay_ms));
+		attempt_timer_.async_wait(strand_.wrap(count_handler(bind(
+			&control_stream::handle_attempt_timer, this, placeholders::error),
+			operations_)));
+	}
 
 	begin_timeout();
 }
 
+template<class client_type>
+void control_stream<client_type>::cancel_attempts()
+{
+	connecting_ = false;
+	attempt_timer_.cancel();
+	
+	for (typename vector<socket_ptr>::iterator attempt = attempts_.begin();
+		attempt != attempts_.end(); attempt++)
+		if (*attempt)
+			(*attempt)->close();
+	
+	attempts_.clear();
+	attempts_pending_ = 0;
+}
+
 template<class client_type>
 void control_stream<client_type>::begin_handshake() throw (runtime_error)
 {
-	trace_this("control_stream starting async_handshake");
+	trace_this_at(debug, control_stream,
+		("control_stream starting async_handshake"));
 	
 	enforce_that(socket_.is_open(), runtime_error, "Socket is not open.");
 	
+	// Pick up where the last connection to the site left off, if we can,
+	// and keep whatever session this one ends up with for the next.
+	tls_session_cache & sessions = tls_session_cache::shared();
+	sessions.resume(native_ssl(stream_), tls_session_key());
+	sessions.save_new_sessions(native_ssl(stream_), tls_session_key());
+	
 	// Begin async handshake.
 	stream_.async_handshake(ssl::stream_base::client,
-		bind(&control_stream::handle_handshake, this, placeholders::error));
+		strand_.wrap(count_handler(bind(&control_stream::handle_handshake, this,
+			placeholders::error), operations_)));
 }
 
 template<class client_type>
@@ -160,29 +307,108 @@ void control_stream<client_type>::begin_read_line() throw (runtime_error)
 {
 	enforce_that(socket_.is_open(), runtime_error, "Socket is not open.");
 	
+	read_requested_ = true;
+	
+	// If we're in the middle of handing buffered lines to the client, the
+	// dispatch loop will pick this request up. Otherwise, if the buffer already
+	// holds a complete line, hand it over without going back to the socket.
+	if (dispatching_ || reading_)
+		return;
+	
+	dispatch_lines();
+}
+
+template<class client_type>
+void control_stream<client_type>::begin_async_read_until()
+{
+	reading_ = true;
+	
 	if (encrypted_)
 	{
-		trace_this("control_stream waiting for a line (SSL stream)");
+		trace_this_at(debug, control_stream,
+			("control_stream waiting for a line (SSL stream)"));
 		
 		async_read_until(stream_, reply_, end_of_line,
-			bind(&control_stream::handle_read_line, this, placeholders::error));
+			strand_.wrap(count_handler(bind(&control_stream::handle_read_line,
+				this, placeholders::error), operations_)));
 	}
 	else
 	{
-		trace_this("control_stream waiting for a line (TCP socket)");
+		trace_this_at(debug, control_stream,
+			("control_stream waiting for a line (TCP socket)"));
 		
 		async_read_until(socket_, reply_, end_of_line,
-			bind(&control_stream::handle_read_line, this, placeholders::error));
+			strand_.wrap(count_handler(bind(&control_stream::handle_read_line,
+				this, placeholders::error), operations_)));
 	}
 	
 	// Note that read line cannot timeout. This is particularly
 	// useful for long-running SITE command e.g. dupecheck.
 }
 
+template<class client_type>
+bool control_stream<client_type>::extract_line(string & line)
+{
+	const char * begin = buffer_cast<const char *>(reply_.data());
+	const char * end = begin + reply_.size();
+	const char * eol = find(begin, end, '\n');
+	
+	if (eol == end)
+		// No complete lines left.
+		return false;
+	
+	// Trim any whitespace/new line crap off the end.
+	const char * last = eol;
+	while (last != begin && isspace(static_cast<unsigned char>(last[-1])))
+		--last;
+	
+	line.assign(begin, last);
+	reply_.consume(eol - begin + 1);
+	
+	return true;
+}
+
+template<class client_type>
+void control_stream<client_type>::dispatch_lines()
+{
+	// Hand every complete line already sitting in the reply buffer to the
+	// client, one at a time, for as long as it keeps asking for more. A
+	// multi-thousand line STAT -l reply that arrived in a handful of socket
+	// reads therefore costs a handful of handler dispatches rather than one
+	// per line.
+	dispatching_ = true;
+	
+	try
+	{
+		while (read_requested_ && socket_.is_open() && extract_line(line_))
+		{
+			read_requested_ = false;
+			
+			// Notify observers that we recieved a line.
+			client_.handle_line_received(line_);
+		}
+	}
+	catch (...)
+	{
+		dispatching_ = false;
+		throw;
+	}
+	
+	dispatching_ = false;
+	
+	// Buffer exhausted -- wait for more from the server.
+	if (read_requested_ && socket_.is_open())
+		begin_async_read_until();
+}
+
 template<class client_type>
 void control_stream<client_type>::handle_resolve(const error_code & error,
 		tcp::resolver::iterator endpoint_iterator) throw (runtime_error)
 {	
+	if (error == error::operation_aborted || !connecting_)
+		// Disconnected in the meantime.
+		return;
+	
 	enforce_that(!socket_.is_open(), runtime_error, "Socket is already open.");
 	
 	// Cancel timeout timer.
@@ -190,15 +416,22 @@ void control_stream<client_type>::handle_resolve(const error_code & error,
 
 	if (!error)
 	{
-		trace_this("control_stream resolved endpoints " 
-			+ to_delimited_list(endpoint_iterator));
+		trace_this_at(info, control_stream,
+			("control_stream resolved endpoints %s",
+			to_delimited_list(endpoint_iterator).c_str()));
+		
+		endpoints_.assign(endpoint_iterator, tcp::resolver::iterator());
+		resolver_cache::shared().insert(host_, ipv6_, endpoints_);
 		
-		// Notify observers that we resolved the host.
-		begin_connect(endpoint_iterator);
+		begin_attempts();
 	}
 	else
 	{
-		trace_this("control_stream async_resolve failed: " + error.message());
+		trace_this_at(warning, control_stream,
+			("control_stream async_resolve failed: %s",
+			error.message().c_str()));
+		
+		connecting_ = false;
 		
 		// Notify observers that an error occured.
 		client_.handle_control_stream_error(error.message(), true);
@@ -207,47 +440,102 @@ void control_stream<client_type>::handle_resolve(const error_code & error,
 
 template<class client_type>
 void control_stream<client_type>::handle_connect(const error_code & error,
-		tcp::resolver::iterator next_endpoint_iterator)
+		size_t attempt)
 {	
-	// Cancel timeout timer.
-	timer_.cancel();
+	if (error == error::operation_aborted || !connecting_)
+		// Lost the race, or disconnected in the meantime.
+		return;
+	
+	socket_ptr socket = attempts_[attempt];
+	attempts_[attempt].reset();
+	attempts_pending_--;
 	
 	if (!error)
 	{
-		trace_this("control_stream connected");
+		trace_this_at(info, control_stream,
+			("control_stream connected to %s",
+			endpoints_[attempt].address().to_string().c_str()));
+		
+		// Cancel timeout timer, and everything else still connecting.
+		timer_.cancel();
+		cancel_attempts();
+		
+		// Take the winning connection over. Sockets can't be moved, so give
+		// socket_ its own descriptor for it.
+		int descriptor = ::dup(socket->native());
+		tcp protocol = endpoints_[attempt].protocol();
+		socket->close();
+		
+		error_code assign_error;
+		if (descriptor != -1)
+			socket_.assign(protocol, descriptor, assign_error);
+		
+		if (descriptor == -1 || assign_error)
+		{
+			if (descriptor != -1)
+				::close(descriptor);
+			
+			client_.handle_control_stream_error("Connection failed.", true);
+			return;
+		}
+		
+		// Commands are small and we usually wait for the reply, so don't let
+		// Nagle hold them back waiting for an ACK.
+		error_code ignored;
+		socket_.set_option(tcp::no_delay(true), ignored);
 		
 		// Notify the client that we are connected.
 		client_.handle_connect();
 		
 		return;
 	}
-	else if (error == error::operation_aborted)
-		// Ignore.
-		return;
 	
-	trace_this("control_stream async_connect failed: " + error.message());
+	socket->close();
+	
+	trace_this_at(warning, control_stream,
+		("control_stream async_connect failed: %s", error.message().c_str()));
 	
 	// Notify the client that an endpoint failed.
 	client_.handle_control_stream_error(error.message(), false);
 	
-	if (next_endpoint_iterator == tcp::resolver::iterator())
+	if (next_attempt_ < endpoints_.size())
 	{
-		trace_this("control_stream has no more endpoints "
-			"-- all endpoints failed");
+		trace_this_at(info, control_stream,
+			("control_stream trying next endpoint"));
 		
-		// That was the last endpoint. Notify the client that ALL endpoints have
-		// failed.
-		client_.handle_control_stream_error("Connection failed.", true);
+		// No point waiting out the delay for an attempt that's already lost.
+		begin_next_attempt();
 	}
-	else
+	else if (attempts_pending_ == 0)
 	{
-		trace_this("control_stream trying next endpoint");
+		trace_this_at(info, control_stream,
+			("control_stream has no more endpoints -- all endpoints failed"));
+		
+		timer_.cancel();
+		cancel_attempts();
 		
-		// Try the next endpoint.
-		begin_connect(next_endpoint_iterator);
+		// The site may have moved; look it up again next time.
+		resolver_cache::shared().erase(host_, ipv6_);
+		
+		// That was the last endpoint. Notify the client that ALL endpoints have
+		// failed.
+		client_.handle_control_stream_error("Connection failed.", true);
 	}
 }
 
+template<class client_type>
+void control_stream<client_type>::handle_attempt_timer(const error_code & error)
+{
+	if (error == error::operation_aborted || !connecting_ ||
+		next_attempt_ == endpoints_.size())
+		return;
+	
+	trace_this_at(info, control_stream,
+		("control_stream trying next endpoint alongside the last"));
+	
+	begin_next_attempt();
+}
+
 template<class client_type>
 void control_stream<client_type>::handle_handshake(const error_code & error)
 	throw (runtime_error)
@@ -259,7 +547,15 @@ void control_stream<client_type>::handle_handshake(const error_code & error)
 
 	if (!error)
 	{
-		trace_this("control_stream handshake successful");
+		tls_session_cache & sessions = tls_session_cache::shared();
+		sessions.handshake_completed(native_ssl(stream_));
+		sessions.save(native_ssl(stream_), tls_session_key());
+		
+		trace_this_at(info, control_stream,
+			("control_stream handshake successful "
+			"(session %s, %lu/%lu resumed)",
+			SSL_session_reused(native_ssl(stream_)) ? "resumed" : "new",
+			sessions.hits(), sessions.hits() + sessions.misses()));
 			
 		encrypted_ = true;
 
@@ -269,47 +565,43 @@ void control_stream<client_type>::handle_handshake(const error_code & error)
 	}
 	else if (error != error::operation_aborted)
 	{
-		trace_this("control_stream async_handshake failed: "
-			+ error.message());
+		trace_this_at(warning, control_stream,
+			("control_stream async_handshake failed: %s",
+			error.message().c_str()));
 		
 		// Notify observers that an error was encountered.
 		client_.handle_control_stream_error(error.message(), true);
 	}
 	else
-		trace_this("control_stream handshake aborted");
+		trace_this_at(debug, control_stream,
+			("control_stream handshake aborted"));
 }
 
 template<class client_type>
 void control_stream<client_type>::handle_read_line(const error_code & error)
 	throw (runtime_error)
 {	
+	reading_ = false;
+	
 	enforce_that(socket_.is_open(), runtime_error, "Socket is not open.");
 	
 	if (!error)
 	{
-		trace_this("control_stream got line");
-			
-		// Read line from reply buffer.
-		string line;
-		istream stream(&reply_);
-		getline(stream, line);
+		trace_this_at(debug, control_stream, ("control_stream got line(s)"));
 		
-		// Trim any whitespace/new line crap off the end.
-		trim_right(line);
-
-		// Notify observers that we recieved a line.
-		client_.handle_line_received(line);
+		dispatch_lines();
 	}
 	else if (error != posix_error::operation_canceled)
 	{
-		trace_this("control_stream async_read_until failed: " 
-			+ error.message());
+		trace_this_at(warning, control_stream,
+			("control_stream async_read_until failed: %s",
+			error.message().c_str()));
 			
 		// Notify observers that an error was encountered.
 		client_.handle_control_stream_error(error.message(), true);
 	}
 	else
-		trace_this("control_stream read aborted");
+		trace_this_at(debug, control_stream, ("control_stream read aborted"));
 }
 
 template<class client_type>
@@ -322,47 +614,70 @@ void control_stream<client_type>::handle_write_line(const error_code & error,
 	timer_.cancel();
 
 	if (!error)
-		trace_this(format(64, "control_stream wrote line (%ld bytes)",
-			bytes_transferred));
-	
+	{
+		trace_this_at(debug, control_stream,
+			("control_stream wrote line (%lu bytes)",
+			static_cast<unsigned long>(bytes_transferred)));
+		
+		writing_.clear();
+		
+		// Send anything queued up in the meantime.
+		if (!outgoing_.empty())
+			begin_async_write();
+	}
 	else if (error != error::operation_aborted)
 	{
-		trace_this("control_stream async_write failed: " 
-			+ error.message());
+		trace_this_at(warning, control_stream,
+			("control_stream async_write failed: %s", error.message().c_str()));
 		
 		// Notify observers that an error was encountered.
 		client_.handle_control_stream_error(error.message(), true);
 	}
 	else
-		trace_this("control_stream write aborted");
+		trace_this_at(debug, control_stream, ("control_stream write aborted"));
 }
 
 template<class client_type>
 void control_stream<client_type>::handle_timeout(const error_code & error)
 	throw (runtime_error)
 {	
-	enforce_that(socket_.is_open(), runtime_error, "Socket is not open.");
+	if (connecting_ && error != error::operation_aborted)
+	{
+		trace_this_at(warning, control_stream,
+			("control_stream connect timed out"));
+		
+		resolver_.cancel();
+		cancel_attempts();
+		client_.handle_control_stream_error("Connection timed out.", true);
+		return;
+	}
+	
+	enforce_that(socket_.is_open() || error == error::operation_aborted,
+		runtime_error, "Socket is not open.");
 		
 	if (error != error::operation_aborted)
 	{
-		trace_this("control_stream timed out, error = " + error.message());
+		trace_this_at(warning, control_stream,
+			("control_stream timed out, error = %s", error.message().c_str()));
 		
 		socket_.close();
 		client_.handle_control_stream_error("Control stream timed out.", true);
 	}
 	else
-		trace_this("control_stream timeout aborted");
+		trace_this_at(debug, control_stream,
+			("control_stream timeout aborted"));
 }
 
 template<class client_type>
 void control_stream<client_type>::begin_timeout()
 {
-	trace_this("control_stream starting timeout");
+	trace_this_at(debug, control_stream, ("control_stream starting timeout"));
 	
 	// Begin timeout timer.
 	timer_.expires_from_now(timeout_);
-	timer_.async_wait(bind(&control_stream::handle_timeout, this,
-		placeholders::error));
+	timer_.async_wait(strand_.wrap(count_handler(bind(
+		&control_stream::handle_timeout, this, placeholders::error),
+		operations_)));
 }
 
 } // namespace ftp
@@ -3,9 +3,11 @@
 
 #include <stdexcept>
 #include <string>
+#include <vector>
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
 #include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/shared_ptr.hpp>
 #include "port_type.hpp"
 
 namespace foofxp {
@@ -19,18 +21,39 @@ public:
 	
 	typedef unsigned short port_type;
 	
+	// Completion handlers are all dispatched through strand, so the stream (and
+	// its client) can live on an io_service that is run by several threads as
+	// long as callers also stick to the strand.
 	control_stream(client_type & client,
 		const std::string & host, port_type port, bool ipv6,
 		boost::asio::io_service & io_service,
+		boost::asio::io_service::strand & strand,
 		boost::asio::ssl::context & context,
 		const boost::posix_time::time_duration & timeout);
 	
 	~control_stream();
 	
 	bool encrypted() const { return encrypted_; };
+	
+	const std::string & host() const { return host_; };
+	port_type port() const { return port_; };
+	
+	// Where this connection's TLS session is kept in tls_session_cache, for
+	// data connections to resume.
+	std::string tls_session_key() const;
 	bool connected() const { return socket_.is_open(); };
+	
+	boost::asio::ip::address remote_address() const
+	{
+		return socket_.remote_endpoint().address();
+	};
 	boost::posix_time::time_duration timeout() const { return timeout_; };
 	
+	// Whether any of the stream's completion handlers are still to run,
+	// including those of operations cancelled by disconnect(). Until they
+	// have, the stream mustn't be destroyed.
+	bool operations_pending() const { return operations_.use_count() > 1; };
+	
 	void timeout(boost::posix_time::time_duration timeout)
 	{
 		timeout_ = timeout;
@@ -44,12 +67,18 @@ public:
 	
 private:
 	
-	void begin_connect(boost::asio::ip::tcp::resolver::iterator
-		endpoint_iterator) throw (std::runtime_error);
+	void begin_attempts();
+	void begin_next_attempt();
+	void cancel_attempts();
 	void begin_timeout();
+	void begin_async_write();
+	void begin_async_read_until();
+	bool extract_line(std::string & line);
+	void dispatch_lines();
 	
 	typedef boost::asio::ssl::stream<boost::asio::ip::tcp::socket &>
 		ssl_stream_type;
+	typedef boost::shared_ptr<boost::asio::ip::tcp::socket> socket_ptr;
 	
 	client_type & client_;
 	std::string host_;
@@ -57,20 +86,41 @@ private:
 	bool ipv6_;
 	bool encrypted_;
 	boost::asio::io_service & io_service_;
+	boost::asio::io_service::strand & strand_;
 	boost::asio::ssl::context & context_;
+	std::string outgoing_;
+	std::string writing_;
 	boost::asio::streambuf reply_;
+	std::string line_;
+	bool read_requested_;
+	bool reading_;
+	bool dispatching_;
 	boost::asio::ip::tcp::socket socket_;
 	ssl_stream_type stream_;
 	boost::asio::ip::tcp::resolver resolver_;
 	boost::posix_time::time_duration timeout_;
 	boost::asio::deadline_timer timer_;
 	
+	// Connection attempts in progress, one per address (in the order they
+	// are tried) until it fails. The winner's connection ends up in socket_.
+	bool connecting_;
+	std::vector<boost::asio::ip::tcp::endpoint> endpoints_;
+	std::vector<socket_ptr> attempts_;
+	std::size_t next_attempt_;
+	std::size_t attempts_pending_;
+	boost::asio::deadline_timer attempt_timer_;
+	
+	// A copy goes with every completion handler (see count_handler()).
+	boost::shared_ptr<void> operations_;
+	
 	void handle_resolve(const boost::system::error_code & error,
 		boost::asio::ip::tcp::resolver::iterator endpoint_iterator)
 		throw (std::runtime_error);
 	
 	void handle_connect(const boost::system::error_code & error,
-		boost::asio::ip::tcp::resolver::iterator next_endpoint_iterator);
+		std::size_t attempt);
+	
+	void handle_attempt_timer(const boost::system::error_code & error);
 		
 	void handle_handshake(const boost::system::error_code & error)
 		throw (std::runtime_error);
@@ -0,0 +1,756 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <boost/version.hpp>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include "data_stream.hpp"
+#include "tls_session_cache.hpp"
+#include "../../utility/asio.hpp"
+#include "../../utility/enforce_that.hpp"
+#include "../../utility/format.hpp"
+#include "../../utility/trace.hpp"
+
+// These are for read(), write(), pwrite(), pipe() and fcntl().
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#	include <sys/sendfile.h>
+#	define FOOFXP_HAVE_ZERO_COPY
+#endif
+
+using namespace std;
+using namespace boost::asio;
+using namespace boost::asio::ip;
+using boost::bind;
+using namespace boost::system;
+using namespace foofxp::utility;
+
+namespace foofxp {
+namespace model {
+namespace ftp {
+
+// Size of the buffer used for TLS and fallback transfers.
+static const size_t buffer_size = 256 * 1024;
+
+// Most we'll ask splice()/sendfile() to move in one call, and the size we ask
+// for the pipe to be.
+static const size_t zero_copy_chunk_size = 1024 * 1024;
+
+// How many chunks to move before going back to the io_service, so one fast
+// transfer can't starve every other session sharing the thread pool.
+static const int zero_copy_chunks_per_wakeup = 16;
+
+// Whether error is a TLS connection closed without a shutdown, which plenty
+// of servers do at the end of a download.
+static bool truncated(const error_code & error)
+{
+#if BOOST_VERSION >= 106200
+	if (error == ssl::error::stream_truncated)
+		return true;
+#endif
+
+	if (error.category() != error::get_ssl_category())
+		return false;
+
+	int reason = ERR_GET_REASON(error.value());
+
+#if defined(SSL_R_SHORT_READ)
+	if (reason == SSL_R_SHORT_READ)
+		return true;
+#endif
+
+#if defined(SSL_R_UNEXPECTED_EOF_WHILE_READING)
+	if (reason == SSL_R_UNEXPECTED_EOF_WHILE_READING)
+		return true;
+#endif
+
+	return false;
+}
+
+template<class owner_type>
+data_stream<owner_type>::data_stream(owner_type & owner,
+	io_service & io_service, io_service::strand & strand,
+	ssl::context & context) :
+	owner_(owner),
+	strand_(strand),
+	context_(context),
+	socket_(io_service),
+	stream_(),
+	encrypt_(false),
+	encrypted_(false),
+	tls_session_key_(),
+	zero_copy_(true),
+	fd_(-1),
+	receiving_(false),
+	positional_(false),
+	offset_(0),
+	limit_(0),
+	buffer_(),
+	bytes_transferred_(0),
+	operations_(new int(0))
+{
+	pipe_[0] = -1;
+	pipe_[1] = -1;
+}
+
+template<class owner_type>
+data_stream<owner_type>::~data_stream()
+{
+	close();
+	close_pipe();
+}
+
+template<class owner_type>
+void data_stream<owner_type>::begin_connect(const tcp::endpoint & endpoint,
+	bool encrypt, const string & tls_session_key) throw (runtime_error)
+{
+	enforce_that(!socket_.is_open(), runtime_error, "Socket is already open.");
+
+	trace_this_at(info, data_stream,
+		("data_stream connecting to %s:%i (encrypt=%i)",
+		endpoint.address().to_string().c_str(), endpoint.port(), encrypt));
+
+	encrypt_ = encrypt;
+	encrypted_ = false;
+	tls_session_key_ = tls_session_key;
+	bytes_transferred_ = 0;
+	
+	// A TLS stream can't be reused for another connection.
+	if (encrypt)
+		stream_.reset(new ssl_stream_type(socket_, context_));
+
+	socket_.async_connect(endpoint,
+		strand_.wrap(count_handler(bind(&data_stream::handle_connect, this,
+			placeholders::error), operations_)));
+}
+
+template<class owner_type>
+void data_stream<owner_type>::begin_download(int fd) throw (runtime_error)
+{
+	enforce_that(socket_.is_open(), runtime_error, "Socket is not open.");
+	enforce_that(fd != -1, runtime_error, "Invalid file descriptor.");
+
+	fd_ = fd;
+	positional_ = false;
+	offset_ = 0;
+	limit_ = 0;
+	bytes_transferred_ = 0;
+
+	start_download();
+}
+
+template<class owner_type>
+void data_stream<owner_type>::begin_download(int fd, boost::uint64_t offset,
+	boost::uint64_t length) throw (runtime_error)
+{
+	enforce_that(socket_.is_open(), runtime_error, "Socket is not open.");
+	enforce_that(fd != -1, runtime_error, "Invalid file descriptor.");
+
+	fd_ = fd;
+	positional_ = true;
+	offset_ = offset;
+	limit_ = length;
+	bytes_transferred_ = 0;
+
+	start_download();
+}
+
+template<class owner_type>
+void data_stream<owner_type>::begin_receive() throw (runtime_error)
+{
+	enforce_that(socket_.is_open(), runtime_error, "Socket is not open.");
+
+	fd_ = -1;
+	receiving_ = true;
+	positional_ = false;
+	limit_ = 0;
+	bytes_transferred_ = 0;
+
+	trace_this_at(debug, data_stream, ("data_stream starting receive"));
+
+	begin_buffered_read();
+}
+
+template<class owner_type>
+void data_stream<owner_type>::limit(boost::uint64_t length)
+{
+	limit_ = length;
+
+	if (fd_ != -1 && limit_reached())
+		complete();
+}
+
+template<class owner_type>
+void data_stream<owner_type>::begin_upload(int fd) throw (runtime_error)
+{
+	enforce_that(socket_.is_open(), runtime_error, "Socket is not open.");
+	enforce_that(fd != -1, runtime_error, "Invalid file descriptor.");
+
+	fd_ = fd;
+	positional_ = false;
+	limit_ = 0;
+	bytes_transferred_ = 0;
+
+#if defined(FOOFXP_HAVE_ZERO_COPY)
+	if (zero_copy_ && !encrypted_ && make_non_blocking())
+	{
+		trace_this_at(debug, data_stream,
+			("data_stream starting upload (sendfile)"));
+
+		begin_wait_writable();
+		return;
+	}
+#endif
+
+	trace_this_at(debug, data_stream,
+		("data_stream starting upload (buffered)"));
+
+	begin_buffered_write();
+}
+
+template<class owner_type>
+void data_stream<owner_type>::close()
+{
+	// The session is usually the control connection's, so keep it resumable.
+	if (encrypted_)
+		tls_session_cache::close_cleanly(native_ssl(*stream_));
+
+	fd_ = -1;
+	receiving_ = false;
+	encrypted_ = false;
+
+	if (socket_.is_open())
+	{
+		trace_this_at(debug, data_stream, ("data_stream closing"));
+
+		error_code ignored;
+		socket_.close(ignored);
+	}
+}
+
+// ----------------------------------------------------------------------------
+// downloads
+// ----------------------------------------------------------------------------
+
+template<class owner_type>
+void data_stream<owner_type>::start_download()
+{
+	if (zero_copy_ && !encrypted_ && open_pipe() && make_non_blocking())
+	{
+		trace_this_at(debug, data_stream,
+			("data_stream starting download (splice)"));
+
+		begin_wait_readable();
+	}
+	else
+	{
+		trace_this_at(debug, data_stream,
+			("data_stream starting download (buffered)"));
+
+		begin_buffered_read();
+	}
+}
+
+template<class owner_type>
+size_t data_stream<owner_type>::wanted(size_t most) const
+{
+	// Never read past the end of a ranged download: the server would happily
+	// carry on sending the rest of the file.
+	if (limit_ == 0 || bytes_transferred_ + most <= limit_)
+		return most;
+
+	return limit_reached() ? 0 :
+		static_cast<size_t>(limit_ - bytes_transferred_);
+}
+
+template<class owner_type>
+bool data_stream<owner_type>::limit_reached() const
+{
+	return limit_ != 0 && bytes_transferred_ >= limit_;
+}
+
+template<class owner_type>
+bool data_stream<owner_type>::write_out(const char * data, size_t length,
+	boost::uint64_t position)
+{
+	while (length > 0)
+	{
+		ssize_t written = positional_ ?
+			::pwrite(fd_, data, length, offset_ + position) :
+			::write(fd_, data, length);
+
+		if (written < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			fail(strerror(errno));
+			return false;
+		}
+
+		data += written;
+		length -= written;
+		position += written;
+	}
+
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+// buffered transfers
+// ----------------------------------------------------------------------------
+
+template<class owner_type>
+void data_stream<owner_type>::begin_buffered_read()
+{
+	// Allocated once, and reused by every transfer after that.
+	if (buffer_.empty())
+		buffer_.resize(buffer_size);
+
+	size_t length = wanted(buffer_.size());
+
+	if (encrypted_)
+		stream_->async_read_some(buffer(&buffer_[0], length),
+			strand_.wrap(count_handler(bind(&data_stream::handle_buffered_read,
+				this, placeholders::error, placeholders::bytes_transferred),
+				operations_)));
+	else
+		socket_.async_read_some(buffer(&buffer_[0], length),
+			strand_.wrap(count_handler(bind(&data_stream::handle_buffered_read,
+				this, placeholders::error, placeholders::bytes_transferred),
+				operations_)));
+}
+
+template<class owner_type>
+void data_stream<owner_type>::handle_buffered_read(const error_code & error,
+	size_t bytes_transferred)
+{
+	if (error == error::operation_aborted || (fd_ == -1 && !receiving_))
+		return;
+
+	// Write whatever arrived, even if the read also hit the end of the stream.
+	// The limit may have moved in since the read was started.
+	bytes_transferred = min(bytes_transferred, wanted(bytes_transferred));
+
+	if (receiving_)
+		owner_.handle_data_received(&buffer_[0], bytes_transferred);
+
+	else if (!write_out(&buffer_[0], bytes_transferred, bytes_transferred_))
+		return;
+
+	bytes_transferred_ += bytes_transferred;
+	owner_.handle_data_progress();
+
+	if (limit_reached())
+		complete();
+
+	else if (!error)
+		begin_buffered_read();
+
+	else if (error == error::eof || (encrypted_ && truncated(error)))
+		// A TLS data connection closed without a shutdown is taken as the
+		// end too. Whether the transfer actually worked is up to the
+		// server's 226 on the control stream.
+		complete();
+
+	else
+		fail(error.message());
+}
+
+template<class owner_type>
+void data_stream<owner_type>::begin_buffered_write()
+{
+	if (buffer_.empty())
+		buffer_.resize(buffer_size);
+
+	ssize_t length;
+	do
+		length = ::read(fd_, &buffer_[0], buffer_.size());
+	while (length < 0 && errno == EINTR);
+
+	if (length < 0)
+	{
+		fail(strerror(errno));
+		return;
+	}
+	else if (length == 0)
+	{
+		// End of file -- closing the connection tells the server we're done.
+		// Over TLS, that takes a close_notify first, or the server can't
+		// tell the end of the file from a connection cut short.
+		if (encrypted_)
+			stream_->async_shutdown(strand_.wrap(count_handler(bind(
+				&data_stream::handle_shutdown, this, placeholders::error),
+				operations_)));
+		else
+			complete();
+
+		return;
+	}
+
+	if (encrypted_)
+		async_write(*stream_, buffer(&buffer_[0], length),
+			strand_.wrap(count_handler(bind(&data_stream::handle_buffered_write,
+				this, placeholders::error, placeholders::bytes_transferred),
+				operations_)));
+	else
+		async_write(socket_, buffer(&buffer_[0], length),
+			strand_.wrap(count_handler(bind(&data_stream::handle_buffered_write,
+				this, placeholders::error, placeholders::bytes_transferred),
+				operations_)));
+}
+
+template<class owner_type>
+void data_stream<owner_type>::handle_buffered_write(const error_code & error,
+	size_t bytes_transferred)
+{
+	if (error == error::operation_aborted || fd_ == -1)
+		return;
+
+	if (error)
+	{
+		fail(error.message());
+		return;
+	}
+
+	bytes_transferred_ += bytes_transferred;
+	begin_buffered_write();
+}
+
+template<class owner_type>
+void data_stream<owner_type>::handle_shutdown(const error_code & error)
+{
+	if (error == error::operation_aborted || fd_ == -1)
+		return;
+
+	// Our close_notify is out. Whatever the server did in return (its own,
+	// or just closing the connection), the upload's fate is up to its reply
+	// on the control stream.
+	complete();
+}
+
+// ----------------------------------------------------------------------------
+// zero-copy transfers
+// ----------------------------------------------------------------------------
+
+template<class owner_type>
+bool data_stream<owner_type>::open_pipe()
+{
+#if defined(FOOFXP_HAVE_ZERO_COPY)
+	if (pipe_[0] == -1)
+	{
+		if (::pipe(pipe_) != 0)
+		{
+			pipe_[0] = pipe_[1] = -1;
+			return false;
+		}
+
+#	if defined(F_SETPIPE_SZ)
+		// The default 64k pipe means a lot of trips round the loop on a fast
+		// link. Not fatal if we aren't allowed a bigger one.
+		::fcntl(pipe_[1], F_SETPIPE_SZ, static_cast<int>(zero_copy_chunk_size));
+#	endif
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+template<class owner_type>
+void data_stream<owner_type>::close_pipe()
+{
+	if (pipe_[0] == -1)
+		return;
+
+	::close(pipe_[0]);
+	::close(pipe_[1]);
+	pipe_[0] = pipe_[1] = -1;
+}
+
+template<class owner_type>
+bool data_stream<owner_type>::make_non_blocking()
+{
+	// We wait for readiness through the io_service, then splice()/sendfile()
+	// without blocking until the socket runs dry (or fills up).
+	int flags = ::fcntl(socket_.native(), F_GETFL, 0);
+
+	return flags != -1 &&
+		::fcntl(socket_.native(), F_SETFL, flags | O_NONBLOCK) != -1;
+}
+
+template<class owner_type>
+void data_stream<owner_type>::begin_wait_readable()
+{
+	socket_.async_read_some(null_buffers(),
+		strand_.wrap(count_handler(bind(&data_stream::handle_readable, this,
+			placeholders::error), operations_)));
+}
+
+template<class owner_type>
+void data_stream<owner_type>::begin_wait_writable()
+{
+	socket_.async_write_some(null_buffers(),
+		strand_.wrap(count_handler(bind(&data_stream::handle_writable, this,
+			placeholders::error), operations_)));
+}
+
+template<class owner_type>
+void data_stream<owner_type>::handle_readable(const error_code & error)
+{
+	if (error == error::operation_aborted || fd_ == -1)
+		return;
+
+	if (error)
+	{
+		fail(error.message());
+		return;
+	}
+
+#if defined(FOOFXP_HAVE_ZERO_COPY)
+	for (int chunk = 0; chunk < zero_copy_chunks_per_wakeup; chunk++)
+	{
+		// Socket -> pipe.
+		ssize_t length = ::splice(socket_.native(), 0, pipe_[1], 0,
+			wanted(zero_copy_chunk_size), SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+		if (length == 0)
+		{
+			complete();
+			return;
+		}
+		else if (length < 0)
+		{
+			if (errno == EAGAIN)
+				break;
+
+			else if (errno == EINTR)
+				continue;
+
+			else if (errno == EINVAL || errno == ENOSYS)
+			{
+				// Not supported here after all. Nothing has been lost -- the
+				// pipe was empty -- so carry on the old-fashioned way.
+				trace_this_at(info, data_stream,
+					("data_stream can't splice, falling back to buffered"));
+
+				begin_buffered_read();
+				return;
+			}
+
+			fail(strerror(errno));
+			return;
+		}
+
+		// Pipe -> file. Some file systems can't take a splice, in which case
+		// the pipe is emptied through the buffer instead.
+		size_t remaining = length;
+		while (remaining > 0)
+		{
+			boost::uint64_t position = bytes_transferred_ + length - remaining;
+			loff_t file_offset = offset_ + position;
+
+			ssize_t moved = ::splice(pipe_[0], 0, fd_,
+				positional_ ? &file_offset : 0, remaining, SPLICE_F_MOVE);
+
+			if (moved < 0 && errno == EINTR)
+				continue;
+
+			else if (moved < 0 && errno == EINVAL)
+			{
+				if (buffer_.empty())
+					buffer_.resize(buffer_size);
+
+				moved = ::read(pipe_[0], &buffer_[0],
+					min(remaining, buffer_.size()));
+
+				if (moved < 0 && errno == EINTR)
+					continue;
+
+				if (moved > 0 && !write_out(&buffer_[0], moved, position))
+					return;
+			}
+
+			// End of file isn't an error, so errno says nothing about it.
+			// The pipe holds everything spliced into it, so it should never
+			// run dry early.
+			if (moved == 0)
+			{
+				fail("Unexpected end of data in pipe.");
+				return;
+			}
+
+			if (moved < 0)
+			{
+				fail(strerror(errno));
+				return;
+			}
+
+			remaining -= moved;
+		}
+
+		bytes_transferred_ += length;
+
+		if (limit_reached())
+		{
+			owner_.handle_data_progress();
+			complete();
+			return;
+		}
+	}
+
+	owner_.handle_data_progress();
+
+	// Either the socket ran dry or we've had our turn; either way, let the
+	// io_service tell us when there's more.
+	begin_wait_readable();
+#endif
+}
+
+template<class owner_type>
+void data_stream<owner_type>::handle_writable(const error_code & error)
+{
+	if (error == error::operation_aborted || fd_ == -1)
+		return;
+
+	if (error)
+	{
+		fail(error.message());
+		return;
+	}
+
+#if defined(FOOFXP_HAVE_ZERO_COPY)
+	for (int chunk = 0; chunk < zero_copy_chunks_per_wakeup; chunk++)
+	{
+		// Moves from fd_'s current position, and advances it.
+		ssize_t length = ::sendfile(socket_.native(), fd_, 0,
+			zero_copy_chunk_size);
+
+		if (length == 0)
+		{
+			complete();
+			return;
+		}
+		else if (length < 0)
+		{
+			if (errno == EAGAIN)
+				break;
+
+			else if (errno == EINTR)
+				continue;
+
+			else if (errno == EINVAL || errno == ENOSYS)
+			{
+				trace_this_at(info, data_stream,
+					("data_stream can't sendfile, falling back to buffered"));
+
+				begin_buffered_write();
+				return;
+			}
+
+			fail(strerror(errno));
+			return;
+		}
+
+		bytes_transferred_ += length;
+	}
+
+	begin_wait_writable();
+#endif
+}
+
+// ----------------------------------------------------------------------------
+// connection
+// ----------------------------------------------------------------------------
+
+template<class owner_type>
+void data_stream<owner_type>::handle_connect(const error_code & error)
+{
+	if (error == error::operation_aborted)
+		return;
+
+	if (error)
+	{
+		trace_this_at(warning, data_stream,
+			("data_stream connect failed: %s", error.message().c_str()));
+
+		fail(error.message());
+		return;
+	}
+
+	if (encrypt_)
+	{
+		if (!tls_session_key_.empty())
+			tls_session_cache::shared().resume(native_ssl(*stream_),
+				tls_session_key_);
+
+		stream_->async_handshake(ssl::stream_base::client,
+			strand_.wrap(count_handler(bind(&data_stream::handle_handshake,
+				this, placeholders::error), operations_)));
+		return;
+	}
+
+	trace_this_at(info, data_stream, ("data_stream connected"));
+	owner_.handle_data_connect();
+}
+
+template<class owner_type>
+void data_stream<owner_type>::handle_handshake(const error_code & error)
+{
+	if (error == error::operation_aborted)
+		return;
+
+	if (error)
+	{
+		trace_this_at(warning, data_stream,
+			("data_stream handshake failed: %s", error.message().c_str()));
+
+		fail(error.message());
+		return;
+	}
+
+	tls_session_cache & sessions = tls_session_cache::shared();
+	sessions.handshake_completed(native_ssl(*stream_));
+
+	trace_this_at(info, data_stream,
+		("data_stream connected (encrypted, session %s, %lu/%lu resumed)",
+		SSL_session_reused(native_ssl(*stream_)) ? "resumed" : "new",
+		sessions.hits(), sessions.hits() + sessions.misses()));
+
+	encrypted_ = true;
+	owner_.handle_data_connect();
+}
+
+template<class owner_type>
+void data_stream<owner_type>::complete()
+{
+	trace_this_at(info, data_stream,
+		("data_stream transfer complete (%lu bytes)",
+		static_cast<unsigned long>(bytes_transferred_)));
+
+	close();
+	owner_.handle_data_transfer_complete();
+}
+
+template<class owner_type>
+void data_stream<owner_type>::fail(const string & message)
+{
+	trace_this_at(warning, data_stream, ("data_stream failed: %s",
+		message.c_str()));
+
+	close();
+
+	// A download can fail with data still in the pipe, which the next one
+	// would otherwise write at the start of its file. A fresh pipe is
+	// cheaper than emptying this one.
+	close_pipe();
+
+	owner_.handle_data_stream_error(message);
+}
+
+} // namespace ftp
+} // namespace model
+} // namespace foofxp
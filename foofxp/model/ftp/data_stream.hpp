@@ -0,0 +1,157 @@
+#ifndef FOOFXP_DATA_STREAM_HPP_INCLUDED
+#define FOOFXP_DATA_STREAM_HPP_INCLUDED
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace foofxp {
+namespace model {
+namespace ftp {
+
+// A passive mode (PASV/EPSV) data connection, used to move a file between the
+// server and a local file descriptor, or to receive a listing (MLSD).
+//
+// On Linux, plain TCP downloads are splice()d from the socket into the file via
+// a pipe, and uploads are sendfile()d from the file to the socket, so the data
+// never passes through user space. TLS connections, and platforms without
+// those calls, go through a single large buffer that is reused for every
+// transfer the stream makes.
+//
+// Like control_stream, all completion handlers run on strand, and the owner is
+// notified through:
+//
+//    void handle_data_connect();
+//    void handle_data_progress();
+//    void handle_data_received(const char * data, std::size_t length);
+//    void handle_data_transfer_complete();
+//    void handle_data_stream_error(const std::string & message);
+//
+// handle_data_progress() is called as a download's data is written out, so
+// bytes_transferred() has moved on. It's up to the owner to keep it cheap.
+// handle_data_received() is given the data of a begin_receive(), as it
+// arrives.
+template<class owner_type>
+class data_stream
+{
+public:
+
+	data_stream(owner_type & owner, boost::asio::io_service & io_service,
+		boost::asio::io_service::strand & strand,
+		boost::asio::ssl::context & context);
+
+	~data_stream();
+
+	bool connected() const { return socket_.is_open(); };
+	bool encrypted() const { return encrypted_; };
+
+	// Zero-copy is used by default wherever it's available.
+	bool zero_copy() const { return zero_copy_; };
+	void zero_copy(bool zero_copy) { zero_copy_ = zero_copy; };
+
+	// Bytes moved by the current (or last) transfer.
+	boost::uint64_t bytes_transferred() const { return bytes_transferred_; };
+
+	// Whether any of the stream's completion handlers are still to run,
+	// including those of operations cancelled by close().
+	bool operations_pending() const { return operations_.use_count() > 1; };
+
+	// Connect to endpoint, followed by a TLS handshake if encrypt is set. The
+	// handshake resumes the TLS session cached for tls_session_key, if any
+	// (see tls_session_cache).
+	void begin_connect(const boost::asio::ip::tcp::endpoint & endpoint,
+		bool encrypt, const std::string & tls_session_key = std::string())
+		throw (std::runtime_error);
+
+	// Copy everything the server sends into fd, until it closes the
+	// connection. fd is not closed.
+	void begin_download(int fd) throw (std::runtime_error);
+
+	// Copy what the server sends into fd from offset onwards, until length
+	// bytes have arrived (0 for no limit) or the server closes the connection.
+	// Writes go to their own position in the file rather than fd's, so several
+	// streams can fill in different parts of one file at once. fd is not
+	// closed.
+	void begin_download(int fd, boost::uint64_t offset, boost::uint64_t length)
+		throw (std::runtime_error);
+
+	// Move the end of the download in progress. If it has already been
+	// passed, the download completes straight away.
+	void limit(boost::uint64_t length);
+	boost::uint64_t limit() const { return limit_; };
+
+	// Hand everything the server sends to the owner, until it closes the
+	// connection. Always buffered.
+	void begin_receive() throw (std::runtime_error);
+
+	// Send everything from fd's current position to end of file, then close
+	// the connection. fd is not closed.
+	void begin_upload(int fd) throw (std::runtime_error);
+
+	void close();
+
+private:
+
+	typedef boost::asio::ssl::stream<boost::asio::ip::tcp::socket &>
+		ssl_stream_type;
+
+	void start_download();
+	void begin_buffered_read();
+	void begin_buffered_write();
+	void begin_wait_readable();
+	void begin_wait_writable();
+
+	std::size_t wanted(std::size_t most) const;
+	bool write_out(const char * data, std::size_t length,
+		boost::uint64_t position);
+	bool limit_reached() const;
+
+	bool open_pipe();
+	void close_pipe();
+	bool make_non_blocking();
+	void complete();
+	void fail(const std::string & message);
+
+	void handle_connect(const boost::system::error_code & error);
+	void handle_handshake(const boost::system::error_code & error);
+	void handle_buffered_read(const boost::system::error_code & error,
+		std::size_t bytes_transferred);
+	void handle_buffered_write(const boost::system::error_code & error,
+		std::size_t bytes_transferred);
+	void handle_shutdown(const boost::system::error_code & error);
+	void handle_readable(const boost::system::error_code & error);
+	void handle_writable(const boost::system::error_code & error);
+
+	owner_type & owner_;
+	boost::asio::io_service::strand & strand_;
+	boost::asio::ssl::context & context_;
+	boost::asio::ip::tcp::socket socket_;
+	boost::scoped_ptr<ssl_stream_type> stream_;
+	bool encrypt_;
+	bool encrypted_;
+	std::string tls_session_key_;
+	bool zero_copy_;
+	int fd_;
+	bool receiving_;
+	bool positional_;
+	boost::uint64_t offset_;
+	boost::uint64_t limit_;
+	int pipe_[2];
+	std::vector<char> buffer_;
+	boost::uint64_t bytes_transferred_;
+
+	// A copy goes with every completion handler (see count_handler()).
+	boost::shared_ptr<void> operations_;
+
+}; // class data_stream
+
+} // namespace ftp
+} // namespace model
+} // namespace foofxp
+
+#endif // FOOFXP_DATA_STREAM_HPP_INCLUDED
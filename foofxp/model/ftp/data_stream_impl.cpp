@@ -0,0 +1,12 @@
+#include "client.hpp"
+#include "data_stream.cpp"
+
+namespace foofxp {
+namespace model {
+namespace ftp {
+
+template class data_stream<client>;
+
+} // namespace ftp
+} // namespace model
+} // namespace foofxp
@@ -0,0 +1,287 @@
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include "feature_cache.hpp"
+#include "../../utility/format.hpp"
+#include "../../utility/trace.hpp"
+
+using namespace std;
+using namespace boost::posix_time;
+using namespace foofxp::utility;
+
+namespace foofxp {
+namespace model {
+namespace ftp {
+
+// The file has a line per server -- host, port, and when it replied to FEAT
+// (UTC, ISO 8601 basic format) -- followed by its features, one per line,
+// each indented by a space as in the reply itself:
+//
+//    ftp.example.com 21 20080517T120000
+//     EPSV
+//     MLST TYPE*;SIZE*;MODIFY*;
+//
+// Lines starting with # are comments.
+
+static string upper_case(const string & text)
+{
+	string result(text);
+	transform(result.begin(), result.end(), result.begin(), ::toupper);
+	return result;
+}
+
+feature_cache::feature_cache(const time_duration & ttl) :
+	mutex_(),
+	ttl_(ttl),
+	entries_()
+{}
+
+feature_cache & feature_cache::shared()
+{
+	static feature_cache cache(hours(24 * 7));
+	return cache;
+}
+
+bool feature_cache::find(const string & host, port_type port,
+	feature_set & result)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+
+	entry_map::iterator found = entries_.find(make_pair(host, port));
+	if (found == entries_.end())
+		return false;
+
+	if (found->second.learned + ttl_ <= microsec_clock::universal_time())
+	{
+		entries_.erase(found);
+		return false;
+	}
+
+	result = found->second.features;
+	return true;
+}
+
+void feature_cache::insert(const string & host, port_type port,
+	const feature_set & features)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+
+	ptime now = microsec_clock::universal_time();
+	purge(now);
+
+	entry & cached = entries_[make_pair(host, port)];
+	cached.features = features;
+	cached.learned = now;
+}
+
+void feature_cache::erase(const string & host, port_type port)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	entries_.erase(make_pair(host, port));
+}
+
+void feature_cache::clear()
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	entries_.clear();
+}
+
+size_t feature_cache::size() const
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	return entries_.size();
+}
+
+time_duration feature_cache::ttl() const
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	return ttl_;
+}
+
+void feature_cache::ttl(const time_duration & ttl)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	ttl_ = ttl;
+}
+
+void feature_cache::load(const string & path) throw (runtime_error)
+{
+	ifstream in(path.c_str());
+	if (!in)
+	{
+		if (errno == ENOENT)
+			// Nothing saved yet.
+			return;
+
+		throw runtime_error(format(256, "Could not open %s: %s",
+			path.c_str(), strerror(errno)));
+	}
+
+	entry_map loaded;
+	entry * current = 0;
+	string line;
+
+	while (getline(in, line))
+	{
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		if (line[0] == ' ')
+		{
+			if (current && line.length() > 1)
+				current->features.insert(upper_case(line.substr(1)));
+
+			continue;
+		}
+
+		istringstream fields(line);
+		string host;
+		unsigned int port;
+		string learned;
+
+		current = 0;
+
+		if (!(fields >> host >> port >> learned) || port == 0 || port > 65535)
+			continue;
+
+		try
+		{
+			entry & server = loaded[make_pair(host,
+				static_cast<port_type>(port))];
+			server.features.clear();
+			server.learned = from_iso_string(learned);
+			current = &server;
+		}
+		catch (const exception &)
+		{
+			// Not a time.
+			loaded.erase(make_pair(host, static_cast<port_type>(port)));
+		}
+	}
+
+	boost::mutex::scoped_lock lock(mutex_);
+
+	ptime now = microsec_clock::universal_time();
+	size_t count = 0;
+
+	for (entry_map::const_iterator server = loaded.begin();
+		server != loaded.end(); server++)
+	{
+		if (server->second.learned.is_special() ||
+			server->second.learned + ttl_ <= now)
+			continue;
+
+		entries_[server->first] = server->second;
+		count++;
+	}
+
+	trace_this_at(info, general, ("feature_cache loaded %lu servers from %s",
+		static_cast<unsigned long>(count), path.c_str()));
+}
+
+void feature_cache::save(const string & path) const throw (runtime_error)
+{
+	ostringstream contents;
+	contents << "# Features listed by FTP servers in reply to FEAT." << endl;
+
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		ptime now = microsec_clock::universal_time();
+
+		for (entry_map::const_iterator server = entries_.begin();
+			server != entries_.end(); server++)
+		{
+			if (server->second.learned + ttl_ <= now)
+				continue;
+
+			contents << server->first.first << ' ' << server->first.second
+				<< ' ' << to_iso_string(server->second.learned) << endl;
+
+			for (feature_set::const_iterator feature =
+				server->second.features.begin();
+				feature != server->second.features.end(); feature++)
+				contents << ' ' << *feature << endl;
+		}
+	}
+
+	// Written to one side and renamed over the old file, so a crash leaves
+	// one or the other, never a mixture.
+	string temporary = path + ".new";
+
+	{
+		ofstream out(temporary.c_str(), ios::out | ios::trunc);
+		out << contents.str();
+		out.close();
+
+		if (!out)
+			throw runtime_error(format(256, "Could not write %s",
+				temporary.c_str()));
+	}
+
+	if (::rename(temporary.c_str(), path.c_str()) != 0)
+		throw runtime_error(format(256, "Could not replace %s: %s",
+			path.c_str(), strerror(errno)));
+}
+
+void feature_cache::parse_feat_reply(const string & text,
+	feature_set & features)
+{
+	string::size_type begin = 0;
+
+	while (begin < text.length())
+	{
+		string::size_type end = text.find('\n', begin);
+		if (end == string::npos)
+			end = text.length();
+
+		// Interior lines only: the first and last start with the code.
+		if (text[begin] == ' ')
+		{
+			string::size_type first = text.find_first_not_of(' ', begin);
+			string::size_type last = text.find_last_not_of(" \r", end - 1);
+
+			if (first < end && last != string::npos && last >= first)
+				features.insert(upper_case(text.substr(first,
+					last - first + 1)));
+		}
+
+		begin = end + 1;
+	}
+}
+
+bool feature_cache::supports(const feature_set & features,
+	const string & feature)
+{
+	string name = upper_case(feature);
+
+	// Lines with parameters sort straight after the bare name followed by a
+	// space.
+	feature_set::const_iterator found = features.lower_bound(name);
+
+	return found != features.end() && (*found == name ||
+		(found->length() > name.length() &&
+		found->compare(0, name.length(), name) == 0 &&
+		(*found)[name.length()] == ' '));
+}
+
+void feature_cache::purge(const ptime & now)
+{
+	entry_map::iterator i = entries_.begin();
+	while (i != entries_.end())
+	{
+		if (i->second.learned + ttl_ <= now)
+			entries_.erase(i++);
+		else
+			++i;
+	}
+}
+
+} // namespace ftp
+} // namespace model
+} // namespace foofxp
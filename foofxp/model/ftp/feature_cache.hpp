@@ -0,0 +1,108 @@
+#ifndef FOOFXP_FEATURE_CACHE_HPP_INCLUDED
+#define FOOFXP_FEATURE_CACHE_HPP_INCLUDED
+
+#include <cstddef>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include "port_type.hpp"
+
+namespace foofxp {
+namespace model {
+namespace ftp {
+
+// What each server said it supports in reply to FEAT (RFC 2389), by host and
+// port, so that only the first session to a site has to ask. Later sessions
+// know before they log in whether they can list with MLSD, use EPSV, or
+// secure FXP with SSCN.
+//
+// A feature is one line of the FEAT reply, upper-cased, e.g. "MLST TYPE*;
+// SIZE*;MODIFY*;" or "REST STREAM". supports() matches either a whole line or
+// its first word, so "MLST" finds the former.
+//
+// Servers get upgraded, so entries expire (after a week, for shared()). A
+// server that doesn't understand FEAT at all is cached with no features, so
+// it isn't asked again either.
+//
+// save() and load() keep the cache in a small text file, e.g. next to the
+// user's bookmarks, so it lasts from one run to the next.
+//
+// Safe to use from any thread.
+class feature_cache : private boost::noncopyable
+{
+public:
+
+	typedef std::set<std::string> feature_set;
+
+	explicit feature_cache(const boost::posix_time::time_duration & ttl);
+
+	// The one used by every client unless told otherwise.
+	static feature_cache & shared();
+
+	// Returns false if there's nothing unexpired for the server.
+	bool find(const std::string & host, port_type port, feature_set & result);
+
+	void insert(const std::string & host, port_type port,
+		const feature_set & features);
+
+	void erase(const std::string & host, port_type port);
+
+	void clear();
+
+	// Unexpired or not.
+	std::size_t size() const;
+
+	boost::posix_time::time_duration ttl() const;
+	void ttl(const boost::posix_time::time_duration & ttl);
+
+	// Adds the unexpired entries in path, replacing any for the same server.
+	// A missing file is the same as an empty one; lines that make no sense
+	// are skipped.
+	void load(const std::string & path) throw (std::runtime_error);
+
+	// Writes every unexpired entry to path, by way of a temporary file so a
+	// crash part way through doesn't lose the old one.
+	void save(const std::string & path) const throw (std::runtime_error);
+
+	// The features listed in a whole FEAT reply, one line per '\n'. The first
+	// and last lines are the reply's own; features are the lines in between,
+	// each indented by a space.
+	static void parse_feat_reply(const std::string & text,
+		feature_set & features);
+
+	// Whether feature (any case) is in features, as a whole line or the
+	// first word of one.
+	static bool supports(const feature_set & features,
+		const std::string & feature);
+
+private:
+
+	struct entry
+	{
+		feature_set features;
+
+		// When we were told, rather than when it expires, as that's what's
+		// saved: the ttl may have changed by the time it's loaded.
+		boost::posix_time::ptime learned;
+	};
+
+	typedef std::map<std::pair<std::string, port_type>, entry> entry_map;
+
+	void purge(const boost::posix_time::ptime & now);
+
+	mutable boost::mutex mutex_;
+	boost::posix_time::time_duration ttl_;
+	entry_map entries_;
+
+}; // class feature_cache
+
+} // namespace ftp
+} // namespace model
+} // namespace foofxp
+
+#endif // FOOFXP_FEATURE_CACHE_HPP_INCLUDED
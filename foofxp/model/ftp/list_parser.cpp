@@ -0,0 +1,339 @@
+#include <algorithm>
+#include <limits>
+#include <sstream>
+#include <boost/date_time/gregorian/gregorian.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include "list_parser.hpp"
+
+using namespace std;
+using namespace boost::posix_time;
+using namespace boost::gregorian;
+
+namespace foofxp {
+namespace model {
+namespace ftp {
+
+namespace {
+
+// A [begin, end) slice of the line being parsed.
+struct token
+{
+	token() : begin(0), end(0) {};
+
+	bool empty() const { return begin == end; };
+	ptrdiff_t length() const { return end - begin; };
+
+	const char * begin;
+	const char * end;
+};
+
+struct month_entry
+{
+	char name[4];
+	int month;
+};
+
+// Month names, lower case, indexed by hash_month(). The hash is collision free
+// for the twelve English abbreviations, so recognising a month costs one
+// lookup and one three-character compare.
+const month_entry month_table[32] =
+{
+	{ "", 0 }, { "", 0 }, { "", 0 }, { "jul", 7 },
+	{ "mar", 3 }, { "", 0 }, { "", 0 }, { "apr", 4 },
+	{ "sep", 9 }, { "jun", 6 }, { "", 0 }, { "aug", 8 },
+	{ "", 0 }, { "", 0 }, { "oct", 10 }, { "", 0 },
+	{ "", 0 }, { "feb", 2 }, { "dec", 12 }, { "", 0 },
+	{ "", 0 }, { "jan", 1 }, { "", 0 }, { "", 0 },
+	{ "", 0 }, { "may", 5 }, { "", 0 }, { "", 0 },
+	{ "", 0 }, { "", 0 }, { "", 0 }, { "nov", 11 }
+};
+
+// Permissions, link count, owner, group and size -- the most tokens that may
+// precede the month.
+const size_t max_meta_tokens = 5;
+
+// Permissions, link count and size -- the fewest tokens that may precede the
+// month.
+const size_t min_meta_tokens = 3;
+
+const char link_arrow[] = " -> ";
+const char * const link_arrow_end = link_arrow + sizeof(link_arrow) - 1;
+
+inline bool is_space(char c)
+{
+	return c == ' ' || c == '\t';
+}
+
+inline bool is_digit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+inline const char * skip_spaces(const char * p, const char * end)
+{
+	while (p != end && is_space(*p))
+		++p;
+
+	return p;
+}
+
+// Read the next whitespace-delimited token, advancing p past it.
+inline token next_token(const char * & p, const char * end)
+{
+	token t;
+
+	p = skip_spaces(p, end);
+	t.begin = p;
+
+	while (p != end && !is_space(*p))
+		++p;
+
+	t.end = p;
+	return t;
+}
+
+// Returns the month number (1-12), or 0 if the token isn't a month name.
+inline int get_month(const token & t)
+{
+	if (t.length() != 3)
+		return 0;
+
+	// Fold to lower case. Non-letters can't fold onto a letter, so they never
+	// match a table entry.
+	unsigned char a = static_cast<unsigned char>(t.begin[0]) | 0x20;
+	unsigned char b = static_cast<unsigned char>(t.begin[1]) | 0x20;
+	unsigned char c = static_cast<unsigned char>(t.begin[2]) | 0x20;
+
+	const month_entry & entry = month_table[(a + b + 3 * c) & 31];
+
+	if (entry.name[0] == a && entry.name[1] == b && entry.name[2] == c)
+		return entry.month;
+
+	return 0;
+}
+
+inline bool is_number(const token & t)
+{
+	if (t.empty())
+		return false;
+
+	for (const char * p = t.begin; p != t.end; ++p)
+		if (!is_digit(*p))
+			return false;
+
+	return true;
+}
+
+template<class integer_type>
+bool parse_number(const char * begin, const char * end, integer_type & value)
+{
+	if (begin == end)
+		return false;
+
+	const integer_type max_value = numeric_limits<integer_type>::max();
+	integer_type result = 0;
+
+	for (const char * p = begin; p != end; ++p)
+	{
+		if (!is_digit(*p))
+			return false;
+
+		integer_type digit = *p - '0';
+
+		if (result > (max_value - digit) / 10)
+			// Overflow.
+			return false;
+
+		result = result * 10 + digit;
+	}
+
+	value = result;
+	return true;
+}
+
+file::file_type get_file_type(const char type)
+{
+	switch (type)
+	{
+		case '-': // Ordinary file.
+			return file::plain_old_file;
+
+		case 'l': // Symbolic link.
+		case 'd': // Directory.
+			return file::directory;
+
+		case 'b': // Block special file.
+		case 'c': // Character special file.
+		case 'p': // FIFO special file.
+		case 's': // Socket link.
+		default:
+			return file::other;
+	}
+}
+
+} // anonymous namespace
+
+list_parser::list_parser() : today_(day_clock::local_day()) {}
+
+list_parser::list_parser(const date & today) : today_(today) {}
+
+bool list_parser::parse_line(const string & line, file & f) const
+	throw (runtime_error)
+{
+	const char * p = line.data();
+	const char * end = p + line.length();
+
+	// Skip "total 1234" summary lines.
+	if (line.compare(0, 5, "total") == 0)
+		return false;
+
+	// Collect the tokens preceding the month. The month is the first month
+	// name that follows a numeric size token, so owners or groups that happen
+	// to be called "Jan" don't throw us off.
+	token meta[max_meta_tokens];
+	size_t meta_count = 0;
+	int month = 0;
+
+	for (;;)
+	{
+		token t = next_token(p, end);
+
+		if (t.empty())
+			throw runtime_error("No month token found.");
+
+		if (meta_count >= min_meta_tokens && is_number(meta[meta_count - 1]))
+		{
+			month = get_month(t);
+			if (month != 0)
+				break;
+		}
+
+		if (meta_count == max_meta_tokens)
+			throw runtime_error("No month token found.");
+
+		meta[meta_count++] = t;
+	}
+
+	const token & permissions = meta[0];
+	const token & size = meta[meta_count - 1];
+
+	token day = next_token(p, end);
+	token clock = next_token(p, end);
+
+	if (clock.empty())
+		throw runtime_error("Too few tokens in line.");
+
+	// The name is everything after the clock token, spaces and all.
+	const char * name_begin = skip_spaces(p, end);
+	const char * name_end = end;
+
+	if (name_begin == end)
+		throw runtime_error("No file name found.");
+
+	int day_of_month = 0;
+	if (!parse_number(day.begin, day.end, day_of_month))
+		throw runtime_error("Invalid day of month.");
+
+	file::size_type file_size = 0;
+	if (!parse_number(size.begin, size.end, file_size))
+		throw runtime_error("Invalid file size.");
+
+	ptime file_time;
+	try
+	{
+		if (clock.length() == 5 && clock.begin[2] == ':')
+		{
+			// Server has given us an hh:mm time, with no year.
+			int hrs = 0;
+			int mins = 0;
+
+			if (!parse_number(clock.begin, clock.begin + 2, hrs) ||
+				!parse_number(clock.begin + 3, clock.end, mins))
+				throw runtime_error("Unknown clock/year format.");
+
+			date file_date(today_.year(), month, day_of_month);
+
+			if (file_date > today_)
+				// Date must have been last year.
+				file_date -= years(1);
+
+			file_time = ptime(file_date, hours(hrs) + minutes(mins));
+		}
+		else
+		{
+			// Server has given us a date only.
+			int year = 0;
+
+			if (!parse_number(clock.begin, clock.end, year))
+				throw runtime_error("Unknown clock/year format.");
+
+			file_time = ptime(date(year, month, day_of_month), hours(0));
+		}
+	}
+	catch (const out_of_range & e)
+	{
+		// boost::gregorian rejects impossible dates with out_of_range.
+		throw runtime_error(e.what());
+	}
+
+	// Handle link name -> link target syntax, e.g.
+	// "lrwxrwxrwx   1        7 Jan 25 00:17 bin -> usr/bin"
+	const char * arrow = search(name_begin, name_end, link_arrow,
+		link_arrow_end);
+
+	if (arrow != name_end)
+	{
+		name_end = arrow;
+		f.type(file::link);
+	}
+	else
+		f.type(get_file_type(*permissions.begin));
+
+	f.name(name_begin, name_end);
+	f.size(file_size);
+	f.time(file_time);
+
+	return true;
+}
+
+vector<file>::size_type list_parser::parse_lines(const vector<string> & lines,
+	vector<file> & files) const throw (runtime_error)
+{
+	const vector<file>::size_type first = files.size();
+	vector<file>::size_type count = first;
+
+	// Allocate a record for every line up front and parse straight into them.
+	// Records left over by "total" lines are trimmed off at the end.
+	files.resize(first + lines.size());
+
+	for (vector<string>::const_iterator iter = lines.begin();
+		iter != lines.end(); ++iter)
+	{
+		try
+		{
+			if (parse_line(*iter, files[count]))
+				++count;
+		}
+		catch (const runtime_error & e)
+		{
+			files.resize(first);
+
+			ostringstream s;
+
+			s << "Could not parse directory list entry '";
+			s << *iter;
+			s << "': ";
+			s << e.what();
+
+			throw runtime_error(s.str());
+		}
+	}
+
+	files.resize(count);
+
+	return count - first;
+}
+
+} // namespace ftp
+} // namespace model
+} // namespace foofxp
@@ -0,0 +1,53 @@
+#ifndef FOOFXP_LIST_PARSER_HPP_INCLUDED
+#define FOOFXP_LIST_PARSER_HPP_INCLUDED
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <boost/date_time/gregorian/gregorian_types.hpp>
+#include "../file.hpp"
+
+namespace foofxp {
+namespace model {
+namespace ftp {
+
+// Single-pass parser for ls-style LIST/STAT -l entries, e.g.:
+//
+//    "-rw-r--r--  1 root  other  531 Jan 29 03:26 README"
+//
+// Each line is walked once with raw character offsets -- no substrings or
+// token vectors are created -- and the result is written straight into a
+// caller-supplied file record, so records (and their name buffers) can be
+// reused between listings.
+class list_parser
+{
+public:
+
+	// Entries with an hh:mm clock and no year are dated relative to today.
+	list_parser();
+	explicit list_parser(const boost::gregorian::date & today);
+
+	// Parse a single entry into f. Returns false (leaving f untouched) if the
+	// line is a "total 1234" summary rather than an entry.
+	bool parse_line(const std::string & line, file & f) const
+		throw (std::runtime_error);
+
+	// Parse every entry in lines, appending the results to files. Returns the
+	// number of entries appended.
+	std::vector<file>::size_type parse_lines(
+		const std::vector<std::string> & lines, std::vector<file> & files)
+		const throw (std::runtime_error);
+
+	const boost::gregorian::date & today() const { return today_; };
+
+private:
+
+	boost::gregorian::date today_;
+
+}; // class list_parser
+
+} // namespace ftp
+} // namespace model
+} // namespace foofxp
+
+#endif // FOOFXP_LIST_PARSER_HPP_INCLUDED
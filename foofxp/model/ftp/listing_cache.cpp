@@ -0,0 +1,139 @@
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include "listing_cache.hpp"
+
+using namespace std;
+using namespace boost::posix_time;
+
+namespace foofxp {
+namespace model {
+namespace ftp {
+
+// What a std::string keeps in its own buffer before going to the heap, give
+// or take a library.
+static const size_t short_string = 15;
+
+listing_cache::listing_cache(size_t max_bytes, const time_duration & ttl) :
+	max_bytes_(max_bytes),
+	ttl_(ttl),
+	entries_(),
+	index_(),
+	bytes_(0)
+{}
+
+const vector<file> * listing_cache::find(const string & path, bool & fresh)
+{
+	entry_map::iterator found = index_.find(path);
+	if (found == index_.end())
+		return 0;
+
+	entry_list::iterator listing = found->second;
+	entries_.splice(entries_.begin(), entries_, listing);
+
+	fresh = listing->fetched + ttl_ > microsec_clock::universal_time();
+	return &listing->files;
+}
+
+void listing_cache::insert(const string & path, const vector<file> & files)
+{
+	invalidate(path);
+
+	size_t bytes = cost(path, files);
+	if (bytes > max_bytes_)
+		return;
+
+	entries_.push_front(entry());
+	entry & listing = entries_.front();
+	listing.path = path;
+	listing.files = files;
+	listing.bytes = bytes;
+	listing.fetched = microsec_clock::universal_time();
+
+	index_[path] = entries_.begin();
+	bytes_ += bytes;
+
+	trim();
+}
+
+void listing_cache::invalidate(const string & path)
+{
+	entry_map::iterator found = index_.find(path);
+	if (found != index_.end())
+		erase(found);
+}
+
+void listing_cache::clear()
+{
+	index_.clear();
+	entries_.clear();
+	bytes_ = 0;
+}
+
+void listing_cache::max_bytes(size_t max_bytes)
+{
+	max_bytes_ = max_bytes;
+	trim();
+}
+
+string listing_cache::absolute_path(const string & working_directory,
+	const string & path)
+{
+	string result;
+
+	if (!path.empty() && path[0] == '/')
+		result = path;
+	else if (working_directory.empty())
+		return string();
+	else if (path.empty())
+		result = working_directory;
+	else
+		result = working_directory + "/" + path;
+
+	// Collapse doubled slashes, and drop a trailing one.
+	string::size_type i;
+	while ((i = result.find("//")) != string::npos)
+		result.erase(i, 1);
+
+	if (result.length() > 1 && result[result.length() - 1] == '/')
+		result.erase(result.length() - 1);
+
+	return result;
+}
+
+string listing_cache::parent_path(const string & path)
+{
+	string::size_type slash = path.rfind('/');
+
+	if (slash == string::npos || slash == 0)
+		return "/";
+
+	return path.substr(0, slash);
+}
+
+size_t listing_cache::cost(const string & path, const vector<file> & files)
+{
+	size_t bytes = sizeof(entry) + 2 * path.length() +
+		files.size() * sizeof(file);
+
+	for (vector<file>::const_iterator f = files.begin(); f != files.end(); ++f)
+		if (f->name().length() > short_string)
+			bytes += f->name().length() + 1;
+
+	return bytes;
+}
+
+void listing_cache::erase(entry_map::iterator found)
+{
+	bytes_ -= found->second->bytes;
+	entries_.erase(found->second);
+	index_.erase(found);
+}
+
+void listing_cache::trim()
+{
+	while (bytes_ > max_bytes_ && !entries_.empty())
+		erase(index_.find(entries_.back().path));
+}
+
+} // namespace ftp
+} // namespace model
+} // namespace foofxp
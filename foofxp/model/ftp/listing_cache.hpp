@@ -0,0 +1,104 @@
+#ifndef FOOFXP_LISTING_CACHE_HPP_INCLUDED
+#define FOOFXP_LISTING_CACHE_HPP_INCLUDED
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/noncopyable.hpp>
+#include "../file.hpp"
+
+namespace foofxp {
+namespace model {
+namespace ftp {
+
+// The directory listings a session has fetched, by absolute path, so that
+// going back to a directory shows it straight away instead of waiting on the
+// server.
+//
+// A listing is fresh for ttl() after it was fetched. After that it's stale:
+// still worth showing while a new one is on its way, but not instead of it.
+// What we change ourselves (STOR, DELE, MKD) is dropped with invalidate()
+// before the command goes out, so it's never shown from the cache afterwards.
+//
+// Bounded by memory rather than count, since one listing can hold a hundred
+// thousand files and the next three: when the listings add up to more than
+// max_bytes(), the least recently used go first. A listing bigger than that on
+// its own isn't kept at all.
+//
+// Belongs to one client and is used on its strand, so there's no locking.
+class listing_cache : private boost::noncopyable
+{
+public:
+
+	listing_cache(std::size_t max_bytes,
+		const boost::posix_time::time_duration & ttl);
+
+	// The cached listing of path, or 0 if there isn't one, marked as most
+	// recently used. fresh says whether it's younger than ttl(). Good until
+	// the cache is next changed.
+	const std::vector<file> * find(const std::string & path, bool & fresh);
+
+	void insert(const std::string & path, const std::vector<file> & files);
+
+	// Forgets path's listing, if any.
+	void invalidate(const std::string & path);
+
+	void clear();
+
+	// Listings held.
+	std::size_t size() const { return entries_.size(); };
+
+	// Roughly what the listings cost, names and all.
+	std::size_t bytes() const { return bytes_; };
+
+	std::size_t max_bytes() const { return max_bytes_; };
+	void max_bytes(std::size_t max_bytes);
+
+	const boost::posix_time::time_duration & ttl() const { return ttl_; };
+	void ttl(const boost::posix_time::time_duration & ttl) { ttl_ = ttl; };
+
+	// Lexically, without asking anyone: working_directory + "/" + path unless
+	// path is already absolute, without a trailing slash. Empty if path is
+	// relative and there's no working directory to go on.
+	static std::string absolute_path(const std::string & working_directory,
+		const std::string & path);
+
+	// The directory an absolute path is in; "/" is its own parent.
+	static std::string parent_path(const std::string & path);
+
+private:
+
+	struct entry
+	{
+		std::string path;
+		std::vector<file> files;
+		std::size_t bytes;
+		boost::posix_time::ptime fetched;
+	};
+
+	// Most recently used at the front.
+	typedef std::list<entry> entry_list;
+	typedef std::map<std::string, entry_list::iterator> entry_map;
+
+	static std::size_t cost(const std::string & path,
+		const std::vector<file> & files);
+
+	void erase(entry_map::iterator found);
+	void trim();
+
+	std::size_t max_bytes_;
+	boost::posix_time::time_duration ttl_;
+	entry_list entries_;
+	entry_map index_;
+	std::size_t bytes_;
+
+}; // class listing_cache
+
+} // namespace ftp
+} // namespace model
+} // namespace foofxp
+
+#endif // FOOFXP_LISTING_CACHE_HPP_INCLUDED
@@ -0,0 +1,270 @@
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <boost/date_time/gregorian/gregorian.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/cstdint.hpp>
+#include "mlsx_parser.hpp"
+
+using namespace std;
+using namespace boost::posix_time;
+using namespace boost::gregorian;
+
+namespace foofxp {
+namespace model {
+namespace ftp {
+
+namespace {
+
+inline bool is_digit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+// Whether [begin, end) is name, ignoring case. name is lower case.
+inline bool matches(const char * begin, const char * end, const char * name)
+{
+	for (; begin != end; ++begin, ++name)
+		if (*name == '\0' || (static_cast<unsigned char>(*begin) | 0x20) !=
+			static_cast<unsigned char>(*name))
+			return false;
+
+	return *name == '\0';
+}
+
+// Whether [begin, end) starts with prefix, ignoring case. prefix is lower
+// case.
+inline bool starts_with(const char * begin, const char * end,
+	const char * prefix)
+{
+	for (; *prefix != '\0'; ++begin, ++prefix)
+		if (begin == end || (static_cast<unsigned char>(*begin) | 0x20) !=
+			static_cast<unsigned char>(*prefix))
+			return false;
+
+	return true;
+}
+
+template<class integer_type>
+bool parse_number(const char * begin, const char * end, integer_type & value)
+{
+	if (begin == end)
+		return false;
+
+	// Worked out once, rather than dividing for every digit.
+	const integer_type max_tens = numeric_limits<integer_type>::max() / 10;
+	const integer_type max_units = numeric_limits<integer_type>::max() % 10;
+	integer_type result = 0;
+
+	for (const char * p = begin; p != end; ++p)
+	{
+		if (!is_digit(*p))
+			return false;
+
+		integer_type digit = *p - '0';
+
+		if (result > max_tens || (result == max_tens && digit > max_units))
+			// Overflow.
+			return false;
+
+		result = result * 10 + digit;
+	}
+
+	value = result;
+	return true;
+}
+
+// Days from 1970-01-01 to the given (valid) date in the proleptic Gregorian
+// calendar, counting years from March so leap days fall at the end.
+long days_since_epoch(long year, long month, long day)
+{
+	if (month <= 2)
+		year--;
+
+	long era = (year >= 0 ? year : year - 399) / 400;
+	long year_of_era = year - era * 400;
+	long day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 +
+		day - 1;
+	long day_of_era = year_of_era * 365 + year_of_era / 4 -
+		year_of_era / 100 + day_of_year;
+
+	return era * 146097 + day_of_era - 719468;
+}
+
+inline bool is_leap_year(int year)
+{
+	return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+// modify=YYYYMMDDHHMMSS, optionally followed by .sss, always UTC. Anything
+// else gives not_a_date_time.
+ptime parse_time(const char * begin, const char * end)
+{
+	static const int month_days[] =
+	{
+		31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31
+	};
+
+	// The Unix epoch, for building times from a count of seconds; that's a
+	// good deal cheaper than boost::gregorian::date's own checking.
+	static const ptime epoch(date(1970, 1, 1));
+
+	int year, month, day, hrs, mins, secs;
+
+	if (end - begin < 14 ||
+		!parse_number(begin, begin + 4, year) ||
+		!parse_number(begin + 4, begin + 6, month) ||
+		!parse_number(begin + 6, begin + 8, day) ||
+		!parse_number(begin + 8, begin + 10, hrs) ||
+		!parse_number(begin + 10, begin + 12, mins) ||
+		!parse_number(begin + 12, begin + 14, secs) ||
+		year < 1400 || month < 1 || month > 12 || day < 1 ||
+		day > month_days[month - 1] + (month == 2 && is_leap_year(year)) ||
+		hrs > 23 || mins > 59 || secs > 60)
+		return ptime();
+
+	time_duration time_of_day = seconds(days_since_epoch(year, month, day) *
+		86400 + hrs * 3600 + mins * 60 + secs);
+
+	const char * fraction = begin + 14;
+	if (fraction != end)
+	{
+		// Keep milliseconds; the RFC allows any number of digits.
+		if (*fraction != '.' || fraction + 1 == end)
+			return ptime();
+
+		int millis = 0;
+		int digits = 0;
+		for (const char * p = fraction + 1; p != end; ++p, ++digits)
+		{
+			if (!is_digit(*p))
+				return ptime();
+
+			if (digits < 3)
+				millis = millis * 10 + (*p - '0');
+		}
+
+		for (; digits < 3; ++digits)
+			millis *= 10;
+
+		time_of_day += milliseconds(millis);
+	}
+
+	return epoch + time_of_day;
+}
+
+} // anonymous namespace
+
+bool mlsx_parser::parse_line(const string & line, file & f) const
+	throw (runtime_error)
+{
+	const char * p = line.data();
+	const char * end = p + line.length();
+
+	if (p != end && end[-1] == '\r')
+		--end;
+
+	file::file_type type = file::plain_old_file;
+	file::size_type size = 0;
+	ptime time;
+
+	// "fact=value;" pairs, up to the space before the name.
+	while (p != end && *p != ' ')
+	{
+		const char * name = p;
+		while (p != end && *p != '=' && *p != ';' && *p != ' ')
+			++p;
+
+		if (p == end || *p != '=')
+			throw runtime_error("Malformed fact.");
+
+		const char * name_end = p;
+		const char * value = ++p;
+
+		// Values are the bulk of the line, so let memchr() find their end.
+		const char * value_end = static_cast<const char *>(
+			memchr(value, ';', end - value));
+
+		if (!value_end)
+			throw runtime_error("Unterminated fact.");
+
+		p = value_end + 1;
+
+		if (matches(name, name_end, "type"))
+		{
+			if (matches(value, value_end, "file"))
+				type = file::plain_old_file;
+			else if (matches(value, value_end, "dir"))
+				type = file::directory;
+			else if (matches(value, value_end, "cdir") ||
+				matches(value, value_end, "pdir"))
+				return false;
+			else if (starts_with(value, value_end, "os.unix=slink") ||
+				starts_with(value, value_end, "os.unix=symlink"))
+				type = file::link;
+			else
+				type = file::other;
+		}
+		else if (matches(name, name_end, "size"))
+		{
+			if (!parse_number(value, value_end, size))
+				throw runtime_error("Invalid file size.");
+		}
+		else if (matches(name, name_end, "modify"))
+			time = parse_time(value, value_end);
+	}
+
+	// Exactly one space, then the name -- which may itself contain spaces
+	// and semicolons.
+	if (p == end || p + 1 == end)
+		throw runtime_error("No file name found.");
+
+	f.name(p + 1, end);
+	f.type(type);
+	f.size(size);
+	f.time(time);
+
+	return true;
+}
+
+vector<file>::size_type mlsx_parser::parse_lines(const vector<string> & lines,
+	vector<file> & files) const throw (runtime_error)
+{
+	const vector<file>::size_type first = files.size();
+	vector<file>::size_type count = first;
+
+	// As list_parser::parse_lines(): records left over by cdir/pdir entries
+	// are trimmed off at the end.
+	files.resize(first + lines.size());
+
+	for (vector<string>::const_iterator iter = lines.begin();
+		iter != lines.end(); ++iter)
+	{
+		try
+		{
+			if (parse_line(*iter, files[count]))
+				++count;
+		}
+		catch (const runtime_error & e)
+		{
+			files.resize(first);
+
+			ostringstream s;
+
+			s << "Could not parse directory list entry '";
+			s << *iter;
+			s << "': ";
+			s << e.what();
+
+			throw runtime_error(s.str());
+		}
+	}
+
+	files.resize(count);
+
+	return count - first;
+}
+
+} // namespace ftp
+} // namespace model
+} // namespace foofxp
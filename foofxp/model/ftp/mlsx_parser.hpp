@@ -0,0 +1,48 @@
+#ifndef FOOFXP_MLSX_PARSER_HPP_INCLUDED
+#define FOOFXP_MLSX_PARSER_HPP_INCLUDED
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "../file.hpp"
+
+namespace foofxp {
+namespace model {
+namespace ftp {
+
+// Single-pass parser for RFC 3659 machine-readable listings (MLSD data, or
+// the entry line of an MLST reply), e.g.:
+//
+//    "type=file;size=531;modify=20080129032600;UNIX.mode=0644; README"
+//
+// Facts are matched case-insensitively; type, size and modify are used and
+// the rest skipped. Unlike ls-style listings, nothing is guessed: sizes are
+// exact 64-bit counts and modify is a full UTC timestamp, so the result
+// doesn't depend on the date or the server's idea of columns. Facts the
+// server leaves out are left at their defaults (a plain file, size 0, no
+// time).
+//
+// Like list_parser, each line is walked once with raw character offsets, and
+// the result is written straight into a caller-supplied file record.
+class mlsx_parser
+{
+public:
+
+	// Parse a single entry into f. Returns false (leaving f untouched) for the
+	// listed directory itself and its parent (type=cdir and type=pdir).
+	bool parse_line(const std::string & line, file & f) const
+		throw (std::runtime_error);
+
+	// Parse every entry in lines, appending the results to files. Returns the
+	// number of entries appended.
+	std::vector<file>::size_type parse_lines(
+		const std::vector<std::string> & lines, std::vector<file> & files)
+		const throw (std::runtime_error);
+
+}; // class mlsx_parser
+
+} // namespace ftp
+} // namespace model
+} // namespace foofxp
+
+#endif // FOOFXP_MLSX_PARSER_HPP_INCLUDED
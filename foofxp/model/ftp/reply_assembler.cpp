@@ -0,0 +1,85 @@
+#include <cctype>
+#include "reply_assembler.hpp"
+
+using namespace std;
+
+namespace foofxp {
+namespace model {
+namespace ftp {
+
+reply_assembler::reply_assembler() :
+	text_(),
+	last_line_(0),
+	lines_(0),
+	in_reply_(false)
+{}
+
+reply_assembler::result_type reply_assembler::add_line(const string & line,
+	bool keep_interior)
+{
+	if (!in_reply_)
+	{
+		// Must start with a 3-digit code, followed by a space if this is the
+		// only line, or a hyphen if there are more to come.
+		if (!has_code(line))
+			return invalid;
+
+		if (line[3] == ' ')
+		{
+			last_line_ = &line;
+			lines_ = 1;
+			return complete;
+		}
+
+		if (line[3] != '-')
+			return invalid;
+
+		line.copy(code_, 3);
+		text_.assign(line);
+		lines_ = 1;
+		in_reply_ = true;
+		return opened;
+	}
+
+	lines_++;
+
+	if (line.length() >= 4 && line[3] == ' ' &&
+		line.compare(0, 3, code_, 3) == 0)
+	{
+		// Same code as the first line, and a space: that's the end.
+		text_ += '\n';
+		text_ += line;
+		last_line_ = &line;
+		in_reply_ = false;
+		return complete;
+	}
+
+	if (keep_interior)
+	{
+		text_ += '\n';
+		text_ += line;
+	}
+
+	return interior;
+}
+
+void reply_assembler::reset()
+{
+	// Keep the buffer's storage for the next reply.
+	text_.clear();
+	last_line_ = 0;
+	lines_ = 0;
+	in_reply_ = false;
+}
+
+bool reply_assembler::has_code(const string & line)
+{
+	return line.length() >= 4 &&
+		isdigit(static_cast<unsigned char>(line[0])) &&
+		isdigit(static_cast<unsigned char>(line[1])) &&
+		isdigit(static_cast<unsigned char>(line[2]));
+}
+
+} // namespace ftp
+} // namespace model
+} // namespace foofxp
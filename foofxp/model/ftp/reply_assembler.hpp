@@ -0,0 +1,84 @@
+#ifndef FOOFXP_REPLY_ASSEMBLER_HPP_INCLUDED
+#define FOOFXP_REPLY_ASSEMBLER_HPP_INCLUDED
+
+#include <cstddef>
+#include <string>
+
+namespace foofxp {
+namespace model {
+namespace ftp {
+
+// Puts replies back together from the lines they arrive in. A multi-line
+// reply (RFC 959 section 4.2) opens with its code and a hyphen, and runs until
+// a line with the same code and a space:
+//
+//    230-Welcome to the site.
+//    Lines in between can say anything,
+//    230- including other codes, or
+//    211 the same code with a space in front.
+//    230 User logged in.
+//
+// Lines are collected into one buffer, which keeps its storage from reply to
+// reply. A single-line reply isn't copied at all.
+class reply_assembler
+{
+public:
+
+	typedef enum
+	{
+		// Not a reply, and not inside one.
+		invalid,
+
+		// The first line of a multi-line reply.
+		opened,
+
+		// A line between the first and last lines of a multi-line reply.
+		interior,
+
+		// The last (or only) line of a reply.
+		complete
+	}
+	result_type;
+
+	reply_assembler();
+
+	// Interior lines are only kept if keep_interior is set. Leave it unset
+	// for replies whose interior lines are dealt with as they arrive, like a
+	// STAT -l listing.
+	result_type add_line(const std::string & line, bool keep_interior = true);
+
+	// Forget any reply in progress.
+	void reset();
+
+	bool in_reply() const { return in_reply_; };
+
+	// Once a reply is complete: its last line, which has the code that
+	// counts, and the whole reply, one line per '\n'. last_line() is the line
+	// last passed to add_line(), as is text() for a one-line reply, so they
+	// are only valid as long as it is.
+	const std::string & last_line() const { return *last_line_; };
+	const std::string & text() const
+	{
+		return lines_ == 1 ? *last_line_ : text_;
+	};
+
+	// Number of lines in the reply so far, including any that weren't kept.
+	std::size_t lines() const { return lines_; };
+
+private:
+
+	static bool has_code(const std::string & line);
+
+	std::string text_;
+	const std::string * last_line_;
+	std::size_t lines_;
+	bool in_reply_;
+	char code_[3];
+
+}; // class reply_assembler
+
+} // namespace ftp
+} // namespace model
+} // namespace foofxp
+
+#endif // FOOFXP_REPLY_ASSEMBLER_HPP_INCLUDED
@@ -0,0 +1,95 @@
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include "resolver_cache.hpp"
+
+using namespace std;
+using namespace boost::posix_time;
+
+namespace foofxp {
+namespace model {
+namespace ftp {
+
+resolver_cache::resolver_cache(const time_duration & ttl) :
+	mutex_(),
+	ttl_(ttl),
+	entries_()
+{}
+
+resolver_cache & resolver_cache::shared()
+{
+	static resolver_cache cache(minutes(5));
+	return cache;
+}
+
+bool resolver_cache::find(const string & host, bool ipv6, endpoints & result)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+
+	entry_map::iterator found = entries_.find(make_pair(host, ipv6));
+	if (found == entries_.end())
+		return false;
+
+	if (found->second.expires <= microsec_clock::universal_time())
+	{
+		entries_.erase(found);
+		return false;
+	}
+
+	result = found->second.addresses;
+	return true;
+}
+
+void resolver_cache::insert(const string & host, bool ipv6,
+	const endpoints & addresses)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+
+	ptime now = microsec_clock::universal_time();
+
+	// Nobody may ask for most hosts again, so clear out the dead wood while
+	// we're here rather than let the cache grow forever.
+	purge(now);
+
+	entry & cached = entries_[make_pair(host, ipv6)];
+	cached.addresses = addresses;
+	cached.expires = now + ttl_;
+}
+
+void resolver_cache::erase(const string & host, bool ipv6)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	entries_.erase(make_pair(host, ipv6));
+}
+
+void resolver_cache::clear()
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	entries_.clear();
+}
+
+time_duration resolver_cache::ttl() const
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	return ttl_;
+}
+
+void resolver_cache::ttl(const time_duration & ttl)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	ttl_ = ttl;
+}
+
+void resolver_cache::purge(const ptime & now)
+{
+	entry_map::iterator i = entries_.begin();
+	while (i != entries_.end())
+	{
+		if (i->second.expires <= now)
+			entries_.erase(i++);
+		else
+			++i;
+	}
+}
+
+} // namespace ftp
+} // namespace model
+} // namespace foofxp
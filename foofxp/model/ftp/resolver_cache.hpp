@@ -0,0 +1,71 @@
+#ifndef FOOFXP_RESOLVER_CACHE_HPP_INCLUDED
+#define FOOFXP_RESOLVER_CACHE_HPP_INCLUDED
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace foofxp {
+namespace model {
+namespace ftp {
+
+// Host name lookups, remembered for a while so that reconnecting a lot of
+// sessions (say, after the network has dropped out) doesn't look every site
+// up again. The system resolver doesn't tell us the real TTL of the records,
+// so entries just expire after a fixed time.
+//
+// Safe to use from any thread.
+class resolver_cache : private boost::noncopyable
+{
+public:
+
+	typedef std::vector<boost::asio::ip::tcp::endpoint> endpoints;
+
+	explicit resolver_cache(const boost::posix_time::time_duration & ttl);
+
+	// The one shared by every control_stream. Entries last five minutes.
+	static resolver_cache & shared();
+
+	// ipv6 lookups are for both address families; others are IPv4 only.
+	// Returns false if there's nothing unexpired for the host.
+	bool find(const std::string & host, bool ipv6, endpoints & result);
+
+	void insert(const std::string & host, bool ipv6,
+		const endpoints & addresses);
+
+	// Forget a host, e.g. because none of its addresses work any more.
+	void erase(const std::string & host, bool ipv6);
+
+	void clear();
+
+	boost::posix_time::time_duration ttl() const;
+	void ttl(const boost::posix_time::time_duration & ttl);
+
+private:
+
+	struct entry
+	{
+		endpoints addresses;
+		boost::posix_time::ptime expires;
+	};
+
+	typedef std::map<std::pair<std::string, bool>, entry> entry_map;
+
+	void purge(const boost::posix_time::ptime & now);
+
+	mutable boost::mutex mutex_;
+	boost::posix_time::time_duration ttl_;
+	entry_map entries_;
+
+}; // class resolver_cache
+
+} // namespace ftp
+} // namespace model
+} // namespace foofxp
+
+#endif // FOOFXP_RESOLVER_CACHE_HPP_INCLUDED
@@ -1,6 +1,6 @@
 #include <cassert>
+#include <cctype>
 #include "../../utility/enforce_that.hpp"
-#include "../../utility/lexical_cast/lexical_cast.hpp"
 #include "server_reply.hpp"
 
 using namespace std;
@@ -11,62 +11,87 @@ namespace model {
 namespace ftp {
 
 server_reply::server_reply(const string & line) : 
-	line_(line), is_valid_format_(is_valid_format(line))
-{}
-
-bool server_reply::is_end_of_reply() const
-{	
-	// 3-digit reply code followed by a space, e.g.:
+	line_(line),
+	code_(0),
+	message_offset_(0),
+	is_valid_format_(false),
+	is_end_of_reply_(false)
+{
+	// 3-digit reply code followed by a space, or a hyphen and a space if
+	// there's more to come:
 	//    213- status of -l:    <--- not the end
 	//    213 End of Status.    <--- end
-	return is_valid_format_ && line_[3] == ' ';
+	//
+	// Line must be big enough to fit 3 digits and a space.
+	if (line.length() < 4)
+		return;
+	
+	// Anything below '0' wraps around, so one comparison per digit will do.
+	unsigned int hundreds = static_cast<unsigned char>(line[0]) - '0';
+	unsigned int tens = static_cast<unsigned char>(line[1]) - '0';
+	unsigned int units = static_cast<unsigned char>(line[2]) - '0';
+	
+	if (hundreds > 9 || tens > 9 || units > 9)
+		return;
+	
+	// A hyphen pushes the space, and everything after it, out by one.
+	bool continued = line[3] == '-';
+	string::size_type offset = continued ? 5 : 4;
+	
+	if (line.length() < offset || line[offset - 1] != ' ')
+		return;
+	
+	code_ = static_cast<reply_code_type>(hundreds * 100 + tens * 10 + units);
+	message_offset_ = offset;
+	is_valid_format_ = true;
+	is_end_of_reply_ = !continued;
+}
+
+bool server_reply::is_preliminary_reply() const throw(invalid_argument)
+{
+	check_valid_format();
+	
+	return code_ / 100 == 1;
 }
 
 bool server_reply::is_transient_negative_reply() const throw(invalid_argument)
 {
-	if (!is_valid_format_)
-		throw invalid_argument("Invalid server reply format.");
+	check_valid_format();
 	
-	return line_[0] == '4';
+	return code_ / 100 == 4;
 }
 	
 bool server_reply::is_permanent_negative_reply() const throw(invalid_argument)
 {
-	if (!is_valid_format_)
-		throw invalid_argument("Invalid server reply format.");
+	check_valid_format();
 	
-	return is_valid_format_ && line_[0] == '5';
+	return code_ / 100 == 5;
 }
 
 bool server_reply::is_negative_reply() const throw(invalid_argument)
 {
-	if (!is_valid_format_)
-		throw invalid_argument("Invalid server reply format.");
+	check_valid_format();
 	
-	return line_[0] == '4' || line_[0] == '5';
+	return code_ >= 400 && code_ < 600;
 }
 
 server_reply::reply_code_type server_reply::get_reply_code() const
 	throw(invalid_argument, out_of_range)
 {
-	if (!is_valid_format_)
-		throw new invalid_argument("Invalid server reply format.");
-		
-	short code = lexical_cast::from_string<short>(line_.substr(0, 3));
+	check_valid_format();
 	
-	if (code < 1)
+	if (code_ < 1)
 		throw out_of_range("Server reply code out of range.");
 	
-	else if (code > 699)
+	else if (code_ > 699)
 		throw out_of_range("Server reply code out of range.");
 	
-	return code;
+	return code_;
 }
 
 string server_reply::get_pwd_path() const throw(invalid_argument)
 {
-	if (!is_valid_format_)
-		throw new invalid_argument("Invalid server reply format.");
+	check_valid_format();
 	
 	// Find the start of the path.
 	string::size_type start = line_.find('"');
@@ -85,41 +110,100 @@ string server_reply::get_pwd_path() const throw(invalid_argument)
 	return line_.substr(start, end - start);
 }
 
+boost::asio::ip::tcp::endpoint server_reply::get_pasv_endpoint() const
+	throw (invalid_argument)
+{
+	check_valid_format();
+	
+	// Not every server puts the numbers in brackets, so just look for the
+	// first six comma-separated numbers after the reply code.
+	string::size_type position = 4;
+	while (position < line_.length() &&
+		!isdigit(static_cast<unsigned char>(line_[position])))
+		position++;
+	
+	unsigned int numbers[6];
+	for (int i = 0; i < 6; i++)
+	{
+		enforce_that(position < line_.length() &&
+			isdigit(static_cast<unsigned char>(line_[position])),
+			invalid_argument, "Invalid PASV reply.");
+		
+		numbers[i] = 0;
+		while (position < line_.length() &&
+			isdigit(static_cast<unsigned char>(line_[position])) &&
+			numbers[i] <= 255)
+			numbers[i] = numbers[i] * 10 + (line_[position++] - '0');
+		
+		enforce_that(numbers[i] <= 255, invalid_argument,
+			"Invalid PASV reply.");
+		
+		if (i < 5)
+		{
+			enforce_that(position < line_.length() && line_[position] == ',',
+				invalid_argument, "Invalid PASV reply.");
+			position++;
+		}
+	}
+	
+	boost::asio::ip::address_v4::bytes_type address;
+	for (int i = 0; i < 4; i++)
+		address[i] = static_cast<unsigned char>(numbers[i]);
+	
+	return boost::asio::ip::tcp::endpoint(
+		boost::asio::ip::address_v4(address),
+		static_cast<port_type>(numbers[4] * 256 + numbers[5]));
+}
+
+port_type server_reply::get_epsv_port() const throw (invalid_argument)
+{
+	check_valid_format();
+	
+	// (<d><d><d><port><d>), where <d> is usually '|'.
+	string::size_type start = line_.find('(');
+	
+	enforce_that(start != string::npos && start + 5 < line_.length(),
+		invalid_argument, "Invalid EPSV reply.");
+	
+	char delimiter = line_[start + 1];
+	
+	enforce_that(line_[start + 2] == delimiter &&
+		line_[start + 3] == delimiter, invalid_argument, "Invalid EPSV reply.");
+	
+	string::size_type position = start + 4;
+	unsigned long port = 0;
+	
+	while (position < line_.length() &&
+		isdigit(static_cast<unsigned char>(line_[position])) && port <= 65535)
+		port = port * 10 + (line_[position++] - '0');
+	
+	enforce_that(position > start + 4 && position < line_.length() &&
+		line_[position] == delimiter && port > 0 && port <= 65535,
+		invalid_argument, "Invalid EPSV reply.");
+	
+	return static_cast<port_type>(port);
+}
+
 string server_reply::get_message() const throw(invalid_argument)
 {
-	if (!is_valid_format_)
-		throw new invalid_argument("Invalid server reply format.");
+	text_range message = get_message_range();
+	return string(message.begin(), message.end());
+}
+
+server_reply::text_range server_reply::get_message_range() const
+	throw(invalid_argument)
+{
+	check_valid_format();
 	
 	// Where does the message start? I.e. "421 Blah" starts at pos 4, 
 	// "421- Blah" starts at 5.
-	if (line_[3] == '-')
-		return line_.substr(5);
-	else
-		return line_.substr(4);
+	return text_range(line_.begin() + message_offset_, line_.end());
 }
 
-bool server_reply::is_valid_format(const string & line)
+void server_reply::check_valid_format() const throw(invalid_argument)
 {
-	// Line must be big enough to fit 3 digits and a space.
-	if (line.length() < 4)
-		return false;
-	
-	if (!isdigit(line[0]) ||
-		!isdigit(line[1]) ||
-		!isdigit(line[2]))
-		return false;
-	
-	// Possibly followed by a hyphen, which pushes everything out by one.
-	if (line[3] == '-')
-	{
-		// Line must be a bit longer to fit the hyphen.
-		if (line.length() < 5)
-			return false;
-		
-		return line[4] == ' ';
-	}
-	else
-		return line[3] == ' ';
+	if (!is_valid_format_)
+		throw invalid_argument("Invalid server reply format.");
 }
 
 } // namespace ftp
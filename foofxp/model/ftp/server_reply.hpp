@@ -3,36 +3,67 @@
 
 #include <stdexcept>
 #include <string>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/range/iterator_range.hpp>
+#include "port_type.hpp"
 
 namespace foofxp {
 namespace model {
 namespace ftp {
 
+// A line received from the server, decoded as a reply. Doesn't copy the line:
+// it refers to it, so the line must outlive the server_reply.
+//
+// The reply code, continuation flag and start of the message are worked out
+// once, up front, so checking them costs nothing. Only the getters that
+// return a std::string (or parse a PASV/EPSV reply) do any real work.
 class server_reply
 {
 public:
 	typedef unsigned short reply_code_type;
+	typedef boost::iterator_range<std::string::const_iterator> text_range;
 
-	server_reply(const std::string & line);
+	explicit server_reply(const std::string & line);
 	
-	bool is_end_of_reply() const;
+	bool is_end_of_reply() const { return is_end_of_reply_; };
 	bool is_valid_format() const {  return is_valid_format_; };
+	bool is_preliminary_reply() const throw(std::invalid_argument);
 	bool is_transient_negative_reply() const throw(std::invalid_argument);
 	bool is_permanent_negative_reply() const throw(std::invalid_argument);
 	bool is_negative_reply() const throw(std::invalid_argument);
 	std::string get_message() const throw(std::invalid_argument);
 	const std::string & original_line() const { return line_; };
 	
+	// The message without the reply code, e.g. "blah" in "501- blah", as a
+	// range of the original line.
+	text_range get_message_range() const throw(std::invalid_argument);
+	
 	reply_code_type get_reply_code() const 
 		throw (std::invalid_argument, std::out_of_range);
 	std::string get_pwd_path() const throw (std::invalid_argument);
 	
+	// Data connection address from a PASV reply, e.g.
+	// "227 Entering Passive Mode (192,168,0,7,4,1)".
+	boost::asio::ip::tcp::endpoint get_pasv_endpoint() const
+		throw (std::invalid_argument);
+	
+	// Data connection port from an EPSV reply, e.g.
+	// "229 Entering Extended Passive Mode (|||1025|)". The address is the same
+	// as the control connection's.
+	port_type get_epsv_port() const throw (std::invalid_argument);
+	
 private:
 	
-	static bool is_valid_format(const std::string & line);
+	void check_valid_format() const throw(std::invalid_argument);
+	
+	const std::string & line_;
 	
-	std::string line_;
+	// Only meaningful if is_valid_format_. code_ is the three digits as is,
+	// and may be out of range.
+	reply_code_type code_;
+	std::string::size_type message_offset_;
 	bool is_valid_format_;
+	bool is_end_of_reply_;
 };
 
 } // namespace ftp
@@ -0,0 +1,158 @@
+#include "tls_session_cache.hpp"
+
+using namespace std;
+
+namespace foofxp {
+namespace model {
+namespace ftp {
+
+namespace {
+
+void free_key(void * parent, void * key, CRYPTO_EX_DATA * data, int index,
+	long argl, void * argp)
+{
+	delete static_cast<string *>(key);
+}
+
+// Where save_new_sessions() leaves the cache and key on an SSL, for
+// handle_new_session(). The key goes when the SSL does.
+const int cache_index = SSL_get_ex_new_index(0, 0, 0, 0, 0);
+const int key_index = SSL_get_ex_new_index(0, 0, 0, 0, &free_key);
+
+} // namespace
+
+tls_session_cache::tls_session_cache() :
+	mutex_(),
+	sessions_(),
+	hits_(0),
+	misses_(0)
+{}
+
+tls_session_cache::~tls_session_cache()
+{
+	clear();
+}
+
+tls_session_cache & tls_session_cache::shared()
+{
+	static tls_session_cache cache;
+	return cache;
+}
+
+void tls_session_cache::resume(SSL * ssl, const string & key)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+
+	session_map::const_iterator found = sessions_.find(key);
+	if (found != sessions_.end())
+		// Takes its own reference.
+		SSL_set_session(ssl, found->second);
+}
+
+void tls_session_cache::handshake_completed(SSL * ssl)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+
+	if (SSL_session_reused(ssl))
+		hits_++;
+	else
+		misses_++;
+}
+
+void tls_session_cache::save(SSL * ssl, const string & key)
+{
+	SSL_SESSION * session = SSL_get1_session(ssl);
+	if (session)
+		store(key, session);
+}
+
+void tls_session_cache::watch_new_sessions(SSL_CTX * context)
+{
+	// Without SSL_SESS_CACHE_CLIENT, OpenSSL doesn't tell a client about
+	// its sessions. It needn't keep them itself, either.
+	SSL_CTX_set_session_cache_mode(context,
+		SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+	SSL_CTX_sess_set_new_cb(context, &tls_session_cache::handle_new_session);
+}
+
+void tls_session_cache::save_new_sessions(SSL * ssl, const string & key)
+{
+	delete static_cast<string *>(SSL_get_ex_data(ssl, key_index));
+	SSL_set_ex_data(ssl, key_index, new string(key));
+	SSL_set_ex_data(ssl, cache_index, this);
+}
+
+void tls_session_cache::close_cleanly(SSL * ssl)
+{
+	// Without waiting around for the server's close_notify.
+	SSL_set_shutdown(ssl, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+}
+
+void tls_session_cache::erase(const string & key)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+
+	session_map::iterator found = sessions_.find(key);
+	if (found == sessions_.end())
+		return;
+
+	SSL_SESSION_free(found->second);
+	sessions_.erase(found);
+}
+
+void tls_session_cache::clear()
+{
+	boost::mutex::scoped_lock lock(mutex_);
+
+	for (session_map::iterator i = sessions_.begin(); i != sessions_.end(); i++)
+		SSL_SESSION_free(i->second);
+
+	sessions_.clear();
+}
+
+void tls_session_cache::store(const string & key, SSL_SESSION * session)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+
+	SSL_SESSION * & saved = sessions_[key];
+
+	// A server may hand over more than one session for the same connection.
+	// Only the latest is kept.
+	if (saved)
+		SSL_SESSION_free(saved);
+
+	saved = session;
+}
+
+int tls_session_cache::handle_new_session(SSL * ssl, SSL_SESSION * session)
+{
+	// Data connections share the context, but not the key: their sessions
+	// aren't wanted.
+	tls_session_cache * cache = static_cast<tls_session_cache *>(
+		SSL_get_ex_data(ssl, cache_index));
+	const string * key = static_cast<const string *>(
+		SSL_get_ex_data(ssl, key_index));
+
+	if (!cache || !key)
+		return 0;
+
+	// Returning 1 keeps OpenSSL's reference to the session for the cache.
+	cache->store(*key, session);
+	return 1;
+}
+
+unsigned long tls_session_cache::hits() const
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	return hits_;
+}
+
+unsigned long tls_session_cache::misses() const
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	return misses_;
+}
+
+} // namespace ftp
+} // namespace model
+} // namespace foofxp
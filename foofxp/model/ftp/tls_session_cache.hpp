@@ -0,0 +1,86 @@
+#ifndef FOOFXP_TLS_SESSION_CACHE_HPP_INCLUDED
+#define FOOFXP_TLS_SESSION_CACHE_HPP_INCLUDED
+
+#include <map>
+#include <string>
+#include <boost/asio/ssl.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace foofxp {
+namespace model {
+namespace ftp {
+
+// TLS sessions, by site, so that a reconnect can resume the last session
+// instead of doing a full handshake, and data connections can resume their
+// control connection's session (which many servers insist on).
+//
+// Only control connections save sessions. If a data connection saved its own
+// session, the next one would offer that instead of the control connection's.
+//
+// Safe to use from any thread.
+class tls_session_cache : private boost::noncopyable
+{
+public:
+
+	tls_session_cache();
+	~tls_session_cache();
+
+	// The one shared by every control_stream and data_stream.
+	static tls_session_cache & shared();
+
+	// Before a handshake: offer the session saved for key, if there is one.
+	void resume(SSL * ssl, const std::string & key);
+
+	// After a successful handshake: count whether the session was resumed.
+	void handshake_completed(SSL * ssl);
+
+	// Remember ssl's current session for key. Cheap to call again with an
+	// unchanged session.
+	void save(SSL * ssl, const std::string & key);
+
+	// Once, where a context is set up, before any of its connections are
+	// made: have it hand new sessions to save_new_sessions().
+	static void watch_new_sessions(SSL_CTX * context);
+
+	// Before a handshake: save each new session the server gives ssl for
+	// key as it arrives. TLS 1.3 servers only send the session to resume
+	// after the handshake (NewSessionTicket), whenever they get round to it.
+	// ssl's context must be watching for them.
+	void save_new_sessions(SSL * ssl, const std::string & key);
+
+	// Call before closing a connection whose session might be resumed. If
+	// a connection just stops without a TLS shutdown, OpenSSL takes it to
+	// have been cut off and won't resume its session again. This only marks
+	// the shutdown as done; where the other end needs the close_notify
+	// (the end of an upload), shut the stream down properly first.
+	static void close_cleanly(SSL * ssl);
+
+	void erase(const std::string & key);
+	void clear();
+
+	// Handshakes that did and didn't resume a session.
+	unsigned long hits() const;
+	unsigned long misses() const;
+
+private:
+
+	typedef std::map<std::string, SSL_SESSION *> session_map;
+
+	// Takes over the caller's reference to session.
+	void store(const std::string & key, SSL_SESSION * session);
+
+	static int handle_new_session(SSL * ssl, SSL_SESSION * session);
+
+	mutable boost::mutex mutex_;
+	session_map sessions_;
+	unsigned long hits_;
+	unsigned long misses_;
+
+}; // class tls_session_cache
+
+} // namespace ftp
+} // namespace model
+} // namespace foofxp
+
+#endif // FOOFXP_TLS_SESSION_CACHE_HPP_INCLUDED
@@ -0,0 +1,536 @@
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include <boost/crc.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include "transfer_journal.hpp"
+#include "../../utility/format.hpp"
+#include "../../utility/trace.hpp"
+
+// These are for open(), pread(), write(), fdatasync() and rename().
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace boost::posix_time;
+using namespace foofxp::utility;
+
+namespace foofxp {
+namespace model {
+namespace ftp {
+
+// Each record is the length of its payload and the payload's CRC-32 (both
+// uint32), then the payload itself: a type byte and the transfer's id
+// (uint64), followed by
+//
+//    begin:       size (uint64), then the remote and local paths, each as a
+//                 uint32 length and that many bytes
+//    checkpoint:  offset (uint64), a checksum flag (uint8) and the checksum
+//                 (uint32)
+//    complete:    nothing
+//
+// in host byte order -- a journal belongs to the machine that wrote it.
+
+// Anything longer is taken to be garbage.
+static const size_t max_record_size = 16 * 1024;
+
+const size_t transfer_journal::tail_size;
+const size_t transfer_journal::compact_size;
+
+template<class value_type>
+static void put(string & out, value_type value)
+{
+	out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+static void put(string & out, const string & value)
+{
+	put(out, static_cast<boost::uint32_t>(value.length()));
+	out.append(value);
+}
+
+template<class value_type>
+static bool get(const string & in, size_t & position, value_type & value)
+{
+	if (in.length() - position < sizeof(value))
+		return false;
+
+	memcpy(&value, in.data() + position, sizeof(value));
+	position += sizeof(value);
+	return true;
+}
+
+static bool get(const string & in, size_t & position, string & value)
+{
+	boost::uint32_t length;
+	if (!get(in, position, length) || in.length() - position < length)
+		return false;
+
+	value.assign(in, position, length);
+	position += length;
+	return true;
+}
+
+static boost::uint32_t crc(const char * data, size_t length)
+{
+	boost::crc_32_type result;
+	result.process_bytes(data, length);
+	return result.checksum();
+}
+
+transfer_journal::entry::entry() :
+	id(0),
+	remote_path(),
+	local_path(),
+	size(0),
+	offset(0),
+	has_checksum(false),
+	checksum(0)
+{}
+
+transfer_journal::transfer_journal(const string & path) throw (runtime_error) :
+	path_(path),
+	flush_interval_(seconds(1)),
+	mutex_(),
+	fd_(-1),
+	file_size_(0),
+	entries_(),
+	next_id_(1),
+	pending_(),
+	last_flush_(microsec_clock::universal_time()),
+	flushes_(0)
+{
+	int fd = ::open(path.c_str(), O_RDONLY);
+
+	if (fd != -1)
+	{
+		string contents;
+		vector<char> buffer(64 * 1024);
+
+		ssize_t length;
+		while ((length = ::read(fd, &buffer[0], buffer.size())) > 0 ||
+			(length < 0 && errno == EINTR))
+			if (length > 0)
+				contents.append(&buffer[0], length);
+
+		::close(fd);
+		replay(contents);
+	}
+
+	// Start afresh with just the transfers still to finish.
+	rewrite();
+
+	trace_this_at(info, general,
+		("transfer_journal opened %s (%lu unfinished)", path.c_str(),
+		static_cast<unsigned long>(entries_.size())));
+}
+
+transfer_journal::~transfer_journal()
+{
+	try
+	{
+		flush();
+	}
+	catch (const runtime_error & ex)
+	{
+		trace_this_at(error, general, ("transfer_journal lost records: %s",
+			ex.what()));
+	}
+
+	if (fd_ != -1)
+		::close(fd_);
+}
+
+// ----------------------------------------------------------------------------
+// public operations
+// ----------------------------------------------------------------------------
+
+time_duration transfer_journal::flush_interval() const
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	return flush_interval_;
+}
+
+void transfer_journal::flush_interval(const time_duration & interval)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	flush_interval_ = interval;
+}
+
+transfer_journal::id_type transfer_journal::begin(const string & remote_path,
+	const string & local_path, boost::uint64_t size)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+
+	for (entry_map::iterator existing = entries_.begin();
+		existing != entries_.end(); existing++)
+	{
+		if (existing->second.remote_path == remote_path &&
+			existing->second.local_path == local_path)
+			return existing->first;
+	}
+
+	entry & transfer = entries_[next_id_];
+	transfer.id = next_id_++;
+	transfer.remote_path = remote_path;
+	transfer.local_path = local_path;
+	transfer.size = size;
+
+	append_begin(pending_, transfer);
+
+	// Nothing is lost if this doesn't make it to disk: there's nothing to
+	// resume yet.
+	return transfer.id;
+}
+
+bool transfer_journal::find(const string & remote_path,
+	const string & local_path, entry & found) const
+{
+	boost::mutex::scoped_lock lock(mutex_);
+
+	for (entry_map::const_iterator existing = entries_.begin();
+		existing != entries_.end(); existing++)
+	{
+		if (existing->second.remote_path == remote_path &&
+			existing->second.local_path == local_path)
+		{
+			found = existing->second;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+vector<transfer_journal::entry> transfer_journal::unfinished() const
+{
+	boost::mutex::scoped_lock lock(mutex_);
+
+	vector<entry> result;
+	for (entry_map::const_iterator existing = entries_.begin();
+		existing != entries_.end(); existing++)
+		result.push_back(existing->second);
+
+	return result;
+}
+
+void transfer_journal::checkpoint(id_type id, boost::uint64_t offset)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+
+	entry_map::iterator found = entries_.find(id);
+	if (found == entries_.end())
+		return;
+
+	found->second.offset = offset;
+	found->second.has_checksum = false;
+	found->second.checksum = 0;
+
+	append_checkpoint(pending_, found->second);
+	flush_if_due();
+}
+
+void transfer_journal::checkpoint(id_type id, boost::uint64_t offset,
+	boost::uint32_t checksum)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+
+	entry_map::iterator found = entries_.find(id);
+	if (found == entries_.end())
+		return;
+
+	found->second.offset = offset;
+	found->second.has_checksum = true;
+	found->second.checksum = checksum;
+
+	append_checkpoint(pending_, found->second);
+	flush_if_due();
+}
+
+void transfer_journal::complete(id_type id)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+
+	if (entries_.erase(id) == 0)
+		return;
+
+	// If this is lost, the transfer is resumed from its last checkpoint,
+	// and there's little or nothing left to fetch.
+	append_complete(pending_, id);
+	flush_if_due();
+}
+
+void transfer_journal::flush() throw (runtime_error)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	flush_locked();
+}
+
+unsigned long transfer_journal::flushes() const
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	return flushes_;
+}
+
+bool transfer_journal::tail_checksum(int fd, boost::uint64_t offset,
+	boost::uint32_t & checksum)
+{
+	size_t length = static_cast<size_t>(min<boost::uint64_t>(offset,
+		tail_size));
+
+	if (length == 0)
+		return false;
+
+	vector<char> buffer(length);
+	size_t done = 0;
+
+	while (done < length)
+	{
+		ssize_t result = ::pread(fd, &buffer[done], length - done,
+			offset - length + done);
+
+		if (result < 0 && errno == EINTR)
+			continue;
+		else if (result <= 0)
+			return false;
+
+		done += result;
+	}
+
+	checksum = crc(&buffer[0], length);
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+// internal transfer_journal stuff
+// ----------------------------------------------------------------------------
+
+void transfer_journal::replay(const string & contents)
+{
+	size_t position = 0;
+
+	while (position < contents.length())
+	{
+		// Stop at the first record that isn't all there -- most likely the
+		// last one, cut off by a crash.
+		boost::uint32_t length, checksum;
+		if (!get(contents, position, length) ||
+			!get(contents, position, checksum) ||
+			length > max_record_size || contents.length() - position < length ||
+			crc(contents.data() + position, length) != checksum)
+		{
+			trace_this_at(warning, general,
+				("transfer_journal %s ends in a damaged record at %lu",
+				path_.c_str(), static_cast<unsigned long>(position)));
+			break;
+		}
+
+		string payload(contents, position, length);
+		position += length;
+
+		size_t field = 0;
+		boost::uint8_t type;
+		id_type id;
+		if (!get(payload, field, type) || !get(payload, field, id))
+			continue;
+
+		next_id_ = max(next_id_, id + 1);
+
+		if (type == begin_record)
+		{
+			entry transfer;
+			transfer.id = id;
+
+			if (get(payload, field, transfer.size) &&
+				get(payload, field, transfer.remote_path) &&
+				get(payload, field, transfer.local_path))
+				entries_[id] = transfer;
+		}
+		else if (type == checkpoint_record)
+		{
+			entry_map::iterator found = entries_.find(id);
+			boost::uint8_t has_checksum;
+
+			if (found != entries_.end() &&
+				get(payload, field, found->second.offset) &&
+				get(payload, field, has_checksum) &&
+				get(payload, field, found->second.checksum))
+				found->second.has_checksum = has_checksum != 0;
+		}
+		else if (type == complete_record)
+			entries_.erase(id);
+	}
+}
+
+void transfer_journal::rewrite() throw (runtime_error)
+{
+	string contents;
+	for (entry_map::const_iterator transfer = entries_.begin();
+		transfer != entries_.end(); transfer++)
+	{
+		append_begin(contents, transfer->second);
+
+		if (transfer->second.offset != 0)
+			append_checkpoint(contents, transfer->second);
+	}
+
+	// Written to one side and renamed over the old file, so a crash leaves
+	// one or the other, never a mixture.
+	string temporary = path_ + ".new";
+	int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1)
+		throw runtime_error(format(256, "Could not create %s: %s",
+			temporary.c_str(), strerror(errno)));
+
+	size_t done = 0;
+	while (done < contents.length())
+	{
+		ssize_t result = ::write(fd, contents.data() + done,
+			contents.length() - done);
+
+		if (result < 0 && errno == EINTR)
+			continue;
+
+		if (result < 0)
+		{
+			string message = format(256, "Could not write %s: %s",
+				temporary.c_str(), strerror(errno));
+			::close(fd);
+			throw runtime_error(message);
+		}
+
+		done += result;
+	}
+
+	if (::fdatasync(fd) != 0 || ::rename(temporary.c_str(), path_.c_str()) != 0)
+	{
+		string message = format(256, "Could not replace %s: %s",
+			path_.c_str(), strerror(errno));
+		::close(fd);
+		throw runtime_error(message);
+	}
+
+	::close(fd);
+
+	if (fd_ != -1)
+		::close(fd_);
+
+	fd_ = ::open(path_.c_str(), O_WRONLY | O_APPEND);
+	if (fd_ == -1)
+		throw runtime_error(format(256, "Could not open %s: %s",
+			path_.c_str(), strerror(errno)));
+
+	file_size_ = contents.length();
+}
+
+void transfer_journal::append_begin(string & out, const entry & transfer) const
+{
+	string payload;
+	put(payload, static_cast<boost::uint8_t>(begin_record));
+	put(payload, transfer.id);
+	put(payload, transfer.size);
+	put(payload, transfer.remote_path);
+	put(payload, transfer.local_path);
+
+	append_record(out, payload);
+}
+
+void transfer_journal::append_checkpoint(string & out,
+	const entry & transfer) const
+{
+	string payload;
+	put(payload, static_cast<boost::uint8_t>(checkpoint_record));
+	put(payload, transfer.id);
+	put(payload, transfer.offset);
+	put(payload, static_cast<boost::uint8_t>(transfer.has_checksum));
+	put(payload, transfer.checksum);
+
+	append_record(out, payload);
+}
+
+void transfer_journal::append_complete(string & out, id_type id) const
+{
+	string payload;
+	put(payload, static_cast<boost::uint8_t>(complete_record));
+	put(payload, id);
+
+	append_record(out, payload);
+}
+
+void transfer_journal::append_record(string & out, const string & payload)
+	const
+{
+	put(out, static_cast<boost::uint32_t>(payload.length()));
+	put(out, crc(payload.data(), payload.length()));
+	out.append(payload);
+}
+
+void transfer_journal::flush_if_due()
+{
+	if (microsec_clock::universal_time() - last_flush_ < flush_interval_)
+		return;
+
+	try
+	{
+		flush_locked();
+	}
+	catch (const runtime_error & ex)
+	{
+		// Try again next time. The transfer itself is fine.
+		trace_this_at(warning, general, ("transfer_journal flush failed: %s",
+			ex.what()));
+	}
+}
+
+void transfer_journal::flush_locked() throw (runtime_error)
+{
+	last_flush_ = microsec_clock::universal_time();
+
+	if (pending_.empty())
+		return;
+
+	if (file_size_ + pending_.length() >= compact_size)
+	{
+		// Everything pending is already reflected in entries_.
+		rewrite();
+		pending_.clear();
+		flushes_++;
+		return;
+	}
+
+	size_t done = 0;
+	while (done < pending_.length())
+	{
+		ssize_t result = ::write(fd_, pending_.data() + done,
+			pending_.length() - done);
+
+		if (result < 0 && errno == EINTR)
+			continue;
+
+		if (result < 0)
+		{
+			// Whatever did get written may end in half a record, which would
+			// hide everything after it, so start a fresh file next time.
+			if (done > 0)
+				file_size_ = compact_size;
+
+			throw runtime_error(format(256, "Could not write %s: %s",
+				path_.c_str(), strerror(errno)));
+		}
+
+		done += result;
+	}
+
+	if (::fdatasync(fd_) != 0)
+		throw runtime_error(format(256, "Could not sync %s: %s",
+			path_.c_str(), strerror(errno)));
+
+	file_size_ += pending_.length();
+	pending_.clear();
+	flushes_++;
+}
+
+} // namespace ftp
+} // namespace model
+} // namespace foofxp
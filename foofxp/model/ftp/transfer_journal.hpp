@@ -0,0 +1,140 @@
+#ifndef FOOFXP_TRANSFER_JOURNAL_HPP_INCLUDED
+#define FOOFXP_TRANSFER_JOURNAL_HPP_INCLUDED
+
+#include <cstddef>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace foofxp {
+namespace model {
+namespace ftp {
+
+// An append-only record of how far each download has got, so one that's cut
+// short -- by a crash, or a dropped connection -- can carry on from where it
+// stopped (REST) instead of starting again.
+//
+// The journal is a file of small checksummed records: one when a transfer
+// starts, one per checkpoint, and one when it's done. Records are held in
+// memory until flush_interval() has passed since the last flush, then written
+// out together with one write() and one fdatasync(), so a fast transfer (or
+// lots of them) costs a sync a second rather than one per checkpoint. A record
+// torn by a crash is where replay stops.
+//
+// An offset is only as good as the data before it, so the local file must be
+// synced up to it before checkpoint() is called (ftp::client does this). A
+// checkpoint can also carry a checksum of the data just before the offset
+// (see tail_checksum()), which catches a local file that has been truncated
+// or written over since.
+//
+// Opening a journal drops the transfers that finished, and rewrites the rest
+// into a fresh file; so does a flush, once the file passes compact_size.
+class transfer_journal : private boost::noncopyable
+{
+public:
+
+	typedef boost::uint64_t id_type;
+
+	struct entry
+	{
+		entry();
+
+		id_type id;
+		std::string remote_path;
+		std::string local_path;
+
+		// 0 if not known.
+		boost::uint64_t size;
+
+		// Everything before offset is in the local file.
+		boost::uint64_t offset;
+		bool has_checksum;
+		boost::uint32_t checksum;
+	};
+
+	// Bytes checked by tail_checksum().
+	static const std::size_t tail_size = 64 * 1024;
+
+	// Size past which the file is rewritten without its dead records.
+	static const std::size_t compact_size = 1024 * 1024;
+
+	// Opens path, creating it if need be, and replays it.
+	explicit transfer_journal(const std::string & path)
+		throw (std::runtime_error);
+
+	// Flushes anything held back.
+	~transfer_journal();
+
+	// Default 1 second.
+	boost::posix_time::time_duration flush_interval() const;
+	void flush_interval(const boost::posix_time::time_duration & interval);
+
+	// Starts recording a transfer, or picks up the unfinished one between
+	// the same two paths.
+	id_type begin(const std::string & remote_path,
+		const std::string & local_path, boost::uint64_t size);
+
+	// The unfinished transfer between the two paths, if any.
+	bool find(const std::string & remote_path, const std::string & local_path,
+		entry & found) const;
+
+	std::vector<entry> unfinished() const;
+
+	// Records that everything before offset is safely in the local file.
+	void checkpoint(id_type id, boost::uint64_t offset);
+	void checkpoint(id_type id, boost::uint64_t offset,
+		boost::uint32_t checksum);
+
+	void complete(id_type id);
+
+	// Writes out and syncs anything held back.
+	void flush() throw (std::runtime_error);
+
+	// Syncs so far.
+	unsigned long flushes() const;
+
+	// CRC-32 of the (up to) tail_size bytes of fd before offset. False if
+	// they can't be read, or there aren't any.
+	static bool tail_checksum(int fd, boost::uint64_t offset,
+		boost::uint32_t & checksum);
+
+private:
+
+	typedef enum { begin_record = 1, checkpoint_record, complete_record }
+		record_type;
+
+	typedef std::map<id_type, entry> entry_map;
+
+	void replay(const std::string & contents);
+	void rewrite() throw (std::runtime_error);
+	void append_begin(std::string & out, const entry & transfer) const;
+	void append_checkpoint(std::string & out, const entry & transfer) const;
+	void append_complete(std::string & out, id_type id) const;
+	void append_record(std::string & out, const std::string & payload) const;
+	void flush_if_due();
+	void flush_locked() throw (std::runtime_error);
+
+	std::string path_;
+	boost::posix_time::time_duration flush_interval_;
+
+	mutable boost::mutex mutex_;
+	int fd_;
+	std::size_t file_size_;
+	entry_map entries_;
+	id_type next_id_;
+	std::string pending_;
+	boost::posix_time::ptime last_flush_;
+	unsigned long flushes_;
+
+}; // class transfer_journal
+
+} // namespace ftp
+} // namespace model
+} // namespace foofxp
+
+#endif // FOOFXP_TRANSFER_JOURNAL_HPP_INCLUDED
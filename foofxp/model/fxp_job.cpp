@@ -0,0 +1,338 @@
+#include <boost/bind.hpp>
+#include "fxp_job.hpp"
+#include "../utility/trace.hpp"
+
+using namespace std;
+using namespace boost::asio::ip;
+using namespace foofxp::model::ftp;
+using namespace foofxp::utility;
+
+namespace foofxp {
+namespace model {
+
+fxp_job::item::item(const string & source_path,
+	const string & destination_path) :
+	source_path(source_path),
+	destination_path(destination_path),
+	endpoint(),
+	source_done(false),
+	destination_done(false),
+	error()
+{}
+
+fxp_job::fxp_job(client & source, client & destination) :
+	source_(source),
+	destination_(destination),
+	connections_(),
+	mutex_(),
+	running_(false),
+	items_(),
+	first_id_(0),
+	next_passive_(0),
+	passive_pending_(false),
+	destination_operations_(),
+	source_operations_()
+{
+	connections_.push_back(destination.passive_mode_entered.connect(
+		boost::bind(&fxp_job::handle_passive_mode_entered, this, _1, _2)));
+	connections_.push_back(destination.transfer_started.connect(
+		boost::bind(&fxp_job::handle_destination_started, this, _1, _2)));
+	connections_.push_back(destination.transfer_completed.connect(
+		boost::bind(&fxp_job::handle_destination_completed, this, _1, _2)));
+	connections_.push_back(destination.transfer_failed.connect(
+		boost::bind(&fxp_job::handle_destination_failed, this, _1, _2)));
+	connections_.push_back(source.transfer_completed.connect(
+		boost::bind(&fxp_job::handle_source_completed, this, _1, _2)));
+	connections_.push_back(source.transfer_failed.connect(
+		boost::bind(&fxp_job::handle_source_failed, this, _1, _2)));
+}
+
+fxp_job::~fxp_job()
+{
+	for (vector<boost::signals::connection>::iterator connection =
+		connections_.begin(); connection != connections_.end(); connection++)
+		connection->disconnect();
+}
+
+// ----------------------------------------------------------------------------
+// public operations
+// ----------------------------------------------------------------------------
+
+void fxp_job::add(const string & source_path, const string & destination_path)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+
+	items_.push_back(item(source_path, destination_path));
+
+	if (running_ && !passive_pending_)
+		request_passive();
+}
+
+void fxp_job::begin()
+{
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		trace_this_at(info, general, ("fxp_job starting with %lu files",
+			static_cast<unsigned long>(items_.size())));
+
+		running_ = true;
+
+		// Two servers that both protect data would both wait for the other
+		// to start the TLS handshake. Have one that can (SSCN) do it instead;
+		// if neither can, they'll have to sort it out themselves.
+		if (source_.protect_data() && destination_.protect_data())
+		{
+			client * tls_client = destination_.has_feature("SSCN") ?
+				&destination_ : source_.has_feature("SSCN") ? &source_ : 0;
+
+			if (tls_client)
+				tls_client->strand().post(boost::bind(
+					static_cast<void (client::*)(bool)>(
+					&client::fxp_tls_client), tls_client, true));
+		}
+
+		if (!items_.empty())
+		{
+			if (!passive_pending_)
+				request_passive();
+
+			return;
+		}
+	}
+
+	// Nothing to do.
+	completed(*this);
+}
+
+size_t fxp_job::remaining() const
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	return items_.size();
+}
+
+// ----------------------------------------------------------------------------
+// client event handlers
+// ----------------------------------------------------------------------------
+
+void fxp_job::handle_passive_mode_entered(client & sender,
+	const tcp::endpoint & endpoint)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+
+	if (destination_operations_.empty() ||
+		destination_operations_.front().first != passive)
+		return;
+
+	size_t id = destination_operations_.front().second;
+	destination_operations_.pop_front();
+	passive_pending_ = false;
+
+	item & entry = find(id);
+	entry.endpoint = endpoint;
+
+	trace_this_at(debug, general, ("fxp_job transferring %s to %s",
+		entry.source_path.c_str(), entry.destination_path.c_str()));
+
+	// Some servers (vsftpd, proftpd) don't answer STOR with 150 until
+	// something has connected to the passive port, so waiting for it before
+	// sending RETR would wait forever. Send RETR right behind STOR instead.
+	destination_operations_.push_back(make_pair(store, id));
+	source_operations_.push_back(id);
+	destination_.strand().post(boost::bind(&fxp_job::begin_transfer, this,
+		entry.destination_path, entry.endpoint, entry.source_path));
+
+	// Queue up the next file behind this one.
+	request_passive();
+}
+
+void fxp_job::handle_destination_started(client & sender,
+	const string & path)
+{
+	trace_this_at(debug, general, ("fxp_job transfer to %s under way",
+		path.c_str()));
+}
+
+void fxp_job::handle_destination_completed(client & sender,
+	const string & path)
+{
+	handle_destination_result(string());
+}
+
+void fxp_job::handle_destination_failed(client & sender,
+	const string & message)
+{
+	handle_destination_result(message);
+}
+
+void fxp_job::handle_source_completed(client & sender, const string & path)
+{
+	handle_source_result(string());
+}
+
+void fxp_job::handle_source_failed(client & sender, const string & message)
+{
+	handle_source_result(message);
+}
+
+void fxp_job::handle_destination_result(const string & message)
+{
+	vector<result> finished;
+	bool done;
+
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		if (destination_operations_.empty())
+			return;
+
+		pair<destination_operation, size_t> operation =
+			destination_operations_.front();
+		destination_operations_.pop_front();
+
+		item & entry = find(operation.second);
+
+		if (operation.first == passive)
+		{
+			// PASV failed. Skip this file, and try the next.
+			passive_pending_ = false;
+			fail(entry, message);
+			entry.source_done = true;
+			entry.destination_done = true;
+			request_passive();
+		}
+		else
+		{
+			entry.destination_done = true;
+
+			if (!message.empty())
+				fail(entry, message);
+		}
+
+		collect_finished(finished);
+		done = !finished.empty() && items_.empty();
+	}
+
+	report(finished, done);
+}
+
+void fxp_job::handle_source_result(const string & message)
+{
+	vector<result> finished;
+	bool done;
+
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		if (source_operations_.empty())
+			return;
+
+		item & entry = find(source_operations_.front());
+		source_operations_.pop_front();
+
+		entry.source_done = true;
+
+		if (!message.empty())
+		{
+			fail(entry, message);
+
+			// Nothing is coming, so don't leave the destination waiting
+			// for its data connection until the server gives up.
+			if (!entry.destination_done)
+				destination_.strand().post(boost::bind(
+					&client::begin_fxp_abort, &destination_,
+					entry.destination_path));
+		}
+
+		collect_finished(finished);
+		done = !finished.empty() && items_.empty();
+	}
+
+	report(finished, done);
+}
+
+// ----------------------------------------------------------------------------
+// internal fxp_job stuff
+// ----------------------------------------------------------------------------
+
+fxp_job::item & fxp_job::find(size_t id)
+{
+	return items_[id - first_id_];
+}
+
+void fxp_job::fail(item & entry, const string & message)
+{
+	// Keep the first error -- later ones are usually a knock-on effect.
+	if (entry.error.empty())
+		entry.error = message;
+}
+
+void fxp_job::begin_transfer(const string & destination_path,
+	const tcp::endpoint & endpoint, const string & source_path)
+{
+	// On the destination's strand, so STOR is on its way before the source
+	// is told to connect.
+	destination_.begin_fxp_store(destination_path);
+
+	source_.strand().post(boost::bind(&client::begin_fxp_retrieve, &source_,
+		endpoint, source_path));
+}
+
+void fxp_job::request_passive()
+{
+	if (next_passive_ == first_id_ + items_.size())
+		// Nothing left to set up.
+		return;
+
+	destination_operations_.push_back(make_pair(passive, next_passive_++));
+	passive_pending_ = true;
+
+	destination_.strand().post(boost::bind(&client::begin_fxp_passive,
+		&destination_));
+}
+
+void fxp_job::collect_finished(vector<result> & finished)
+{
+	// Files finish in order on each side, but a file that fails early can
+	// finish before the one ahead of it. Hold it back so the ids stay put.
+	while (!items_.empty() && items_.front().source_done &&
+		items_.front().destination_done)
+	{
+		result file;
+		file.path = items_.front().source_path;
+		file.error = items_.front().error;
+		finished.push_back(file);
+
+		items_.pop_front();
+		first_id_++;
+	}
+}
+
+void fxp_job::report(const vector<result> & finished, bool done)
+{
+	for (vector<result>::const_iterator file = finished.begin();
+		file != finished.end(); file++)
+	{
+		if (file->error.empty())
+		{
+			trace_this_at(info, general, ("fxp_job transferred %s",
+				file->path.c_str()));
+
+			file_completed(*this, file->path);
+		}
+		else
+		{
+			trace_this_at(warning, general,
+				("fxp_job failed to transfer %s: %s", file->path.c_str(),
+				file->error.c_str()));
+
+			file_failed(*this, file->path, file->error);
+		}
+	}
+
+	if (done)
+		completed(*this);
+}
+
+} // namespace model
+} // namespace foofxp
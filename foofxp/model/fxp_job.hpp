@@ -0,0 +1,139 @@
+#ifndef FOOFXP_FXP_JOB_HPP_INCLUDED
+#define FOOFXP_FXP_JOB_HPP_INCLUDED
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread_safe_signal.hpp>
+#include "ftp/client.hpp"
+
+namespace foofxp {
+namespace model {
+
+// A queue of site-to-site (FXP) transfers from one logged in session to
+// another. The data goes directly between the two servers.
+//
+// For each file, the destination is put into passive mode and sent STOR, and
+// the source is sent PORT and RETR straight after, without waiting for the
+// destination's 150: some servers only send that once the source has
+// connected. A file is done when both servers have sent their final reply.
+//
+// The next file's PASV goes out as soon as the current file's STOR has, so it
+// is already answered (right behind the current 226) by the time the
+// destination is free. Each file therefore costs about one round trip on top
+// of the transfer itself, instead of one per command.
+//
+// If both sessions protect data, one of the servers is asked to play the TLS
+// client on the data connections (SSCN), where either supports it.
+//
+// The job drives the clients from their own strands, and its signals fire on
+// whichever thread the client signal that triggered them was on. Both clients
+// must outlive the job, and shouldn't be given anything else to do while it
+// runs.
+class fxp_job : private boost::noncopyable
+{
+public:
+
+	typedef boost::signal<void(fxp_job & sender)> fxp_job_event;
+	typedef boost::signal<void(fxp_job & sender, const std::string & path)>
+		fxp_file_event;
+	typedef boost::signal<void(fxp_job & sender, const std::string & path,
+		const std::string & message)> fxp_file_error_event;
+
+	fxp_job(ftp::client & source, ftp::client & destination);
+	~fxp_job();
+
+	// Fire with the source path of each file, in the order they were added.
+	fxp_file_event file_completed;
+	fxp_file_error_event file_failed;
+
+	// Fires when the queue runs dry.
+	fxp_job_event completed;
+
+	// Files may be added before or while the job runs.
+	void add(const std::string & source_path,
+		const std::string & destination_path);
+
+	// Both clients must be logged in.
+	void begin();
+
+	// Files queued or in flight.
+	std::size_t remaining() const;
+
+private:
+
+	typedef enum { passive, store } destination_operation;
+
+	struct item
+	{
+		item(const std::string & source_path,
+			const std::string & destination_path);
+
+		std::string source_path;
+		std::string destination_path;
+		boost::asio::ip::tcp::endpoint endpoint;
+		bool source_done;
+		bool destination_done;
+		std::string error;
+	};
+
+	struct result
+	{
+		std::string path;
+		std::string error;
+	};
+
+	item & find(std::size_t id);
+	void fail(item & entry, const std::string & message);
+	void begin_transfer(const std::string & destination_path,
+		const boost::asio::ip::tcp::endpoint & endpoint,
+		const std::string & source_path);
+	void request_passive();
+	void collect_finished(std::vector<result> & finished);
+	void report(const std::vector<result> & finished, bool done);
+
+	void handle_passive_mode_entered(ftp::client & sender,
+		const boost::asio::ip::tcp::endpoint & endpoint);
+	void handle_destination_started(ftp::client & sender,
+		const std::string & path);
+	void handle_destination_completed(ftp::client & sender,
+		const std::string & path);
+	void handle_destination_failed(ftp::client & sender,
+		const std::string & message);
+	void handle_source_completed(ftp::client & sender,
+		const std::string & path);
+	void handle_source_failed(ftp::client & sender,
+		const std::string & message);
+
+	void handle_destination_result(const std::string & message);
+	void handle_source_result(const std::string & message);
+
+	ftp::client & source_;
+	ftp::client & destination_;
+	std::vector<boost::signals::connection> connections_;
+
+	mutable boost::mutex mutex_;
+	bool running_;
+
+	// Files in order of submission. first_id_ is the id of items_.front(), and
+	// next_passive_ the id of the first file not put in passive mode yet.
+	std::deque<item> items_;
+	std::size_t first_id_;
+	std::size_t next_passive_;
+	bool passive_pending_;
+
+	// Outstanding operations on each client, oldest first. Their replies come
+	// back in the same order.
+	std::deque<std::pair<destination_operation, std::size_t> >
+		destination_operations_;
+	std::deque<std::size_t> source_operations_;
+
+}; // class fxp_job
+
+} // namespace model
+} // namespace foofxp
+
+#endif // FOOFXP_FXP_JOB_HPP_INCLUDED
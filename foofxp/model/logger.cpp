@@ -1,40 +1,84 @@
+#include <boost/bind.hpp>
 #include "logger.hpp"
 
 using std::string;
+using boost::asio::io_service;
 
 namespace foofxp {
 namespace model {
 
-logger::logger(size_type size) : lines_(), max_size_(size) {}
-	
-logger::logger(const logger & other) : 
-	lines_(other.lines_), max_size_(other.max_size_)
+logger::logger(size_type size) :
+	lines_(size),
+	max_size_(size),
+	next_(0),
+	size_(0),
+	lines_added_(0),
+	strand_(0),
+	notify_pending_(false)
 {}
-	
+
+logger::logger(size_type size, io_service::strand & strand) :
+	lines_(size),
+	max_size_(size),
+	next_(0),
+	size_(0),
+	lines_added_(0),
+	strand_(&strand),
+	notify_pending_(false)
+{}
+
+logger::logger(const logger & other) :
+	lines_(other.lines_),
+	max_size_(other.max_size_),
+	next_(other.next_),
+	size_(other.size_),
+	lines_added_(other.lines_added_),
+	strand_(other.strand_),
+	notify_pending_(false)
+{}
+
 logger::~logger() {}
 
-string logger::last_line() const
+const string & logger::last_line() const
 {
-	if (lines_.empty())
-		// Return empty string.
-		return string();
-		
+	static const string empty;
+
+	if (size_ == 0)
+		return empty;
+
 	else
-		return string(lines_.front());
+		return (*this)[0];
 }
-	
+
 void logger::add_line(const string & line)
 {
-	lines_.push_front(line);
-	trim_size();
-	updated(*this);
+	if (max_size_ == 0)
+		return;
+
+	// Overwrite the oldest slot, reusing its storage.
+	lines_[next_].assign(line);
+	next_ = (next_ + 1) % max_size_;
+
+	if (size_ < max_size_)
+		size_++;
+
+	lines_added_++;
+
+	if (strand_ == 0)
+		updated(*this);
+
+	else if (!notify_pending_)
+	{
+		// Let the rest of this batch of lines arrive before telling anyone.
+		notify_pending_ = true;
+		strand_->post(boost::bind(&logger::notify, this));
+	}
 }
 
-void logger::trim_size()
+void logger::notify()
 {
-	// Trim log.
-	if (lines_.size() > max_size_)
-		lines_.resize(max_size_);
+	notify_pending_ = false;
+	updated(*this);
 }
 
 } // namespace model
@@ -2,39 +2,114 @@
 #define FOOFXP_SESSION_LOG_HPP_INCLUDED
 
 #include <string>
-#include <deque>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/iterator/iterator_facade.hpp>
+#include <boost/range/iterator_range.hpp>
 #include <boost/thread_safe_signal.hpp>
 
 namespace foofxp {
 namespace model {
 
+// Fixed-capacity session log. Lines are kept in a ring of preallocated string
+// slots, so once the ring has wrapped, adding a line reuses the storage of the
+// line it replaces instead of allocating.
 class logger
 {
 public:
-	
+
 	typedef boost::signal<void(const logger &)> log_event;
-	typedef std::deque<std::string> string_deque;
-	typedef string_deque::size_type size_type;
-	
-	logger(size_type size);
+	typedef std::vector<std::string>::size_type size_type;
+
+	// Random access iterator over the lines, newest first.
+	class const_iterator : public boost::iterator_facade<const_iterator,
+		const std::string, boost::random_access_traversal_tag>
+	{
+	public:
+
+		const_iterator() : log_(0), index_(0) {};
+
+		const_iterator(const logger & log, size_type index) :
+			log_(&log), index_(index)
+		{};
+
+	private:
+
+		friend class boost::iterator_core_access;
+
+		const std::string & dereference() const { return (*log_)[index_]; };
+		void increment() { ++index_; };
+		void decrement() { --index_; };
+		void advance(difference_type n) { index_ += n; };
+
+		bool equal(const const_iterator & other) const
+		{
+			return log_ == other.log_ && index_ == other.index_;
+		};
+
+		difference_type distance_to(const const_iterator & other) const
+		{
+			return static_cast<difference_type>(other.index_) -
+				static_cast<difference_type>(index_);
+		};
+
+		const logger * log_;
+		size_type index_;
+	};
+
+	typedef boost::iterator_range<const_iterator> lines_view;
+
+	// Notifies listeners synchronously, once per line.
+	explicit logger(size_type size);
+
+	// Coalesces notifications: however many lines are added in one go,
+	// updated fires once, from a handler posted to strand. Lines must be added
+	// from the same strand.
+	logger(size_type size, boost::asio::io_service::strand & strand);
+
 	logger(const logger & other);
 	~logger();
-	
+
 	log_event updated;
-	
-	std::string last_line() const;
-	
-	string_deque lines() const { return lines_; };
-	
+
+	const std::string & last_line() const;
+
+	// A view of the lines, newest first. No lines are copied, but the view is
+	// only valid until the next add_line().
+	lines_view lines() const
+	{
+		return lines_view(const_iterator(*this, 0),
+			const_iterator(*this, size_));
+	};
+
+	// Line by age; 0 is the newest.
+	const std::string & operator[](size_type index) const
+	{
+		return lines_[(next_ + max_size_ - 1 - index) % max_size_];
+	};
+
+	size_type size() const { return size_; };
+	size_type max_size() const { return max_size_; };
+
+	// Total number of lines ever added. Listeners of a coalescing logger can
+	// compare this against the value they saw last time to tell how many
+	// lines are new.
+	unsigned long lines_added() const { return lines_added_; };
+
 	void add_line(const std::string & line);
-		
+
 private:
-	
-	void trim_size();
-	
-	string_deque lines_;
+
+	void notify();
+
+	std::vector<std::string> lines_;
 	size_type max_size_;
-	
+	size_type next_;
+	size_type size_;
+	unsigned long lines_added_;
+	boost::asio::io_service::strand * strand_;
+	bool notify_pending_;
+
 }; // class logger
 
 } // namespace model
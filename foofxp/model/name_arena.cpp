@@ -0,0 +1,136 @@
+#include <cstring>
+#include "name_arena.hpp"
+
+using namespace std;
+
+namespace foofxp {
+namespace model {
+
+// Most names are well under 100 bytes, so a block holds hundreds of them.
+static const size_t block_size = 64 * 1024;
+
+static const size_t initial_slots = 1024;
+
+// FNV-1a.
+static size_t hash_name(const char * name, size_t length)
+{
+	size_t hash = 2166136261U;
+
+	for (size_t i = 0; i < length; ++i)
+	{
+		hash ^= static_cast<unsigned char>(name[i]);
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+name_arena::name_arena() :
+	blocks_(),
+	block_bytes_(0),
+	next_(0),
+	limit_(0),
+	index_(initial_slots, static_cast<const char *>(0)),
+	count_(0)
+{}
+
+name_arena::~name_arena()
+{
+	for (vector<char *>::iterator block = blocks_.begin();
+		block != blocks_.end(); ++block)
+		delete [] *block;
+}
+
+const char * name_arena::intern(const char * begin, const char * end)
+{
+	size_t length = end - begin;
+	size_t i = slot(begin, length);
+
+	if (index_[i])
+		return index_[i];
+
+	const char * name = store(begin, end);
+
+	index_[i] = name;
+	if (++count_ * 2 > index_.size())
+		grow_index();
+
+	return name;
+}
+
+const char * name_arena::intern(const char * name)
+{
+	return intern(name, name + strlen(name));
+}
+
+const char * name_arena::find(const char * begin, const char * end) const
+{
+	return index_[slot(begin, end - begin)];
+}
+
+size_t name_arena::memory_used() const
+{
+	return block_bytes_ + index_.capacity() * sizeof(const char *) +
+		blocks_.capacity() * sizeof(char *);
+}
+
+const char * name_arena::store(const char * begin, const char * end)
+{
+	size_t length = end - begin;
+	char * name;
+
+	if (length + 1 > block_size)
+	{
+		// A block to itself, leaving the current one to fill.
+		blocks_.push_back(0);
+		blocks_.back() = new char[length + 1];
+		block_bytes_ += length + 1;
+		name = blocks_.back();
+	}
+	else
+	{
+		if (static_cast<size_t>(limit_ - next_) < length + 1)
+		{
+			blocks_.push_back(0);
+			blocks_.back() = new char[block_size];
+			block_bytes_ += block_size;
+			next_ = blocks_.back();
+			limit_ = next_ + block_size;
+		}
+
+		name = next_;
+		next_ += length + 1;
+	}
+
+	memcpy(name, begin, length);
+	name[length] = '\0';
+
+	return name;
+}
+
+size_t name_arena::slot(const char * name, size_t length) const
+{
+	size_t mask = index_.size() - 1;
+	size_t i = hash_name(name, length) & mask;
+
+	// The load factor is kept under a half, so there's always a gap.
+	while (index_[i] && (strncmp(index_[i], name, length) != 0 ||
+		index_[i][length] != '\0'))
+		i = (i + 1) & mask;
+
+	return i;
+}
+
+void name_arena::grow_index()
+{
+	vector<const char *> old(index_.size() * 2, static_cast<const char *>(0));
+	old.swap(index_);
+
+	for (vector<const char *>::const_iterator name = old.begin();
+		name != old.end(); ++name)
+		if (*name)
+			index_[slot(*name, strlen(*name))] = *name;
+}
+
+} // namespace model
+} // namespace foofxp
@@ -0,0 +1,62 @@
+#ifndef FOOFXP_NAME_ARENA_HPP_INCLUDED
+#define FOOFXP_NAME_ARENA_HPP_INCLUDED
+
+#include <cstddef>
+#include <vector>
+#include <boost/noncopyable.hpp>
+
+namespace foofxp {
+namespace model {
+
+// Keeps one copy of each file name, for directory_tables that would otherwise
+// hold thousands of std::strings saying "Sample", ".message" or "*.nfo".
+// Names are packed end to end, each terminated by a NUL, in big blocks that
+// are only freed with the arena, so a name interned once can be compared by
+// pointer and read without a lock for as long as the arena lasts.
+//
+// intern() and find() aren't thread safe -- callers sharing an arena between
+// threads must take turns -- but reading names already handed out is.
+class name_arena : private boost::noncopyable
+{
+public:
+
+	name_arena();
+	~name_arena();
+
+	// The arena's copy of [begin, end), added if it isn't there yet.
+	const char * intern(const char * begin, const char * end);
+	const char * intern(const char * name);
+
+	// The arena's copy of [begin, end), or 0 if it hasn't one.
+	const char * find(const char * begin, const char * end) const;
+
+	// Distinct names held.
+	std::size_t size() const { return count_; };
+
+	// Bytes allocated, for blocks and the index both.
+	std::size_t memory_used() const;
+
+private:
+
+	// Copies [begin, end) and a NUL after the last name, starting a new
+	// block if need be.
+	const char * store(const char * begin, const char * end);
+
+	std::size_t slot(const char * name, std::size_t length) const;
+	void grow_index();
+
+	std::vector<char *> blocks_;
+	std::size_t block_bytes_;
+	char * next_;
+	char * limit_;
+
+	// Open addressing, by hash of the name; 0 is an empty slot.
+	std::vector<const char *> index_;
+	std::size_t count_;
+
+}; // class name_arena
+
+} // namespace model
+} // namespace foofxp
+
+#endif // FOOFXP_NAME_ARENA_HPP_INCLUDED
@@ -0,0 +1,576 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include "segmented_download.hpp"
+#include "../utility/format.hpp"
+#include "../utility/trace.hpp"
+
+// These are for open(), close(), ftruncate() and posix_fallocate().
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace boost::posix_time;
+using namespace foofxp::model::ftp;
+using namespace foofxp::utility;
+
+namespace foofxp {
+namespace model {
+
+double segmented_download::segment_report::bytes_per_second() const
+{
+	return seconds > 0 ? length / seconds : 0;
+}
+
+segmented_download::slot::slot(ftp::client & session) :
+	client(&session),
+	active(false),
+	dead(false),
+	finished(false),
+	generation(0),
+	offset(0),
+	end(0),
+	transferred(0),
+	started(),
+	rate(0)
+{}
+
+segmented_download::segmented_download(const vector<client *> & clients,
+	const string & remote_path, const string & local_path,
+	boost::uint64_t size) :
+	slots_(),
+	connections_(),
+	remote_path_(remote_path),
+	local_path_(local_path),
+	size_(size),
+	minimum_segment_(1024 * 1024),
+	split_segments_(true),
+	max_failures_(3),
+	mutex_(),
+	fd_(-1),
+	running_(false),
+	error_(),
+	failures_(0),
+	pending_(),
+	waiting_(),
+	samples_pending_(0)
+{
+	for (vector<client *>::const_iterator c = clients.begin();
+		c != clients.end(); c++)
+	{
+		client & session = **c;
+		slots_.push_back(slot(session));
+
+		connections_.push_back(session.transfer_completed.connect(
+			boost::bind(&segmented_download::handle_transfer_completed, this,
+				_1, _2)));
+		connections_.push_back(session.transfer_failed.connect(
+			boost::bind(&segmented_download::handle_transfer_failed, this,
+				_1, _2)));
+		connections_.push_back(session.fatal_error_occurred.connect(
+			boost::bind(&segmented_download::handle_fatal_error, this,
+				_1, _2)));
+		connections_.push_back(session.idle.connect(
+			boost::bind(&segmented_download::handle_idle, this, _1)));
+	}
+}
+
+segmented_download::~segmented_download()
+{
+	for (vector<boost::signals::connection>::iterator connection =
+		connections_.begin(); connection != connections_.end(); connection++)
+		connection->disconnect();
+
+	if (fd_ != -1)
+		::close(fd_);
+}
+
+// ----------------------------------------------------------------------------
+// public operations
+// ----------------------------------------------------------------------------
+
+void segmented_download::begin()
+{
+	string error;
+
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		fd_ = ::open(local_path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+		if (fd_ == -1)
+			error = format(256, "Could not open %s: %s", local_path_.c_str(),
+				strerror(errno));
+		else
+		{
+			// Reserve the whole file up front, so the ranges don't leave it
+			// fragmented, and a full disk shows up now rather than halfway
+			// through.
+			// posix_fallocate() returns its error rather than setting errno.
+			// Only a filesystem that can't reserve space is worth falling
+			// back to ftruncate() for; anything else, a full disk above all,
+			// is an error.
+			int result = EOPNOTSUPP;
+#if defined(__linux__)
+			if (size_ > 0)
+				result = ::posix_fallocate(fd_, 0, size_);
+#endif
+			if (result == EOPNOTSUPP || result == EINVAL)
+				result = ::ftruncate(fd_, size_) == 0 ? 0 : errno;
+
+			if (result != 0)
+				error = format(256, "Could not allocate %s: %s",
+					local_path_.c_str(), strerror(result));
+		}
+
+		if (error.empty())
+		{
+			// A small file isn't worth splitting as many ways.
+			boost::uint64_t count = slots_.size();
+			if (minimum_segment_ > 0)
+				count = max<boost::uint64_t>(1,
+					min(count, size_ / minimum_segment_));
+
+			trace_this_at(info, general,
+				("segmented_download starting %s in %lu segments",
+				remote_path_.c_str(), static_cast<unsigned long>(count)));
+
+			running_ = true;
+
+			boost::uint64_t offset = 0;
+			for (size_t index = 0; index < count; index++)
+			{
+				boost::uint64_t end = index + 1 == count ? size_ :
+					size_ / count * (index + 1);
+
+				start(index, range(offset, end));
+				offset = end;
+			}
+		}
+	}
+
+	if (!error.empty())
+		failed(*this, error);
+}
+
+size_t segmented_download::active_segments() const
+{
+	boost::mutex::scoped_lock lock(mutex_);
+
+	size_t active = 0;
+	for (vector<slot>::const_iterator entry = slots_.begin();
+		entry != slots_.end(); entry++)
+		if (entry->active)
+			active++;
+
+	return active;
+}
+
+// ----------------------------------------------------------------------------
+// client event handlers
+// ----------------------------------------------------------------------------
+
+void segmented_download::handle_transfer_completed(client & sender,
+	const string & path)
+{
+	segment_report segment;
+
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		size_t index = find(sender);
+		if (index == slots_.size() || !slots_[index].active)
+			return;
+
+		slot & entry = slots_[index];
+		entry.active = false;
+		entry.finished = true;
+
+		segment.client = index;
+		segment.offset = entry.offset;
+		segment.length = sender.bytes_transferred();
+		segment.seconds = (microsec_clock::universal_time() -
+			entry.started).total_microseconds() / 1e6;
+		entry.rate = segment.bytes_per_second();
+
+		// The server only stops early at the end of the file.
+		if (segment.length < entry.end - entry.offset && error_.empty())
+			error_ = format(256, "%s is shorter than expected.",
+				remote_path_.c_str());
+	}
+
+	trace_this_at(info, general,
+		("segmented_download segment at %lu done: %lu bytes, %.0f bytes/s",
+		static_cast<unsigned long>(segment.offset),
+		static_cast<unsigned long>(segment.length),
+		segment.bytes_per_second()));
+
+	segment_completed(*this, segment);
+}
+
+void segmented_download::handle_transfer_failed(client & sender,
+	const string & message)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+
+	size_t index = find(sender);
+	if (index == slots_.size() || !slots_[index].active)
+		return;
+
+	slot & entry = slots_[index];
+	entry.active = false;
+	entry.finished = true;
+
+	trace_this_at(warning, general,
+		("segmented_download segment at %lu failed: %s",
+		static_cast<unsigned long>(entry.offset), message.c_str()));
+
+	// Put back what's left, for whoever is free next.
+	boost::uint64_t position = entry.offset + min(sender.bytes_transferred(),
+		entry.end - entry.offset);
+
+	if (position < entry.end)
+		pending_.push_back(range(position, entry.end));
+
+	if (++failures_ > max_failures_ && error_.empty())
+		error_ = message;
+}
+
+void segmented_download::handle_fatal_error(client & sender,
+	const string & message)
+{
+	string error;
+	bool done;
+
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		size_t index = find(sender);
+		if (index == slots_.size() || slots_[index].dead)
+			return;
+
+		slot & entry = slots_[index];
+		entry.dead = true;
+		entry.finished = false;
+
+		if (entry.active)
+		{
+			entry.active = false;
+
+			boost::uint64_t position = entry.offset +
+				min(sender.bytes_transferred(), entry.end - entry.offset);
+
+			if (position < entry.end)
+				pending_.push_back(range(position, entry.end));
+
+			if (++failures_ > max_failures_ && error_.empty())
+				error_ = message;
+		}
+
+		// Hand the range on to a client that has run out of work, if any.
+		for (size_t other = 0; other < slots_.size() && !pending_.empty() &&
+			error_.empty(); other++)
+		{
+			slot & candidate = slots_[other];
+
+			if (!candidate.active && !candidate.dead && !candidate.finished &&
+				std::find(waiting_.begin(), waiting_.end(), other) ==
+				waiting_.end())
+			{
+				start(other, pending_.front());
+				pending_.pop_front();
+			}
+		}
+
+		done = finish(error);
+	}
+
+	report(done, error);
+}
+
+void segmented_download::handle_idle(client & sender)
+{
+	string error;
+	bool done;
+
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		size_t index = find(sender);
+		if (index == slots_.size() || !slots_[index].finished)
+			return;
+
+		slots_[index].finished = false;
+
+		if (error_.empty())
+			assign(index);
+
+		done = finish(error);
+	}
+
+	report(done, error);
+}
+
+void segmented_download::handle_sample(size_t index, unsigned int generation)
+{
+	string error;
+	bool done;
+
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		// Runs on the client's strand, so its progress can be read safely.
+		slot & entry = slots_[index];
+		if (entry.active && entry.generation == generation)
+			entry.transferred = entry.client->bytes_transferred();
+
+		if (--samples_pending_ == 0)
+			rebalance();
+
+		done = finish(error);
+	}
+
+	report(done, error);
+}
+
+// ----------------------------------------------------------------------------
+// internal segmented_download stuff
+// ----------------------------------------------------------------------------
+
+size_t segmented_download::find(const client & session) const
+{
+	for (size_t index = 0; index < slots_.size(); index++)
+		if (slots_[index].client == &session)
+			return index;
+
+	return slots_.size();
+}
+
+void segmented_download::start(size_t index, const range & part)
+{
+	slot & entry = slots_[index];
+	entry.active = true;
+	entry.finished = false;
+	entry.generation++;
+	entry.offset = part.first;
+	entry.end = part.second;
+	entry.transferred = 0;
+	entry.started = microsec_clock::universal_time();
+
+	trace_this_at(debug, general,
+		("segmented_download client %lu taking %lu-%lu",
+		static_cast<unsigned long>(index),
+		static_cast<unsigned long>(part.first),
+		static_cast<unsigned long>(part.second)));
+
+	// A range that runs to the end of the file is left open, so there's no
+	// ABOR unless it gets split later.
+	boost::uint64_t length = part.second == size_ ? 0 :
+		part.second - part.first;
+
+	entry.client->strand().post(boost::bind(&client::begin_download_range,
+		entry.client, remote_path_, fd_, part.first, length));
+}
+
+void segmented_download::assign(size_t index)
+{
+	if (!pending_.empty())
+	{
+		start(index, pending_.front());
+		pending_.pop_front();
+		return;
+	}
+
+	if (!split_segments_)
+		return;
+
+	// Nothing left unclaimed, so see whose range to take a share of.
+	waiting_.push_back(index);
+
+	if (samples_pending_ == 0)
+		begin_sampling();
+}
+
+void segmented_download::begin_sampling()
+{
+	for (size_t index = 0; index < slots_.size(); index++)
+	{
+		slot & entry = slots_[index];
+
+		if (!entry.active)
+			continue;
+
+		samples_pending_++;
+		entry.client->strand().post(boost::bind(
+			&segmented_download::handle_sample, this, index,
+			entry.generation));
+	}
+
+	if (samples_pending_ == 0)
+		rebalance();
+}
+
+void segmented_download::rebalance()
+{
+	ptime now = microsec_clock::universal_time();
+
+	// The least worth handing over, and never an empty range.
+	boost::uint64_t smallest = max<boost::uint64_t>(1, minimum_segment_);
+
+	while (!waiting_.empty() && error_.empty())
+	{
+		size_t thief = waiting_.front();
+
+		// Each client's speed on the range it's on now, or failing that, the
+		// last one it finished. The average stands in for clients we know
+		// nothing about yet.
+		vector<double> rates(slots_.size(), 0);
+		double total = 0;
+		size_t known = 0;
+
+		for (size_t index = 0; index < slots_.size(); index++)
+		{
+			const slot & entry = slots_[index];
+			double seconds = (now - entry.started).total_microseconds() / 1e6;
+
+			if (entry.active && entry.transferred > 0 && seconds > 0)
+				rates[index] = entry.transferred / seconds;
+			else
+				rates[index] = entry.rate;
+
+			if (rates[index] > 0)
+			{
+				total += rates[index];
+				known++;
+			}
+		}
+
+		double average = known > 0 ? total / known : 0;
+		for (size_t index = 0; index < slots_.size(); index++)
+			if (rates[index] == 0)
+				rates[index] = average;
+
+		// The range that looks like finishing last.
+		size_t victim = slots_.size();
+		double latest = -1;
+
+		for (size_t index = 0; index < slots_.size(); index++)
+		{
+			const slot & entry = slots_[index];
+
+			if (!entry.active)
+				continue;
+
+			boost::uint64_t position = entry.offset + entry.transferred;
+			if (position >= entry.end || entry.end - position <= smallest)
+				continue;
+
+			// With nothing to go on, bytes left will have to do.
+			double remaining = static_cast<double>(entry.end - position);
+			double finish = rates[index] > 0 ? remaining / rates[index] :
+				remaining;
+
+			if (finish > latest)
+			{
+				latest = finish;
+				victim = index;
+			}
+		}
+
+		if (victim == slots_.size())
+			// Nothing worth splitting.
+			break;
+
+		slot & entry = slots_[victim];
+		boost::uint64_t position = entry.offset + entry.transferred;
+		boost::uint64_t remaining = entry.end - position;
+
+		// Give each side a share in proportion to its speed, so they should
+		// both finish at about the same time.
+		boost::uint64_t keep = remaining / 2;
+		if (rates[victim] > 0 && rates[thief] > 0)
+			keep = static_cast<boost::uint64_t>(remaining *
+				(rates[victim] / (rates[victim] + rates[thief])));
+
+		keep = min(max<boost::uint64_t>(keep, 1), remaining - smallest);
+
+		boost::uint64_t split = position + keep;
+		boost::uint64_t end = entry.end;
+		entry.end = split;
+
+		trace_this_at(info, general,
+			("segmented_download splitting segment at %lu at %lu",
+			static_cast<unsigned long>(entry.offset),
+			static_cast<unsigned long>(split)));
+
+		entry.client->strand().post(boost::bind(
+			&client::shrink_download_range, entry.client,
+			split - entry.offset));
+
+		waiting_.pop_front();
+		start(thief, range(split, end));
+	}
+
+	// Anyone still waiting has nothing left to do.
+	waiting_.clear();
+}
+
+bool segmented_download::finish(string & error)
+{
+	if (!running_ || samples_pending_ > 0)
+		return false;
+
+	bool live = false;
+
+	for (vector<slot>::const_iterator entry = slots_.begin();
+		entry != slots_.end(); entry++)
+	{
+		if (entry->active || entry->finished)
+			return false;
+
+		if (!entry->dead)
+			live = true;
+	}
+
+	if (!pending_.empty() && error_.empty())
+	{
+		if (live)
+			return false;
+
+		error_ = "No sessions left to download with.";
+	}
+
+	running_ = false;
+	error = error_;
+
+	::close(fd_);
+	fd_ = -1;
+
+	return true;
+}
+
+void segmented_download::report(bool done, const string & error)
+{
+	if (!done)
+		return;
+
+	if (error.empty())
+	{
+		trace_this_at(info, general, ("segmented_download of %s complete",
+			remote_path_.c_str()));
+
+		completed(*this);
+	}
+	else
+	{
+		trace_this_at(warning, general, ("segmented_download of %s failed: %s",
+			remote_path_.c_str(), error.c_str()));
+
+		failed(*this, error);
+	}
+}
+
+} // namespace model
+} // namespace foofxp
@@ -0,0 +1,169 @@
+#ifndef FOOFXP_SEGMENTED_DOWNLOAD_HPP_INCLUDED
+#define FOOFXP_SEGMENTED_DOWNLOAD_HPP_INCLUDED
+
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread_safe_signal.hpp>
+#include "ftp/client.hpp"
+
+namespace foofxp {
+namespace model {
+
+// Downloads one large file over several sessions to the same site at once,
+// each fetching its own range of the file (REST + RETR) into its own part of
+// a preallocated local file. Useful where the server, or the route to it,
+// limits each connection well below what the link can carry.
+//
+// The file starts off split evenly between the clients. Whenever a client
+// finishes its range, the job looks at how the others are getting on, and
+// takes over the back of whichever range looks like finishing last, sized so
+// both should finish together. That client's range is shortened (it closes
+// its data connection and sends ABOR when it gets there), and the free client
+// downloads the rest. A client only takes over a share of at least
+// minimum_segment(), so the cost of an extra REST/RETR/ABOR is never more than
+// a small part of the transfer.
+//
+// A range that fails is put back and picked up by the next free client, until
+// more than max_failures() ranges have failed.
+//
+// The job drives the clients from their own strands, and its signals fire on
+// whichever thread the client signal that triggered them was on. The clients
+// must outlive the job, and shouldn't be given anything else to do while it
+// runs. Once begun, the job itself must last until completed or failed fires.
+class segmented_download : private boost::noncopyable
+{
+public:
+
+	// How one range went. A range that was shortened reports the bytes it
+	// actually moved, which can run a little past where it was cut.
+	struct segment_report
+	{
+		std::size_t client;
+		boost::uint64_t offset;
+		boost::uint64_t length;
+		double seconds;
+
+		double bytes_per_second() const;
+	};
+
+	typedef boost::signal<void(segmented_download & sender)>
+		segmented_download_event;
+	typedef boost::signal<void(segmented_download & sender,
+		const segment_report & segment)> segment_event;
+	typedef boost::signal<void(segmented_download & sender,
+		const std::string & message)> segmented_download_error_event;
+
+	// size is the size of remote_path, e.g. from a directory list. local_path
+	// is overwritten.
+	segmented_download(const std::vector<ftp::client *> & clients,
+		const std::string & remote_path, const std::string & local_path,
+		boost::uint64_t size);
+	~segmented_download();
+
+	// Fires as each range is finished.
+	segment_event segment_completed;
+
+	// Exactly one of these fires, once every client is done.
+	segmented_download_event completed;
+	segmented_download_error_event failed;
+
+	// Default 1 MB.
+	boost::uint64_t minimum_segment() const { return minimum_segment_; };
+	void minimum_segment(boost::uint64_t size) { minimum_segment_ = size; };
+
+	// Take over part of a slower client's range when one finishes early. On
+	// by default.
+	bool split_segments() const { return split_segments_; };
+	void split_segments(bool split) { split_segments_ = split; };
+
+	// Default 3.
+	unsigned int max_failures() const { return max_failures_; };
+	void max_failures(unsigned int failures) { max_failures_ = failures; };
+
+	// All the clients must be logged in and idle.
+	void begin();
+
+	// Ranges in flight.
+	std::size_t active_segments() const;
+
+private:
+
+	struct slot
+	{
+		slot(ftp::client & session);
+
+		ftp::client * client;
+		bool active;
+
+		// Lost its connection, and won't be used again.
+		bool dead;
+
+		// Waiting for the client to go idle before being given more to do.
+		bool finished;
+
+		// Bumped for every range, so a progress sample taken for an earlier
+		// one is recognised.
+		unsigned int generation;
+
+		boost::uint64_t offset;
+		boost::uint64_t end;
+		boost::uint64_t transferred;
+		boost::posix_time::ptime started;
+
+		// Bytes per second over the last range finished.
+		double rate;
+	};
+
+	typedef std::pair<boost::uint64_t, boost::uint64_t> range;
+
+	std::size_t find(const ftp::client & session) const;
+	void start(std::size_t index, const range & part);
+	void assign(std::size_t index);
+	void begin_sampling();
+	void rebalance();
+	bool finish(std::string & error);
+
+	void handle_transfer_completed(ftp::client & sender,
+		const std::string & path);
+	void handle_transfer_failed(ftp::client & sender,
+		const std::string & message);
+	void handle_fatal_error(ftp::client & sender, const std::string & message);
+	void handle_idle(ftp::client & sender);
+	void handle_sample(std::size_t index, unsigned int generation);
+
+	void report(bool done, const std::string & error);
+
+	std::vector<slot> slots_;
+	std::vector<boost::signals::connection> connections_;
+	std::string remote_path_;
+	std::string local_path_;
+	boost::uint64_t size_;
+	boost::uint64_t minimum_segment_;
+	bool split_segments_;
+	unsigned int max_failures_;
+
+	mutable boost::mutex mutex_;
+	int fd_;
+	bool running_;
+	std::string error_;
+	unsigned int failures_;
+
+	// Ranges put back after a failure, and clients waiting for the progress
+	// samples to come back so they can take over part of someone else's.
+	std::deque<range> pending_;
+	std::deque<std::size_t> waiting_;
+	std::size_t samples_pending_;
+
+}; // class segmented_download
+
+} // namespace model
+} // namespace foofxp
+
+#endif // FOOFXP_SEGMENTED_DOWNLOAD_HPP_INCLUDED
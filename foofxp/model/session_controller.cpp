@@ -7,5 +7,784 @@
  *
  */
 
+#include <algorithm>
+#include <iterator>
+#include <boost/bind.hpp>
 #include "session_controller.hpp"
+#include "ftp/tls_session_cache.hpp"
+#include "../utility/asio.hpp"
+#include "../utility/enforce_that.hpp"
+#include "../utility/format.hpp"
+#include "../utility/trace.hpp"
 
+using namespace std;
+using namespace boost::asio;
+using namespace foofxp::model::ftp;
+using namespace foofxp::utility;
+
+namespace foofxp {
+namespace model {
+
+// The keep-alive wheel ticks once a second. Intervals longer than the wheel
+// just go round more than once.
+static const long keep_alive_tick_ms = 1000;
+static const size_t keep_alive_wheel_slots = 64;
+
+// How often a closed session is checked for handlers still to run, once the
+// first look finds some.
+static const long release_poll_ms = 50;
+
+session_controller::session_controller(size_t thread_count) :
+	io_service_(),
+	work_(new io_service::work(io_service_)),
+	context_(io_service_, ssl::context::tlsv1_client),
+	threads_(),
+	keep_alive_timer_(io_service_),
+	mutex_(),
+	default_site_limit_(0),
+	site_limits_(),
+	sites_(),
+	sessions_(),
+	idle_count_(0),
+	busy_count_(0),
+	keep_alives_(keep_alive_wheel_slots),
+	idle_timeout_(0),
+	idle_timeouts_(keep_alive_wheel_slots),
+	pool_mutex_()
+{
+	enforce_that(thread_count > 0, invalid_argument,
+		"A session_controller needs at least one thread.");
+
+	// Every connection shares the context, so set it up before there are
+	// any.
+	ftp::tls_session_cache::watch_new_sessions(native_context(context_));
+
+	trace_this_at(info, general, ("session_controller starting %lu threads",
+		static_cast<unsigned long>(thread_count)));
+
+	begin_keep_alive_timer();
+
+	for (size_t i = 0; i < thread_count; i++)
+		threads_.create_thread(boost::bind(&session_controller::run, this));
+}
+
+session_controller::~session_controller()
+{
+	stop();
+	join();
+
+	// Nothing can call back into the sessions now.
+	sessions_.clear();
+	sites_.clear();
+}
+
+// ----------------------------------------------------------------------------
+// site limits
+// ----------------------------------------------------------------------------
+
+void session_controller::default_site_limit(size_t limit)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	default_site_limit_ = limit;
+}
+
+size_t session_controller::default_site_limit() const
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	return default_site_limit_;
+}
+
+void session_controller::site_limit(const bookmark & bookmark, size_t limit)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	site_limits_[site_key(bookmark)] = limit;
+}
+
+size_t session_controller::site_limit(const bookmark & bookmark) const
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	return site_limit(site_key(bookmark));
+}
+
+size_t session_controller::site_limit(const string & key) const
+{
+	map<string, size_t>::const_iterator limit = site_limits_.find(key);
+
+	if (limit == site_limits_.end())
+		return default_site_limit_;
+
+	return limit->second;
+}
+
+bool session_controller::can_open_session(const bookmark & bookmark) const
+{
+	string key = site_key(bookmark);
+
+	boost::mutex::scoped_lock lock(mutex_);
+
+	size_t limit = site_limit(key);
+	if (limit == 0)
+		return true;
+
+	site_map::const_iterator site = sites_.find(key);
+	return site == sites_.end() || site->second.connections < limit;
+}
+
+// ----------------------------------------------------------------------------
+// opening and closing sessions
+// ----------------------------------------------------------------------------
+
+session_controller::client_ptr session_controller::open_session(
+	const bookmark & bookmark) throw (runtime_error)
+{
+	client_ptr client = create_session(bookmark, false);
+
+	state_changed(*this);
+
+	return client;
+}
+
+session_controller::client_ptr session_controller::create_session(
+	const bookmark & bookmark, bool pooled) throw (runtime_error)
+{
+	string key = site_key(bookmark);
+
+	client_ptr client(new ftp::client(bookmark.host(), bookmark.port(),
+		bookmark.ipv6(), bookmark.auth_tls(), bookmark.username(),
+		bookmark.password(), io_service_, context_));
+
+	client->protect_data(bookmark.tls_data());
+	client->pipeline_commands(bookmark.pipelining());
+
+	client->idle.connect(boost::bind(&session_controller::handle_idle, this,
+		_1));
+	client->busy.connect(boost::bind(&session_controller::handle_busy, this,
+		_1));
+	client->fatal_error_occurred.connect(
+		boost::bind(&session_controller::handle_fatal_error, this, _1, _2));
+
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		site_map::iterator site = sites_.find(key);
+		size_t limit = site_limit(key);
+
+		if (site != sites_.end() && limit != 0 &&
+			site->second.connections >= limit)
+			throw runtime_error(format(128,
+				"Already at the limit of %lu connections to %s.",
+				static_cast<unsigned long>(limit), key.c_str()));
+
+		if (site == sites_.end())
+			site = sites_.insert(make_pair(key, site_record())).first;
+
+		session_record & session = sessions_[client.get()];
+		session.client = client;
+		session.site = site;
+		session.state = session_busy;
+		session.idle_position = site->second.idle.end();
+		session.keep_alive_interval = bookmark.keep_alive_interval();
+		session.pooled = pooled;
+		session.client_idle = false;
+
+		site->second.connections++;
+		if (pooled)
+			site->second.pooled++;
+		busy_count_++;
+	}
+
+	trace_this_at(info, general,
+		("session_controller opened %ssession %p to %s",
+		pooled ? "pooled " : "", static_cast<void *>(client.get()),
+		key.c_str()));
+
+	return client;
+}
+
+void session_controller::begin_connect(const client_ptr & client)
+{
+	client->strand().post(boost::bind(&ftp::client::begin_connect,
+		client.get()));
+}
+
+void session_controller::close_session(const client_ptr & client)
+{
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		session_map::iterator position = sessions_.find(client.get());
+		if (position == sessions_.end())
+			// Already closed.
+			return;
+
+		site_map::iterator site = position->second.site;
+		forget_session(position);
+		release_site(site);
+	}
+
+	trace_this_at(info, general, ("session_controller closing session %p",
+		static_cast<void *>(client.get())));
+
+	begin_close(client);
+
+	state_changed(*this);
+}
+
+void session_controller::forget_session(session_map::iterator position)
+{
+	session_record & session = position->second;
+	set_state(session, session_failed);
+
+	site_record & site = session.site->second;
+	site.connections--;
+	if (session.pooled)
+		site.pooled--;
+
+	sessions_.erase(position);
+}
+
+void session_controller::begin_close(const client_ptr & client)
+{
+	client->strand().post(boost::bind(&session_controller::handle_close,
+		this, client));
+}
+
+void session_controller::handle_close(const client_ptr & client)
+{
+	client->begin_close();
+
+	// Not straight away: closing posts a few handlers of its own (the log,
+	// for one) that don't count as operations, and they're ahead of this.
+	client->strand().post(boost::bind(&session_controller::release_closed,
+		this, client));
+}
+
+void session_controller::release_closed(const client_ptr & client)
+{
+	if (!client->operations_pending())
+	{
+		// This handler has the last reference, so the client goes with it.
+		trace_this_at(debug, general,
+			("session_controller releasing session %p",
+			static_cast<void *>(client.get())));
+		return;
+	}
+
+	// Whatever begin_close() cancelled is queued but not necessarily run,
+	// and a lookup can take a while to give up. Look again shortly.
+	timer_ptr timer(new deadline_timer(io_service_,
+		boost::posix_time::milliseconds(release_poll_ms)));
+	timer->async_wait(client->strand().wrap(boost::bind(
+		&session_controller::handle_release_timer, this, client, timer)));
+}
+
+void session_controller::handle_release_timer(const client_ptr & client,
+	timer_ptr timer)
+{
+	release_closed(client);
+}
+
+void session_controller::release_site(site_map::iterator site)
+{
+	if (site->second.connections == 0 && site->second.warm == 0)
+		sites_.erase(site);
+}
+
+// ----------------------------------------------------------------------------
+// pooling
+// ----------------------------------------------------------------------------
+
+void session_controller::keep_warm(const bookmark & bookmark, size_t count)
+{
+	string key = site_key(bookmark);
+
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		site_map::iterator site = sites_.find(key);
+		if (site == sites_.end())
+			site = sites_.insert(make_pair(key, site_record())).first;
+
+		site->second.warm = count;
+		site->second.bookmark.reset(new ftp::bookmark(bookmark));
+		release_site(site);
+	}
+
+	trace_this_at(info, general,
+		("session_controller keeping %lu sessions to %s warm",
+		static_cast<unsigned long>(count), key.c_str()));
+
+	if (replenish_pools())
+		state_changed(*this);
+}
+
+size_t session_controller::warm_count(const bookmark & bookmark) const
+{
+	string key = site_key(bookmark);
+
+	boost::mutex::scoped_lock lock(mutex_);
+
+	site_map::const_iterator site = sites_.find(key);
+	return site == sites_.end() ? 0 : site->second.warm;
+}
+
+session_controller::client_ptr session_controller::lease_session(
+	const bookmark & bookmark)
+{
+	string key = site_key(bookmark);
+	client_ptr client;
+
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		site_map::iterator site = sites_.find(key);
+		if (site == sites_.end() || site->second.idle.empty())
+			return client_ptr();
+
+		client = site->second.idle.front();
+		set_state(sessions_.find(client.get())->second, session_leased);
+	}
+
+	trace_this_at(debug, general, ("session_controller leased session %p",
+		static_cast<void *>(client.get())));
+
+	state_changed(*this);
+
+	return client;
+}
+
+void session_controller::release_session(const client_ptr & client)
+{
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		session_map::iterator session = sessions_.find(client.get());
+		if (session == sessions_.end() ||
+			session->second.state != session_leased)
+			return;
+
+		set_state(session->second,
+			session->second.client_idle ? session_idle : session_busy);
+	}
+
+	trace_this_at(debug, general, ("session_controller released session %p",
+		static_cast<void *>(client.get())));
+
+	state_changed(*this);
+}
+
+void session_controller::idle_timeout(unsigned int seconds)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	idle_timeout_ = seconds;
+}
+
+unsigned int session_controller::idle_timeout() const
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	return idle_timeout_;
+}
+
+bool session_controller::expire_idle_sessions()
+{
+	vector<client_ptr> closing;
+
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		vector<const client *> expired;
+		idle_timeouts_.tick(back_inserter(expired));
+
+		for (vector<const client *>::const_iterator iter = expired.begin();
+			iter != expired.end(); iter++)
+		{
+			session_map::iterator session = sessions_.find(*iter);
+			if (session == sessions_.end() ||
+				session->second.state != session_idle ||
+				session->second.pooled)
+				continue;
+
+			site_map::iterator site = session->second.site;
+			closing.push_back(session->second.client);
+			forget_session(session);
+			release_site(site);
+		}
+	}
+
+	for (vector<client_ptr>::const_iterator iter = closing.begin();
+		iter != closing.end(); iter++)
+	{
+		trace_this_at(info, general,
+			("session_controller closing idle session %p",
+			static_cast<void *>(iter->get())));
+
+		begin_close(*iter);
+	}
+
+	return !closing.empty();
+}
+
+bool session_controller::replenish_pools()
+{
+	boost::mutex::scoped_lock pool_lock(pool_mutex_);
+
+	vector<client_ptr> closing;
+	vector<boost::shared_ptr<bookmark> > opening;
+
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		// Failed pooled sessions make way for new ones.
+		for (session_map::iterator iter = sessions_.begin();
+			iter != sessions_.end(); )
+		{
+			session_map::iterator session = iter++;
+			if (!session->second.pooled ||
+				session->second.state != session_failed)
+				continue;
+
+			site_map::iterator site = session->second.site;
+			closing.push_back(session->second.client);
+			forget_session(session);
+			release_site(site);
+		}
+
+		for (site_map::iterator iter = sites_.begin(); iter != sites_.end(); )
+		{
+			site_map::iterator site = iter++;
+			site_record & record = site->second;
+
+			// A pool that's been shrunk gives up its idle sessions.
+			client_list::iterator idle = record.idle.begin();
+			while (record.pooled > record.warm && idle != record.idle.end())
+			{
+				session_map::iterator session = sessions_.find((idle++)->get());
+				if (!session->second.pooled)
+					continue;
+
+				closing.push_back(session->second.client);
+				forget_session(session);
+			}
+
+			size_t limit = site_limit(site->first);
+			size_t wanted = record.warm - min(record.pooled, record.warm);
+			if (limit != 0)
+				wanted = min(wanted, limit - min(limit, record.connections));
+
+			opening.insert(opening.end(), wanted, record.bookmark);
+
+			release_site(site);
+		}
+	}
+
+	for (vector<client_ptr>::const_iterator iter = closing.begin();
+		iter != closing.end(); iter++)
+	{
+		trace_this_at(info, general,
+			("session_controller closing pooled session %p",
+			static_cast<void *>(iter->get())));
+
+		begin_close(*iter);
+	}
+
+	for (vector<boost::shared_ptr<bookmark> >::const_iterator iter =
+		opening.begin(); iter != opening.end(); iter++)
+	{
+		try
+		{
+			begin_connect(create_session(**iter, true));
+		}
+		catch (const runtime_error & ex)
+		{
+			// Someone else took the last connection the site allows.
+			trace_this_at(warning, general,
+				("session_controller couldn't top up pool: %s", ex.what()));
+		}
+	}
+
+	return !closing.empty() || !opening.empty();
+}
+
+// ----------------------------------------------------------------------------
+// session state
+// ----------------------------------------------------------------------------
+
+session_controller::client_ptr session_controller::idle_session(
+	const bookmark & bookmark) const
+{
+	string key = site_key(bookmark);
+
+	boost::mutex::scoped_lock lock(mutex_);
+
+	site_map::const_iterator site = sites_.find(key);
+	if (site == sites_.end() || site->second.idle.empty())
+		return client_ptr();
+
+	return site->second.idle.front();
+}
+
+session_controller::client_ptr session_controller::idle_session() const
+{
+	boost::mutex::scoped_lock lock(mutex_);
+
+	if (idle_count_ == 0)
+		return client_ptr();
+
+	for (site_map::const_iterator site = sites_.begin(); site != sites_.end();
+		site++)
+	{
+		if (!site->second.idle.empty())
+			return site->second.idle.front();
+	}
+
+	return client_ptr();
+}
+
+size_t session_controller::session_count(const bookmark & bookmark) const
+{
+	string key = site_key(bookmark);
+
+	boost::mutex::scoped_lock lock(mutex_);
+
+	site_map::const_iterator site = sites_.find(key);
+	return site == sites_.end() ? 0 : site->second.connections;
+}
+
+size_t session_controller::session_count() const
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	return sessions_.size();
+}
+
+size_t session_controller::idle_count() const
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	return idle_count_;
+}
+
+size_t session_controller::busy_count() const
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	return busy_count_;
+}
+
+bool session_controller::set_state(session_record & session,
+	session_state state)
+{
+	if (session.state == state)
+		return false;
+
+	// Leased sessions are in use, so they count as busy.
+	if (session.state == session_idle)
+	{
+		session.site->second.idle.erase(session.idle_position);
+		session.idle_position = session.site->second.idle.end();
+		keep_alives_.cancel(session.client.get());
+		idle_timeouts_.cancel(session.client.get());
+		idle_count_--;
+	}
+	else if (session.state == session_busy ||
+		session.state == session_leased)
+		busy_count_--;
+
+	if (state == session_idle)
+	{
+		session.idle_position = session.site->second.idle.insert(
+			session.site->second.idle.end(), session.client);
+		idle_count_++;
+
+		// Any activity (including a NOOP) restarts the server's idle timer,
+		// so it's always a full interval from the last time we went idle.
+		if (session.keep_alive_interval != 0)
+			keep_alives_.schedule(session.client.get(),
+				session.keep_alive_interval * 1000 / keep_alive_tick_ms);
+
+		if (idle_timeout_ != 0 && !session.pooled)
+			idle_timeouts_.schedule(session.client.get(),
+				idle_timeout_ * 1000 / keep_alive_tick_ms);
+	}
+	else if (state == session_busy || state == session_leased)
+		busy_count_++;
+
+	session.state = state;
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+// pool threads
+// ----------------------------------------------------------------------------
+
+void session_controller::stop()
+{
+	work_.reset();
+	io_service_.stop();
+}
+
+void session_controller::join()
+{
+	threads_.join_all();
+}
+
+void session_controller::run()
+{
+	for (;;)
+	{
+		try
+		{
+			io_service_.run();
+			return;
+		}
+		catch (const exception & ex)
+		{
+			// One session's problem shouldn't take down the whole pool.
+			trace_this_at(error, general,
+				("session_controller caught exception from handler: %s",
+				ex.what()));
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+// keep-alives
+// ----------------------------------------------------------------------------
+
+void session_controller::begin_keep_alive_timer()
+{
+	keep_alive_timer_.expires_from_now(
+		boost::posix_time::milliseconds(keep_alive_tick_ms));
+	keep_alive_timer_.async_wait(boost::bind(
+		&session_controller::handle_keep_alive_timer, this,
+		placeholders::error));
+}
+
+void session_controller::handle_keep_alive_timer(
+	const boost::system::error_code & error)
+{
+	if (error == error::operation_aborted)
+		// Shutting down.
+		return;
+
+	vector<client_ptr> due;
+
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		vector<const client *> expired;
+		keep_alives_.tick(back_inserter(expired));
+
+		for (vector<const client *>::const_iterator iter = expired.begin();
+			iter != expired.end(); iter++)
+		{
+			session_map::iterator session = sessions_.find(*iter);
+			if (session == sessions_.end() ||
+				session->second.state != session_idle)
+				continue;
+
+			set_state(session->second, session_busy);
+			due.push_back(session->second.client);
+		}
+	}
+
+	for (vector<client_ptr>::const_iterator iter = due.begin();
+		iter != due.end(); iter++)
+	{
+		trace_this_at(debug, general,
+			("session_controller sending keep-alive for session %p",
+			static_cast<void *>(iter->get())));
+
+		(*iter)->strand().post(boost::bind(
+			&session_controller::send_keep_alive, this, *iter));
+	}
+
+	// The same tick looks after idle timeouts and pools.
+	bool changed = expire_idle_sessions() || !due.empty();
+	if (replenish_pools())
+		changed = true;
+
+	if (changed)
+		state_changed(*this);
+
+	begin_keep_alive_timer();
+}
+
+void session_controller::send_keep_alive(const client_ptr & client)
+{
+	client->begin_keep_alive();
+
+	// Sent, it's busy until the reply comes in. Dropped, the client's no
+	// longer logged in and is about to say so; until then, it's as idle as
+	// it was.
+	if (client->is_busy())
+		return;
+
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		session_map::iterator session = sessions_.find(client.get());
+		if (session == sessions_.end() ||
+			session->second.state != session_busy ||
+			!set_state(session->second, session_idle))
+			return;
+	}
+
+	state_changed(*this);
+}
+
+// ----------------------------------------------------------------------------
+// client event handlers
+// ----------------------------------------------------------------------------
+
+void session_controller::handle_idle(client & client)
+{
+	handle_state(client, session_idle);
+}
+
+void session_controller::handle_busy(client & client)
+{
+	handle_state(client, session_busy);
+}
+
+void session_controller::handle_fatal_error(client & client,
+	const string & message)
+{
+	handle_state(client, session_failed);
+}
+
+void session_controller::handle_state(const client & client,
+	session_state state)
+{
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		session_map::iterator session = sessions_.find(&client);
+		if (session == sessions_.end())
+			// Closed while the signal was in flight.
+			return;
+
+		session_record & record = session->second;
+		record.client_idle = state == session_idle;
+
+		// A leased session stays out of the pool until it's released, whatever
+		// it's doing, unless it fails.
+		if (record.state == session_leased && state != session_failed)
+			return;
+
+		if (!set_state(record, state))
+			return;
+	}
+
+	state_changed(*this);
+}
+
+// ----------------------------------------------------------------------------
+// internal session_controller stuff
+// ----------------------------------------------------------------------------
+
+string session_controller::site_key(const bookmark & bookmark)
+{
+	return format(256, "%s:%u", bookmark.host().c_str(),
+		static_cast<unsigned int>(bookmark.port()));
+}
+
+} // namespace model
+} // namespace foofxp
@@ -7,42 +7,238 @@
  *
  */
 
-#include <algorithm>
-#if 0
+#ifndef FOOFXP_SESSION_CONTROLLER_HPP_INCLUDED
+#define FOOFXP_SESSION_CONTROLLER_HPP_INCLUDED
 
-using std::for_each;
+#include <list>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread_safe_signal.hpp>
+#include "ftp/bookmark.hpp"
+#include "ftp/client.hpp"
+#include "../utility/timer_wheel.hpp"
 
 namespace foofxp {
 namespace model {
 
-class session_controller
+// Owns a set of ftp::client sessions and the pool of threads that drives them.
+//
+// All sessions share one io_service, run by thread_count threads. Each client
+// is confined to its own strand, so sessions run in parallel but a single
+// session's handlers never overlap. Client signals therefore fire on pool
+// threads -- listeners that touch shared state (e.g. the UI) must do their own
+// locking or hand the work off.
+//
+// The controller follows each session's idle/busy signals, so the UI can ask
+// for an idle session to a site without scanning every session. Sessions that
+// stay idle for longer than their bookmark's keep_alive_interval() are sent a
+// NOOP. Keep-alives for every session are driven off a single one second
+// timer and a timer wheel, rather than a deadline_timer per session.
+//
+// The controller can also pool sessions: keep_warm() keeps a number of logged
+// in sessions open to a site, which callers lease_session() for as long as
+// they need one (a transfer, say) and then release_session() back to the pool,
+// so a queue of small files only pays for each login once. Pooled sessions
+// that fail are replaced on the next tick, and ones that aren't pooled can be
+// closed once they've been idle for idle_timeout() seconds.
+class session_controller : private boost::noncopyable
 {
 public:
-	
-	void something()
+
+	typedef boost::shared_ptr<ftp::client> client_ptr;
+	typedef boost::signal<void(session_controller & sender)>
+		session_controller_event;
+
+	explicit session_controller(std::size_t thread_count);
+	~session_controller();
+
+	// Fires whenever a session is opened or closed, or goes idle or busy.
+	session_controller_event state_changed;
+
+	boost::asio::io_service & io_service() { return io_service_; };
+
+	// Limit on the number of sessions open to any one site (host and port).
+	// 0, the default, means no limit. Overridden per site by site_limit().
+	void default_site_limit(std::size_t limit);
+	std::size_t default_site_limit() const;
+
+	void site_limit(const ftp::bookmark & bookmark, std::size_t limit);
+	std::size_t site_limit(const ftp::bookmark & bookmark) const;
+
+	bool can_open_session(const ftp::bookmark & bookmark) const;
+
+	// Creates a session for bookmark. It isn't connected yet, to give the
+	// caller a chance to hook up its signals first -- see begin_connect().
+	// Throws if the site is already at its connection limit.
+	client_ptr open_session(const ftp::bookmark & bookmark)
+		throw (std::runtime_error);
+
+	void begin_connect(const client_ptr & client);
+
+	// Disconnects the session and stops tracking it.
+	void close_session(const client_ptr & client);
+
+	// Keep count sessions to bookmark's site open and logged in, within the
+	// site limit. Missing sessions are opened and connected right away, and
+	// failed ones replaced, here and then once a second.
+	void keep_warm(const ftp::bookmark & bookmark, std::size_t count);
+	std::size_t warm_count(const ftp::bookmark & bookmark) const;
+
+	// Takes an idle, logged in session to bookmark's site (pooled or not) for
+	// the caller's exclusive use, or returns an empty pointer if none is free
+	// right now. Until it's released, the session counts as busy, isn't sent
+	// keep-alives and isn't returned by idle_session() or lease_session().
+	client_ptr lease_session(const ftp::bookmark & bookmark);
+	void release_session(const client_ptr & client);
+
+	// Sessions left idle this long are closed, unless they're in a pool. 0,
+	// the default, means never.
+	void idle_timeout(unsigned int seconds);
+	unsigned int idle_timeout() const;
+
+	// An idle, logged in session to bookmark's site (or to any site), or an
+	// empty pointer if there isn't one.
+	client_ptr idle_session(const ftp::bookmark & bookmark) const;
+	client_ptr idle_session() const;
+
+	// Sessions open to bookmark's site (or to any site), whatever they're
+	// doing, including ones still logging in.
+	std::size_t session_count(const ftp::bookmark & bookmark) const;
+	std::size_t session_count() const;
+	std::size_t idle_count() const;
+	std::size_t busy_count() const;
+
+	// Stop the io_service (abandoning anything outstanding) and wait for the
+	// pool threads to finish.
+	void stop();
+	void join();
+
+private:
+
+	typedef enum
+	{
+		session_busy,
+		session_idle,
+		session_leased,
+		session_failed
+	}
+	session_state;
+
+	typedef std::list<client_ptr> client_list;
+
+	struct site_record
 	{
-		for_each(sessions_.begin(), sessions_.end(), check_keep_alive);
+		site_record() : connections(0), idle(), warm(0), pooled(0),
+			bookmark() {};
+
+		std::size_t connections;
+		client_list idle;
+
+		// Sessions to keep open, sessions opened to do so, and what to open
+		// them with.
+		std::size_t warm;
+		std::size_t pooled;
+		boost::shared_ptr<ftp::bookmark> bookmark;
 	};
-	
-	
-	
-private:
 
-	void check_keep_alive(session_ptr & session)
+	typedef std::map<std::string, site_record> site_map;
+
+	struct session_record
 	{
-		if (session->is_busy())
-			return;
-		
-		if (session->requires_keep_alive())
-			session->begin_keep_alive();
+		client_ptr client;
+		site_map::iterator site;
+		session_state state;
+		client_list::iterator idle_position;
+		unsigned int keep_alive_interval;
+
+		// Whether the pool opened it, and (while it's leased) whether the
+		// client last said it was idle.
+		bool pooled;
+		bool client_idle;
 	};
 
-	typedef vector<session_ptr> session_ptr_vector;
+	typedef std::map<const ftp::client *, session_record> session_map;
+	typedef boost::shared_ptr<boost::asio::deadline_timer> timer_ptr;
+
+	static std::string site_key(const ftp::bookmark & bookmark);
+
+	std::size_t site_limit(const std::string & key) const;
+
+	// Registers a new session without signalling state_changed.
+	client_ptr create_session(const ftp::bookmark & bookmark, bool pooled)
+		throw (std::runtime_error);
+
+	// Caller must hold mutex_. Stops tracking the session; it still needs
+	// begin_close().
+	void forget_session(session_map::iterator position);
+
+	// Closes a forgotten session on its strand. From then on only handlers
+	// hold on to it, and once its connections have nothing left to run, the
+	// last of them lets it go.
+	void begin_close(const client_ptr & client);
+	void handle_close(const client_ptr & client);
+	void release_closed(const client_ptr & client);
+	void handle_release_timer(const client_ptr & client, timer_ptr timer);
+
+	// Caller must hold mutex_. Stops tracking the site if it has no sessions
+	// and no pool.
+	void release_site(site_map::iterator site);
+
+	// Caller must hold mutex_. Returns true if the state changed.
+	bool set_state(session_record & session, session_state state);
+
+	void run();
+
+	void begin_keep_alive_timer();
+	void handle_keep_alive_timer(const boost::system::error_code & error);
+
+	// A session is taken out of the idle list before its keep-alive is
+	// posted, so it can't be leased with a NOOP about to go out.
+	void send_keep_alive(const client_ptr & client);
+
+	// Close sessions that have been idle too long, and replace failed pooled
+	// ones. Either returns whether anything changed.
+	bool expire_idle_sessions();
+	bool replenish_pools();
+
+	void handle_idle(ftp::client & client);
+	void handle_busy(ftp::client & client);
+	void handle_fatal_error(ftp::client & client, const std::string & message);
+	void handle_state(const ftp::client & client, session_state state);
+
+	boost::asio::io_service io_service_;
+	boost::scoped_ptr<boost::asio::io_service::work> work_;
+	boost::asio::ssl::context context_;
+	boost::thread_group threads_;
+	boost::asio::deadline_timer keep_alive_timer_;
+
+	mutable boost::mutex mutex_;
+	std::size_t default_site_limit_;
+	std::map<std::string, std::size_t> site_limits_;
+	site_map sites_;
+	session_map sessions_;
+	std::size_t idle_count_;
+	std::size_t busy_count_;
+	utility::timer_wheel<const ftp::client *> keep_alives_;
+	unsigned int idle_timeout_;
+	utility::timer_wheel<const ftp::client *> idle_timeouts_;
+
+	// Held while topping pools up, so two threads don't both open the
+	// missing sessions. Taken before mutex_.
+	boost::mutex pool_mutex_;
 
-	session_ptr_vector sessions_;
-};
+}; // class session_controller
 
 } // namespace model
 } // namespace foofxp
 
-#endif
\ No newline at end of file
+#endif // FOOFXP_SESSION_CONTROLLER_HPP_INCLUDED
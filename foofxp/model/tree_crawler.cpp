@@ -0,0 +1,552 @@
+#include <cassert>
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include "tree_crawler.hpp"
+#include "../utility/format.hpp"
+#include "../utility/trace.hpp"
+
+using namespace std;
+using namespace boost::posix_time;
+using namespace foofxp::model::ftp;
+using namespace foofxp::utility;
+
+namespace foofxp {
+namespace model {
+
+// client::begin_get_directory_contents() is overloaded, so bind() needs telling
+// which one.
+typedef void (client::*list_operation)(const string & path);
+
+static string join(const string & path, const string & name)
+{
+	if (!path.empty() && path[path.length() - 1] == '/')
+		return path + name;
+
+	return path + "/" + name;
+}
+
+tree_crawler::directory::directory(const string & path, size_t depth,
+	const boost::shared_ptr<name_arena> & names) :
+	path(path),
+	depth(depth),
+	files(names),
+	subdirectories(),
+	listed(false),
+	attempts(0)
+{}
+
+tree_crawler::site_record::site_record(const ftp::bookmark & site) :
+	bookmark(site),
+	pending(),
+	active(0),
+	starved(false),
+	waiting_since()
+{}
+
+tree_crawler::tree_crawler(session_controller & controller) :
+	controller_(controller),
+	state_changed_(),
+	sites_(),
+	roots_(),
+	root_sites_(),
+	names_(new name_arena()),
+	max_sessions_(8),
+	max_site_sessions_(3),
+	max_depth_(0),
+	max_attempts_(3),
+	max_wait_(60),
+	mutex_(),
+	running_(false),
+	leases_(),
+	active_(0),
+	next_site_(0),
+	listed_(0),
+	dispatching_(false),
+	dispatch_again_(false),
+	wait_timer_(controller.io_service()),
+	wait_timer_pending_(false),
+	completing_(false)
+{}
+
+tree_crawler::~tree_crawler()
+{
+	state_changed_.disconnect();
+
+	boost::mutex::scoped_lock lock(mutex_);
+
+	for (lease_map::iterator l = leases_.begin(); l != leases_.end(); l++)
+		for (vector<boost::signals::connection>::iterator connection =
+			l->second.connections.begin();
+			connection != l->second.connections.end(); connection++)
+			connection->disconnect();
+}
+
+// ----------------------------------------------------------------------------
+// public operations
+// ----------------------------------------------------------------------------
+
+size_t tree_crawler::add_root(const bookmark & site, const string & path)
+{
+	assert(!running_);
+
+	// Roots on the same site share its sessions.
+	size_t index = 0;
+	while (index < sites_.size() &&
+		(sites_[index].bookmark.host() != site.host() ||
+		sites_[index].bookmark.port() != site.port()))
+		index++;
+
+	if (index == sites_.size())
+		sites_.push_back(site_record(site));
+
+	roots_.push_back(boost::shared_ptr<directory>(
+		new directory(path, 0, names_)));
+	root_sites_.push_back(index);
+
+	return roots_.size() - 1;
+}
+
+const tree_crawler::directory & tree_crawler::root(size_t index) const
+{
+	return *roots_.at(index);
+}
+
+void tree_crawler::begin()
+{
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		for (size_t index = 0; index < roots_.size(); index++)
+			sites_[root_sites_[index]].pending.push_back(roots_[index].get());
+
+		running_ = !roots_.empty();
+	}
+
+	trace_this_at(info, general,
+		("tree_crawler starting %lu roots on %lu sites",
+		static_cast<unsigned long>(roots_.size()),
+		static_cast<unsigned long>(sites_.size())));
+
+	if (roots_.empty())
+	{
+		completed(*this);
+		return;
+	}
+
+	state_changed_ = controller_.state_changed.connect(
+		boost::bind(&tree_crawler::handle_state_changed, this));
+
+	dispatch();
+}
+
+size_t tree_crawler::directories_listed() const
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	return listed_;
+}
+
+// ----------------------------------------------------------------------------
+// internal tree_crawler stuff
+// ----------------------------------------------------------------------------
+
+bool tree_crawler::next_listing(size_t & site, directory *& listing)
+{
+	if (!running_ || active_ >= max_sessions_)
+		return false;
+
+	// Carry on round the sites from wherever the last one went, so each gets
+	// its turn.
+	for (size_t i = 0; i < sites_.size(); i++)
+	{
+		size_t index = (next_site_ + i) % sites_.size();
+		site_record & candidate = sites_[index];
+
+		if (candidate.starved || candidate.pending.empty() ||
+			candidate.active >= max_site_sessions_)
+			continue;
+
+		site = index;
+		listing = candidate.pending.front();
+		candidate.pending.pop_front();
+
+		// Held for it while we ask for a session.
+		candidate.active++;
+		active_++;
+
+		next_site_ = index + 1;
+		return true;
+	}
+
+	return false;
+}
+
+void tree_crawler::dispatch()
+{
+	listing_list abandoned;
+	bool all_done = false;
+
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		// Leasing a session fires state_changed, which lands back here.
+		if (dispatching_)
+		{
+			dispatch_again_ = true;
+			return;
+		}
+
+		dispatching_ = true;
+
+		for (size_t index = 0; index < sites_.size(); index++)
+			sites_[index].starved = false;
+
+		for (;;)
+		{
+			size_t site;
+			directory * listing;
+
+			if (!next_listing(site, listing))
+			{
+				if (!dispatch_again_)
+					break;
+
+				// Something may have come free since we last asked.
+				dispatch_again_ = false;
+				for (size_t index = 0; index < sites_.size(); index++)
+					sites_[index].starved = false;
+
+				continue;
+			}
+
+			// The controller signals while leasing, so not under our lock.
+			const bookmark & site_bookmark = sites_[site].bookmark;
+			lock.unlock();
+			session_controller::client_ptr session =
+				controller_.lease_session(site_bookmark);
+
+			// Nothing open to the site, and nothing going to be.
+			bool hopeless = !session &&
+				controller_.session_count(site_bookmark) == 0 &&
+				controller_.warm_count(site_bookmark) == 0;
+			lock.lock();
+
+			site_record & record = sites_[site];
+
+			if (session)
+			{
+				record.waiting_since = ptime();
+				start(site, listing, session);
+				continue;
+			}
+
+			record.pending.push_front(listing);
+			record.active--;
+			record.starved = true;
+			active_--;
+
+			// A site with listings under way gets its sessions back.
+			if (record.active != 0)
+				continue;
+
+			ptime now = microsec_clock::universal_time();
+			if (record.waiting_since.is_not_a_date_time())
+				record.waiting_since = now;
+
+			if (hopeless || now - record.waiting_since >= seconds(max_wait_))
+				give_up(site, abandoned);
+		}
+
+		dispatching_ = false;
+
+		if (!abandoned.empty())
+		{
+			all_done = done();
+			if (all_done)
+				running_ = false;
+		}
+
+		begin_wait_timer();
+	}
+
+	for (listing_list::const_iterator entry = abandoned.begin();
+		entry != abandoned.end(); entry++)
+	{
+		const bookmark & site = sites_[entry->first].bookmark;
+		directory_failed(*this, site, *entry->second, format(256,
+			"No session to %s:%u came free.", site.host().c_str(),
+			static_cast<unsigned int>(site.port())));
+	}
+
+	if (all_done)
+		report_completed();
+}
+
+void tree_crawler::give_up(size_t site, listing_list & abandoned)
+{
+	site_record & record = sites_[site];
+
+	trace_this_at(warning, general,
+		("tree_crawler giving up on %lu directories on %s",
+		static_cast<unsigned long>(record.pending.size()),
+		record.bookmark.host().c_str()));
+
+	for (deque<directory *>::const_iterator listing = record.pending.begin();
+		listing != record.pending.end(); listing++)
+		abandoned.push_back(make_pair(site, *listing));
+
+	record.pending.clear();
+	record.waiting_since = ptime();
+}
+
+void tree_crawler::start(size_t site, directory * listing,
+	const session_controller::client_ptr & session)
+{
+	trace_this_at(debug, general, ("tree_crawler listing %s",
+		listing->path.c_str()));
+
+	lease & entry = leases_[session.get()];
+	entry.client = session;
+	entry.site = site;
+	entry.listing = listing;
+
+	listing->attempts++;
+
+	entry.connections.push_back(session->received_directory_list.connect(
+		boost::bind(&tree_crawler::handle_list, this, _1, _2)));
+	entry.connections.push_back(session->directory_list_failed.connect(
+		boost::bind(&tree_crawler::handle_list_failed, this, _1, _2)));
+	entry.connections.push_back(session->fatal_error_occurred.connect(
+		boost::bind(&tree_crawler::handle_fatal_error, this, _1, _2)));
+
+	session->strand().post(boost::bind(static_cast<list_operation>(
+		&client::begin_get_directory_contents), session, listing->path));
+}
+
+bool tree_crawler::finish(client & sender, lease & finished)
+{
+	lease_map::iterator entry = leases_.find(&sender);
+	if (entry == leases_.end())
+		return false;
+
+	finished = entry->second;
+	leases_.erase(entry);
+
+	for (vector<boost::signals::connection>::iterator connection =
+		finished.connections.begin(); connection != finished.connections.end();
+		connection++)
+		connection->disconnect();
+
+	sites_[finished.site].active--;
+	active_--;
+
+	return true;
+}
+
+bool tree_crawler::done() const
+{
+	if (!running_ || active_ != 0)
+		return false;
+
+	for (size_t index = 0; index < sites_.size(); index++)
+		if (!sites_[index].pending.empty())
+			return false;
+
+	return true;
+}
+
+void tree_crawler::report_completed()
+{
+	trace_this_at(info, general, ("tree_crawler listed %lu directories",
+		static_cast<unsigned long>(directories_listed())));
+
+	state_changed_.disconnect();
+
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		if (wait_timer_pending_)
+		{
+			completing_ = true;
+			wait_timer_.cancel();
+			return;
+		}
+	}
+
+	completed(*this);
+}
+
+void tree_crawler::begin_wait_timer()
+{
+	if (!running_ || wait_timer_pending_)
+		return;
+
+	// A site whose wait is already up only missed out on being given up on
+	// because every session the crawler may use is listing something, and
+	// the next of those to finish will have another look.
+	ptime now = microsec_clock::universal_time();
+	ptime first;
+
+	for (size_t index = 0; index < sites_.size(); index++)
+	{
+		const ptime & since = sites_[index].waiting_since;
+		if (since.is_not_a_date_time())
+			continue;
+
+		ptime deadline = since + seconds(max_wait_);
+		if (deadline > now && (first.is_not_a_date_time() || deadline < first))
+			first = deadline;
+	}
+
+	if (first.is_not_a_date_time())
+		return;
+
+	wait_timer_.expires_at(first);
+	wait_timer_.async_wait(boost::bind(&tree_crawler::handle_wait_timer,
+		this, boost::asio::placeholders::error));
+	wait_timer_pending_ = true;
+}
+
+void tree_crawler::handle_wait_timer(const boost::system::error_code & error)
+{
+	bool complete;
+
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		wait_timer_pending_ = false;
+		complete = completing_;
+	}
+
+	if (complete)
+		completed(*this);
+
+	else if (error != boost::asio::error::operation_aborted)
+		dispatch();
+}
+
+void tree_crawler::handle_state_changed()
+{
+	dispatch();
+}
+
+void tree_crawler::handle_list(client & sender, const vector<file> & files)
+{
+	lease finished;
+	bool all_done;
+
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		if (!finish(sender, finished))
+			return;
+
+		directory & listing = *finished.listing;
+		listing.listed = true;
+		listing.files.reserve(files.size());
+		listed_++;
+
+		bool descend = max_depth_ == 0 || listing.depth < max_depth_;
+
+		for (vector<file>::const_iterator f = files.begin(); f != files.end();
+			f++)
+		{
+			const string & name = f->name();
+			if (name == "." || name == "..")
+				continue;
+
+			listing.files.push_back(*f);
+
+			if (f->type() != file::directory)
+				continue;
+
+			boost::shared_ptr<directory> subdirectory(new directory(
+				join(listing.path, name), listing.depth + 1, names_));
+			listing.subdirectories.push_back(subdirectory);
+
+			if (descend)
+				sites_[finished.site].pending.push_back(subdirectory.get());
+		}
+
+		all_done = done();
+		if (all_done)
+			running_ = false;
+	}
+
+	controller_.release_session(finished.client);
+	directory_listed(*this, sites_[finished.site].bookmark, *finished.listing);
+
+	if (all_done)
+		report_completed();
+	else
+		dispatch();
+}
+
+void tree_crawler::handle_list_failed(client & sender, const string & message)
+{
+	lease finished;
+	bool all_done;
+
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		if (!finish(sender, finished))
+			return;
+
+		all_done = done();
+		if (all_done)
+			running_ = false;
+	}
+
+	trace_this_at(info, general, ("tree_crawler could not list %s: %s",
+		finished.listing->path.c_str(), message.c_str()));
+
+	controller_.release_session(finished.client);
+	directory_failed(*this, sites_[finished.site].bookmark, *finished.listing,
+		message);
+
+	if (all_done)
+		report_completed();
+	else
+		dispatch();
+}
+
+void tree_crawler::handle_fatal_error(client & sender, const string & message)
+{
+	lease finished;
+	bool retry;
+	bool all_done;
+
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		if (!finish(sender, finished))
+			return;
+
+		// Not the directory's fault, most likely; give it to another session.
+		retry = finished.listing->attempts < max_attempts_;
+		if (retry)
+			sites_[finished.site].pending.push_front(finished.listing);
+
+		all_done = done();
+		if (all_done)
+			running_ = false;
+	}
+
+	trace_this_at(warning, general, ("tree_crawler lost session listing %s: %s",
+		finished.listing->path.c_str(), message.c_str()));
+
+	// The controller replaces it, if it's pooled.
+	controller_.release_session(finished.client);
+
+	if (!retry)
+		directory_failed(*this, sites_[finished.site].bookmark,
+			*finished.listing, message);
+
+	if (all_done)
+		report_completed();
+	else
+		dispatch();
+}
+
+} // namespace model
+} // namespace foofxp
@@ -0,0 +1,205 @@
+#ifndef FOOFXP_TREE_CRAWLER_HPP_INCLUDED
+#define FOOFXP_TREE_CRAWLER_HPP_INCLUDED
+
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread_safe_signal.hpp>
+#include "directory_table.hpp"
+#include "file.hpp"
+#include "ftp/bookmark.hpp"
+#include "session_controller.hpp"
+
+namespace foofxp {
+namespace model {
+
+// Lists whole directory trees, on one or more sites, breadth first over
+// sessions leased from a session_controller -- e.g. to mirror or dupe check a
+// release. Each directory is listed by path -- MLSD <path> where the server
+// has it, STAT -l <path> where not -- so there are no CWD/PWD round trips, and
+// every subdirectory found is queued behind the ones already waiting. Links
+// aren't followed.
+//
+// Up to max_sessions() directories are listed at once, no more than
+// max_sessions_per_site() of them on any one site. Free slots go round the
+// sites in turn, so a big tree on one site doesn't hold up a small one on
+// another. The crawler only leases sessions that are idle; keep_warm() some
+// for each site. A site with no sessions open or kept warm, or none free for
+// max_wait() seconds while none of its directories are being listed, is given
+// up on: its waiting directories fire directory_failed. The wait is checked
+// whenever the controller's sessions change, a listing finishes, or the
+// longest wait runs out.
+//
+// Results stream into a tree of directory records: directory_listed fires as
+// each one is filled in (its subdirectories are there, but not listed yet),
+// and completed once everything has been. A directory whose session is lost
+// is tried again on another, up to max_attempts() times; one the server
+// refuses to list fires directory_failed and is left empty.
+//
+// The signals fire on whichever session's strand did the listing. Roots must
+// be added before begin(), and once begun, the crawler must last until
+// completed fires.
+class tree_crawler : private boost::noncopyable
+{
+public:
+
+	struct directory
+	{
+		directory(const std::string & path, std::size_t depth,
+			const boost::shared_ptr<name_arena> & names);
+
+		// Absolute.
+		std::string path;
+		std::size_t depth;
+
+		// Everything listed, including subdirectories, but not . and ..
+		// Every directory's names are interned in the crawler's arena.
+		directory_table files;
+		std::vector<boost::shared_ptr<directory> > subdirectories;
+
+		bool listed;
+		unsigned int attempts;
+	};
+
+	typedef boost::signal<void(tree_crawler & sender)> tree_crawler_event;
+	typedef boost::signal<void(tree_crawler & sender,
+		const ftp::bookmark & site, const directory & listed)>
+		directory_event;
+	typedef boost::signal<void(tree_crawler & sender,
+		const ftp::bookmark & site, const directory & failed,
+		const std::string & message)> directory_error_event;
+
+	explicit tree_crawler(session_controller & controller);
+	~tree_crawler();
+
+	directory_event directory_listed;
+	directory_error_event directory_failed;
+	tree_crawler_event completed;
+
+	// Default 8.
+	std::size_t max_sessions() const { return max_sessions_; };
+	void max_sessions(std::size_t sessions) { max_sessions_ = sessions; };
+
+	// Default 3.
+	std::size_t max_sessions_per_site() const { return max_site_sessions_; };
+	void max_sessions_per_site(std::size_t sessions)
+	{
+		max_site_sessions_ = sessions;
+	};
+
+	// Levels below a root to descend; the root is level 0. 0, the default,
+	// means no limit.
+	std::size_t max_depth() const { return max_depth_; };
+	void max_depth(std::size_t depth) { max_depth_ = depth; };
+
+	// Default 3.
+	unsigned int max_attempts() const { return max_attempts_; };
+	void max_attempts(unsigned int attempts) { max_attempts_ = attempts; };
+
+	// Seconds. Default 60.
+	unsigned int max_wait() const { return max_wait_; };
+	void max_wait(unsigned int seconds) { max_wait_ = seconds; };
+
+	// Returns the root's index, for root().
+	std::size_t add_root(const ftp::bookmark & site, const std::string & path);
+
+	// Safe to walk once completed has fired.
+	const directory & root(std::size_t index) const;
+	std::size_t root_count() const { return roots_.size(); };
+
+	void begin();
+
+	std::size_t directories_listed() const;
+
+private:
+
+	struct site_record
+	{
+		explicit site_record(const ftp::bookmark & site);
+
+		ftp::bookmark bookmark;
+		std::deque<directory *> pending;
+		std::size_t active;
+
+		// No session was free the last time we asked.
+		bool starved;
+
+		// Since when none has been, with nothing being listed; not a date
+		// time otherwise.
+		boost::posix_time::ptime waiting_since;
+	};
+
+	typedef std::vector<std::pair<std::size_t, directory *> > listing_list;
+
+	struct lease
+	{
+		session_controller::client_ptr client;
+		std::size_t site;
+		directory * listing;
+		std::vector<boost::signals::connection> connections;
+	};
+
+	typedef std::map<const ftp::client *, lease> lease_map;
+
+	bool next_listing(std::size_t & site, directory *& listing);
+	void give_up(std::size_t site, listing_list & abandoned);
+	void dispatch();
+	void start(std::size_t site, directory * listing,
+		const session_controller::client_ptr & session);
+	bool finish(ftp::client & sender, lease & finished);
+	bool done() const;
+	void report_completed();
+
+	// Caller must hold mutex_. Has dispatch() look again when the next
+	// waiting site's max_wait() is up, in case nothing else does.
+	void begin_wait_timer();
+	void handle_wait_timer(const boost::system::error_code & error);
+
+	void handle_state_changed();
+	void handle_list(ftp::client & sender, const std::vector<file> & files);
+	void handle_list_failed(ftp::client & sender, const std::string & message);
+	void handle_fatal_error(ftp::client & sender, const std::string & message);
+
+	session_controller & controller_;
+	boost::signals::connection state_changed_;
+	std::vector<site_record> sites_;
+	std::vector<boost::shared_ptr<directory> > roots_;
+	std::vector<std::size_t> root_sites_;
+	boost::shared_ptr<name_arena> names_;
+	std::size_t max_sessions_;
+	std::size_t max_site_sessions_;
+	std::size_t max_depth_;
+	unsigned int max_attempts_;
+	unsigned int max_wait_;
+
+	mutable boost::mutex mutex_;
+	bool running_;
+	lease_map leases_;
+	std::size_t active_;
+	std::size_t next_site_;
+	std::size_t listed_;
+
+	// Set while a thread is handing out sessions, and when another finds it
+	// should have a second look.
+	bool dispatching_;
+	bool dispatch_again_;
+
+	// Once begun, the timer's handler has to run before completed can fire
+	// (and the crawler go), so completing is left to it if it's waiting.
+	boost::asio::deadline_timer wait_timer_;
+	bool wait_timer_pending_;
+	bool completing_;
+
+}; // class tree_crawler
+
+} // namespace model
+} // namespace foofxp
+
+#endif // FOOFXP_TREE_CRAWLER_HPP_INCLUDED
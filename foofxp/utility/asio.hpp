@@ -34,6 +34,8 @@
 
 #include <string>
 #include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/shared_ptr.hpp>
 
 namespace foofxp
 {
@@ -43,6 +45,66 @@ to_delimited_list(
 	const boost::asio::ip::tcp::resolver::iterator & endpoint_iterator,
 	const std::string & delimiter = std::string(", "));
 
+/// @brief The OpenSSL connection underneath an ssl::stream, for the things
+/// asio doesn't wrap (like session resumption).
+template<class stream_type>
+SSL *
+native_ssl(
+	stream_type & stream)
+{
+	return stream.impl()->ssl;
+}
+
+/// @brief The OpenSSL context underneath an ssl::context, for settings asio
+/// doesn't wrap.
+inline SSL_CTX *
+native_context(
+	boost::asio::ssl::context & context)
+{
+	return context.impl();
+}
+
+/// @brief A completion handler that holds a copy of a token for as long as
+/// it exists, so that the token's use_count() tells its owner how many of its
+/// handlers are still waiting to run (cancelled ones included).
+template<class handler_type>
+class counted_handler
+{
+public:
+
+	counted_handler(
+		const handler_type & handler,
+		const boost::shared_ptr<void> & token) :
+		handler_(handler),
+		token_(token)
+	{}
+
+	void operator()() { handler_(); }
+
+	template<class arg1_type>
+	void operator()(const arg1_type & arg1) { handler_(arg1); }
+
+	template<class arg1_type, class arg2_type>
+	void operator()(const arg1_type & arg1, const arg2_type & arg2)
+	{
+		handler_(arg1, arg2);
+	}
+
+private:
+
+	handler_type handler_;
+	boost::shared_ptr<void> token_;
+};
+
+template<class handler_type>
+counted_handler<handler_type>
+count_handler(
+	const handler_type & handler,
+	const boost::shared_ptr<void> & token)
+{
+	return counted_handler<handler_type>(handler, token);
+}
+
 } // namespace foofxp
 
 #endif // FOOFXP_ASIO_HPP_INCLUDED
@@ -0,0 +1,170 @@
+// Copyright (c) 2007, Richard Dingwall
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the organization nor the names of its contributors
+//       may be used to endorse or promote products derived from this software
+//       without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+// POSSIBILITY OF SUCH DAMAGE.
+
+/// @file timer_wheel.hpp
+///
+/// @brief Header file containing the timer_wheel class.
+
+#ifndef FOOFXP_TIMER_WHEEL_HPP_INCLUDED
+#define FOOFXP_TIMER_WHEEL_HPP_INCLUDED
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <vector>
+#include <boost/noncopyable.hpp>
+
+namespace foofxp {
+namespace utility {
+
+/// @brief A hashed timer wheel.
+///
+/// Keeps track of when each of a set of keys is due, in ticks, without a timer
+/// per key: the owner calls tick() from a single periodic timer and gets back
+/// the keys that expired. Scheduling and cancelling don't depend on the number
+/// of keys in the wheel (other than the lookup of the key itself), and a tick
+/// only looks at the keys in one slot.
+///
+/// Delays longer than the number of slots wrap around the wheel, and are
+/// passed over until their last lap.
+template<class key_type>
+class timer_wheel : private boost::noncopyable
+{
+public:
+
+	/// @param[in] slot_count Number of slots. Delays up to this many ticks
+	/// expire on their first visit.
+	explicit timer_wheel(std::size_t slot_count) :
+		slots_(slot_count == 0 ? 1 : slot_count),
+		current_(0),
+		positions_()
+	{};
+
+	/// @brief (Re)schedule key to expire after the given number of ticks.
+	///
+	/// Any earlier schedule for key is replaced. A delay of 0 is treated as 1.
+	void schedule(const key_type & key, std::size_t ticks)
+	{
+		cancel(key);
+
+		if (ticks == 0)
+			ticks = 1;
+
+		std::size_t slot = (current_ + ticks) % slots_.size();
+
+		entry new_entry;
+		new_entry.key = key;
+		new_entry.rounds = (ticks - 1) / slots_.size();
+
+		position & where = positions_[key];
+		where.slot = slot;
+		where.entry = slots_[slot].insert(slots_[slot].end(), new_entry);
+	};
+
+	/// @brief Forget about key.
+	///
+	/// @returns true if key was scheduled.
+	bool cancel(const key_type & key)
+	{
+		typename position_map::iterator where = positions_.find(key);
+		if (where == positions_.end())
+			return false;
+
+		slots_[where->second.slot].erase(where->second.entry);
+		positions_.erase(where);
+		return true;
+	};
+
+	bool scheduled(const key_type & key) const
+	{
+		return positions_.find(key) != positions_.end();
+	};
+
+	std::size_t size() const { return positions_.size(); };
+	bool empty() const { return positions_.empty(); };
+
+	/// @brief Advance the wheel by one tick.
+	///
+	/// @param[out] expired Receives each key that expired on this tick. The
+	/// keys are no longer scheduled.
+	///
+	/// @returns The output iterator, past the last key written.
+	template<class output_iterator>
+	output_iterator tick(output_iterator expired)
+	{
+		current_ = (current_ + 1) % slots_.size();
+
+		slot_type & slot = slots_[current_];
+		typename slot_type::iterator next = slot.begin();
+
+		while (next != slot.end())
+		{
+			typename slot_type::iterator due = next++;
+
+			if (due->rounds > 0)
+			{
+				// Not on this lap.
+				due->rounds--;
+				continue;
+			}
+
+			*expired++ = due->key;
+			positions_.erase(due->key);
+			slot.erase(due);
+		}
+
+		return expired;
+	}
+
+private:
+
+	struct entry
+	{
+		key_type key;
+		std::size_t rounds;
+	};
+
+	typedef std::list<entry> slot_type;
+
+	struct position
+	{
+		std::size_t slot;
+		typename slot_type::iterator entry;
+	};
+
+	typedef std::map<key_type, position> position_map;
+
+	std::vector<slot_type> slots_;
+	std::size_t current_;
+	position_map positions_;
+
+}; // class timer_wheel
+
+} // namespace utility
+} // namespace foofxp
+
+#endif // FOOFXP_TIMER_WHEEL_HPP_INCLUDED
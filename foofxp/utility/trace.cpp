@@ -1,7 +1,20 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
 #include <ctime>
-#include <fstream>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/thread_time.hpp>
 
-// These two are for getpid().
+// These are for getpid(), open(), write() and close().
+#include <fcntl.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -13,65 +26,281 @@ using namespace std;
 namespace foofxp {
 namespace utility {
 
-static std::string get_trace_prefix(const std::string & path, 
-	int line_number)
+namespace {
+
+// The process's trace file, foofxp-trace-<pid>.log.
+//
+// Callers format their records into a preallocated ring buffer under a mutex;
+// a background thread drains the buffer to a single open descriptor every
+// flush_interval_ms, or sooner once the buffer is half full. If the buffer
+// fills up, records are dropped (and counted) rather than blocking the caller.
+class trace_sink : private boost::noncopyable
 {
-	string file_name = path;
-	
-	// Clean-up the path.
-	if (file_name.length() > 0)
+public:
+
+	trace_sink() :
+		buffer_(capacity),
+		head_(0),
+		size_(0),
+		dropped_(0),
+		fd_(-1),
+		cached_second_(-1),
+		stopping_(false)
 	{
-		// Trim surrounding quotes, e.g. "foofxp.cpp" -> foofxp.cpp.
-		if (file_name[0] == '"' && file_name[file_name.length() - 1] == '"')
-			file_name = file_name.substr(1, file_name.length() - 2);
-		
-		// Trim path. We don't care where it was compiled, just the file name.
-		string::size_type pos = file_name.find_last_of("\\/");
-		if (pos != string::npos)
-			file_name = file_name.substr(pos + 1);
-	}
-	
-	// Get the time prefix.
-	time_t now = time(0);
-	char time_buf[20];
-	strftime(time_buf, sizeof(time_buf), "%Y-%m-%d %X", localtime(&now));
-	
-	char buf[256];
-	snprintf(buf, sizeof(buf), "[%s %s:%i]", time_buf, file_name.c_str(),
-		line_number);
-	
-	return buf;
+		cached_time_[0] = '\0';
+
+		string trace_file = format(32, "foofxp-trace-%d.log", getpid());
+		fd_ = ::open(trace_file.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+
+		flusher_.reset(new boost::thread(boost::bind(&trace_sink::run, this)));
+	};
+
+	~trace_sink()
+	{
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			stopping_ = true;
+		}
+
+		wake_.notify_one();
+		flusher_->join();
+
+		if (fd_ != -1)
+			::close(fd_);
+	};
+
+	void write(const char * path, int line_number, const void * sender,
+		const char * message, size_t message_length)
+	{
+		// Trim surrounding quotes and the path, e.g. "model/foo.cpp" -> foo.cpp.
+		// We don't care where it was compiled, just the file name.
+		const char * file_name = path;
+		const char * slash = strrchr(path, '/');
+		if (slash != 0)
+			file_name = slash + 1;
+		else if (*file_name == '"')
+			++file_name;
+
+		int file_name_length = static_cast<int>(strlen(file_name));
+		if (file_name_length > 0 && file_name[file_name_length - 1] == '"')
+			--file_name_length;
+
+		boost::mutex::scoped_lock lock(mutex_);
+
+		// localtime() and strftime() are only needed once per second.
+		time_t now = time(0);
+		if (now != cached_second_)
+		{
+			struct tm local;
+			localtime_r(&now, &local);
+			strftime(cached_time_, sizeof(cached_time_), "%Y-%m-%d %X", &local);
+			cached_second_ = now;
+		}
+
+		char prefix[256];
+		int prefix_length;
+
+		if (sender != 0)
+			prefix_length = snprintf(prefix, sizeof(prefix),
+				"[%s %.*s:%i] (this=%p) ", cached_time_, file_name_length,
+				file_name, line_number, sender);
+		else
+			prefix_length = snprintf(prefix, sizeof(prefix), "[%s %.*s:%i] ",
+				cached_time_, file_name_length, file_name, line_number);
+
+		prefix_length = min(prefix_length, static_cast<int>(sizeof(prefix) - 1));
+
+		if (prefix_length + message_length + 1 > capacity - size_)
+		{
+			// No room. Better to lose a trace record than stall the caller.
+			++dropped_;
+			wake_.notify_one();
+			return;
+		}
+
+		append(prefix, prefix_length);
+		append(message, message_length);
+		append("\n", 1);
+
+		if (size_ > capacity / 2)
+			wake_.notify_one();
+	};
+
+private:
+
+	static const size_t capacity = 1024 * 1024;
+	static const long flush_interval_ms = 250;
+
+	// Copy data into the free end of the ring. Caller must hold mutex_ and
+	// have checked there's room.
+	void append(const char * data, size_t length)
+	{
+		size_t tail = (head_ + size_) % capacity;
+		size_t first = min(length, capacity - tail);
+
+		memcpy(&buffer_[tail], data, first);
+		memcpy(&buffer_[0], data + first, length - first);
+
+		size_ += length;
+	};
+
+	void run()
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		while (!stopping_)
+		{
+			wake_.timed_wait(lock, boost::get_system_time() +
+				boost::posix_time::milliseconds(flush_interval_ms));
+
+			drain(lock);
+		}
+
+		// Flush whatever's left on the way out.
+		drain(lock);
+	};
+
+	// Write the buffered records out. Producers only ever append past the
+	// region being written, so the lock is released during the write itself.
+	void drain(boost::mutex::scoped_lock & lock)
+	{
+		if (dropped_ != 0)
+		{
+			char note[64];
+			int length = snprintf(note, sizeof(note),
+				"[%lu trace records dropped]\n", dropped_);
+
+			if (length + size_ <= capacity)
+			{
+				append(note, length);
+				dropped_ = 0;
+			}
+		}
+
+		size_t head = head_;
+		size_t count = size_;
+
+		if (count == 0)
+			return;
+
+		lock.unlock();
+
+		size_t first = min(count, capacity - head);
+		write_fully(&buffer_[head], first);
+		write_fully(&buffer_[0], count - first);
+
+		lock.lock();
+
+		head_ = (head + count) % capacity;
+		size_ -= count;
+	};
+
+	void write_fully(const char * data, size_t length)
+	{
+		while (length > 0 && fd_ != -1)
+		{
+			ssize_t written = ::write(fd_, data, length);
+
+			if (written < 0)
+			{
+				if (errno == EINTR)
+					continue;
+
+				// Nowhere to report this -- give up on this batch.
+				return;
+			}
+
+			data += written;
+			length -= written;
+		}
+	};
+
+	vector<char> buffer_;
+	size_t head_;
+	size_t size_;
+	unsigned long dropped_;
+	int fd_;
+	time_t cached_second_;
+	char cached_time_[20];
+	bool stopping_;
+	boost::mutex mutex_;
+	boost::condition_variable wake_;
+	boost::scoped_ptr<boost::thread> flusher_;
+};
+
+const size_t trace_sink::capacity;
+const long trace_sink::flush_interval_ms;
+
+trace_sink & get_trace_sink()
+{
+	static trace_sink sink;
+	return sink;
 }
 
-void __trace(const std::string & message, const std::string & path, 
-	int line_number)
-{	
-	// Get the file name: foofxp.<pid>.log.
-	string trace_file = format(24, "foofxp-trace-%d.log", getpid());
-	
-	ofstream stream(trace_file.c_str(), ios_base::app);
-	
-	string prefix = get_trace_prefix(path, line_number);
-	
-	stream << prefix << " " << message << endl;
-	
-	stream.close();
+} // anonymous namespace
+
+#if defined(__ATOMIC_RELAXED)
+
+unsigned int __trace_category_mask = trace_category::all;
+
+void set_trace_categories(unsigned int mask)
+{
+	__atomic_store_n(&__trace_category_mask, mask, __ATOMIC_RELAXED);
 }
 
-void __trace_this(const std::string & message, const std::string & path, 
+#else
+
+static unsigned int category_mask = trace_category::all;
+static boost::mutex category_mutex;
+
+void set_trace_categories(unsigned int mask)
+{
+	boost::mutex::scoped_lock lock(category_mutex);
+	category_mask = mask;
+}
+
+unsigned int __trace_load_categories()
+{
+	boost::mutex::scoped_lock lock(category_mutex);
+	return category_mask;
+}
+
+#endif
+
+unsigned int trace_categories()
+{
+	return __trace_load_categories();
+}
+
+void __trace(const std::string & message, const char * path, int line_number)
+{
+	get_trace_sink().write(path, line_number, 0, message.data(),
+		message.length());
+}
+
+void __trace_this(const std::string & message, const char * path,
 	int line_number, const void * sender)
-{	
-	// Get the file name: foofxp.<pid>.log.
-	string trace_file = format(24, "foofxp-trace-%d.log", getpid());
-	
-	ofstream stream(trace_file.c_str(), ios_base::app);
+{
+	get_trace_sink().write(path, line_number, sender, message.data(),
+		message.length());
+}
+
+void __trace_record::format(const char * format, ...)
+{
+	char buffer[1024];
 	
-	string prefix = get_trace_prefix(path, line_number);
+	// Format buffer using parameter list. Anything longer is truncated.
+	va_list args;
+	va_start(args, format);
+	int length = vsnprintf(buffer, sizeof(buffer), format, args);
+	va_end(args);
 	
-	stream << prefix << " " << "(this=" << sender << ") " << message << endl;
+	if (length < 0)
+		return;
 	
-	stream.close();
+	get_trace_sink().write(path_, line_number_, sender_, buffer,
+		min(static_cast<size_t>(length), sizeof(buffer) - 1));
 }
 
 } // namespace utility
-} // namespace foofxp
\ No newline at end of file
+} // namespace foofxp
@@ -4,29 +4,156 @@
 #include <string>
 #include <boost/preprocessor/stringize.hpp>
 
-#define FOOFXP_TRACE
-
-#if defined(FOOFXP_TRACE)
-#	define trace(message) \
-		foofxp::utility::__trace((message), \
-			BOOST_PP_STRINGIZE(__FILE__), __LINE__)
-#	define trace_this(message) \
-		foofxp::utility::__trace_this((message), \
-			BOOST_PP_STRINGIZE(__FILE__), __LINE__, this)
+// Records below FOOFXP_TRACE_MIN_LEVEL are compiled out entirely -- their
+// arguments are never evaluated. Release (NDEBUG) builds trace nothing unless
+// told otherwise, e.g. -DFOOFXP_TRACE_MIN_LEVEL=2 for warnings and up.
+#if !defined(FOOFXP_TRACE_MIN_LEVEL)
+#	if defined(NDEBUG)
+#		define FOOFXP_TRACE_MIN_LEVEL 4 // none
+#	else
+#		define FOOFXP_TRACE_MIN_LEVEL 0 // debug
+#	endif
+#endif
+
+// trace_at(level, category, (format, ...))
+//
+// printf-style trace record, e.g.:
+//
+//    trace_at(debug, client, ("sending command \"%s\"", command.c_str()));
+//
+// The format and its arguments go in a second pair of parentheses, as C++03
+// has no variadic macros.
+//
+// level is one of trace_level's values, category one of trace_category's.
+// Records are written if the level is at or above FOOFXP_TRACE_MIN_LEVEL and
+// the category is enabled in the runtime mask (see set_trace_categories()).
+// trace_this_at() also records the this pointer of the caller.
+#define trace_at(level, category, arguments) \
+	do \
+	{ \
+		if (foofxp::utility::trace_level::level >= FOOFXP_TRACE_MIN_LEVEL && \
+			foofxp::utility::__trace_enabled( \
+				foofxp::utility::trace_category::category)) \
+			foofxp::utility::__trace_record( \
+				BOOST_PP_STRINGIZE(__FILE__), __LINE__, 0).format arguments; \
+	} \
+	while (false)
+
+#define trace_this_at(level, category, arguments) \
+	do \
+	{ \
+		if (foofxp::utility::trace_level::level >= FOOFXP_TRACE_MIN_LEVEL && \
+			foofxp::utility::__trace_enabled( \
+				foofxp::utility::trace_category::category)) \
+			foofxp::utility::__trace_record( \
+				BOOST_PP_STRINGIZE(__FILE__), __LINE__, this).format arguments; \
+	} \
+	while (false)
+
+// Plain message traces, at info level in the general category.
+#define trace(message) \
+	do \
+	{ \
+		if (foofxp::utility::trace_level::info >= FOOFXP_TRACE_MIN_LEVEL && \
+			foofxp::utility::__trace_enabled( \
+				foofxp::utility::trace_category::general)) \
+			foofxp::utility::__trace((message), \
+				BOOST_PP_STRINGIZE(__FILE__), __LINE__); \
+	} \
+	while (false)
+
+#define trace_this(message) \
+	do \
+	{ \
+		if (foofxp::utility::trace_level::info >= FOOFXP_TRACE_MIN_LEVEL && \
+			foofxp::utility::__trace_enabled( \
+				foofxp::utility::trace_category::general)) \
+			foofxp::utility::__trace_this((message), \
+				BOOST_PP_STRINGIZE(__FILE__), __LINE__, this); \
+	} \
+	while (false)
+
+#if defined(__GNUC__)
+#	define FOOFXP_TRACE_PRINTF_FORMAT \
+		__attribute__((format(printf, 2, 3)))
 #else
-#	define trace(message) 
-#	define trace_this(message) 
+#	define FOOFXP_TRACE_PRINTF_FORMAT
 #endif
 
 namespace foofxp {
 namespace utility {
 
-void __trace(const std::string & message, const std::string & path, 
-	int line_number);
-	
-void __trace_this(const std::string & message, const std::string & path, 
+namespace trace_level
+{
+	enum type { debug = 0, info = 1, warning = 2, error = 3, none = 4 };
+}
+
+namespace trace_category
+{
+	enum type
+	{
+		general        = 1 << 0,
+		control_stream = 1 << 1,
+		client         = 1 << 2,
+		parser         = 1 << 3,
+		curses         = 1 << 4,
+		data_stream    = 1 << 5,
+		all            = 0xffffffff
+	};
+}
+
+// Enable or disable trace categories at runtime, e.g.
+// set_trace_categories(trace_category::all & ~trace_category::control_stream).
+// Everything is enabled by default.
+void set_trace_categories(unsigned int mask);
+unsigned int trace_categories();
+
+// Read by every thread on every record, and written whenever. Where the
+// compiler has atomic builtins, a relaxed load: one plain read on the hot
+// path, and a change is seen soon enough. Elsewhere it's read under a mutex.
+#if defined(__ATOMIC_RELAXED)
+extern unsigned int __trace_category_mask;
+
+inline unsigned int __trace_load_categories()
+{
+	return __atomic_load_n(&__trace_category_mask, __ATOMIC_RELAXED);
+}
+#else
+unsigned int __trace_load_categories();
+#endif
+
+inline bool __trace_enabled(trace_category::type category)
+{
+	return (__trace_load_categories() & category) != 0;
+}
+
+// Trace records are buffered in memory and written out by a background thread,
+// so these return without touching the trace file.
+void __trace(const std::string & message, const char * path, int line_number);
+
+void __trace_this(const std::string & message, const char * path,
 	int line_number, const void * sender);
 
+// Where a record came from, until format() has its arguments.
+class __trace_record
+{
+public:
+
+	__trace_record(const char * path, int line_number, const void * sender) :
+		path_(path),
+		line_number_(line_number),
+		sender_(sender)
+	{}
+
+	void format(const char * format, ...) FOOFXP_TRACE_PRINTF_FORMAT;
+
+private:
+
+	const char * path_;
+	int line_number_;
+	const void * sender_;
+};
+
 } // namespace utility
 } // namespace foofxp
 
@@ -0,0 +1,154 @@
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/test/unit_test.hpp>
+#include "../foofxp/model/directory_index.hpp"
+
+using namespace std;
+using namespace boost::posix_time;
+using foofxp::model::directory_index;
+using foofxp::model::file;
+
+static const char * index_path = "/tmp/foofxp-directory-index-test";
+
+static vector<file> listing(const char * first, const char * second = 0,
+	const char * third = 0)
+{
+	vector<file> files;
+	files.push_back(file(first));
+	if (second)
+		files.push_back(file(second));
+	if (third)
+		files.push_back(file(third));
+	return files;
+}
+
+static string where(const vector<directory_index::match> & matches,
+	size_t i = 0)
+{
+	const string & path = matches[i].path;
+	return matches[i].site + ":" + path + (path == "/" ? "" : "/") +
+		matches[i].entry.name();
+}
+
+BOOST_AUTO_TEST_SUITE(directory_index_tests)
+
+BOOST_AUTO_TEST_CASE(finds_names_in_any_case)
+{
+	directory_index index;
+	index.update("alpha", "/pub", listing("Some.Release-GRP", ".", ".."));
+	index.update("beta", "/incoming", listing("some.release-grp", "other"));
+
+	vector<directory_index::match> matches;
+	BOOST_CHECK_EQUAL(index.find("SOME.RELEASE-GRP", matches), 2U);
+	BOOST_CHECK_EQUAL(index.find("some", matches), 0U);
+	BOOST_CHECK_EQUAL(index.find(".", matches), 0U);
+
+	BOOST_CHECK_EQUAL(index.size(), 3U);
+	BOOST_CHECK_EQUAL(index.directories(), 2U);
+}
+
+BOOST_AUTO_TEST_CASE(saves_and_opens)
+{
+	remove(index_path);
+
+	vector<file> files = listing("Some.Release-GRP", "some.other-GRP", "x");
+	files[0].type(file::directory);
+	files[0].time(ptime(boost::gregorian::date(2009, 4, 1), hours(12)));
+	files[1].size(1234567890123ULL);
+
+	{
+		directory_index index;
+		index.open(index_path);
+		BOOST_CHECK_EQUAL(index.size(), 0U);
+
+		index.update("alpha", "/pub", files);
+		index.update("beta", "/", listing("SOME.RELEASE-GRP"));
+		index.save(index_path);
+		BOOST_CHECK_EQUAL(index.size(), 4U);
+	}
+
+	directory_index index;
+	index.open(index_path);
+	BOOST_CHECK_EQUAL(index.size(), 4U);
+	BOOST_CHECK_EQUAL(index.directories(), 2U);
+
+	vector<directory_index::match> matches;
+	BOOST_REQUIRE_EQUAL(index.find("some.release-grp", matches), 2U);
+	BOOST_CHECK_EQUAL(where(matches, 0), "alpha:/pub/Some.Release-GRP");
+	BOOST_CHECK_EQUAL(where(matches, 1), "beta:/SOME.RELEASE-GRP");
+	BOOST_CHECK(matches[0].entry == files[0]);
+	BOOST_CHECK_EQUAL(matches[0].entry.type(), file::directory);
+	BOOST_CHECK_EQUAL(matches[0].entry.time(), files[0].time());
+	BOOST_CHECK(matches[1].entry.time().is_special());
+
+	matches.clear();
+	BOOST_CHECK_EQUAL(index.find_prefix("SOME.", matches), 3U);
+	BOOST_CHECK_EQUAL(where(matches, 0), "alpha:/pub/some.other-GRP");
+	BOOST_CHECK_EQUAL(matches[0].entry.size(), 1234567890123ULL);
+
+	matches.clear();
+	BOOST_CHECK_EQUAL(index.search("-grp", matches), 3U);
+	matches.clear();
+	BOOST_CHECK_EQUAL(index.search("other", matches), 1U);
+	matches.clear();
+	BOOST_CHECK_EQUAL(index.search("nowhere", matches), 0U);
+	matches.clear();
+	BOOST_CHECK_EQUAL(index.search("", matches), 4U);
+	matches.clear();
+	BOOST_CHECK_EQUAL(index.search("e", matches, 2), 2U);
+
+	remove(index_path);
+}
+
+BOOST_AUTO_TEST_CASE(newer_listings_hide_older)
+{
+	remove(index_path);
+
+	directory_index index;
+	index.update("alpha", "/pub", listing("old", "kept"));
+	index.update("alpha", "/tmp", listing("gone"));
+	index.save(index_path);
+
+	index.update("alpha", "/pub", listing("new", "kept"));
+	index.remove("alpha", "/tmp");
+
+	vector<directory_index::match> matches;
+	BOOST_CHECK_EQUAL(index.find("old", matches), 0U);
+	BOOST_CHECK_EQUAL(index.find("gone", matches), 0U);
+	BOOST_CHECK_EQUAL(index.find("new", matches), 1U);
+	BOOST_CHECK_EQUAL(index.find("kept", matches), 1U);
+	BOOST_CHECK_EQUAL(index.size(), 2U);
+	BOOST_CHECK_EQUAL(index.directories(), 1U);
+
+	// And the same again once saved.
+	index.save(index_path);
+	index.open(index_path);
+
+	matches.clear();
+	BOOST_CHECK_EQUAL(index.search("e", matches), 2U);
+	BOOST_CHECK_EQUAL(index.size(), 2U);
+	BOOST_CHECK_EQUAL(index.directories(), 1U);
+
+	remove(index_path);
+}
+
+BOOST_AUTO_TEST_CASE(rejects_other_files)
+{
+	{
+		ofstream out(index_path);
+		out << "This is not a directory index, but it is long enough to "
+			"have a header.";
+	}
+
+	directory_index index;
+	BOOST_CHECK_THROW(index.open(index_path), runtime_error);
+	BOOST_CHECK_EQUAL(index.size(), 0U);
+
+	remove(index_path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
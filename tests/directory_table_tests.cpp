@@ -0,0 +1,159 @@
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/test/unit_test.hpp>
+#include "../foofxp/model/directory_table.hpp"
+
+using namespace std;
+using namespace boost::gregorian;
+using namespace boost::posix_time;
+using foofxp::model::directory_table;
+using foofxp::model::file;
+using foofxp::model::name_arena;
+
+static file make_file(const string & name, file::file_type type,
+	file::size_type size, const ptime & time)
+{
+	file f(name);
+	f.type(type);
+	f.size(size);
+	f.time(time);
+	return f;
+}
+
+BOOST_AUTO_TEST_SUITE(directory_table_tests)
+
+BOOST_AUTO_TEST_CASE(arena_interns_names)
+{
+	name_arena arena;
+	string name("Sample");
+
+	const char * first = arena.intern("Sample");
+	const char * second = arena.intern(name.data(), name.data() + 6);
+
+	BOOST_CHECK_EQUAL(first, second);
+	BOOST_CHECK_EQUAL(string(first), "Sample");
+	BOOST_CHECK(arena.intern("Sampl") != first);
+	BOOST_CHECK_EQUAL(arena.size(), 2U);
+
+	BOOST_CHECK_EQUAL(arena.find(name.data(), name.data() + 6), first);
+	BOOST_CHECK(!arena.find(name.data(), name.data() + 2));
+}
+
+BOOST_AUTO_TEST_CASE(arena_keeps_names_where_they_are)
+{
+	name_arena arena;
+	const char * first = arena.intern("first");
+	string long_name(100000, 'x');
+
+	// Enough to need more blocks and a bigger index, and one long name.
+	for (int i = 0; i < 20000; ++i)
+		arena.intern(string(i % 50 + 1, 'a' + i % 26).c_str());
+	const char * interned = arena.intern(long_name.c_str());
+
+	BOOST_CHECK_EQUAL(arena.intern("first"), first);
+	BOOST_CHECK_EQUAL(string(first), "first");
+	BOOST_CHECK_EQUAL(string(interned), long_name);
+	BOOST_CHECK_EQUAL(arena.find(long_name.data(),
+		long_name.data() + long_name.length()), interned);
+}
+
+BOOST_AUTO_TEST_CASE(round_trips_files)
+{
+	directory_table table;
+	ptime time(date(2008, 5, 17), hours(12) + milliseconds(500));
+	ptime old(date(1969, 7, 20), hours(20) + minutes(17));
+	file big = make_file("big.iso", file::plain_old_file,
+		static_cast<file::size_type>(1) << 33, time);
+	file moon = make_file("moon", file::directory, 4096, old);
+	file undated = make_file("undated", file::link, 7, ptime());
+
+	table.push_back(big);
+	table.push_back(moon);
+	table.push_back(undated);
+
+	BOOST_REQUIRE_EQUAL(table.size(), 3U);
+	BOOST_CHECK(table.at(0) == big);
+	BOOST_CHECK(table.at(1) == moon);
+	BOOST_CHECK(table.at(2) == undated);
+	BOOST_CHECK(table.time(2).is_not_a_date_time());
+	BOOST_CHECK(!(table.flags()[2] & directory_table::has_time));
+	BOOST_CHECK(table.epoch_time(1) < 0);
+	BOOST_CHECK(table.is_directory(2));
+	BOOST_CHECK(!table.is_directory(0));
+}
+
+BOOST_AUTO_TEST_CASE(tables_share_an_arena)
+{
+	boost::shared_ptr<name_arena> arena(new name_arena());
+	directory_table a(arena);
+	directory_table b(arena);
+
+	a.push_back(file("Sample"));
+	b.push_back(file("Sample"));
+
+	BOOST_CHECK_EQUAL(a.name(0), b.name(0));
+	BOOST_CHECK_EQUAL(arena->size(), 1U);
+
+	BOOST_CHECK_EQUAL(b.find("Sample"), 0U);
+	BOOST_CHECK_EQUAL(b.find("sample"), directory_table::npos);
+
+	// Interned, but not in this table.
+	arena->intern("other");
+	BOOST_CHECK_EQUAL(b.find("other"), directory_table::npos);
+}
+
+BOOST_AUTO_TEST_CASE(orders_rows)
+{
+	directory_table table;
+	ptime time(date(2008, 1, 1));
+
+	table.push_back(make_file("c", file::plain_old_file, 1, time + hours(2)));
+	table.push_back(make_file("a", file::directory, 3, time));
+	table.push_back(make_file("b", file::plain_old_file, 2, time + hours(1)));
+	table.push_back(make_file("d", file::plain_old_file, 2, ptime()));
+
+	vector<directory_table::index_type> rows;
+
+	table.order_by_name(rows);
+	BOOST_REQUIRE_EQUAL(rows.size(), 4U);
+	BOOST_CHECK_EQUAL(rows[0], 1U);
+	BOOST_CHECK_EQUAL(rows[1], 2U);
+	BOOST_CHECK_EQUAL(rows[2], 0U);
+	BOOST_CHECK_EQUAL(rows[3], 3U);
+
+	// Ties keep their order.
+	table.order_by_size(rows);
+	BOOST_CHECK_EQUAL(rows[0], 0U);
+	BOOST_CHECK_EQUAL(rows[1], 2U);
+	BOOST_CHECK_EQUAL(rows[2], 3U);
+	BOOST_CHECK_EQUAL(rows[3], 1U);
+
+	// No time sorts first.
+	table.order_by_time(rows);
+	BOOST_CHECK_EQUAL(rows[0], 3U);
+	BOOST_CHECK_EQUAL(rows[1], 1U);
+	BOOST_CHECK_EQUAL(rows[2], 2U);
+	BOOST_CHECK_EQUAL(rows[3], 0U);
+}
+
+BOOST_AUTO_TEST_CASE(selects_by_type)
+{
+	directory_table table;
+	table.push_back(make_file("a", file::directory, 0, ptime()));
+	table.push_back(make_file("b", file::plain_old_file, 0, ptime()));
+	table.push_back(make_file("c", file::directory, 0, ptime()));
+
+	vector<directory_table::index_type> rows;
+	table.select(file::directory, rows);
+
+	BOOST_REQUIRE_EQUAL(rows.size(), 2U);
+	BOOST_CHECK_EQUAL(rows[0], 0U);
+	BOOST_CHECK_EQUAL(rows[1], 2U);
+
+	table.clear();
+	BOOST_CHECK(table.empty());
+	BOOST_CHECK(table.arena()->find("a", "a" + 1));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -41,6 +41,8 @@ struct bookmark_fixture
 		instance.username("root");
 		instance.password("pass");
 		instance.path("/incoming/");
+		instance.keep_alive_interval(30);
+		instance.pipelining(false);
 		
 		BOOST_REQUIRE_EQUAL(instance.name(), "FOO");
 		BOOST_REQUIRE_EQUAL(instance.auth_tls(), true);
@@ -51,6 +53,8 @@ struct bookmark_fixture
 		BOOST_REQUIRE_EQUAL(instance.username(), "root");
 		BOOST_REQUIRE_EQUAL(instance.password(), "pass");
 		BOOST_REQUIRE_EQUAL(instance.path(), "/incoming/");
+		BOOST_REQUIRE_EQUAL(instance.keep_alive_interval(), 30U);
+		BOOST_REQUIRE_EQUAL(instance.pipelining(), false);
 	};
 	
 	bookmark instance;
@@ -135,6 +139,22 @@ BOOST_AUTO_TEST_CASE(setting_path_triggers_modified_event)
 	fixture.instance.path("/incoming/");
 }
 
+BOOST_AUTO_TEST_CASE(setting_keep_alive_interval_triggers_modified_event)
+{
+	bookmark_fixture fixture;
+	modified_handler handler(fixture.instance);
+	fixture.instance.modified.connect(ref(handler));
+	fixture.instance.keep_alive_interval(120);
+}
+
+BOOST_AUTO_TEST_CASE(setting_pipelining_triggers_modified_event)
+{
+	bookmark_fixture fixture;
+	modified_handler handler(fixture.instance);
+	fixture.instance.modified.connect(ref(handler));
+	fixture.instance.pipelining(true);
+}
+
 BOOST_AUTO_TEST_CASE(assignment_operator_triggers_modified_event)
 {
 	bookmark_fixture fixture;
@@ -165,6 +185,9 @@ BOOST_AUTO_TEST_CASE(copy_constructor_copies)
 	BOOST_CHECK_EQUAL(copy.username(), fixture.instance.username());
 	BOOST_CHECK_EQUAL(copy.password(), fixture.instance.password());
 	BOOST_CHECK_EQUAL(copy.path(), fixture.instance.path());
+	BOOST_CHECK_EQUAL(copy.keep_alive_interval(),
+		fixture.instance.keep_alive_interval());
+	BOOST_CHECK_EQUAL(copy.pipelining(), fixture.instance.pipelining());
 }
 
 BOOST_AUTO_TEST_CASE(assignment_operator_assigns)
@@ -183,6 +206,9 @@ BOOST_AUTO_TEST_CASE(assignment_operator_assigns)
 	BOOST_CHECK_EQUAL(copy.username(), fixture.instance.username());
 	BOOST_CHECK_EQUAL(copy.password(), fixture.instance.password());
 	BOOST_CHECK_EQUAL(copy.path(), fixture.instance.path());
+	BOOST_CHECK_EQUAL(copy.keep_alive_interval(),
+		fixture.instance.keep_alive_interval());
+	BOOST_CHECK_EQUAL(copy.pipelining(), fixture.instance.pipelining());
 }
 
 // ----------------------------------------------------------------------------
@@ -9,6 +9,11 @@ using namespace foofxp::model::ftp;
 
 BOOST_AUTO_TEST_SUITE(commands_tests)
 
+BOOST_AUTO_TEST_CASE(abor)
+{
+	BOOST_REQUIRE_EQUAL(commands::abor(), "ABOR");
+}
+
 BOOST_AUTO_TEST_CASE(auth_tls)
 {
 	BOOST_REQUIRE_EQUAL(commands::auth_tls(), "AUTH TLS");
@@ -28,6 +33,21 @@ BOOST_AUTO_TEST_CASE(dele)
 	BOOST_CHECK_THROW(commands::dele(string()), invalid_argument);
 }
 
+BOOST_AUTO_TEST_CASE(eprt)
+{
+	using namespace boost::asio::ip;
+	
+	BOOST_REQUIRE_EQUAL(commands::eprt(tcp::endpoint(
+		address::from_string("::1"), 1234)), "EPRT |2|::1|1234|");
+	BOOST_REQUIRE_EQUAL(commands::eprt(tcp::endpoint(
+		address::from_string("10.0.0.1"), 21)), "EPRT |1|10.0.0.1|21|");
+}
+
+BOOST_AUTO_TEST_CASE(epsv)
+{
+	BOOST_REQUIRE_EQUAL(commands::epsv(), "EPSV");
+}
+
 BOOST_AUTO_TEST_CASE(feat)
 {
 	BOOST_REQUIRE_EQUAL(commands::feat(), "FEAT");
@@ -41,6 +61,13 @@ BOOST_AUTO_TEST_CASE(mdkir)
 	BOOST_CHECK_THROW(commands::mkdir(string()), invalid_argument);
 }
 
+BOOST_AUTO_TEST_CASE(mlsd)
+{
+	BOOST_REQUIRE_EQUAL(commands::mlsd(), "MLSD");
+	BOOST_REQUIRE_EQUAL(commands::mlsd("/a b"), "MLSD /a b");
+	BOOST_CHECK_THROW(commands::mlsd(string()), invalid_argument);
+}
+
 BOOST_AUTO_TEST_CASE(pass)
 {
 	BOOST_REQUIRE_EQUAL(commands::pass("aaa"), "PASS aaa");
@@ -52,16 +79,52 @@ BOOST_AUTO_TEST_CASE(pasv)
 	BOOST_REQUIRE_EQUAL(commands::pasv(), "PASV");
 }
 
+BOOST_AUTO_TEST_CASE(port)
+{
+	using namespace boost::asio::ip;
+	
+	BOOST_REQUIRE_EQUAL(commands::port(tcp::endpoint(
+		address::from_string("127.0.0.1"), 1234)), "PORT 127,0,0,1,4,210");
+	BOOST_REQUIRE_EQUAL(commands::port(tcp::endpoint(
+		address::from_string("192.168.10.200"), 65535)),
+		"PORT 192,168,10,200,255,255");
+	BOOST_CHECK_THROW(commands::port(tcp::endpoint(
+		address::from_string("::1"), 1234)), invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(noop)
+{
+	BOOST_REQUIRE_EQUAL(commands::noop(), "NOOP");
+}
+
 BOOST_AUTO_TEST_CASE(pbsz)
 {
 	BOOST_REQUIRE_EQUAL(commands::pbsz(), "PBSZ 0");
 }
 
+BOOST_AUTO_TEST_CASE(prot_p)
+{
+	BOOST_REQUIRE_EQUAL(commands::prot_p(), "PROT P");
+}
+
 BOOST_AUTO_TEST_CASE(pwd)
 {
 	BOOST_REQUIRE_EQUAL(commands::pwd(), "PWD");
 }
 
+BOOST_AUTO_TEST_CASE(rest)
+{
+	BOOST_REQUIRE_EQUAL(commands::rest(0), "REST 0");
+	BOOST_REQUIRE_EQUAL(commands::rest(5368709120ULL), "REST 5368709120");
+}
+
+BOOST_AUTO_TEST_CASE(retr)
+{
+	BOOST_REQUIRE_EQUAL(commands::retr("aaa"), "RETR aaa");
+	BOOST_REQUIRE_EQUAL(commands::retr("aaa bbb"), "RETR aaa bbb");
+	BOOST_CHECK_THROW(commands::retr(string()), invalid_argument);
+}
+
 BOOST_AUTO_TEST_CASE(site)
 {
 	BOOST_REQUIRE_EQUAL(commands::site("aaa"), "SITE aaa");
@@ -69,5 +132,30 @@ BOOST_AUTO_TEST_CASE(site)
 	BOOST_CHECK_THROW(commands::site(string()), invalid_argument);
 }
 
+BOOST_AUTO_TEST_CASE(sscn)
+{
+	BOOST_REQUIRE_EQUAL(commands::sscn(true), "SSCN ON");
+	BOOST_REQUIRE_EQUAL(commands::sscn(false), "SSCN OFF");
+}
+
+
+BOOST_AUTO_TEST_CASE(stat_l)
+{
+	BOOST_REQUIRE_EQUAL(commands::stat_l(), "STAT -l");
+	BOOST_REQUIRE_EQUAL(commands::stat_l("/a b"), "STAT -l /a b");
+	BOOST_CHECK_THROW(commands::stat_l(string()), invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(stor)
+{
+	BOOST_REQUIRE_EQUAL(commands::stor("aaa"), "STOR aaa");
+	BOOST_REQUIRE_EQUAL(commands::stor("aaa bbb"), "STOR aaa bbb");
+	BOOST_CHECK_THROW(commands::stor(string()), invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(type_i)
+{
+	BOOST_REQUIRE_EQUAL(commands::type_i(), "TYPE I");
+}
 
 BOOST_AUTO_TEST_SUITE_END()
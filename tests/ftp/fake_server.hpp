@@ -0,0 +1,899 @@
+#ifndef FOOFXP_FAKE_SERVER_HPP_INCLUDED
+#define FOOFXP_FAKE_SERVER_HPP_INCLUDED
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/thread_time.hpp>
+#include "../../foofxp/model/session_controller.hpp"
+
+// These are for the sockets.
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// An FTP server on the loopback interface that knows just enough of the
+// protocol to take ftp::client through a login, listings (STAT -l) and
+// transfers, so the classes built on top of it can be tested against
+// something real. Every command it's sent is recorded.
+//
+// Tests script it from outside: the files it serves, replies to give instead
+// of the usual ones, commands to hold until released, and a retrieve to pause
+// or cut off part way.
+//
+// Each control connection is served by a thread of its own, one command at a
+// time, so a transfer is over before the next command (e.g. ABOR) is read --
+// except that while a transfer waits for its data connection, it reads ahead
+// and gives up if there's an ABOR coming. The ABOR is still answered in turn.
+// Data connections are passive, except that a RETR after PORT connects out,
+// so two of these can FXP a file between them.
+class fake_server : private boost::noncopyable
+{
+public:
+
+	fake_server() :
+		listener_(-1),
+		port_(0),
+		acceptor_(),
+		mutex_(),
+		changed_(),
+		stopping_(false),
+		sockets_(),
+		sessions_(),
+		files_(),
+		directories_(),
+		commands_(),
+		answers_(),
+		hold_(),
+		held_(0),
+		releases_(0),
+		pause_after_(0),
+		pausing_(false),
+		cut_after_(0),
+		cutting_(false),
+		accept_timeout_ms_(5000)
+	{
+		directories_["/"];
+
+		listener_ = listen_socket(port_);
+		acceptor_.reset(new boost::thread(
+			boost::bind(&fake_server::accept_loop, this)));
+	};
+
+	~fake_server()
+	{
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			stopping_ = true;
+			changed_.notify_all();
+
+			// Wakes up anything blocked on them.
+			for (std::set<int>::iterator s = sockets_.begin();
+				s != sockets_.end(); s++)
+				::shutdown(*s, SHUT_RDWR);
+		}
+
+		// No more sessions once the listener is done.
+		::shutdown(listener_, SHUT_RDWR);
+		acceptor_->join();
+		::close(listener_);
+
+		for (std::vector<boost::shared_ptr<boost::thread> >::iterator t =
+			sessions_.begin(); t != sessions_.end(); t++)
+			(*t)->join();
+	};
+
+	unsigned short port() const { return port_; };
+
+	// A bookmark for logging in to it.
+	foofxp::model::ftp::bookmark site() const
+	{
+		foofxp::model::ftp::bookmark site;
+		site.host("127.0.0.1");
+		site.port(port_);
+		site.auth_tls(false);
+		site.username("test");
+		site.password("test");
+		return site;
+	};
+
+	// A file for RETR and SIZE, listed in its directory. Its directory (and
+	// theirs) is made if need be. STOR adds files too.
+	void file(const std::string & path, const std::string & contents)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		add_entry(path, false);
+		files_[path] = contents;
+	};
+
+	// Empty if there's no such file.
+	std::string file(const std::string & path) const
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		std::map<std::string, std::string>::const_iterator found =
+			files_.find(path);
+		return found == files_.end() ? std::string() : found->second;
+	};
+
+	void directory(const std::string & path)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		add_entry(path, true);
+	};
+
+	// Every command received, in order, on any connection.
+	std::vector<std::string> commands() const
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		return commands_;
+	};
+
+	// Just the ones starting with prefix.
+	std::vector<std::string> commands(const std::string & prefix) const
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		std::vector<std::string> matching;
+		for (std::vector<std::string>::const_iterator c = commands_.begin();
+			c != commands_.end(); c++)
+			if (starts_with(*c, prefix))
+				matching.push_back(*c);
+		return matching;
+	};
+
+	// The next times commands starting with prefix get reply, rather than
+	// being carried out. A reply may run to several lines, separated by CRLF.
+	// An empty one closes the connection.
+	void answer(const std::string & prefix, const std::string & reply,
+		unsigned int times = 1)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		answer_record entry = { prefix, reply, times };
+		answers_.push_back(entry);
+	};
+
+	// Commands starting with prefix wait until release() before they're
+	// carried out. An empty prefix holds nothing more.
+	void hold(const std::string & prefix)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		hold_ = prefix;
+	};
+
+	// Commands waiting to be carried out, or retrieves paused.
+	std::size_t held() const
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		return held_;
+	};
+
+	// Waits a few seconds at most for held() to reach count.
+	bool wait_held(std::size_t count) const
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		boost::system_time deadline = boost::get_system_time() +
+			boost::posix_time::seconds(5);
+
+		while (held_ < count)
+			if (!changed_.timed_wait(lock, deadline))
+				return held_ >= count;
+
+		return true;
+	};
+
+	// Lets everything held go.
+	void release()
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		releases_++;
+		changed_.notify_all();
+	};
+
+	// The next RETR sends bytes and then waits for release().
+	void pause_retrieve(std::size_t bytes)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		pause_after_ = bytes;
+		pausing_ = true;
+	};
+
+	// The next RETR sends bytes and then drops the data connection (426).
+	void cut_retrieve(std::size_t bytes)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		cut_after_ = bytes;
+		cutting_ = true;
+	};
+
+	// How long a transfer waits for its data connection. Default 5 seconds.
+	void accept_timeout(int milliseconds)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		accept_timeout_ms_ = milliseconds;
+	};
+
+private:
+
+	struct answer_record
+	{
+		std::string prefix;
+		std::string reply;
+		unsigned int times;
+	};
+
+	struct session
+	{
+		session(int control) : control(control), passive(-1), active(),
+			has_active(false), offset(0), input() {};
+
+		int control;
+		int passive;
+		sockaddr_in active;
+		bool has_active;
+		unsigned long offset;
+		std::string input;
+	};
+
+	static bool starts_with(const std::string & s, const std::string & prefix)
+	{
+		return s.compare(0, prefix.length(), prefix) == 0;
+	};
+
+	static std::string parent_of(const std::string & path)
+	{
+		std::string::size_type slash = path.rfind('/');
+		return slash == 0 || slash == std::string::npos ? "/" :
+			path.substr(0, slash);
+	};
+
+	static int listen_socket(unsigned short & port)
+	{
+		int s = ::socket(AF_INET, SOCK_STREAM, 0);
+
+		sockaddr_in address;
+		std::memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		socklen_t length = sizeof(address);
+		if (s == -1 ||
+			::bind(s, reinterpret_cast<sockaddr *>(&address), length) != 0 ||
+			::listen(s, 16) != 0 ||
+			::getsockname(s, reinterpret_cast<sockaddr *>(&address),
+				&length) != 0)
+		{
+			std::perror("fake_server");
+			std::abort();
+		}
+
+		port = ntohs(address.sin_port);
+		return s;
+	};
+
+	// Caller must hold mutex_.
+	void add_entry(const std::string & path, bool is_directory)
+	{
+		if (path == "/")
+			return;
+
+		std::string parent = parent_of(path);
+		if (directories_.find(parent) == directories_.end())
+			add_entry(parent, true);
+
+		std::vector<std::string> & entries = directories_[parent];
+		std::string name = path.substr(path.rfind('/') + 1);
+		if (std::find(entries.begin(), entries.end(), name) == entries.end())
+			entries.push_back(name);
+
+		if (is_directory)
+			directories_[path];
+	};
+
+	void track(int s)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		sockets_.insert(s);
+
+		if (stopping_)
+			::shutdown(s, SHUT_RDWR);
+	};
+
+	void close_socket(int & s)
+	{
+		if (s == -1)
+			return;
+
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			sockets_.erase(s);
+		}
+
+		::close(s);
+		s = -1;
+	};
+
+	void accept_loop()
+	{
+		for (;;)
+		{
+			int s = ::accept(listener_, 0, 0);
+
+			if (s == -1 && errno == EINTR)
+				continue;
+
+			if (s == -1)
+				return;
+
+			track(s);
+
+			boost::mutex::scoped_lock lock(mutex_);
+			sessions_.push_back(boost::shared_ptr<boost::thread>(
+				new boost::thread(boost::bind(&fake_server::serve, this, s))));
+		}
+	};
+
+	bool send_all(int s, const char * data, std::size_t length)
+	{
+		while (length > 0)
+		{
+			ssize_t sent = ::send(s, data, length, MSG_NOSIGNAL);
+
+			if (sent < 0 && errno == EINTR)
+				continue;
+
+			if (sent <= 0)
+				return false;
+
+			data += sent;
+			length -= sent;
+		}
+
+		return true;
+	};
+
+	bool reply(session & client, const std::string & text)
+	{
+		std::string line = text + "\r\n";
+		return send_all(client.control, line.data(), line.length());
+	};
+
+	bool read_line(session & client, std::string & line)
+	{
+		for (;;)
+		{
+			std::string::size_type end = client.input.find("\r\n");
+			if (end != std::string::npos)
+			{
+				line = client.input.substr(0, end);
+				client.input.erase(0, end + 2);
+				return true;
+			}
+
+			char buffer[1024];
+			ssize_t received = ::recv(client.control, buffer, sizeof(buffer),
+				0);
+
+			if (received < 0 && errno == EINTR)
+				continue;
+
+			if (received <= 0)
+				return false;
+
+			client.input.append(buffer, received);
+		}
+	};
+
+	void serve(int control)
+	{
+		session client(control);
+
+		if (reply(client, "220 fake_server ready."))
+		{
+			std::string line;
+			while (read_line(client, line) && handle(client, line))
+				;
+		}
+
+		close_socket(client.passive);
+		close_socket(client.control);
+	};
+
+	// Records the command, and waits if it's held. False if it has been
+	// answered already, or the server is stopping.
+	bool admit(session & client, const std::string & line, bool & open)
+	{
+		std::string scripted;
+		bool answered = false;
+
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			commands_.push_back(line);
+
+			if (!hold_.empty() && starts_with(line, hold_))
+			{
+				unsigned long releases = releases_;
+				held_++;
+				changed_.notify_all();
+
+				while (releases == releases_ && !stopping_)
+					changed_.wait(lock);
+
+				held_--;
+			}
+
+			if (stopping_)
+			{
+				open = false;
+				return false;
+			}
+
+			for (std::vector<answer_record>::iterator a = answers_.begin();
+				a != answers_.end(); a++)
+			{
+				if (!starts_with(line, a->prefix))
+					continue;
+
+				scripted = a->reply;
+				answered = true;
+
+				if (--a->times == 0)
+					answers_.erase(a);
+				break;
+			}
+		}
+
+		if (!answered)
+			return true;
+
+		open = !scripted.empty() && reply(client, scripted);
+		return false;
+	};
+
+	bool handle(session & client, const std::string & line)
+	{
+		bool open = true;
+		if (!admit(client, line, open))
+			return open;
+
+		std::string::size_type space = line.find(' ');
+		std::string verb = line.substr(0, space);
+		std::string argument = space == std::string::npos ? std::string() :
+			line.substr(space + 1);
+
+		if (verb == "USER")
+			return reply(client, "331 Password required.");
+		if (verb == "PASS")
+			return reply(client, "230 Logged in.");
+		if (verb == "FEAT")
+			return reply(client, "211-Features:\r\n REST STREAM\r\n211 End");
+		if (verb == "PWD")
+			return reply(client, "257 \"/\" is the current directory.");
+		if (verb == "CWD")
+			return reply(client, "250 Directory changed.");
+		if (verb == "TYPE" || verb == "NOOP" || verb == "PBSZ" ||
+			verb == "PROT" || verb == "SSCN")
+			return reply(client, "200 OK.");
+		if (verb == "ABOR")
+			return reply(client, "226 Abort successful.");
+		if (verb == "QUIT")
+		{
+			reply(client, "221 Goodbye.");
+			return false;
+		}
+		if (verb == "REST")
+		{
+			client.offset = std::strtoul(argument.c_str(), 0, 10);
+			return reply(client, "350 Restarting at " + argument + ".");
+		}
+		if (verb == "SIZE")
+		{
+			std::string contents = file(argument);
+			char buffer[32];
+			std::sprintf(buffer, "213 %lu",
+				static_cast<unsigned long>(contents.size()));
+			return reply(client, contents.empty() ? "550 No such file." :
+				buffer);
+		}
+		if (verb == "STAT" && starts_with(argument, "-l"))
+			return list(client, argument.length() > 3 ?
+				argument.substr(3) : "/");
+		if (verb == "PASV")
+			return enter_passive(client);
+		if (verb == "PORT")
+			return enter_active(client, argument);
+		if (verb == "RETR")
+			return retrieve(client, argument);
+		if (verb == "STOR")
+			return store(client, argument);
+
+		return reply(client, "500 Unknown command.");
+	};
+
+	bool list(session & client, const std::string & path)
+	{
+		std::string text = "213-Status of " + path + ":";
+
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+
+			std::map<std::string, std::vector<std::string> >::const_iterator
+				found = directories_.find(path);
+			if (found == directories_.end())
+				return reply(client, "450 No such directory.");
+
+			for (std::vector<std::string>::const_iterator name =
+				found->second.begin(); name != found->second.end(); name++)
+			{
+				std::string full = (path == "/" ? "" : path) + "/" + *name;
+				std::map<std::string, std::string>::const_iterator contents =
+					files_.find(full);
+
+				char entry[512];
+				if (contents == files_.end())
+					std::sprintf(entry, "drwxr-xr-x  2 ftp  ftp  4096 "
+						"Jan 29  2008 %s", name->c_str());
+				else
+					std::sprintf(entry, "-rw-r--r--  1 ftp  ftp  %lu "
+						"Jan 29  2008 %s",
+						static_cast<unsigned long>(contents->second.size()),
+						name->c_str());
+
+				text += "\r\n";
+				text += entry;
+			}
+		}
+
+		return reply(client, text + "\r\n213 End of status.");
+	};
+
+	bool enter_passive(session & client)
+	{
+		close_socket(client.passive);
+		client.has_active = false;
+
+		unsigned short port;
+		client.passive = listen_socket(port);
+		track(client.passive);
+
+		char text[64];
+		std::sprintf(text, "227 Entering Passive Mode (127,0,0,1,%u,%u).",
+			port >> 8, port & 0xff);
+		return reply(client, text);
+	};
+
+	bool enter_active(session & client, const std::string & argument)
+	{
+		unsigned int n[6];
+		if (std::sscanf(argument.c_str(), "%u,%u,%u,%u,%u,%u", &n[0], &n[1],
+			&n[2], &n[3], &n[4], &n[5]) != 6)
+			return reply(client, "501 Bad PORT.");
+
+		close_socket(client.passive);
+
+		std::memset(&client.active, 0, sizeof(client.active));
+		client.active.sin_family = AF_INET;
+		client.active.sin_addr.s_addr = htonl((n[0] << 24) | (n[1] << 16) |
+			(n[2] << 8) | n[3]);
+		client.active.sin_port = htons((n[4] << 8) | n[5]);
+		client.has_active = true;
+
+		return reply(client, "200 PORT command successful.");
+	};
+
+	// The data connection for a transfer, or -1.
+	int open_data(session & client)
+	{
+		int s = -1;
+
+		if (client.has_active)
+		{
+			client.has_active = false;
+			s = ::socket(AF_INET, SOCK_STREAM, 0);
+			if (s != -1 && ::connect(s,
+				reinterpret_cast<sockaddr *>(&client.active),
+				sizeof(client.active)) != 0)
+			{
+				::close(s);
+				s = -1;
+			}
+		}
+		else if (client.passive != -1)
+		{
+			int timeout;
+			{
+				boost::mutex::scoped_lock lock(mutex_);
+				timeout = accept_timeout_ms_;
+			}
+
+			boost::system_time deadline = boost::get_system_time() +
+				boost::posix_time::milliseconds(timeout);
+
+			while (!abort_coming(client))
+			{
+				long left = (deadline -
+					boost::get_system_time()).total_milliseconds();
+
+				pollfd waiting[2] = { { client.passive, POLLIN, 0 },
+					{ client.control, POLLIN, 0 } };
+				if (left <= 0 || ::poll(waiting, 2, left) <= 0)
+					break;
+
+				if (waiting[0].revents != 0)
+				{
+					s = ::accept(client.passive, 0, 0);
+					break;
+				}
+
+				char buffer[1024];
+				ssize_t received = ::recv(client.control, buffer,
+					sizeof(buffer), 0);
+				if (received <= 0)
+					break;
+
+				client.input.append(buffer, received);
+			}
+
+			close_socket(client.passive);
+		}
+
+		if (s != -1)
+			track(s);
+
+		return s;
+	};
+
+	// Whether there's an ABOR among the commands read but not yet handled.
+	static bool abort_coming(const session & client)
+	{
+		return ("\r\n" + client.input).find("\r\nABOR\r\n") !=
+			std::string::npos;
+	};
+
+	bool retrieve(session & client, const std::string & path)
+	{
+		unsigned long offset = client.offset;
+		client.offset = 0;
+
+		std::string contents;
+		std::size_t pause = 0;
+		bool pausing = false;
+		std::size_t cut = 0;
+		bool cutting = false;
+
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+
+			std::map<std::string, std::string>::const_iterator found =
+				files_.find(path);
+			if (found == files_.end())
+			{
+				lock.unlock();
+				close_socket(client.passive);
+				return reply(client, "550 No such file.");
+			}
+
+			contents = found->second.substr(std::min<std::size_t>(offset,
+				found->second.size()));
+
+			std::swap(pausing, pausing_);
+			pause = pause_after_;
+			std::swap(cutting, cutting_);
+			cut = cut_after_;
+		}
+
+		int data = open_data(client);
+		if (data == -1 && abort_coming(client))
+			return reply(client, "426 Transfer aborted.");
+
+		if (data == -1)
+			return reply(client, "425 Can't open data connection.");
+
+		char text[64];
+		std::sprintf(text, "150 Opening BINARY mode data connection "
+			"(%lu bytes).", static_cast<unsigned long>(contents.size()));
+		if (!reply(client, text))
+		{
+			close_socket(data);
+			return false;
+		}
+
+		if (cutting && cut < contents.size())
+		{
+			send_all(data, contents.data(), cut);
+			close_socket(data);
+			return reply(client, "426 Connection closed; transfer aborted.");
+		}
+
+		bool sent = true;
+		std::size_t first = pausing ? std::min(pause, contents.size()) :
+			contents.size();
+
+		if (!send_all(data, contents.data(), first))
+			sent = false;
+
+		if (sent && pausing)
+		{
+			{
+				boost::mutex::scoped_lock lock(mutex_);
+				unsigned long releases = releases_;
+				held_++;
+				changed_.notify_all();
+
+				while (releases == releases_ && !stopping_)
+					changed_.wait(lock);
+
+				held_--;
+			}
+
+			sent = send_all(data, contents.data() + first,
+				contents.size() - first);
+		}
+
+		close_socket(data);
+
+		return reply(client, sent ? "226 Transfer complete." :
+			"426 Connection closed; transfer aborted.");
+	};
+
+	bool store(session & client, const std::string & path)
+	{
+		int data = open_data(client);
+		if (data == -1 && abort_coming(client))
+			return reply(client, "426 Transfer aborted.");
+
+		if (data == -1)
+			return reply(client, "425 Can't open data connection.");
+
+		if (!reply(client, "150 Ok to send data."))
+		{
+			close_socket(data);
+			return false;
+		}
+
+		std::string contents;
+		char buffer[4096];
+		ssize_t received;
+		while ((received = ::recv(data, buffer, sizeof(buffer), 0)) != 0)
+		{
+			if (received < 0 && errno == EINTR)
+				continue;
+
+			if (received < 0)
+				break;
+
+			contents.append(buffer, received);
+		}
+
+		close_socket(data);
+
+		if (received < 0)
+			return reply(client, "426 Connection closed; transfer aborted.");
+
+		file(path, contents);
+		return reply(client, "226 Transfer complete.");
+	};
+
+	int listener_;
+	unsigned short port_;
+	boost::shared_ptr<boost::thread> acceptor_;
+
+	mutable boost::mutex mutex_;
+	mutable boost::condition changed_;
+	bool stopping_;
+	std::set<int> sockets_;
+	std::vector<boost::shared_ptr<boost::thread> > sessions_;
+
+	std::map<std::string, std::string> files_;
+	std::map<std::string, std::vector<std::string> > directories_;
+	std::vector<std::string> commands_;
+	std::vector<answer_record> answers_;
+
+	std::string hold_;
+	std::size_t held_;
+	unsigned long releases_;
+	std::size_t pause_after_;
+	bool pausing_;
+	std::size_t cut_after_;
+	bool cutting_;
+	int accept_timeout_ms_;
+
+}; // class fake_server
+
+// Has a pool keep count sessions to site, and leases them all once they're
+// logged in, adding them to sessions. False if they weren't within a few
+// seconds.
+inline bool lease_sessions(foofxp::model::session_controller & controller,
+	const foofxp::model::ftp::bookmark & site, std::size_t count,
+	std::vector<foofxp::model::session_controller::client_ptr> & sessions)
+{
+	std::size_t wanted = sessions.size() + count;
+	controller.keep_warm(site, count);
+
+	for (int i = 0; i < 100 && sessions.size() < wanted; i++)
+	{
+		foofxp::model::session_controller::client_ptr session =
+			controller.lease_session(site);
+
+		if (session)
+			sessions.push_back(session);
+		else
+			boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+	}
+
+	return sessions.size() == wanted;
+}
+
+// Counts a signal firing on the pool's threads, for a test to wait on. Bind
+// the signal to fire(), or to note() to keep a message too.
+class event_counter : private boost::noncopyable
+{
+public:
+
+	event_counter() : mutex_(), changed_(), fired_(0), messages_() {};
+
+	void fire()
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		fired_++;
+		changed_.notify_all();
+	};
+
+	void note(const std::string & message)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		messages_.push_back(message);
+		fired_++;
+		changed_.notify_all();
+	};
+
+	std::size_t fired() const
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		return fired_;
+	};
+
+	std::vector<std::string> messages() const
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		return messages_;
+	};
+
+	// Waits ten seconds at most for it to have fired count times.
+	bool wait(std::size_t count = 1) const
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		boost::system_time deadline = boost::get_system_time() +
+			boost::posix_time::seconds(10);
+
+		while (fired_ < count)
+			if (!changed_.timed_wait(lock, deadline))
+				return fired_ >= count;
+
+		return true;
+	};
+
+private:
+
+	mutable boost::mutex mutex_;
+	mutable boost::condition changed_;
+	std::size_t fired_;
+	std::vector<std::string> messages_;
+
+}; // class event_counter
+
+#endif // FOOFXP_FAKE_SERVER_HPP_INCLUDED
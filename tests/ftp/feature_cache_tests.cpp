@@ -0,0 +1,133 @@
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/test/unit_test.hpp>
+#include "../../foofxp/model/ftp/feature_cache.hpp"
+
+using namespace std;
+using namespace boost::posix_time;
+using foofxp::model::ftp::feature_cache;
+
+static const char * cache_path = "/tmp/foofxp-feature-cache-test";
+
+static feature_cache::feature_set some_features()
+{
+	feature_cache::feature_set features;
+	features.insert("EPSV");
+	features.insert("MLST TYPE*;SIZE*;MODIFY*;");
+	features.insert("REST STREAM");
+	return features;
+}
+
+BOOST_AUTO_TEST_SUITE(feature_cache_tests)
+
+BOOST_AUTO_TEST_CASE(parses_feat_reply)
+{
+	feature_cache::feature_set features;
+	feature_cache::parse_feat_reply("211-Features:\n"
+		" MDTM\n"
+		" mlst type*;size*;modify*;\r\n"
+		"  REST STREAM \n"
+		"211 End", features);
+
+	BOOST_CHECK_EQUAL(features.size(), 3U);
+	BOOST_CHECK(features.count("MDTM"));
+	BOOST_CHECK(features.count("MLST TYPE*;SIZE*;MODIFY*;"));
+	BOOST_CHECK(features.count("REST STREAM"));
+}
+
+BOOST_AUTO_TEST_CASE(supports_whole_lines_and_first_words)
+{
+	feature_cache::feature_set features = some_features();
+
+	BOOST_CHECK(feature_cache::supports(features, "epsv"));
+	BOOST_CHECK(feature_cache::supports(features, "MLST"));
+	BOOST_CHECK(feature_cache::supports(features, "REST STREAM"));
+	BOOST_CHECK(!feature_cache::supports(features, "REST STREAMING"));
+	BOOST_CHECK(!feature_cache::supports(features, "MLS"));
+	BOOST_CHECK(!feature_cache::supports(features, "SSCN"));
+}
+
+BOOST_AUTO_TEST_CASE(find_inserted)
+{
+	feature_cache cache(hours(1));
+	feature_cache::feature_set found;
+
+	BOOST_CHECK(!cache.find("ftp.example.com", 21, found));
+
+	cache.insert("ftp.example.com", 21, some_features());
+
+	BOOST_CHECK(cache.find("ftp.example.com", 21, found));
+	BOOST_CHECK(found == some_features());
+	BOOST_CHECK(!cache.find("ftp.example.com", 2121, found));
+}
+
+BOOST_AUTO_TEST_CASE(entries_expire)
+{
+	feature_cache cache(seconds(0));
+	feature_cache::feature_set found;
+
+	cache.insert("ftp.example.com", 21, some_features());
+
+	BOOST_CHECK(!cache.find("ftp.example.com", 21, found));
+}
+
+BOOST_AUTO_TEST_CASE(saves_and_loads)
+{
+	{
+		feature_cache cache(hours(1));
+		cache.insert("ftp.example.com", 21, some_features());
+		cache.insert("ftp.example.org", 990, feature_cache::feature_set());
+		cache.save(cache_path);
+	}
+
+	feature_cache cache(hours(1));
+	cache.load(cache_path);
+	::remove(cache_path);
+
+	feature_cache::feature_set found;
+
+	BOOST_CHECK_EQUAL(cache.size(), 2U);
+	BOOST_CHECK(cache.find("ftp.example.com", 21, found));
+	BOOST_CHECK(found == some_features());
+	BOOST_CHECK(cache.find("ftp.example.org", 990, found));
+	BOOST_CHECK(found.empty());
+}
+
+BOOST_AUTO_TEST_CASE(load_skips_garbage_and_expired_entries)
+{
+	{
+		ofstream out(cache_path);
+		out << "# comment" << endl
+			<< "ftp.example.com 21 yesterday" << endl
+			<< " EPSV" << endl
+			<< "ftp.example.org 21 20000101T000000" << endl
+			<< " EPSV" << endl
+			<< "ftp.example.net 21 "
+			<< to_iso_string(second_clock::universal_time()) << endl
+			<< " MLST" << endl;
+	}
+
+	feature_cache cache(hours(1));
+	cache.load(cache_path);
+	::remove(cache_path);
+
+	feature_cache::feature_set found;
+
+	BOOST_CHECK_EQUAL(cache.size(), 1U);
+	BOOST_CHECK(cache.find("ftp.example.net", 21, found));
+	BOOST_CHECK(found.count("MLST"));
+}
+
+BOOST_AUTO_TEST_CASE(loads_nothing_from_missing_file)
+{
+	feature_cache cache(hours(1));
+	::remove(cache_path);
+
+	cache.load(cache_path);
+
+	BOOST_CHECK_EQUAL(cache.size(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
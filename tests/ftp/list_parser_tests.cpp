@@ -0,0 +1,156 @@
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <boost/test/unit_test.hpp>
+#include "../../foofxp/model/ftp/list_parser.hpp"
+
+using namespace std;
+using namespace boost::gregorian;
+using namespace boost::posix_time;
+using foofxp::model::file;
+using foofxp::model::ftp::list_parser;
+
+struct list_parser_fixture
+{
+	list_parser_fixture() : parser(date(2008, 5, 17)) {};
+
+	file parse(const string & line)
+	{
+		file f;
+		BOOST_REQUIRE_EQUAL(parser.parse_line(line, f), true);
+		return f;
+	};
+
+	list_parser parser;
+};
+
+BOOST_AUTO_TEST_SUITE(list_parser_tests)
+
+BOOST_AUTO_TEST_CASE(parses_owner_and_group)
+{
+	list_parser_fixture fixture;
+	file f = fixture.parse(
+		"-rw-r--r--  1 root  other  531 Jan 29 03:26 README");
+
+	BOOST_CHECK_EQUAL(f.name(), "README");
+	BOOST_CHECK_EQUAL(f.type(), file::plain_old_file);
+	BOOST_CHECK_EQUAL(f.size(), 531UL);
+	BOOST_CHECK_EQUAL(f.time(),
+		ptime(date(2008, 1, 29), hours(3) + minutes(26)));
+}
+
+BOOST_AUTO_TEST_CASE(parses_group_only)
+{
+	list_parser_fixture fixture;
+	file f = fixture.parse("drwxr-xr-x  1 other  4096 Feb  3 2006 incoming");
+
+	BOOST_CHECK_EQUAL(f.name(), "incoming");
+	BOOST_CHECK_EQUAL(f.type(), file::directory);
+	BOOST_CHECK_EQUAL(f.size(), 4096UL);
+	BOOST_CHECK_EQUAL(f.time(), ptime(date(2006, 2, 3)));
+}
+
+BOOST_AUTO_TEST_CASE(parses_no_owner_or_group)
+{
+	list_parser_fixture fixture;
+	file f = fixture.parse("-rw-r--r--  1  531 Dec 31 1999 party.mp3");
+
+	BOOST_CHECK_EQUAL(f.name(), "party.mp3");
+	BOOST_CHECK_EQUAL(f.size(), 531UL);
+	BOOST_CHECK_EQUAL(f.time(), ptime(date(1999, 12, 31)));
+}
+
+BOOST_AUTO_TEST_CASE(keeps_spaces_in_names)
+{
+	list_parser_fixture fixture;
+	file f = fixture.parse(
+		"-rw-r--r--  1 root  other  1 Mar  1 2001 a name  with spaces");
+
+	BOOST_CHECK_EQUAL(f.name(), "a name  with spaces");
+}
+
+BOOST_AUTO_TEST_CASE(ignores_month_names_in_owner_and_group)
+{
+	list_parser_fixture fixture;
+	file f = fixture.parse("-rw-r--r--  1 Jan  May  12 Oct  9 2007 Apr 1");
+
+	BOOST_CHECK_EQUAL(f.name(), "Apr 1");
+	BOOST_CHECK_EQUAL(f.size(), 12UL);
+	BOOST_CHECK_EQUAL(f.time(), ptime(date(2007, 10, 9)));
+}
+
+BOOST_AUTO_TEST_CASE(trims_link_targets)
+{
+	list_parser_fixture fixture;
+	file f = fixture.parse(
+		"lrwxrwxrwx   1        7 Jan 25 00:17 bin -> usr/bin");
+
+	BOOST_CHECK_EQUAL(f.name(), "bin");
+	BOOST_CHECK_EQUAL(f.type(), file::link);
+}
+
+BOOST_AUTO_TEST_CASE(clock_times_in_the_future_are_last_year)
+{
+	list_parser_fixture fixture;
+
+	BOOST_CHECK_EQUAL(
+		fixture.parse("-rw-r--r--  1  1 May 17 23:59 today").time(),
+		ptime(date(2008, 5, 17), hours(23) + minutes(59)));
+	BOOST_CHECK_EQUAL(
+		fixture.parse("-rw-r--r--  1  1 May 18 00:00 tomorrow").time(),
+		ptime(date(2007, 5, 18)));
+}
+
+BOOST_AUTO_TEST_CASE(skips_total_lines)
+{
+	list_parser_fixture fixture;
+	file f("untouched");
+
+	BOOST_CHECK_EQUAL(fixture.parser.parse_line("total 64", f), false);
+	BOOST_CHECK_EQUAL(f.name(), "untouched");
+}
+
+BOOST_AUTO_TEST_CASE(rejects_malformed_lines)
+{
+	list_parser_fixture fixture;
+	file f;
+
+	BOOST_CHECK_THROW(fixture.parser.parse_line("", f), runtime_error);
+	BOOST_CHECK_THROW(fixture.parser.parse_line("garbage", f),
+		runtime_error);
+	BOOST_CHECK_THROW(
+		fixture.parser.parse_line("-rw-r--r--  1  531 Jan 29 03:26", f),
+		runtime_error);
+	BOOST_CHECK_THROW(
+		fixture.parser.parse_line("-rw-r--r--  1  531 Jan 32 2001 x", f),
+		runtime_error);
+	BOOST_CHECK_THROW(
+		fixture.parser.parse_line("-rw-r--r--  1  531 Jan 29 3:2x x", f),
+		runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(parse_lines_appends_entries)
+{
+	list_parser_fixture fixture;
+
+	vector<string> lines;
+	lines.push_back("total 2");
+	lines.push_back("-rw-r--r--  1 root  other  1 Jan  1 2001 a");
+	lines.push_back("-rw-r--r--  1 root  other  2 Jan  2 2002 b");
+
+	vector<file> files(1, file("existing"));
+
+	BOOST_CHECK_EQUAL(fixture.parser.parse_lines(lines, files), 2U);
+	BOOST_REQUIRE_EQUAL(files.size(), 3U);
+	BOOST_CHECK_EQUAL(files[0].name(), "existing");
+	BOOST_CHECK_EQUAL(files[1].name(), "a");
+	BOOST_CHECK_EQUAL(files[2].name(), "b");
+
+	lines.push_back("rubbish");
+
+	BOOST_CHECK_THROW(fixture.parser.parse_lines(lines, files),
+		runtime_error);
+	BOOST_CHECK_EQUAL(files.size(), 3U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,117 @@
+#include <string>
+#include <vector>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/test/unit_test.hpp>
+#include "../../foofxp/model/ftp/listing_cache.hpp"
+
+using namespace std;
+using namespace boost::posix_time;
+using foofxp::model::file;
+using foofxp::model::ftp::listing_cache;
+
+static vector<file> listing(const string & name, size_t count = 1)
+{
+	return vector<file>(count, file(name));
+}
+
+BOOST_AUTO_TEST_SUITE(listing_cache_tests)
+
+BOOST_AUTO_TEST_CASE(finds_inserted_listings)
+{
+	listing_cache cache(1024 * 1024, hours(1));
+	bool fresh = false;
+
+	BOOST_CHECK(!cache.find("/pub", fresh));
+
+	cache.insert("/pub", listing("a"));
+
+	const vector<file> * found = cache.find("/pub", fresh);
+	BOOST_REQUIRE(found);
+	BOOST_CHECK(*found == listing("a"));
+	BOOST_CHECK(fresh);
+	BOOST_CHECK(!cache.find("/pub/a", fresh));
+}
+
+BOOST_AUTO_TEST_CASE(old_listings_are_stale)
+{
+	listing_cache cache(1024 * 1024, seconds(0));
+	bool fresh = true;
+
+	cache.insert("/pub", listing("a"));
+
+	BOOST_CHECK(cache.find("/pub", fresh));
+	BOOST_CHECK(!fresh);
+}
+
+BOOST_AUTO_TEST_CASE(evicts_least_recently_used)
+{
+	listing_cache cache(1024 * 1024, hours(1));
+	bool fresh;
+
+	cache.insert("/a", listing("a", 100));
+	size_t one = cache.bytes();
+
+	// Room for two.
+	cache.max_bytes(one * 2 + one / 2);
+	cache.insert("/b", listing("b", 100));
+	BOOST_CHECK(cache.find("/a", fresh));
+	cache.insert("/c", listing("c", 100));
+
+	BOOST_CHECK_EQUAL(cache.size(), 2U);
+	BOOST_CHECK(cache.find("/a", fresh));
+	BOOST_CHECK(!cache.find("/b", fresh));
+	BOOST_CHECK(cache.find("/c", fresh));
+	BOOST_CHECK(cache.bytes() <= cache.max_bytes());
+}
+
+BOOST_AUTO_TEST_CASE(skips_listings_bigger_than_the_cache)
+{
+	listing_cache cache(1024, hours(1));
+	bool fresh;
+
+	cache.insert("/small", listing("a"));
+	cache.insert("/big", listing("a", 1000));
+
+	BOOST_CHECK(cache.find("/small", fresh));
+	BOOST_CHECK(!cache.find("/big", fresh));
+}
+
+BOOST_AUTO_TEST_CASE(invalidates_and_replaces)
+{
+	listing_cache cache(1024 * 1024, hours(1));
+	bool fresh;
+
+	cache.insert("/pub", listing("a"));
+	cache.insert("/pub", listing("b", 2));
+
+	BOOST_CHECK_EQUAL(cache.size(), 1U);
+	BOOST_CHECK(*cache.find("/pub", fresh) == listing("b", 2));
+
+	size_t bytes = cache.bytes();
+	cache.insert("/incoming", listing("c"));
+	cache.invalidate("/incoming");
+	cache.invalidate("/nowhere");
+
+	BOOST_CHECK_EQUAL(cache.bytes(), bytes);
+	BOOST_CHECK(!cache.find("/incoming", fresh));
+
+	cache.clear();
+	BOOST_CHECK_EQUAL(cache.size(), 0U);
+	BOOST_CHECK_EQUAL(cache.bytes(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(makes_paths_absolute)
+{
+	BOOST_CHECK_EQUAL(listing_cache::absolute_path("/pub", ""), "/pub");
+	BOOST_CHECK_EQUAL(listing_cache::absolute_path("/pub", "a"), "/pub/a");
+	BOOST_CHECK_EQUAL(listing_cache::absolute_path("/", "a/"), "/a");
+	BOOST_CHECK_EQUAL(listing_cache::absolute_path("/pub", "/b//c"), "/b/c");
+	BOOST_CHECK_EQUAL(listing_cache::absolute_path("", "/"), "/");
+	BOOST_CHECK_EQUAL(listing_cache::absolute_path("", "a"), "");
+
+	BOOST_CHECK_EQUAL(listing_cache::parent_path("/pub/a"), "/pub");
+	BOOST_CHECK_EQUAL(listing_cache::parent_path("/pub"), "/");
+	BOOST_CHECK_EQUAL(listing_cache::parent_path("/"), "/");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
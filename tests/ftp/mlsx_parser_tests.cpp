@@ -0,0 +1,143 @@
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <boost/test/unit_test.hpp>
+#include "../../foofxp/model/ftp/mlsx_parser.hpp"
+
+using namespace std;
+using namespace boost::gregorian;
+using namespace boost::posix_time;
+using foofxp::model::file;
+using foofxp::model::ftp::mlsx_parser;
+
+struct mlsx_parser_fixture
+{
+	file parse(const string & line)
+	{
+		file f;
+		BOOST_REQUIRE_EQUAL(parser.parse_line(line, f), true);
+		return f;
+	};
+
+	mlsx_parser parser;
+};
+
+BOOST_AUTO_TEST_SUITE(mlsx_parser_tests)
+
+BOOST_AUTO_TEST_CASE(parses_file_facts)
+{
+	mlsx_parser_fixture fixture;
+	file f = fixture.parse(
+		"type=file;size=531;modify=20080129032600;UNIX.mode=0644; README");
+
+	BOOST_CHECK_EQUAL(f.name(), "README");
+	BOOST_CHECK_EQUAL(f.type(), file::plain_old_file);
+	BOOST_CHECK_EQUAL(f.size(), 531UL);
+	BOOST_CHECK_EQUAL(f.time(),
+		ptime(date(2008, 1, 29), hours(3) + minutes(26)));
+}
+
+BOOST_AUTO_TEST_CASE(parses_directories_and_links)
+{
+	mlsx_parser_fixture fixture;
+
+	BOOST_CHECK_EQUAL(fixture.parse("type=dir;perm=flcdmpe; incoming").type(),
+		file::directory);
+	BOOST_CHECK_EQUAL(
+		fixture.parse("type=OS.unix=slink:/pub;size=4; pub").type(),
+		file::link);
+	BOOST_CHECK_EQUAL(fixture.parse("type=device; null").type(),
+		file::other);
+}
+
+BOOST_AUTO_TEST_CASE(skips_current_and_parent_directories)
+{
+	mlsx_parser_fixture fixture;
+	file f;
+
+	BOOST_CHECK_EQUAL(fixture.parser.parse_line("type=cdir; /pub", f), false);
+	BOOST_CHECK_EQUAL(fixture.parser.parse_line("type=pdir; ..", f), false);
+}
+
+BOOST_AUTO_TEST_CASE(ignores_case_of_facts)
+{
+	mlsx_parser_fixture fixture;
+	file f = fixture.parse("Type=DIR;Modify=20061231235959.5; old");
+
+	BOOST_CHECK_EQUAL(f.type(), file::directory);
+	BOOST_CHECK_EQUAL(f.time(), ptime(date(2006, 12, 31),
+		hours(23) + minutes(59) + seconds(59) + milliseconds(500)));
+}
+
+BOOST_AUTO_TEST_CASE(keeps_spaces_and_semicolons_in_names)
+{
+	mlsx_parser_fixture fixture;
+
+	BOOST_CHECK_EQUAL(fixture.parse("type=file;size=1; a name;  x\r").name(),
+		"a name;  x");
+	BOOST_CHECK_EQUAL(fixture.parse(" no facts").name(), "no facts");
+}
+
+BOOST_AUTO_TEST_CASE(parses_sizes_past_4_gb)
+{
+	mlsx_parser_fixture fixture;
+	file f = fixture.parse("type=file;size=8589934592; big.iso");
+
+	BOOST_CHECK(f.size() == (static_cast<file::size_type>(1) << 33));
+}
+
+BOOST_AUTO_TEST_CASE(ignores_invalid_times)
+{
+	mlsx_parser_fixture fixture;
+
+	BOOST_CHECK(fixture.parse("type=file;modify=20080230000000; x").time()
+		.is_not_a_date_time());
+	BOOST_CHECK(fixture.parse("type=file;modify=yesterday; x").time()
+		.is_not_a_date_time());
+}
+
+BOOST_AUTO_TEST_CASE(rejects_malformed_entries)
+{
+	mlsx_parser_fixture fixture;
+	file f;
+
+	BOOST_CHECK_THROW(fixture.parser.parse_line("", f), runtime_error);
+	BOOST_CHECK_THROW(fixture.parser.parse_line("type=file;", f),
+		runtime_error);
+	BOOST_CHECK_THROW(fixture.parser.parse_line("type=file x", f),
+		runtime_error);
+	BOOST_CHECK_THROW(fixture.parser.parse_line("type; x", f),
+		runtime_error);
+	BOOST_CHECK_THROW(fixture.parser.parse_line("size=12k; x", f),
+		runtime_error);
+	BOOST_CHECK_THROW(
+		fixture.parser.parse_line("size=99999999999999999999; x", f),
+		runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(parse_lines_appends_entries)
+{
+	mlsx_parser_fixture fixture;
+
+	vector<string> lines;
+	lines.push_back("type=cdir; .");
+	lines.push_back("type=file;size=1; a");
+	lines.push_back("type=dir; b");
+
+	vector<file> files(1);
+	files[0].name("existing");
+
+	BOOST_CHECK_EQUAL(fixture.parser.parse_lines(lines, files), 2U);
+	BOOST_REQUIRE_EQUAL(files.size(), 3U);
+	BOOST_CHECK_EQUAL(files[0].name(), "existing");
+	BOOST_CHECK_EQUAL(files[1].name(), "a");
+	BOOST_CHECK_EQUAL(files[2].name(), "b");
+
+	lines.push_back("garbage");
+
+	BOOST_CHECK_THROW(fixture.parser.parse_lines(lines, files),
+		runtime_error);
+	BOOST_CHECK_EQUAL(files.size(), 3U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,110 @@
+#include <string>
+#include <boost/test/unit_test.hpp>
+#include "../../foofxp/model/ftp/reply_assembler.hpp"
+
+using namespace std;
+using foofxp::model::ftp::reply_assembler;
+
+BOOST_AUTO_TEST_SUITE(reply_assembler_tests)
+
+BOOST_AUTO_TEST_CASE(single_line)
+{
+	reply_assembler replies;
+	string line("200 Command okay.");
+
+	BOOST_CHECK_EQUAL(replies.add_line(line), reply_assembler::complete);
+	BOOST_CHECK_EQUAL(replies.text(), line);
+	BOOST_CHECK_EQUAL(&replies.last_line(), &line);
+	BOOST_CHECK_EQUAL(replies.lines(), 1u);
+	BOOST_CHECK_EQUAL(replies.in_reply(), false);
+}
+
+BOOST_AUTO_TEST_CASE(multi_line)
+{
+	reply_assembler replies;
+	string lines[] =
+	{
+		"230-Welcome to the site.",
+		"Lines in between can say anything,",
+		"230- including other codes, or",
+		" 230 the same code with a space in front,",
+		"211 or another code with a space after.",
+		"230 User logged in."
+	};
+
+	BOOST_CHECK_EQUAL(replies.add_line(lines[0]), reply_assembler::opened);
+	BOOST_CHECK_EQUAL(replies.in_reply(), true);
+
+	for (int i = 1; i < 5; i++)
+		BOOST_CHECK_EQUAL(replies.add_line(lines[i]),
+			reply_assembler::interior);
+
+	BOOST_CHECK_EQUAL(replies.add_line(lines[5]), reply_assembler::complete);
+	BOOST_CHECK_EQUAL(replies.in_reply(), false);
+	BOOST_CHECK_EQUAL(replies.lines(), 6u);
+	BOOST_CHECK_EQUAL(replies.last_line(), lines[5]);
+	BOOST_CHECK_EQUAL(replies.text(), lines[0] + '\n' + lines[1] + '\n' +
+		lines[2] + '\n' + lines[3] + '\n' + lines[4] + '\n' + lines[5]);
+}
+
+BOOST_AUTO_TEST_CASE(no_space_after_hyphen)
+{
+	reply_assembler replies;
+
+	BOOST_CHECK_EQUAL(replies.add_line("211-Features:"),
+		reply_assembler::opened);
+	BOOST_CHECK_EQUAL(replies.add_line(" MDTM"), reply_assembler::interior);
+	BOOST_CHECK_EQUAL(replies.add_line("211 End"), reply_assembler::complete);
+	BOOST_CHECK_EQUAL(replies.text(), "211-Features:\n MDTM\n211 End");
+}
+
+BOOST_AUTO_TEST_CASE(interior_lines_not_kept)
+{
+	reply_assembler replies;
+
+	replies.add_line("213-status of -l:");
+	BOOST_CHECK_EQUAL(replies.add_line("-rw-r--r-- 1 a b 1 Jan 1 2008 x",
+		false), reply_assembler::interior);
+	BOOST_CHECK_EQUAL(replies.add_line("213 End of Status", false),
+		reply_assembler::complete);
+	BOOST_CHECK_EQUAL(replies.lines(), 3u);
+	BOOST_CHECK_EQUAL(replies.text(), "213-status of -l:\n213 End of Status");
+}
+
+BOOST_AUTO_TEST_CASE(buffer_reused)
+{
+	reply_assembler replies;
+
+	replies.add_line("220-one");
+	replies.add_line("220 two");
+	BOOST_CHECK_EQUAL(replies.text(), "220-one\n220 two");
+
+	replies.add_line("331-three");
+	replies.add_line("331 four");
+	BOOST_CHECK_EQUAL(replies.text(), "331-three\n331 four");
+}
+
+BOOST_AUTO_TEST_CASE(invalid)
+{
+	reply_assembler replies;
+
+	BOOST_CHECK_EQUAL(replies.add_line(string()), reply_assembler::invalid);
+	BOOST_CHECK_EQUAL(replies.add_line("total 64"), reply_assembler::invalid);
+	BOOST_CHECK_EQUAL(replies.add_line("200"), reply_assembler::invalid);
+	BOOST_CHECK_EQUAL(replies.add_line("200x"), reply_assembler::invalid);
+	BOOST_CHECK_EQUAL(replies.in_reply(), false);
+}
+
+BOOST_AUTO_TEST_CASE(reset)
+{
+	reply_assembler replies;
+
+	replies.add_line("220-one");
+	replies.reset();
+
+	BOOST_CHECK_EQUAL(replies.in_reply(), false);
+	BOOST_CHECK_EQUAL(replies.add_line("200 ok"), reply_assembler::complete);
+	BOOST_CHECK_EQUAL(replies.text(), "200 ok");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
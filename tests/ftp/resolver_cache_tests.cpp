@@ -0,0 +1,73 @@
+#include <string>
+#include <boost/asio.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/test/unit_test.hpp>
+#include "../../foofxp/model/ftp/resolver_cache.hpp"
+
+using namespace std;
+using namespace boost::asio::ip;
+using namespace boost::posix_time;
+using foofxp::model::ftp::resolver_cache;
+
+static resolver_cache::endpoints some_endpoints()
+{
+	resolver_cache::endpoints endpoints;
+	endpoints.push_back(tcp::endpoint(address::from_string("::1"), 0));
+	endpoints.push_back(tcp::endpoint(address::from_string("127.0.0.1"), 0));
+	return endpoints;
+}
+
+BOOST_AUTO_TEST_SUITE(resolver_cache_tests)
+
+BOOST_AUTO_TEST_CASE(find_inserted)
+{
+	resolver_cache cache(minutes(5));
+	resolver_cache::endpoints found;
+
+	BOOST_CHECK(!cache.find("ftp.example.com", true, found));
+
+	cache.insert("ftp.example.com", true, some_endpoints());
+
+	BOOST_CHECK(cache.find("ftp.example.com", true, found));
+	BOOST_CHECK(found == some_endpoints());
+}
+
+BOOST_AUTO_TEST_CASE(families_cached_separately)
+{
+	resolver_cache cache(minutes(5));
+	resolver_cache::endpoints found;
+
+	cache.insert("ftp.example.com", true, some_endpoints());
+
+	BOOST_CHECK(!cache.find("ftp.example.com", false, found));
+	BOOST_CHECK(found.empty());
+}
+
+BOOST_AUTO_TEST_CASE(entries_expire)
+{
+	resolver_cache cache(seconds(0));
+	resolver_cache::endpoints found;
+
+	cache.insert("ftp.example.com", true, some_endpoints());
+
+	BOOST_CHECK(!cache.find("ftp.example.com", true, found));
+}
+
+BOOST_AUTO_TEST_CASE(erase)
+{
+	resolver_cache cache(minutes(5));
+	resolver_cache::endpoints found;
+
+	cache.insert("ftp.example.com", true, some_endpoints());
+	cache.insert("ftp.example.org", true, some_endpoints());
+	cache.erase("ftp.example.com", true);
+
+	BOOST_CHECK(!cache.find("ftp.example.com", true, found));
+	BOOST_CHECK(cache.find("ftp.example.org", true, found));
+
+	cache.clear();
+
+	BOOST_CHECK(!cache.find("ftp.example.org", true, found));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
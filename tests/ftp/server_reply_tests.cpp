@@ -25,6 +25,41 @@ BOOST_AUTO_TEST_CASE(get_pwd_path)
 		invalid_argument);
 }
 
+BOOST_AUTO_TEST_CASE(get_pasv_endpoint)
+{
+	using boost::asio::ip::address_v4;
+	
+	BOOST_CHECK_EQUAL(server_reply("227 Entering Passive Mode "
+		"(192,168,0,7,4,1)").get_pasv_endpoint().address(),
+		address_v4::from_string("192.168.0.7"));
+	BOOST_CHECK_EQUAL(server_reply("227 Entering Passive Mode "
+		"(192,168,0,7,4,1)").get_pasv_endpoint().port(), 1025);
+	BOOST_CHECK_EQUAL(server_reply("227 =127,0,0,1,0,21").get_pasv_endpoint()
+		.port(), 21);
+	
+	BOOST_CHECK_THROW(server_reply("227 Entering Passive Mode "
+		"(192,168,0,7,4)").get_pasv_endpoint(), invalid_argument);
+	BOOST_CHECK_THROW(server_reply("227 Entering Passive Mode "
+		"(192,168,0,256,4,1)").get_pasv_endpoint(), invalid_argument);
+	BOOST_CHECK_THROW(server_reply("227 Entering Passive Mode")
+		.get_pasv_endpoint(), invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(get_epsv_port)
+{
+	BOOST_CHECK_EQUAL(server_reply("229 Entering Extended Passive Mode "
+		"(|||1025|)").get_epsv_port(), 1025);
+	BOOST_CHECK_EQUAL(server_reply("229 Entering Extended Passive Mode "
+		"(!!!65535!)").get_epsv_port(), 65535);
+	
+	BOOST_CHECK_THROW(server_reply("229 Entering Extended Passive Mode "
+		"(|||65536|)").get_epsv_port(), invalid_argument);
+	BOOST_CHECK_THROW(server_reply("229 Entering Extended Passive Mode "
+		"(||||)").get_epsv_port(), invalid_argument);
+	BOOST_CHECK_THROW(server_reply("229 Entering Extended Passive Mode "
+		"(|||1025)").get_epsv_port(), invalid_argument);
+}
+
 BOOST_AUTO_TEST_CASE(is_end_of_reply)
 {
 	BOOST_CHECK_EQUAL(
@@ -176,6 +211,31 @@ BOOST_AUTO_TEST_CASE(get_message)
 	BOOST_CHECK_THROW(server_reply("000-Blah").get_message(), invalid_argument);
 }
 
+BOOST_AUTO_TEST_CASE(get_message_range)
+{
+	string line("501- blah");
+	server_reply::text_range message = server_reply(line).get_message_range();
+	
+	BOOST_CHECK(message.begin() == line.begin() + 5);
+	BOOST_CHECK(message.end() == line.end());
+	BOOST_CHECK(server_reply(string("501 ")).get_message_range().empty());
+	
+	BOOST_CHECK_THROW(server_reply("000-Blah").get_message_range(),
+		invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(is_preliminary_reply)
+{
+	BOOST_CHECK_EQUAL(server_reply("150 Opening").is_preliminary_reply(), true);
+	BOOST_CHECK_EQUAL(server_reply("150- Opening").is_preliminary_reply(),
+		true);
+	BOOST_CHECK_EQUAL(server_reply("226 Done").is_preliminary_reply(), false);
+	BOOST_CHECK_EQUAL(server_reply("000 ").is_preliminary_reply(), false);
+	
+	BOOST_CHECK_THROW(server_reply("total 64").is_preliminary_reply(),
+		invalid_argument);
+}
+
 BOOST_AUTO_TEST_CASE(get_reply_code)
 {
 	BOOST_CHECK_EQUAL(server_reply("001 blah").get_reply_code(), 1);
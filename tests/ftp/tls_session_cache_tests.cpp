@@ -0,0 +1,220 @@
+#include <string>
+#include <vector>
+#include <boost/test/unit_test.hpp>
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include "../../foofxp/model/ftp/tls_session_cache.hpp"
+
+using namespace std;
+using foofxp::model::ftp::tls_session_cache;
+
+// Both ends of a TLS connection, talking through memory.
+struct connection
+{
+	SSL * client;
+	SSL * server;
+};
+
+static EVP_PKEY * make_key()
+{
+	EVP_PKEY * key = 0;
+	EVP_PKEY_CTX * context = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, 0);
+
+	EVP_PKEY_keygen_init(context);
+	EVP_PKEY_CTX_set_rsa_keygen_bits(context, 2048);
+	EVP_PKEY_keygen(context, &key);
+	EVP_PKEY_CTX_free(context);
+
+	return key;
+}
+
+static X509 * make_certificate(EVP_PKEY * key)
+{
+	X509 * certificate = X509_new();
+
+	ASN1_INTEGER_set(X509_get_serialNumber(certificate), 1);
+	X509_gmtime_adj(X509_get_notBefore(certificate), 0);
+	X509_gmtime_adj(X509_get_notAfter(certificate), 3600);
+	X509_set_pubkey(certificate, key);
+
+	X509_NAME * name = X509_get_subject_name(certificate);
+	X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+		reinterpret_cast<const unsigned char *>("localhost"), -1, -1, 0);
+	X509_set_issuer_name(certificate, name);
+	X509_sign(certificate, key, EVP_sha256());
+
+	return certificate;
+}
+
+struct tls_session_cache_fixture
+{
+	tls_session_cache_fixture() : key(make_key()),
+		certificate(make_certificate(key)),
+		server_context(SSL_CTX_new(SSLv23_server_method())),
+		client_context(SSL_CTX_new(SSLv23_client_method())), cache(),
+		connections()
+	{
+		SSL_CTX_use_certificate(server_context, certificate);
+		SSL_CTX_use_PrivateKey(server_context, key);
+		tls_session_cache::watch_new_sessions(client_context);
+	};
+
+	~tls_session_cache_fixture()
+	{
+		for (vector<connection>::iterator c = connections.begin();
+			c != connections.end(); c++)
+		{
+			SSL_free(c->client);
+			SSL_free(c->server);
+		}
+
+		SSL_CTX_free(client_context);
+		SSL_CTX_free(server_context);
+		X509_free(certificate);
+		EVP_PKEY_free(key);
+	};
+
+	// Highest protocol version the client will use, e.g. TLS1_2_VERSION.
+	connection connect(int version)
+	{
+		connection c = { SSL_new(client_context), SSL_new(server_context) };
+		connections.push_back(c);
+
+		BIO * client_end;
+		BIO * server_end;
+		BIO_new_bio_pair(&client_end, 0, &server_end, 0);
+		SSL_set_bio(c.client, client_end, client_end);
+		SSL_set_bio(c.server, server_end, server_end);
+
+		SSL_set_connect_state(c.client);
+		SSL_set_accept_state(c.server);
+		SSL_set_max_proto_version(c.client, version);
+
+		return c;
+	};
+
+	bool handshake(const connection & c)
+	{
+		for (int i = 0; i < 10; i++)
+		{
+			int client_done = SSL_do_handshake(c.client);
+			int server_done = SSL_do_handshake(c.server);
+
+			if (client_done == 1 && server_done == 1)
+				return true;
+		}
+
+		return false;
+	};
+
+	// Has the client take in whatever the server has sent since the
+	// handshake, as it would on reading the next reply.
+	void read(const connection & c)
+	{
+		char buffer[16];
+		SSL_read(c.client, buffer, sizeof(buffer));
+	};
+
+	EVP_PKEY * key;
+	X509 * certificate;
+	SSL_CTX * server_context;
+	SSL_CTX * client_context;
+	tls_session_cache cache;
+	vector<connection> connections;
+};
+
+BOOST_FIXTURE_TEST_SUITE(tls_session_cache_tests,
+	tls_session_cache_fixture)
+
+BOOST_AUTO_TEST_CASE(saved_session_is_resumed)
+{
+	connection first = connect(TLS1_2_VERSION);
+	cache.resume(first.client, "site");
+	BOOST_CHECK(!SSL_get_session(first.client));
+
+	BOOST_REQUIRE(handshake(first));
+	cache.handshake_completed(first.client);
+	cache.save(first.client, "site");
+
+	connection second = connect(TLS1_2_VERSION);
+	cache.resume(second.client, "site");
+	BOOST_CHECK(SSL_get_session(second.client) ==
+		SSL_get_session(first.client));
+
+	BOOST_REQUIRE(handshake(second));
+	cache.handshake_completed(second.client);
+	BOOST_CHECK(SSL_session_reused(second.client));
+
+	BOOST_CHECK_EQUAL(cache.misses(), 1U);
+	BOOST_CHECK_EQUAL(cache.hits(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(sessions_are_kept_by_key)
+{
+	connection first = connect(TLS1_2_VERSION);
+	BOOST_REQUIRE(handshake(first));
+	cache.save(first.client, "site");
+
+	connection other = connect(TLS1_2_VERSION);
+	cache.resume(other.client, "other site");
+	BOOST_CHECK(!SSL_get_session(other.client));
+
+	cache.erase("site");
+
+	connection again = connect(TLS1_2_VERSION);
+	cache.resume(again.client, "site");
+	BOOST_CHECK(!SSL_get_session(again.client));
+}
+
+BOOST_AUTO_TEST_CASE(saving_again_replaces_the_session)
+{
+	connection first = connect(TLS1_2_VERSION);
+	connection second = connect(TLS1_2_VERSION);
+	BOOST_REQUIRE(handshake(first));
+	BOOST_REQUIRE(handshake(second));
+	BOOST_REQUIRE(SSL_get_session(first.client) !=
+		SSL_get_session(second.client));
+
+	cache.save(first.client, "site");
+	cache.save(second.client, "site");
+	cache.save(second.client, "site");
+
+	connection third = connect(TLS1_2_VERSION);
+	cache.resume(third.client, "site");
+	BOOST_CHECK(SSL_get_session(third.client) ==
+		SSL_get_session(second.client));
+
+	BOOST_REQUIRE(handshake(third));
+	cache.handshake_completed(third.client);
+	BOOST_CHECK_EQUAL(cache.hits(), 1U);
+}
+
+#if defined(TLS1_3_VERSION)
+BOOST_AUTO_TEST_CASE(ticket_after_handshake_is_saved)
+{
+	connection first = connect(TLS1_3_VERSION);
+	cache.save_new_sessions(first.client, "site");
+	BOOST_REQUIRE(handshake(first));
+	cache.handshake_completed(first.client);
+
+	// The server's tickets are still on their way.
+	connection early = connect(TLS1_3_VERSION);
+	cache.resume(early.client, "site");
+	BOOST_CHECK(!SSL_get_session(early.client));
+
+	read(first);
+
+	connection second = connect(TLS1_3_VERSION);
+	cache.resume(second.client, "site");
+	BOOST_REQUIRE(SSL_get_session(second.client));
+
+	BOOST_REQUIRE(handshake(second));
+	cache.handshake_completed(second.client);
+	BOOST_CHECK(SSL_session_reused(second.client));
+	BOOST_CHECK_EQUAL(cache.hits(), 1U);
+	BOOST_CHECK_EQUAL(cache.misses(), 1U);
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
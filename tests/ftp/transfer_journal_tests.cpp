@@ -0,0 +1,258 @@
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/test/unit_test.hpp>
+#include "../../foofxp/model/ftp/transfer_journal.hpp"
+#include "../../foofxp/model/session_controller.hpp"
+#include "fake_server.hpp"
+
+// For open(), write(), truncate() and unlink().
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace boost::posix_time;
+using foofxp::model::session_controller;
+using foofxp::model::ftp::client;
+using foofxp::model::ftp::transfer_journal;
+
+static const char * journal_path = "/tmp/foofxp-transfer-journal-tests";
+static const char * download_path =
+	"/tmp/foofxp-transfer-journal-tests.download";
+
+// Starts each test with no journal on disk.
+struct fresh_journal
+{
+	fresh_journal() { remove(); };
+	~fresh_journal() { remove(); };
+
+	void remove()
+	{
+		::unlink(journal_path);
+		::unlink((string(journal_path) + ".new").c_str());
+	};
+};
+
+static off_t file_size(const char * path)
+{
+	struct stat status;
+	return ::stat(path, &status) == 0 ? status.st_size : -1;
+}
+
+// A journaled client downloading from a scripted server.
+struct journaled_download : fresh_journal
+{
+	journaled_download() : journal(journal_path), server(), controller(1),
+		sessions(), completed(), failed(), contents(300000, '\0')
+	{
+		for (size_t i = 0; i < contents.size(); i++)
+			contents[i] = static_cast<char>(i % 251);
+		server.file("/pub/file", contents);
+
+		BOOST_REQUIRE(lease_sessions(controller, server.site(), 1,
+			sessions));
+
+		client & session = *sessions[0];
+		session.journal(&journal);
+		session.checkpoint_bytes(16 * 1024);
+		session.transfer_completed.connect(boost::bind(&event_counter::fire,
+			&completed));
+		session.transfer_failed.connect(boost::bind(&event_counter::note,
+			&failed, _2));
+	};
+
+	~journaled_download() { ::unlink(download_path); };
+
+	void download(boost::uint64_t size)
+	{
+		client * session = sessions[0].get();
+		session->strand().post(boost::bind(&client::begin_download, session,
+			string("/pub/file"), string(download_path), size));
+	};
+
+	string key() const
+	{
+		char buffer[64];
+		std::sprintf(buffer, "ftp://test@127.0.0.1:%u/pub/file",
+			static_cast<unsigned int>(server.port()));
+		return buffer;
+	};
+
+	string local_contents() const
+	{
+		ifstream in(download_path, ios::binary);
+		return string(istreambuf_iterator<char>(in),
+			istreambuf_iterator<char>());
+	};
+
+	transfer_journal journal;
+	fake_server server;
+	session_controller controller;
+	vector<session_controller::client_ptr> sessions;
+
+	event_counter completed;
+	event_counter failed;
+	string contents;
+};
+
+BOOST_FIXTURE_TEST_SUITE(transfer_journal_tests, fresh_journal)
+
+BOOST_AUTO_TEST_CASE(checkpoints_survive_reopening)
+{
+	{
+		transfer_journal journal(journal_path);
+		transfer_journal::id_type id = journal.begin("ftp://a@b:21/c", "/d",
+			0);
+		journal.checkpoint(id, 1234, 0xdeadbeef);
+	}
+
+	transfer_journal journal(journal_path);
+	transfer_journal::entry found;
+
+	BOOST_REQUIRE(journal.find("ftp://a@b:21/c", "/d", found));
+	BOOST_CHECK_EQUAL(found.offset, 1234u);
+	BOOST_CHECK(found.has_checksum);
+	BOOST_CHECK_EQUAL(found.checksum, 0xdeadbeefu);
+
+	BOOST_CHECK(!journal.find("ftp://a@b:21/c", "/e", found));
+}
+
+BOOST_AUTO_TEST_CASE(begin_picks_up_unfinished)
+{
+	transfer_journal journal(journal_path);
+	transfer_journal::id_type id = journal.begin("/a", "/b", 0);
+
+	BOOST_CHECK_EQUAL(journal.begin("/a", "/b", 0), id);
+	BOOST_CHECK(journal.begin("/a", "/c", 0) != id);
+	BOOST_CHECK_EQUAL(journal.unfinished().size(), 2u);
+}
+
+BOOST_AUTO_TEST_CASE(completed_are_dropped)
+{
+	{
+		transfer_journal journal(journal_path);
+		journal.checkpoint(journal.begin("/a", "/b", 0), 10);
+		journal.complete(journal.begin("/c", "/d", 0));
+	}
+
+	transfer_journal journal(journal_path);
+	transfer_journal::entry found;
+
+	BOOST_CHECK(journal.find("/a", "/b", found));
+	BOOST_CHECK(!journal.find("/c", "/d", found));
+	BOOST_CHECK_EQUAL(journal.unfinished().size(), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(torn_record_is_ignored)
+{
+	{
+		transfer_journal journal(journal_path);
+		transfer_journal::id_type id = journal.begin("/a", "/b", 0);
+		journal.checkpoint(id, 10);
+		journal.flush();
+		journal.checkpoint(id, 20);
+	}
+
+	// Cut the last checkpoint short, as a crash mid-write would.
+	BOOST_REQUIRE_EQUAL(::truncate(journal_path, file_size(journal_path) - 3),
+		0);
+
+	transfer_journal journal(journal_path);
+	transfer_journal::entry found;
+
+	BOOST_REQUIRE(journal.find("/a", "/b", found));
+	BOOST_CHECK_EQUAL(found.offset, 10u);
+}
+
+BOOST_AUTO_TEST_CASE(checkpoints_batched_until_due)
+{
+	transfer_journal journal(journal_path);
+	journal.flush_interval(hours(1));
+
+	transfer_journal::id_type id = journal.begin("/a", "/b", 0);
+	for (int i = 1; i <= 100; i++)
+		journal.checkpoint(id, i);
+
+	BOOST_CHECK_EQUAL(journal.flushes(), 0u);
+
+	journal.flush();
+	BOOST_CHECK_EQUAL(journal.flushes(), 1u);
+
+	journal.flush_interval(seconds(0));
+	journal.checkpoint(id, 101);
+	BOOST_CHECK_EQUAL(journal.flushes(), 2u);
+}
+
+BOOST_AUTO_TEST_CASE(tail_checksum_covers_data_before_offset)
+{
+	const char * data_path = "/tmp/foofxp-transfer-journal-tests.data";
+	int fd = ::open(data_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	BOOST_REQUIRE(fd != -1);
+
+	string data(100, 'x');
+	BOOST_REQUIRE_EQUAL(::write(fd, data.data(), data.length()), 100);
+
+	boost::uint32_t before, after;
+	BOOST_CHECK(!transfer_journal::tail_checksum(fd, 0, before));
+	BOOST_CHECK(!transfer_journal::tail_checksum(fd, 200, before));
+	BOOST_REQUIRE(transfer_journal::tail_checksum(fd, 50, before));
+
+	// Past the offset makes no difference; before it does.
+	BOOST_REQUIRE_EQUAL(::pwrite(fd, "y", 1, 60), 1);
+	BOOST_REQUIRE(transfer_journal::tail_checksum(fd, 50, after));
+	BOOST_CHECK_EQUAL(before, after);
+
+	BOOST_REQUIRE_EQUAL(::pwrite(fd, "y", 1, 40), 1);
+	BOOST_REQUIRE(transfer_journal::tail_checksum(fd, 50, after));
+	BOOST_CHECK(before != after);
+
+	::close(fd);
+	::unlink(data_path);
+}
+
+BOOST_FIXTURE_TEST_CASE(cut_download_is_resumed, journaled_download)
+{
+	server.cut_retrieve(150000);
+	download(contents.size());
+	BOOST_REQUIRE(failed.wait());
+
+	transfer_journal::entry unfinished;
+	BOOST_REQUIRE(journal.find(key(), download_path, unfinished));
+	BOOST_CHECK_EQUAL(unfinished.size, contents.size());
+	BOOST_CHECK_GT(unfinished.offset, 0u);
+	BOOST_CHECK_LE(unfinished.offset, 150000u);
+
+	download(contents.size());
+	BOOST_REQUIRE(completed.wait());
+
+	vector<string> rests = server.commands("REST");
+	BOOST_REQUIRE_EQUAL(rests.size(), 1u);
+	BOOST_CHECK_EQUAL(strtoul(rests[0].c_str() + 5, 0, 10),
+		unfinished.offset);
+	BOOST_CHECK(local_contents() == contents);
+	BOOST_CHECK(!journal.find(key(), download_path, unfinished));
+}
+
+BOOST_FIXTURE_TEST_CASE(changed_file_is_downloaded_again, journaled_download)
+{
+	server.cut_retrieve(150000);
+	download(contents.size());
+	BOOST_REQUIRE(failed.wait());
+
+	// Listed at a different size this time.
+	download(contents.size() + 1);
+	BOOST_REQUIRE(completed.wait());
+
+	BOOST_CHECK(server.commands("REST").empty());
+	BOOST_CHECK(local_contents() == contents);
+
+	transfer_journal::entry unfinished;
+	BOOST_CHECK(!journal.find(key(), download_path, unfinished));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
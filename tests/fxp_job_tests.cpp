@@ -0,0 +1,154 @@
+#include <string>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+#include "../foofxp/model/fxp_job.hpp"
+#include "../foofxp/model/session_controller.hpp"
+#include "ftp/fake_server.hpp"
+
+using namespace std;
+using foofxp::model::fxp_job;
+using foofxp::model::session_controller;
+
+struct fxp_job_fixture
+{
+	fxp_job_fixture() : source(), destination(), controller(2), sessions(),
+		transferred(), failed(), completed()
+	{
+		source.file("/pub/a", string(50000, 'a'));
+		source.file("/pub/b", string(70000, 'b'));
+
+		BOOST_REQUIRE(lease_sessions(controller, source.site(), 1,
+			sessions));
+		BOOST_REQUIRE(lease_sessions(controller, destination.site(), 1,
+			sessions));
+	};
+
+	void watch(fxp_job & job)
+	{
+		job.file_completed.connect(boost::bind(&event_counter::note,
+			&transferred, _2));
+		job.file_failed.connect(boost::bind(&event_counter::note, &failed,
+			_3));
+		job.completed.connect(boost::bind(&event_counter::fire,
+			&completed));
+
+		job.add("/pub/a", "/incoming/a");
+		job.add("/pub/b", "/incoming/b");
+	};
+
+	fake_server source;
+	fake_server destination;
+	session_controller controller;
+	vector<session_controller::client_ptr> sessions;
+
+	event_counter transferred;
+	event_counter failed;
+	event_counter completed;
+};
+
+BOOST_FIXTURE_TEST_SUITE(fxp_job_tests, fxp_job_fixture)
+
+BOOST_AUTO_TEST_CASE(files_are_transferred_in_order)
+{
+	fxp_job job(*sessions[0], *sessions[1]);
+	watch(job);
+	job.begin();
+
+	BOOST_REQUIRE(completed.wait());
+	BOOST_CHECK_EQUAL(failed.fired(), 0U);
+	BOOST_REQUIRE_EQUAL(transferred.messages().size(), 2U);
+	BOOST_CHECK_EQUAL(transferred.messages()[0], "/pub/a");
+	BOOST_CHECK_EQUAL(transferred.messages()[1], "/pub/b");
+
+	BOOST_CHECK(destination.file("/incoming/a") == source.file("/pub/a"));
+	BOOST_CHECK(destination.file("/incoming/b") == source.file("/pub/b"));
+	BOOST_CHECK_EQUAL(job.remaining(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(retrieve_does_not_wait_for_store_reply)
+{
+	// Like vsftpd, which doesn't answer STOR until the source has connected.
+	// Hold the destination's STOR unanswered altogether: the source must be
+	// sent RETR regardless.
+	destination.hold("STOR");
+
+	fxp_job job(*sessions[0], *sessions[1]);
+	watch(job);
+	job.begin();
+
+	BOOST_REQUIRE(destination.wait_held(1));
+
+	for (int i = 0; i < 100 && source.commands("RETR").empty(); i++)
+		boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+
+	BOOST_CHECK_EQUAL(source.commands("PORT").size(), 1U);
+	BOOST_CHECK_EQUAL(source.commands("RETR").size(), 1U);
+
+	destination.hold("");
+	destination.release();
+	BOOST_REQUIRE(completed.wait());
+	BOOST_CHECK_EQUAL(transferred.fired(), 2U);
+}
+
+BOOST_AUTO_TEST_CASE(refused_passive_skips_the_file)
+{
+	destination.answer("PASV", "502 Command not implemented.");
+
+	fxp_job job(*sessions[0], *sessions[1]);
+	watch(job);
+	job.begin();
+
+	BOOST_REQUIRE(completed.wait());
+	BOOST_REQUIRE_EQUAL(failed.messages().size(), 1U);
+	BOOST_CHECK_EQUAL(failed.messages()[0], "502 Command not implemented.");
+	BOOST_REQUIRE_EQUAL(transferred.messages().size(), 1U);
+	BOOST_CHECK_EQUAL(transferred.messages()[0], "/pub/b");
+
+	// The source never heard about the first file.
+	BOOST_CHECK_EQUAL(source.commands("RETR").size(), 1U);
+	BOOST_CHECK(destination.file("/incoming/b") == source.file("/pub/b"));
+}
+
+BOOST_AUTO_TEST_CASE(refused_store_fails_the_file)
+{
+	destination.answer("STOR", "553 Could not create file.");
+
+	fxp_job job(*sessions[0], *sessions[1]);
+	watch(job);
+	job.begin();
+
+	BOOST_REQUIRE(completed.wait());
+
+	// Whichever side gives up first has its say: the source may find no one
+	// listening any more before the destination's refusal comes in.
+	BOOST_CHECK_EQUAL(failed.fired(), 1U);
+	BOOST_REQUIRE_EQUAL(transferred.messages().size(), 1U);
+	BOOST_CHECK_EQUAL(transferred.messages()[0], "/pub/b");
+
+	BOOST_CHECK(destination.file("/incoming/a").empty());
+	BOOST_CHECK(destination.file("/incoming/b") == source.file("/pub/b"));
+}
+
+BOOST_AUTO_TEST_CASE(refused_retrieve_fails_the_file)
+{
+	// Nothing will connect for the first STOR, so it's aborted rather than
+	// left to the destination's (much longer) accept timeout.
+	source.answer("RETR", "550 Permission denied.");
+
+	fxp_job job(*sessions[0], *sessions[1]);
+	watch(job);
+	job.begin();
+
+	BOOST_REQUIRE(completed.wait());
+	BOOST_REQUIRE_EQUAL(failed.messages().size(), 1U);
+	BOOST_CHECK_EQUAL(failed.messages()[0], "550 Permission denied.");
+	BOOST_REQUIRE_EQUAL(transferred.messages().size(), 1U);
+	BOOST_CHECK_EQUAL(transferred.messages()[0], "/pub/b");
+
+	BOOST_CHECK(destination.file("/incoming/a").empty());
+	BOOST_CHECK(destination.file("/incoming/b") == source.file("/pub/b"));
+	BOOST_CHECK_EQUAL(destination.commands("ABOR").size(), 1U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
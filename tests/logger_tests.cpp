@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <string>
+#include <boost/asio.hpp>
+#include <boost/ref.hpp>
+#include <boost/test/unit_test.hpp>
+#include "../foofxp/model/logger.hpp"
+
+using namespace std;
+using boost::asio::io_service;
+using boost::ref;
+using foofxp::model::logger;
+
+struct update_counter
+{
+	update_counter() : calls(0) {};
+
+	void operator()(const logger &) { ++calls; };
+
+	int calls;
+};
+
+BOOST_AUTO_TEST_SUITE(logger_tests)
+
+BOOST_AUTO_TEST_CASE(empty_log)
+{
+	logger log(3);
+
+	BOOST_CHECK_EQUAL(log.size(), 0U);
+	BOOST_CHECK_EQUAL(log.last_line(), "");
+	BOOST_CHECK(log.lines().empty());
+}
+
+BOOST_AUTO_TEST_CASE(lines_are_newest_first)
+{
+	logger log(3);
+	log.add_line("a");
+	log.add_line("b");
+
+	BOOST_REQUIRE_EQUAL(log.size(), 2U);
+	BOOST_CHECK_EQUAL(log.last_line(), "b");
+	BOOST_CHECK_EQUAL(log[0], "b");
+	BOOST_CHECK_EQUAL(log[1], "a");
+
+	logger::lines_view lines = log.lines();
+	BOOST_REQUIRE_EQUAL(lines.size(), 2);
+	BOOST_CHECK_EQUAL(*lines.begin(), "b");
+	BOOST_CHECK_EQUAL(*(lines.begin() + 1), "a");
+}
+
+BOOST_AUTO_TEST_CASE(oldest_lines_are_dropped)
+{
+	logger log(3);
+	log.add_line("a");
+	log.add_line("b");
+	log.add_line("c");
+	log.add_line("d");
+	log.add_line("e");
+
+	BOOST_REQUIRE_EQUAL(log.size(), 3U);
+	BOOST_CHECK_EQUAL(log.lines_added(), 5UL);
+
+	const char * expected[] = { "e", "d", "c" };
+	logger::lines_view lines = log.lines();
+	BOOST_CHECK(equal(lines.begin(), lines.end(), expected));
+}
+
+BOOST_AUTO_TEST_CASE(zero_capacity_log_keeps_nothing)
+{
+	logger log(0);
+	log.add_line("a");
+
+	BOOST_CHECK_EQUAL(log.size(), 0U);
+	BOOST_CHECK_EQUAL(log.last_line(), "");
+}
+
+BOOST_AUTO_TEST_CASE(updates_fire_per_line_without_strand)
+{
+	logger log(3);
+	update_counter counter;
+	log.updated.connect(ref(counter));
+
+	log.add_line("a");
+	log.add_line("b");
+
+	BOOST_CHECK_EQUAL(counter.calls, 2);
+}
+
+BOOST_AUTO_TEST_CASE(updates_are_coalesced_with_strand)
+{
+	io_service service;
+	io_service::strand strand(service);
+	logger log(3, strand);
+	update_counter counter;
+	log.updated.connect(ref(counter));
+
+	log.add_line("a");
+	log.add_line("b");
+	log.add_line("c");
+
+	BOOST_CHECK_EQUAL(counter.calls, 0);
+
+	service.run();
+	BOOST_CHECK_EQUAL(counter.calls, 1);
+
+	service.reset();
+	log.add_line("d");
+	service.run();
+	BOOST_CHECK_EQUAL(counter.calls, 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
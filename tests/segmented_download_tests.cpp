@@ -0,0 +1,294 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+#include "../foofxp/model/segmented_download.hpp"
+#include "../foofxp/model/session_controller.hpp"
+#include "ftp/fake_server.hpp"
+
+using namespace std;
+using foofxp::model::segmented_download;
+using foofxp::model::session_controller;
+using foofxp::model::ftp::bookmark;
+using foofxp::model::ftp::client;
+
+static const char * local_path = "/tmp/foofxp-segmented-download-test";
+
+// Something that shows up out of place if a range lands in the wrong spot.
+static string pattern(size_t size)
+{
+	string contents(size, '\0');
+	for (size_t i = 0; i < size; i++)
+		contents[i] = static_cast<char>(i * 7 % 251);
+	return contents;
+}
+
+static string local_contents()
+{
+	ifstream in(local_path, ios::binary);
+	return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+}
+
+static vector<unsigned long> offsets(const vector<string> & rests)
+{
+	vector<unsigned long> found;
+	for (vector<string>::const_iterator r = rests.begin(); r != rests.end();
+		r++)
+		found.push_back(strtoul(r->c_str() + 5, 0, 10));
+
+	sort(found.begin(), found.end());
+	return found;
+}
+
+struct segmented_download_fixture
+{
+	segmented_download_fixture() : server(), controller(2), sessions(),
+		clients(), completed(), failed(), segments()
+	{
+		remove(local_path);
+	};
+
+	~segmented_download_fixture() { remove(local_path); };
+
+	// Leases count sessions to server, for the download to use.
+	void lease(fake_server & from, size_t count)
+	{
+		size_t first = sessions.size();
+
+		BOOST_REQUIRE(lease_sessions(controller, from.site(), count,
+			sessions));
+
+		for (size_t i = first; i < sessions.size(); i++)
+			clients.push_back(sessions[i].get());
+	};
+
+	void watch(segmented_download & download)
+	{
+		download.completed.connect(boost::bind(&event_counter::fire,
+			&completed));
+		download.failed.connect(boost::bind(&event_counter::note, &failed,
+			_2));
+		download.segment_completed.connect(boost::bind(
+			&segmented_download_fixture::handle_segment, this, _2));
+	};
+
+	void handle_segment(const segmented_download::segment_report & segment)
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		segments.push_back(segment);
+	};
+
+	// Whichever of completed or failed fires.
+	bool finished() const
+	{
+		for (int i = 0; i < 200; i++)
+		{
+			if (completed.fired() + failed.fired() > 0)
+				return true;
+
+			boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+		}
+
+		return false;
+	};
+
+	fake_server server;
+	session_controller controller;
+	vector<session_controller::client_ptr> sessions;
+	vector<client *> clients;
+
+	event_counter completed;
+	event_counter failed;
+
+	boost::mutex mutex;
+	vector<segmented_download::segment_report> segments;
+};
+
+BOOST_FIXTURE_TEST_SUITE(segmented_download_tests, segmented_download_fixture)
+
+BOOST_AUTO_TEST_CASE(file_is_split_evenly)
+{
+	string contents = pattern(300000);
+	server.file("/pub/file", contents);
+	lease(server, 3);
+
+	segmented_download download(clients, "/pub/file", local_path,
+		contents.size());
+	download.minimum_segment(1000);
+	download.split_segments(false);
+	watch(download);
+	download.begin();
+
+	BOOST_REQUIRE(completed.wait());
+	BOOST_CHECK_EQUAL(failed.fired(), 0U);
+	BOOST_CHECK(local_contents() == contents);
+
+	// The first range starts at the beginning, so needs no REST.
+	BOOST_CHECK_EQUAL(server.commands("RETR").size(), 3U);
+	vector<unsigned long> rests = offsets(server.commands("REST"));
+	BOOST_REQUIRE_EQUAL(rests.size(), 2U);
+	BOOST_CHECK_EQUAL(rests[0], 100000U);
+	BOOST_CHECK_EQUAL(rests[1], 200000U);
+
+	boost::mutex::scoped_lock lock(mutex);
+	BOOST_REQUIRE_EQUAL(segments.size(), 3U);
+	for (size_t i = 0; i < segments.size(); i++)
+		BOOST_CHECK_GE(segments[i].length, 100000U);
+}
+
+BOOST_AUTO_TEST_CASE(small_file_gets_fewer_segments)
+{
+	// Only room for two segments of the minimum size.
+	string contents = pattern(2500);
+	server.file("/pub/file", contents);
+	lease(server, 4);
+
+	segmented_download download(clients, "/pub/file", local_path,
+		contents.size());
+	download.minimum_segment(1000);
+	download.split_segments(false);
+	watch(download);
+	download.begin();
+
+	BOOST_REQUIRE(completed.wait());
+	BOOST_CHECK(local_contents() == contents);
+
+	BOOST_CHECK_EQUAL(server.commands("RETR").size(), 2U);
+	vector<unsigned long> rests = offsets(server.commands("REST"));
+	BOOST_REQUIRE_EQUAL(rests.size(), 1U);
+	BOOST_CHECK_EQUAL(rests[0], 1250U);
+}
+
+BOOST_AUTO_TEST_CASE(slow_range_is_split_in_proportion)
+{
+	// One session to a server that sends the whole of its range, and one to
+	// a server that stalls early on.
+	fake_server slow;
+	string contents = pattern(400000);
+	server.file("/pub/file", contents);
+	slow.file("/pub/file", contents);
+
+	lease(server, 1);
+	lease(slow, 1);
+
+	server.pause_retrieve(200000);
+	slow.pause_retrieve(10000);
+
+	segmented_download download(clients, "/pub/file", local_path,
+		contents.size());
+	download.minimum_segment(1000);
+	watch(download);
+	download.begin();
+
+	BOOST_REQUIRE(server.wait_held(1));
+	BOOST_REQUIRE(slow.wait_held(1));
+	boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+
+	// Let the fast one finish, and take over most of what the slow one has
+	// left: both had the same time, and it moved 20 times as much.
+	server.release();
+
+	for (int i = 0; i < 100 && server.commands("RETR").size() < 2; i++)
+		boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+
+	vector<unsigned long> rests = offsets(server.commands("REST"));
+	BOOST_REQUIRE_EQUAL(rests.size(), 1U);
+
+	unsigned long position = 200000 + 10000;
+	unsigned long remaining = contents.size() - position;
+	BOOST_CHECK_GT(rests[0], position);
+	BOOST_CHECK_LT(rests[0] - position, remaining / 10);
+
+	slow.release();
+
+	BOOST_REQUIRE(completed.wait());
+	BOOST_CHECK(local_contents() == contents);
+}
+
+BOOST_AUTO_TEST_CASE(failed_range_is_tried_again)
+{
+	string contents = pattern(200000);
+	server.file("/pub/file", contents);
+	server.answer("RETR", "550 Try again later.");
+	lease(server, 2);
+
+	segmented_download download(clients, "/pub/file", local_path,
+		contents.size());
+	download.minimum_segment(1000);
+	download.split_segments(false);
+	watch(download);
+	download.begin();
+
+	BOOST_REQUIRE(completed.wait());
+	BOOST_CHECK_EQUAL(failed.fired(), 0U);
+	BOOST_CHECK(local_contents() == contents);
+	BOOST_CHECK_EQUAL(server.commands("RETR").size(), 3U);
+}
+
+BOOST_AUTO_TEST_CASE(lost_session_hands_its_range_on)
+{
+	string contents = pattern(200000);
+	server.file("/pub/file", contents);
+	lease(server, 2);
+
+	// Hangs up on whichever asks first.
+	server.answer("RETR", "");
+
+	segmented_download download(clients, "/pub/file", local_path,
+		contents.size());
+	download.minimum_segment(1000);
+	download.split_segments(false);
+	watch(download);
+	download.begin();
+
+	BOOST_REQUIRE(completed.wait());
+	BOOST_CHECK_EQUAL(failed.fired(), 0U);
+	BOOST_CHECK(local_contents() == contents);
+	BOOST_CHECK_EQUAL(server.commands("RETR").size(), 3U);
+}
+
+BOOST_AUTO_TEST_CASE(gives_up_after_max_failures)
+{
+	string contents = pattern(200000);
+	server.file("/pub/file", contents);
+	server.answer("RETR", "550 Permission denied.", 10);
+	lease(server, 2);
+
+	segmented_download download(clients, "/pub/file", local_path,
+		contents.size());
+	download.minimum_segment(1000);
+	download.max_failures(1);
+	watch(download);
+	download.begin();
+
+	BOOST_REQUIRE(finished());
+	BOOST_CHECK_EQUAL(completed.fired(), 0U);
+	BOOST_REQUIRE_EQUAL(failed.messages().size(), 1U);
+	BOOST_CHECK_EQUAL(failed.messages()[0], "550 Permission denied.");
+	BOOST_CHECK_EQUAL(download.active_segments(), 0U);
+}
+
+#if defined(__linux__)
+BOOST_AUTO_TEST_CASE(full_disk_is_reported)
+{
+	lease(server, 1);
+
+	// More than any disk here has room for. Setting the size instead would
+	// make a sparse file, and only fail halfway through.
+	segmented_download download(clients, "/pub/file", local_path,
+		1ULL << 50);
+	watch(download);
+	download.begin();
+
+	BOOST_CHECK_EQUAL(completed.fired(), 0U);
+	BOOST_REQUIRE_EQUAL(failed.messages().size(), 1U);
+	BOOST_CHECK_EQUAL(failed.messages()[0].find("Could not allocate"), 0U);
+	BOOST_CHECK(server.commands("RETR").empty());
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,245 @@
+#include <stdexcept>
+#include <vector>
+#include <boost/ref.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/weak_ptr.hpp>
+#include "../foofxp/model/session_controller.hpp"
+
+using namespace std;
+using boost::ref;
+using foofxp::model::session_controller;
+using foofxp::model::ftp::bookmark;
+using foofxp::model::ftp::client;
+
+typedef vector<boost::weak_ptr<client> > client_refs;
+
+// Waits a few seconds at most for every one of clients to be destroyed.
+static bool released(const client_refs & clients)
+{
+	for (int i = 0; i < 50; ++i)
+	{
+		bool alive = false;
+		for (client_refs::const_iterator c = clients.begin();
+			c != clients.end(); ++c)
+			alive = alive || !c->expired();
+
+		if (!alive)
+			return true;
+
+		boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+	}
+
+	return false;
+}
+
+struct state_change_counter
+{
+	state_change_counter() : calls(0) {};
+
+	void operator()(session_controller &) { ++calls; };
+
+	int calls;
+};
+
+struct session_controller_fixture
+{
+	session_controller_fixture() : controller(2), site(), other_site()
+	{
+		site.host("localhost");
+		site.port(21);
+
+		other_site.host("localhost");
+		other_site.port(2121);
+	};
+
+	session_controller controller;
+	bookmark site;
+	bookmark other_site;
+};
+
+BOOST_FIXTURE_TEST_SUITE(session_controller_tests, session_controller_fixture)
+
+BOOST_AUTO_TEST_CASE(new_sessions_are_busy)
+{
+	session_controller::client_ptr client = controller.open_session(site);
+
+	BOOST_CHECK_EQUAL(controller.session_count(), 1U);
+	BOOST_CHECK_EQUAL(controller.busy_count(), 1U);
+	BOOST_CHECK_EQUAL(controller.idle_count(), 0U);
+	BOOST_CHECK(!controller.idle_session(site));
+	BOOST_CHECK(!controller.idle_session());
+}
+
+BOOST_AUTO_TEST_CASE(idle_sessions_are_found_by_site)
+{
+	session_controller::client_ptr client = controller.open_session(site);
+	client->idle(*client);
+
+	BOOST_CHECK_EQUAL(controller.idle_count(), 1U);
+	BOOST_CHECK_EQUAL(controller.busy_count(), 0U);
+	BOOST_CHECK(controller.idle_session(site) == client);
+	BOOST_CHECK(controller.idle_session() == client);
+	BOOST_CHECK(!controller.idle_session(other_site));
+
+	client->busy(*client);
+
+	BOOST_CHECK_EQUAL(controller.idle_count(), 0U);
+	BOOST_CHECK_EQUAL(controller.busy_count(), 1U);
+	BOOST_CHECK(!controller.idle_session(site));
+}
+
+BOOST_AUTO_TEST_CASE(failed_sessions_are_neither_idle_nor_busy)
+{
+	session_controller::client_ptr client = controller.open_session(site);
+	client->idle(*client);
+	client->fatal_error_occurred(*client, "Connection failed.");
+
+	BOOST_CHECK_EQUAL(controller.session_count(), 1U);
+	BOOST_CHECK_EQUAL(controller.idle_count(), 0U);
+	BOOST_CHECK_EQUAL(controller.busy_count(), 0U);
+	BOOST_CHECK(!controller.idle_session(site));
+}
+
+BOOST_AUTO_TEST_CASE(site_limits_are_enforced)
+{
+	controller.default_site_limit(1);
+	controller.site_limit(other_site, 2);
+
+	session_controller::client_ptr client = controller.open_session(site);
+
+	BOOST_CHECK(!controller.can_open_session(site));
+	BOOST_CHECK_THROW(controller.open_session(site), runtime_error);
+
+	BOOST_CHECK(controller.can_open_session(other_site));
+	controller.open_session(other_site);
+	controller.open_session(other_site);
+	BOOST_CHECK(!controller.can_open_session(other_site));
+
+	controller.close_session(client);
+
+	BOOST_CHECK(controller.can_open_session(site));
+	BOOST_CHECK_EQUAL(controller.session_count(), 2U);
+}
+
+BOOST_AUTO_TEST_CASE(closed_sessions_are_forgotten)
+{
+	session_controller::client_ptr client = controller.open_session(site);
+	client->idle(*client);
+	controller.close_session(client);
+
+	BOOST_CHECK_EQUAL(controller.session_count(), 0U);
+	BOOST_CHECK_EQUAL(controller.idle_count(), 0U);
+	BOOST_CHECK(!controller.idle_session(site));
+
+	// Signals from a closed session are ignored.
+	client->idle(*client);
+	BOOST_CHECK_EQUAL(controller.idle_count(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(closed_sessions_are_let_go)
+{
+	client_refs closed;
+
+	{
+		session_controller::client_ptr client = controller.open_session(site);
+		closed.push_back(client);
+		controller.close_session(client);
+	}
+
+	BOOST_CHECK(released(closed));
+}
+
+BOOST_AUTO_TEST_CASE(evicted_sessions_are_let_go)
+{
+	controller.idle_timeout(1);
+
+	// Every round's sessions go, not just the last.
+	for (int round = 0; round < 3; ++round)
+	{
+		client_refs evicted;
+
+		for (int i = 0; i < 4; ++i)
+		{
+			session_controller::client_ptr client =
+				controller.open_session(site);
+			client->idle(*client);
+			evicted.push_back(client);
+		}
+
+		BOOST_CHECK(released(evicted));
+		BOOST_CHECK_EQUAL(controller.session_count(), 0U);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(state_changes_are_signalled)
+{
+	state_change_counter counter;
+	controller.state_changed.connect(ref(counter));
+
+	session_controller::client_ptr client = controller.open_session(site);
+	client->idle(*client);
+	client->idle(*client);
+	client->busy(*client);
+
+	BOOST_CHECK_EQUAL(counter.calls, 3);
+}
+
+BOOST_AUTO_TEST_CASE(leased_sessions_stay_out_of_the_pool)
+{
+	session_controller::client_ptr client = controller.open_session(site);
+	client->idle(*client);
+
+	BOOST_CHECK(controller.lease_session(site) == client);
+	BOOST_CHECK_EQUAL(controller.idle_count(), 0U);
+	BOOST_CHECK_EQUAL(controller.busy_count(), 1U);
+	BOOST_CHECK(!controller.idle_session(site));
+	BOOST_CHECK(!controller.lease_session(site));
+
+	// Going idle between transfers doesn't put it back.
+	client->busy(*client);
+	client->idle(*client);
+	BOOST_CHECK(!controller.idle_session(site));
+
+	controller.release_session(client);
+
+	BOOST_CHECK_EQUAL(controller.idle_count(), 1U);
+	BOOST_CHECK(controller.idle_session(site) == client);
+}
+
+BOOST_AUTO_TEST_CASE(released_busy_sessions_stay_busy)
+{
+	session_controller::client_ptr client = controller.open_session(site);
+	client->idle(*client);
+	controller.lease_session(site);
+	client->busy(*client);
+	controller.release_session(client);
+
+	BOOST_CHECK_EQUAL(controller.busy_count(), 1U);
+	BOOST_CHECK(!controller.idle_session(site));
+}
+
+BOOST_AUTO_TEST_CASE(warm_sessions_are_opened)
+{
+	// Keep the sessions from actually connecting.
+	controller.stop();
+	controller.join();
+	controller.site_limit(other_site, 2);
+
+	controller.keep_warm(site, 3);
+	controller.keep_warm(other_site, 3);
+
+	BOOST_CHECK_EQUAL(controller.warm_count(site), 3U);
+	BOOST_CHECK_EQUAL(controller.session_count(), 5U);
+
+	// Opening them again changes nothing.
+	controller.keep_warm(site, 3);
+	BOOST_CHECK_EQUAL(controller.session_count(), 5U);
+
+	// Nor does shrinking a pool whose sessions are all busy.
+	controller.keep_warm(site, 1);
+	BOOST_CHECK_EQUAL(controller.warm_count(site), 1U);
+	BOOST_CHECK_EQUAL(controller.session_count(), 5U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,130 @@
+// Copyright (c) 2007, Richard Dingwall
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the organization nor the names of its contributors
+//       may be used to endorse or promote products derived from this software
+//       without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <iterator>
+#include <vector>
+#include <boost/test/unit_test.hpp>
+#include "../foofxp/utility/timer_wheel.hpp"
+
+using namespace std;
+using foofxp::utility::timer_wheel;
+
+// Ticks the wheel until something expires, returning the number of ticks
+// taken (or 0 if nothing expired within max_ticks).
+size_t ticks_until_expiry(timer_wheel<int> & wheel, vector<int> & expired,
+	size_t max_ticks)
+{
+	for (size_t ticks = 1; ticks <= max_ticks; ticks++)
+	{
+		wheel.tick(back_inserter(expired));
+
+		if (!expired.empty())
+			return ticks;
+	}
+
+	return 0;
+}
+
+BOOST_AUTO_TEST_SUITE(timer_wheel_tests)
+
+BOOST_AUTO_TEST_CASE(key_expires_after_delay)
+{
+	timer_wheel<int> wheel(8);
+	wheel.schedule(1, 3);
+
+	vector<int> expired;
+	BOOST_CHECK_EQUAL(ticks_until_expiry(wheel, expired, 20), 3U);
+	BOOST_REQUIRE_EQUAL(expired.size(), 1U);
+	BOOST_CHECK_EQUAL(expired[0], 1);
+	BOOST_CHECK(!wheel.scheduled(1));
+	BOOST_CHECK(wheel.empty());
+}
+
+BOOST_AUTO_TEST_CASE(delays_longer_than_the_wheel_wrap_around)
+{
+	timer_wheel<int> wheel(8);
+	wheel.schedule(1, 8);
+	wheel.schedule(2, 19);
+
+	vector<int> expired;
+	BOOST_CHECK_EQUAL(ticks_until_expiry(wheel, expired, 40), 8U);
+	BOOST_CHECK_EQUAL(expired[0], 1);
+
+	expired.clear();
+	BOOST_CHECK_EQUAL(ticks_until_expiry(wheel, expired, 40), 11U);
+	BOOST_CHECK_EQUAL(expired[0], 2);
+}
+
+BOOST_AUTO_TEST_CASE(zero_delay_expires_on_next_tick)
+{
+	timer_wheel<int> wheel(4);
+	wheel.schedule(1, 0);
+
+	vector<int> expired;
+	BOOST_CHECK_EQUAL(ticks_until_expiry(wheel, expired, 10), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(rescheduling_replaces_earlier_schedule)
+{
+	timer_wheel<int> wheel(8);
+	wheel.schedule(1, 2);
+	wheel.schedule(1, 5);
+
+	BOOST_CHECK_EQUAL(wheel.size(), 1U);
+
+	vector<int> expired;
+	BOOST_CHECK_EQUAL(ticks_until_expiry(wheel, expired, 20), 5U);
+	BOOST_CHECK_EQUAL(expired.size(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(cancelled_keys_do_not_expire)
+{
+	timer_wheel<int> wheel(8);
+	wheel.schedule(1, 2);
+	wheel.schedule(2, 2);
+
+	BOOST_CHECK(wheel.cancel(1));
+	BOOST_CHECK(!wheel.cancel(1));
+
+	vector<int> expired;
+	BOOST_CHECK_EQUAL(ticks_until_expiry(wheel, expired, 20), 2U);
+	BOOST_REQUIRE_EQUAL(expired.size(), 1U);
+	BOOST_CHECK_EQUAL(expired[0], 2);
+}
+
+BOOST_AUTO_TEST_CASE(keys_due_together_expire_together)
+{
+	timer_wheel<int> wheel(8);
+	for (int key = 0; key < 100; key++)
+		wheel.schedule(key, 4);
+
+	vector<int> expired;
+	BOOST_CHECK_EQUAL(ticks_until_expiry(wheel, expired, 20), 4U);
+	BOOST_CHECK_EQUAL(expired.size(), 100U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,299 @@
+#include <string>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+#include "../foofxp/model/session_controller.hpp"
+#include "../foofxp/model/tree_crawler.hpp"
+#include "ftp/fake_server.hpp"
+
+using namespace std;
+using foofxp::model::session_controller;
+using foofxp::model::tree_crawler;
+using foofxp::model::ftp::bookmark;
+
+struct tree_crawler_fixture
+{
+	tree_crawler_fixture() : server(), other(), controller(2),
+		crawler(controller), listed(), failed(), completed()
+	{
+		crawler.directory_listed.connect(boost::bind(
+			&tree_crawler_fixture::handle_listed, this, _2, _3));
+		crawler.directory_failed.connect(boost::bind(
+			&tree_crawler_fixture::handle_failed, this, _3, _4));
+		crawler.completed.connect(boost::bind(&event_counter::fire,
+			&completed));
+	};
+
+	// Has count sessions to from logged in and idle, for the crawler.
+	void warm(fake_server & from, size_t count)
+	{
+		vector<session_controller::client_ptr> sessions;
+		BOOST_REQUIRE(lease_sessions(controller, from.site(), count,
+			sessions));
+
+		for (size_t i = 0; i < sessions.size(); i++)
+			controller.release_session(sessions[i]);
+	};
+
+	// Listed directories are noted as port:path, so sites can be told apart.
+	void handle_listed(const bookmark & site,
+		const tree_crawler::directory & directory)
+	{
+		listed.note(label(site, directory.path));
+	};
+
+	void handle_failed(const tree_crawler::directory & directory,
+		const string & message)
+	{
+		failed.note(directory.path + ": " + message);
+	};
+
+	static string label(const bookmark & site, const string & path)
+	{
+		char buffer[16];
+		std::sprintf(buffer, "%u:", static_cast<unsigned int>(site.port()));
+		return buffer + path;
+	};
+
+	// Listings started, not counting the one at login.
+	static size_t listings(const fake_server & from)
+	{
+		return from.commands("STAT -l /").size();
+	};
+
+	fake_server server;
+	fake_server other;
+	session_controller controller;
+	tree_crawler crawler;
+
+	event_counter listed;
+	event_counter failed;
+	event_counter completed;
+};
+
+BOOST_FIXTURE_TEST_SUITE(tree_crawler_tests, tree_crawler_fixture)
+
+BOOST_AUTO_TEST_CASE(tree_is_listed_breadth_first)
+{
+	server.directory("/r/a/c");
+	server.directory("/r/b/d");
+	server.file("/r/b/f", "contents");
+	warm(server, 1);
+
+	crawler.add_root(server.site(), "/r");
+	crawler.begin();
+
+	BOOST_REQUIRE(completed.wait());
+	BOOST_CHECK_EQUAL(failed.fired(), 0U);
+
+	vector<string> order = listed.messages();
+	string site = label(server.site(), "");
+	BOOST_REQUIRE_EQUAL(order.size(), 5U);
+	BOOST_CHECK_EQUAL(order[0], site + "/r");
+	BOOST_CHECK_EQUAL(order[1], site + "/r/a");
+	BOOST_CHECK_EQUAL(order[2], site + "/r/b");
+	BOOST_CHECK_EQUAL(order[3], site + "/r/a/c");
+	BOOST_CHECK_EQUAL(order[4], site + "/r/b/d");
+
+	const tree_crawler::directory & root = crawler.root(0);
+	BOOST_CHECK(root.listed);
+	BOOST_REQUIRE_EQUAL(root.subdirectories.size(), 2U);
+	BOOST_CHECK_EQUAL(root.subdirectories[1]->path, "/r/b");
+	BOOST_CHECK_EQUAL(root.subdirectories[1]->files.size(), 2U);
+	BOOST_CHECK_EQUAL(crawler.directories_listed(), 5U);
+}
+
+BOOST_AUTO_TEST_CASE(sessions_per_site_are_capped)
+{
+	for (char name = 'a'; name <= 'f'; name++)
+		server.directory(string("/r/") + name);
+	warm(server, 4);
+
+	crawler.max_sessions_per_site(2);
+	crawler.add_root(server.site(), "/r");
+
+	// Every subdirectory's listing waits, so they pile up.
+	server.hold("STAT -l /r/");
+	crawler.begin();
+
+	BOOST_REQUIRE(server.wait_held(2));
+	boost::this_thread::sleep(boost::posix_time::milliseconds(200));
+	BOOST_CHECK_EQUAL(server.held(), 2U);
+
+	server.hold("");
+	server.release();
+
+	BOOST_REQUIRE(completed.wait());
+	BOOST_CHECK_EQUAL(listed.fired(), 7U);
+}
+
+BOOST_AUTO_TEST_CASE(sessions_overall_are_capped)
+{
+	for (char name = 'a'; name <= 'd'; name++)
+	{
+		server.directory(string("/r/") + name);
+		other.directory(string("/s/") + name);
+	}
+	warm(server, 3);
+	warm(other, 3);
+
+	crawler.max_sessions(3);
+	crawler.add_root(server.site(), "/r");
+	crawler.add_root(other.site(), "/s");
+
+	server.hold("STAT -l /r/");
+	other.hold("STAT -l /s/");
+	crawler.begin();
+
+	BOOST_REQUIRE(server.wait_held(1));
+	BOOST_REQUIRE(other.wait_held(1));
+	boost::this_thread::sleep(boost::posix_time::milliseconds(200));
+	BOOST_CHECK_EQUAL(server.held() + other.held(), 3U);
+
+	server.hold("");
+	other.hold("");
+	server.release();
+	other.release();
+
+	BOOST_REQUIRE(completed.wait());
+	BOOST_CHECK_EQUAL(listed.fired(), 10U);
+}
+
+BOOST_AUTO_TEST_CASE(sites_take_turns)
+{
+	// A big tree on one site, and a small one on the other, one listing at
+	// a time between them.
+	for (char name = 'a'; name <= 'f'; name++)
+		server.directory(string("/r/") + name);
+	other.directory("/s/a");
+	other.directory("/s/b");
+	warm(server, 1);
+	warm(other, 1);
+
+	crawler.max_sessions(1);
+	crawler.add_root(server.site(), "/r");
+	crawler.add_root(other.site(), "/s");
+	crawler.begin();
+
+	BOOST_REQUIRE(completed.wait());
+
+	// Taking turns, the small tree is done by the time the big one is half
+	// way; one after the other, it would come last. (Listings are reported
+	// as they finish, which can be a little out of turn.)
+	vector<string> order = listed.messages();
+	string small = label(other.site(), "");
+	BOOST_REQUIRE_EQUAL(order.size(), 10U);
+
+	size_t last_small = 0;
+	for (size_t i = 0; i < order.size(); i++)
+		if (order[i].compare(0, small.size(), small) == 0)
+			last_small = i;
+
+	BOOST_CHECK_LE(last_small, 6U);
+}
+
+BOOST_AUTO_TEST_CASE(lost_session_is_tried_again)
+{
+	server.directory("/r/a");
+	server.answer("STAT -l /r", "");
+	warm(server, 2);
+
+	crawler.add_root(server.site(), "/r");
+	crawler.begin();
+
+	BOOST_REQUIRE(completed.wait());
+	BOOST_CHECK_EQUAL(failed.fired(), 0U);
+	BOOST_CHECK_EQUAL(listed.fired(), 2U);
+	BOOST_CHECK_EQUAL(server.commands("STAT -l /r").size(), 3U);
+}
+
+BOOST_AUTO_TEST_CASE(gives_up_after_max_attempts)
+{
+	server.answer("STAT -l /r", "", 2);
+	warm(server, 2);
+
+	crawler.max_attempts(2);
+	crawler.add_root(server.site(), "/r");
+	crawler.begin();
+
+	BOOST_REQUIRE(completed.wait());
+	BOOST_CHECK_EQUAL(listed.fired(), 0U);
+	BOOST_CHECK_EQUAL(failed.fired(), 1U);
+	BOOST_CHECK_EQUAL(listings(server), 2U);
+	BOOST_CHECK(!crawler.root(0).listed);
+}
+
+BOOST_AUTO_TEST_CASE(site_without_sessions_is_given_up)
+{
+	// Nothing is kept warm on the other site, so it'll never have any.
+	server.directory("/r/a");
+	other.directory("/s/a");
+	warm(server, 1);
+
+	crawler.add_root(server.site(), "/r");
+	crawler.add_root(other.site(), "/s");
+	crawler.begin();
+
+	BOOST_REQUIRE(completed.wait());
+	BOOST_CHECK_EQUAL(listed.fired(), 2U);
+	BOOST_REQUIRE_EQUAL(failed.messages().size(), 1U);
+
+	char expected[64];
+	std::sprintf(expected, "/s: No session to 127.0.0.1:%u came free.",
+		static_cast<unsigned int>(other.port()));
+	BOOST_CHECK_EQUAL(failed.messages()[0], expected);
+	BOOST_CHECK_EQUAL(listings(other), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(site_without_free_sessions_is_given_up)
+{
+	server.directory("/r/a");
+	other.directory("/s/a");
+	warm(server, 1);
+
+	// The other site's only session is busy elsewhere.
+	vector<session_controller::client_ptr> taken;
+	BOOST_REQUIRE(lease_sessions(controller, other.site(), 1, taken));
+
+	crawler.max_wait(1);
+	crawler.add_root(server.site(), "/r");
+	crawler.add_root(other.site(), "/s");
+
+	// Keep the first site going past the wait: the other is given up on
+	// while it is.
+	server.hold("STAT -l /r");
+	crawler.begin();
+
+	BOOST_REQUIRE(server.wait_held(1));
+	BOOST_REQUIRE(failed.wait(1));
+	BOOST_CHECK_EQUAL(listed.fired(), 0U);
+
+	server.hold("");
+	server.release();
+
+	BOOST_REQUIRE(completed.wait());
+	BOOST_CHECK_EQUAL(listed.fired(), 2U);
+	BOOST_CHECK_EQUAL(failed.fired(), 1U);
+	BOOST_CHECK_EQUAL(listings(other), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(site_whose_sessions_stay_busy_is_given_up)
+{
+	// Nothing else is listing, and the session never comes free, so only
+	// the wait running out can end it.
+	other.directory("/s/a");
+
+	vector<session_controller::client_ptr> taken;
+	BOOST_REQUIRE(lease_sessions(controller, other.site(), 1, taken));
+
+	crawler.max_wait(1);
+	crawler.add_root(other.site(), "/s");
+	crawler.begin();
+
+	BOOST_REQUIRE(completed.wait());
+	BOOST_CHECK_EQUAL(listed.fired(), 0U);
+	BOOST_CHECK_EQUAL(failed.fired(), 1U);
+	BOOST_CHECK_EQUAL(listings(other), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()